@@ -0,0 +1,61 @@
+/* common functions used inside the any hit shader */
+
+// states of a triangle and of a micro-triangle, same values as pt::MeshOpacity::State
+const uint OPACITY_TRANSPARENT = 0;
+const uint OPACITY_OPAQUE = 1;
+const uint OPACITY_UNKNOWN = 2;
+const uint OPACITY_MIXED = 3;
+
+// number of micro-triangles along every edge of a triangle, same as pt::MeshOpacity::SUBDIVISION
+const uint OPACITY_SUBDIVISION = 8;
+
+/**
+* @brief    Returns the index of the micro-triangle that contains the hit. The micro-triangles are stored in rows along
+*           the first barycentric weight, every cell of a row is split into a lower and an upper micro-triangle.
+* @return   Index of the micro-triangle of the hit.
+*/
+uint get_micro_triangle(void)
+{
+    const float n = float(OPACITY_SUBDIVISION);
+    const uint i = min(uint(hit_info.x * n), OPACITY_SUBDIVISION - 1);
+    const uint j = min(uint(hit_info.y * n), OPACITY_SUBDIVISION - 1 - i);
+    const vec2 f = hit_info * n - vec2(i, j);
+    const uint upper = (f.x + f.y > 1.0f && i + j < OPACITY_SUBDIVISION - 1) ? 1 : 0;
+    return i * (2 * OPACITY_SUBDIVISION - i) + 2 * j + upper;
+}
+
+/**
+* @brief    Reads the alpha map at the hit, the same test as the classification on the host.
+* @return   True if the hit is opaque.
+*/
+bool is_alpha_opaque(void)
+{
+    const uint i0 = ibo[nonuniformEXT(record.geometryID)].index[gl_PrimitiveID * 3 + 0];
+    const uint i1 = ibo[nonuniformEXT(record.geometryID)].index[gl_PrimitiveID * 3 + 1];
+    const uint i2 = ibo[nonuniformEXT(record.geometryID)].index[gl_PrimitiveID * 3 + 2];
+    const vec2 texcoord = abo[nonuniformEXT(record.geometryID)].attrib[i0].texcoord * (1.0f - hit_info.x - hit_info.y) +
+                          abo[nonuniformEXT(record.geometryID)].attrib[i1].texcoord * hit_info.x +
+                          abo[nonuniformEXT(record.geometryID)].attrib[i2].texcoord * hit_info.y;
+
+    // the any hit shader has no derivatives, the classification is done with the full resolution
+    return textureLod(map_rma[nonuniformEXT(record.materialID)], texcoord, 0.0f).b >= 0.5f;
+}
+
+/**
+* @brief    Returns the opacity of the hit from the precomputed states, only unknown micro-triangles read the alpha map.
+* @return   True if the hit is opaque.
+*/
+bool is_opaque(void)
+{
+    const uint entry = opacity.entry[record.opacityOffset + gl_PrimitiveID];
+    uint state = entry >> 30;
+    if(state == OPACITY_MIXED)
+    {
+        const uint index = get_micro_triangle();
+        const uint word = opacity.entry[record.opacityOffset + (entry & 0x3FFFFFFFu) + index / 16];
+        state = (word >> ((index % 16) * 2)) & 0x3u;
+    }
+    if(state == OPACITY_UNKNOWN)
+        return is_alpha_opaque();
+    return state == OPACITY_OPAQUE;
+}
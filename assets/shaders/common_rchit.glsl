@@ -1,10 +1,32 @@
 /* common functions used inside the closest hit shader */
 
+#include "environment.glsl"
+
+/**
+* @brief    Unpacks the tangent frame of a vertex, see pt::ObjMesh::TANGENT_VALID.
+* @param    packed Packed tangent frame of the vertex.
+* @return   Unit tangent (XYZ) and the sign of the bitangent (W), zero if the vertex has no tangent.
+*/
+vec4 unpack_tangent(in uint packed)
+{
+    if((packed & TANGENT_VALID) == 0u) return vec4(0.0f);
+
+    // octahedral coordinates, the lower half of the octahedron is folded over the diagonals
+    const vec2 f = vec2(packed & 0x7FFFu, (packed >> 15) & 0x7FFFu) * (2.0f / 32767.0f) - 1.0f;
+    vec3 t = vec3(f, 1.0f - abs(f.x) - abs(f.y));
+    const float fold = max(-t.z, 0.0f);
+    t.x += (t.x >= 0.0f) ? -fold : fold;
+    t.y += (t.y >= 0.0f) ? -fold : fold;
+    return vec4(normalize(t), ((packed & TANGENT_FLIP) != 0u) ? -1.0f : 1.0f);
+}
+
 /**
-* @brief    Returns the interpolated attributes of the hit primitive.
-* @return   Interpolated attributes of the hit primitive.
+* @brief            Returns the interpolated attributes of the hit primitive.
+* @param tangent    Receives the interpolated tangent (XYZ) and the sign of the bitangent (W),
+*                   zero if a vertex of the primitive has no tangent.
+* @return           Interpolated attributes of the hit primitive, the packed tangent is not set.
 */
-attribute_t get_attribute(void)
+attribute_t get_attribute(out vec4 tangent)
 {
     // Combute the barycentric coordinates from the barycentric weights
     // in the hitAttributeNV. The barycentric weights correspond to the UV
@@ -34,6 +56,18 @@ attribute_t get_attribute(void)
     attribute_t a;
     a.normal    = a0.normal * barycentric.x + a1.normal * barycentric.y + a2.normal * barycentric.z;
     a.texcoord  = a0.texcoord * barycentric.x + a1.texcoord * barycentric.y + a2.texcoord * barycentric.z;
+    a.tangent   = 0u;
+
+    // The tangent frames are precomputed per vertex, they are interpolated like the normals.
+    // The bitangent is rebuilt from the interpolated vectors, see apply_normal_map.
+    const vec4 t0 = unpack_tangent(a0.tangent);
+    const vec4 t1 = unpack_tangent(a1.tangent);
+    const vec4 t2 = unpack_tangent(a2.tangent);
+    if(t0.w == 0.0f || t1.w == 0.0f || t2.w == 0.0f)
+        tangent = vec4(0.0f);
+    else
+        tangent = vec4(t0.xyz * barycentric.x + t1.xyz * barycentric.y + t2.xyz * barycentric.z,
+                       (t0.w * barycentric.x + t1.w * barycentric.y + t2.w * barycentric.z < 0.0f) ? -1.0f : 1.0f);
     return a;
 }
 
@@ -86,3 +120,180 @@ vec3 get_normal(in vec2 uv)
 {
     return normalize(texture(map_normal[record.materialID], uv).xyz * 2.0f - 1.0f);
 }
+
+/**
+* @brief            Perturbs the interpolated normal with the normal map in the tangent frame of the vertices, the same
+*                   reconstruction as MikkTSpace: the vectors are interpolated without normalizing them and the
+*                   bitangent is sign * cross(normal, tangent).
+* @param normal     Interpolated normal.
+* @param tangent    Interpolated tangent and sign of the bitangent, see get_attribute.
+* @param uv         U,V coordinates
+* @return           Unit shading normal, the interpolated normal if the primitive has no tangent frame.
+*/
+vec3 apply_normal_map(in vec3 normal, in vec4 tangent, in vec2 uv)
+{
+    if(tangent.w == 0.0f) return normalize(normal);
+    const vec3 bitangent = tangent.w * cross(normal, tangent.xyz);
+    const vec3 m = get_normal(uv);
+    const vec3 n = m.x * tangent.xyz + m.y * bitangent + m.z * normal;
+    return (dot(n, n) > 0.0f) ? normalize(n) : normalize(normal);
+}
+
+/**
+* @brief    Returns the next dimension of the samples of the path.
+* @return   Sample in [0, 1).
+*/
+float next_sample(void)
+{
+    return get_sample(payload.pixel, payload.sample_index, payload.dimension++);
+}
+
+const float ONE_MINUS_EPSILON = uintBitsToFloat(0x3F7FFFFFu);
+
+/**
+* @brief        Decides between an entry of an alias table and its alias, same as pt::sample_alias.
+* @param entry  Bucket of the table that the random number fell into.
+* @param i      Index of the bucket.
+* @param t      Position of the random number inside of the bucket in [0, 1), receives the remainder rescaled to [0, 1).
+* @return       Index of the chosen entry inside of the table.
+*/
+uint resolve_alias(in alias_t entry, in uint i, inout float t)
+{
+    if(t < entry.threshold)
+    {
+        t = t / entry.threshold;
+    }
+    else
+    {
+        t = (t - entry.threshold) / (1.0f - entry.threshold);
+        i = entry.alias;
+    }
+    t = clamp(t, 0.0f, ONE_MINUS_EPSILON);
+    return i;
+}
+
+/**
+* @brief        Chooses an entry of an alias table of the environment map, same as pt::EnvironmentSampler.
+* @param first  Index of the first entry of the table.
+* @param count  Number of entries of the table.
+* @param u      Random number in [0, 1), receives the remainder of the choice rescaled to [0, 1).
+* @return       Index of the chosen entry inside of the table.
+*/
+uint sample_alias(in uint first, in uint count, inout float u)
+{
+    const float x = u * float(count);
+    const uint i = min(uint(x), count - 1);
+    u = min(x - float(i), ONE_MINUS_EPSILON);
+    return resolve_alias(environment_alias.entry[first + i], i, u);
+}
+
+/**
+* @brief        Samples a direction of the environment map proportional to its luminance,
+*               same as pt::EnvironmentSampler::sample on the host.
+* @param u      Random numbers in [0, 1), x chooses the row, y the pixel of the row.
+* @param pdf    Receives the probability density of the direction with respect to the solid angle.
+* @return       Unit direction.
+*/
+vec3 sample_environment_light(in vec2 u, out float pdf)
+{
+    const uvec2 size = uvec2(textureSize(environment, 0));
+    const uint y = sample_alias(0, size.y, u.x);
+    const uint row = size.y + y * size.x;
+    const uint x = sample_alias(row, size.x, u.y);
+
+    // the remainders of the choices place the direction inside of the pixel
+    const vec2 uv = (vec2(x, y) + u.yx) / vec2(size);
+    const float phi = (uv.x - 0.5f) * 2.0f * PI;
+    const float latitude = (uv.y - 0.5f) * PI;
+    const float cos_latitude = cos(latitude);
+
+    // the density is constant in (u, v), a pixel covers 2pi^2 cos(latitude) / (width * height) of the sphere
+    const float p = environment_alias.entry[y].probability * environment_alias.entry[row + x].probability;
+    pdf = (cos_latitude > 0.0f) ? p * float(size.x) * float(size.y) / (2.0f * PI * PI * cos_latitude) : 0.0f;
+    return vec3(cos_latitude * cos(phi), sin(latitude), cos_latitude * sin(phi));
+}
+
+/**
+* @brief            Samples a point on an emissive triangle, the triangle is chosen proportional to its area times
+*                   its mean emission, same as pt::LightSampler::sample on the host.
+* @param position   Position of the shaded point.
+* @param u          Random numbers in [0, 1), x chooses the triangle, y and z the point on the triangle.
+* @param radiance   Receives the emission of the sampled point, both sides of a triangle emit.
+* @param pdf        Receives the probability density of the direction with respect to the solid angle,
+*                   0 if the scene has no lights or the triangle is seen edge-on.
+* @param distance   Receives the distance to the sampled point.
+* @return           Unit direction to the sampled point.
+*/
+vec3 sample_emitter_light(in vec3 position, in vec3 u, out vec3 radiance, out float pdf, out float distance)
+{
+    radiance = vec3(0.0f);
+    pdf = 0.0f;
+    distance = 0.0f;
+    const uint count = lights.count;
+    if(count == 0)
+        return vec3(0.0f, 1.0f, 0.0f);
+
+    // the alias table is stored inside of the lights, one bucket per light
+    const float x = u.x * float(count);
+    uint i = min(uint(x), count - 1);
+    float t = min(x - float(i), ONE_MINUS_EPSILON);
+    i = resolve_alias(lights.light[i].choice, i, t);
+    const light_t light = lights.light[i];
+
+    // uniform point on the triangle, the square root warps the first random number so the density is constant over the area
+    const float s = sqrt(u.y);
+    const vec3 barycentric = vec3(1.0f - s, u.z * s, s - u.z * s);
+    const vec3 p = light.p0 * barycentric.x + light.p1 * barycentric.y + light.p2 * barycentric.z;
+    const vec3 d = p - position;
+    const float distance2 = dot(d, d);
+    if(distance2 <= 0.0f)
+        return vec3(0.0f, 1.0f, 0.0f);
+    distance = sqrt(distance2);
+    const vec3 l = d / distance;
+
+    // the density with respect to the area is converted to the solid angle: pdf_w = pdf_A * d^2 / |cos|
+    const vec3 n = cross(light.p1 - light.p0, light.p2 - light.p0);
+    const float cos_light = abs(dot(n, l)) / length(n);
+    if(cos_light <= 0.0f)
+        return l;
+    pdf = (light.choice.probability / light.area) * distance2 / cos_light;
+
+    // the emission map is looked up at the texture coordinate of the sampled point
+    const uint i0 = ibo[nonuniformEXT(light.geometry_id)].index[light.primitive * 3 + 0];
+    const uint i1 = ibo[nonuniformEXT(light.geometry_id)].index[light.primitive * 3 + 1];
+    const uint i2 = ibo[nonuniformEXT(light.geometry_id)].index[light.primitive * 3 + 2];
+    const vec2 texcoord = abo[nonuniformEXT(light.geometry_id)].attrib[i0].texcoord * barycentric.x +
+                          abo[nonuniformEXT(light.geometry_id)].attrib[i1].texcoord * barycentric.y +
+                          abo[nonuniformEXT(light.geometry_id)].attrib[i2].texcoord * barycentric.z;
+    radiance = texture(map_emissive[nonuniformEXT(light.material_id)], texcoord).xyz;
+    return l;
+}
+
+/**
+* @brief            Tests if a segment is blocked by any geometry. The shadow ray ends at the first hit it finds,
+*                   no closest hit shader is invoked and no attributes are interpolated. Only the miss shader of
+*                   the shadow rays is invoked, it clears the flag if the segment is not blocked. Cut out parts of
+*                   alpha tested meshes are skipped by their any hit shader.
+* @param origin     Start of the segment, it must already be moved away from the surface.
+* @param direction  Unit direction of the segment.
+* @param t_max      Length of the segment.
+* @return           True if the segment is blocked.
+*/
+bool is_occluded(in vec3 origin, in vec3 direction, in float t_max)
+{
+    shadow_payload.occluded = true;
+    traceNV(
+        tlas,
+        gl_RayFlagsTerminateOnFirstHitNV | gl_RayFlagsSkipClosestHitShaderNV,
+        0xFF,
+        RAY_TYPE_SHADOW,    // hit group of the shadow rays of every geometry
+        RAY_TYPE_COUNT,     // number of hit groups per geometry
+        RAY_TYPE_SHADOW,    // miss record of the shadow rays
+        origin,
+        0.0f,
+        direction,
+        t_max,
+        1                   // payload location
+    );
+    return shadow_payload.occluded;
+}
@@ -1,35 +1,105 @@
 /* common functions used inside the ray generation shader */
 
+// same as pt::PathTracer::ADAPTIVE_TILE_SIZE
+#define ADAPTIVE_TILE_SIZE 8
+
+/**
+* @brief    Checks if adaptive sampling still traces the tile of the current pixel.
+* @return   False if the tile converged.
+*/
+bool is_tile_active(void)
+{
+    if(pc.adaptive == 0) return true;
+    const uvec2 tile = gl_LaunchIDNV.xy / ADAPTIVE_TILE_SIZE;
+    const uint tiles_x = (gl_LaunchSizeNV.x + ADAPTIVE_TILE_SIZE - 1) / ADAPTIVE_TILE_SIZE;
+    return tile_mask[tile.y * tiles_x + tile.x] != 0;
+}
+
 /**
-* @brief    Combutes the Normalized-Device-Coordinates via the gl_LaunchIDNV,
-*           which holds the current pixel position of out image,
-*           and gl_LaunchSizeNV, which holds the image size to render.
+* @brief    Returns the position of the current pixel inside of the frame.
+*           The launched image can be a tile of a larger frame.
+* @return   Pixel position inside of the frame.
+*/
+uvec2 get_frame_pixel(void)
+{
+    return gl_LaunchIDNV.xy + pc.tile_offset;
+}
+
+/**
+* @brief    Combutes the Normalized-Device-Coordinates via the position of
+*           the current pixel inside of the frame and the size of the frame.
 * @return   Normalized-Device-Coordinates of the current pixel postion.
 *           The left upper corner has the coordinates (-1, -1) and
 *           the right lower corner has the coordinates (+1, +1).
+*           The aspect of the image is part of the camera.
 */
 vec2 get_NDC(void)
 {
-    const float aspect = float(gl_LaunchSizeNV.x) / float(gl_LaunchSizeNV.y);
-    vec2 ndc = vec2(gl_LaunchIDNV) / vec2(gl_LaunchSizeNV);
-    ndc = ndc * 2.0f - 1.0f;
-    ndc.x *= aspect;
-    return ndc;
+    vec2 ndc = vec2(get_frame_pixel()) / vec2(pc.frame_extent);
+    return ndc * 2.0f - 1.0f;
 }
 
 /**
-* @brief    Transforms a camera ray to any view direction.
-* @param vd View direction.
-* @param up Up vector.
-* @param rd Ray direction to transform.
-* @return   The camera ray transformed to the view direction
+* @brief    Returns a sample on the lens of the current pixel, the first two dimensions of the
+*           samples of the path. A tile gets the same samples as the same pixels of the whole frame.
+* @return   Sample in [0, 1)^2.
 */
-vec3 combute_direction(in vec3 vd, in vec3 up, in vec3 rd)
+vec2 get_lens_sample(void)
 {
-    mat3 transform;
-    transform[2] = vd;
-    transform[0] = normalize(cross(up, vd));
-    transform[1] = cross(transform[0], vd);
+    const uvec2 pixel = get_frame_pixel();
+    return vec2(get_sample(pixel, pc.sample_index, 0), get_sample(pixel, pc.sample_index, 1));
+}
+
+/**
+* @brief    Maps a sample of the unit square to the unit disk (concentric mapping).
+*           Same mapping as the host camera.
+* @param u  Sample in [0, 1)^2.
+* @return   Sample on the unit disk.
+*/
+vec2 sample_disk(in vec2 u)
+{
+    const float PI = 3.14159265358979f;
+    const vec2 ab = u * 2.0f - 1.0f;
+    if(ab.x == 0.0f && ab.y == 0.0f) return vec2(0.0f);
+
+    float r, phi;
+    if(abs(ab.x) > abs(ab.y))
+    {
+        r = ab.x;
+        phi = (PI / 4.0f) * (ab.y / ab.x);
+    }
+    else
+    {
+        r = ab.y;
+        phi = (PI / 2.0f) - (PI / 4.0f) * (ab.x / ab.y);
+    }
+    return r * vec2(cos(phi), sin(phi));
+}
+
+/**
+* @brief        Generates the camera ray through a point of the image plane,
+*               same as pt::CameraData::generate_ray on the host.
+* @param ndc    Position on the image plane, see get_NDC.
+* @param lens   Sample on the lens in [0, 1)^2, not used by a pinhole camera.
+* @return       Camera ray with a normalized direction.
+*/
+ray_t generate_ray(in vec2 ndc, in vec2 lens)
+{
+    // direction through the image plane at distance 1
+    const vec3 d = pc.camera.forward.xyz + ndc.x * pc.camera.right.w * pc.camera.right.xyz - ndc.y * pc.camera.up.w * pc.camera.up.xyz;
+
+    ray_t ray;
+    if(pc.camera.origin.w == 0.0f)
+    {
+        ray.origin = pc.camera.origin.xyz;
+        ray.direction = normalize(d);
+        return ray;
+    }
 
-    return transform * rd;
+    // thin lens: all rays through the same point of the image plane meet on the focus plane
+    const vec2 l = sample_disk(lens) * pc.camera.origin.w;
+    const vec3 focus = pc.camera.origin.xyz + d * pc.camera.forward.w;
+    ray.origin = pc.camera.origin.xyz + l.x * pc.camera.right.xyz + l.y * pc.camera.up.xyz;
+    ray.direction = normalize(focus - ray.origin);
+    return ray;
 }
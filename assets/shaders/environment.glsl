@@ -0,0 +1,17 @@
+/* lookup of the environment map, used by the miss and the closest hit shader */
+
+#define PI 3.14159265358979f
+
+/**
+* @brief            Samples an equirectangular environment map.
+* @param direction  direction to sample from
+* @return           Color of the environment map at the specified position.
+*/
+const vec2 inv_atan = vec2(1.0f / (2.0f * PI), 1.0f / PI);
+vec3 sample_environment(in vec3 direction)
+{
+    vec2 uv = vec2(atan(direction.z, direction.x), asin(clamp(direction.y, -1.0f, 1.0f)));
+    uv *= inv_atan;
+    uv += 0.5f;
+    return texture(environment, uv).xyz;
+}
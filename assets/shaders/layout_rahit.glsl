@@ -0,0 +1,45 @@
+/* layout spiecifiers for the any hit shader */
+
+// location (set = 1, binding = 0) contains all vertex attribute buffer descriptors.
+// There are as many vertex attribute buffer descriptors as unique geometries loaded into the scene.
+// The attributes are tightly packed (24 bytes), so the buffer requires the extension GL_EXT_scalar_block_layout.
+// NOTE: This array of descriptors has no fixed size, therefore the extension
+// GL_EXT_nonuniform_qualifier is requiered.
+layout (scalar, set = 1, binding = 0) buffer AttributeBuffer
+{
+    attribute_t attrib[];
+} abo[];
+
+// location (set = 1, binding = 1) contains all index buffer descriptors.
+// There are as many index buffer descriptors as unique geometries loaded into the scene.
+// NOTE: This array of descriptors has no fixed size, therefore the extension
+// GL_EXT_nonuniform_qualifier is requiered.
+layout (set = 1, binding = 1) buffer IndexBuffer
+{
+    uint index[];
+} ibo[];
+
+// location (set = 1, binding = 5) contains all RMA texture samplers, the alpha map is stored inside the B component
+// There are as many RMA texture sampler descriptors as materials loaded into the scene.
+// NOTE: This array of descriptors has no fixed size, therefore the extension
+// GL_EXT_nonuniform_qualifier is requiered.
+layout (set = 1, binding = 5) uniform sampler2D map_rma[];
+
+// location (set = 1, binding = 10) contains the opacity of the triangles of all meshes, see pt::MeshOpacity
+// Every mesh starts at the opacity offset of its record. The upper 2 bits of the entry of a triangle are its state,
+// the lower 30 bits of a mixed triangle are the offset of its mask, 2 bits per micro-triangle.
+layout (set = 1, binding = 10) readonly buffer OpacityBuffer
+{
+    uint entry[];
+} opacity;
+
+// SBT record parameter
+layout (shaderRecordNV) buffer Record
+{
+    uint geometryID;
+    uint materialID;
+    uint opacityOffset;
+} record;
+
+// Barycentric weights of the triangle intersection
+hitAttributeNV vec2 hit_info;
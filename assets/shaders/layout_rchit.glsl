@@ -1,16 +1,27 @@
 /* layout spiecifiers for the closest hit shader */
 
+// location (set = 0, binding = 1) contains the top level acceleration structure, the shadow rays are traced against it
+layout (set = 0, binding = 1) uniform accelerationStructureNV tlas;
+
+// location (set = 0, binding = 8) contains the ranks of the blue noise tile, see pt::BlueNoiseTile
+// The tile repeats over the frame, it rotates the samples of every pixel.
+layout (set = 0, binding = 8) readonly buffer BlueNoise
+{
+    uint rank[];
+} blue_noise;
+
 // location (set = 1, binding = 0) contains all vertex attribute buffer descriptors.
-// There are as many vertex attribute buffer descriptors as meshes loaded into the scene.
+// There are as many vertex attribute buffer descriptors as unique geometries loaded into the scene.
+// The attributes are tightly packed (24 bytes), so the buffer requires the extension GL_EXT_scalar_block_layout.
 // NOTE: This array of descriptors has no fixed size, therefore the extension
 // GL_EXT_nonuniform_qualifier is requiered.
-layout (set = 1, binding = 0) buffer AttributeBuffer
+layout (scalar, set = 1, binding = 0) buffer AttributeBuffer
 {
     attribute_t attrib[];
 } abo[];
 
 // location (set = 1, binding = 1) contains all index buffer descriptors.
-// There are as many index buffer descriptors as meshes loaded into the scene.
+// There are as many index buffer descriptors as unique geometries loaded into the scene.
 // NOTE: This array of descriptors has no fixed size, therefore the extension
 // GL_EXT_nonuniform_qualifier is requiered.
 layout (set = 1, binding = 1) buffer IndexBuffer
@@ -56,16 +67,40 @@ layout (set = 1, binding = 5) uniform sampler2D map_rma[];
 // GL_EXT_nonuniform_qualifier is requiered.
 layout (set = 1, binding = 6) uniform sampler2D map_normal[];
 
+// location (set = 1, binding = 7) contains the environment map, it lights the hit points
+// !!! The environment map is an HDR image. 32-Bit-Format !!!
+layout (set = 1, binding = 7) uniform sampler2D environment;
+
+// location (set = 1, binding = 8) contains the alias tables of the environment map, see pt::EnvironmentSampler
+// The first table chooses a row, it has one entry per row. It is followed by one table per row that chooses a pixel of the row.
+layout (set = 1, binding = 8) buffer EnvironmentAlias
+{
+    alias_t entry[];
+} environment_alias;
+
+// location (set = 1, binding = 9) contains the emissive triangles of the scene, see pt::LightSampler
+// Every light contains its bucket of the alias table that chooses a light proportional to its area times its emission.
+layout (set = 1, binding = 9) buffer LightBuffer
+{
+    uint count;
+    light_t light[];
+} lights;
+
 // SBT record parameter
 layout (shaderRecordNV) buffer Record
 {
     uint geometryID;
     uint materialID;
+    uint opacityOffset;
 } record;
 
 // The closest hit and the miss shader can return some values via the payload.
 // This payload uses the location 0.
 layout (location = 0) rayPayloadInNV payload_t payload;
 
+// The shadow rays of the closest hit shader return the visibility via this payload.
+// This payload uses the location 1.
+layout (location = 1) rayPayloadNV shadow_payload_t shadow_payload;
+
 // Barycentric weights of the triangle intersection
 hitAttributeNV vec2 hit_info;
@@ -9,6 +9,49 @@ layout (set = 0, binding = 0, rgba8) uniform image2D rop;
 // location (set = 0, binding = 1) contains the top level acceleration structure
 layout (set = 0, binding = 1) uniform accelerationStructureNV tlas;
 
+// location (set = 0, binding = 2) contains the mean of all samples per pixel
+// rgba32f stands for 32R 32G 32B 32A bits (float)
+layout (set = 0, binding = 2, rgba32f) uniform image2D accumulation;
+
+// location (set = 0, binding = 3) contains the number of samples per pixel
+// r32ui stands for one 32bit unsigned integer
+layout (set = 0, binding = 3, r32ui) uniform uimage2D sample_counts;
+
+// location (set = 0, binding = 4) contains one flag per tile of ADAPTIVE_TILE_SIZE^2 pixels,
+// adaptive sampling does not trace the tiles with flag 0
+layout (set = 0, binding = 4) readonly buffer TileMask { uint tile_mask[]; };
+
+// location (set = 0, binding = 5) contains the mean albedo of the first hit, the denoiser is guided by it
+// rgba16f stands for 16R 16G 16B 16A bits (half float), A: number of samples of the features
+layout (set = 0, binding = 5, rgba16f) uniform image2D feature_albedo;
+
+// location (set = 0, binding = 6) contains the mean normal of the first hit, zero if the camera ray missed
+layout (set = 0, binding = 6, rgba16f) uniform image2D feature_normal;
+
+// location (set = 0, binding = 7) contains the first hit of the pixel, the values can't be averaged
+// x: bits of the distance to the hit, y: geometry ID, z: material ID, w: unused
+layout (set = 0, binding = 7, rgba32ui) uniform uimage2D first_hit;
+
+// location (set = 0, binding = 8) contains the ranks of the blue noise tile, see pt::BlueNoiseTile
+// The tile repeats over the frame, it rotates the samples of every pixel.
+layout (set = 0, binding = 8) readonly buffer BlueNoise
+{
+    uint rank[];
+} blue_noise;
+
+// Push constants, same layout as pt::PushConstants.
+// They can change without recompiling the shaders or updating any descriptor.
+layout (push_constant) uniform PushConstants
+{
+    camera_t camera;    // camera parameters
+    uvec2 tile_offset;  // position of the launched image inside of the frame in pixels
+    uvec2 frame_extent; // size of the whole frame in pixels
+    uint sample_index;  // index of the sample, it selects the random numbers of the sample
+    uint sample_count;  // number of samples per pixel that are already accumulated
+    uint adaptive;      // if 1, the tile mask is used
+    uint features;      // if 1, the feature images are written
+} pc;
+
 // The closest hit and the miss shader can return some values via the payload.
 // This payload uses the location 0.
 layout (location = 0) rayPayloadNV payload_t payload;
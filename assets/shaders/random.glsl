@@ -0,0 +1,16 @@
+/* random numbers used by all shaders */
+
+/**
+* @brief    Hashes an integer, used to derive the seeds of the samples without any state.
+* @param x  Integer to hash.
+* @return   Hashed integer.
+*/
+uint hash(in uint x)
+{
+    x ^= x >> 16;
+    x *= 0x7FEB352Du;
+    x ^= x >> 15;
+    x *= 0x846CA68Bu;
+    x ^= x >> 16;
+    return x;
+}
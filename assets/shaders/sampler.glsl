@@ -0,0 +1,78 @@
+/* samples of the path, same as pt::Sampler of type BLUE_NOISE on the host */
+
+// same as pt::BlueNoiseTile::SIZE
+#define BLUE_NOISE_SIZE 64u
+// number of bits of the ranks of the blue noise tile, log2(BLUE_NOISE_SIZE^2)
+#define BLUE_NOISE_BITS 12
+
+// Generator matrices of the first 4 dimensions of the Sobol sequence, 32 columns per dimension.
+// The other dimensions reuse them with a different scrambling.
+const uint SOBOL_MATRICES[128] = uint[](
+    0x80000000u, 0x40000000u, 0x20000000u, 0x10000000u, 0x08000000u, 0x04000000u, 0x02000000u, 0x01000000u,
+    0x00800000u, 0x00400000u, 0x00200000u, 0x00100000u, 0x00080000u, 0x00040000u, 0x00020000u, 0x00010000u,
+    0x00008000u, 0x00004000u, 0x00002000u, 0x00001000u, 0x00000800u, 0x00000400u, 0x00000200u, 0x00000100u,
+    0x00000080u, 0x00000040u, 0x00000020u, 0x00000010u, 0x00000008u, 0x00000004u, 0x00000002u, 0x00000001u,
+    0x80000000u, 0xC0000000u, 0xA0000000u, 0xF0000000u, 0x88000000u, 0xCC000000u, 0xAA000000u, 0xFF000000u,
+    0x80800000u, 0xC0C00000u, 0xA0A00000u, 0xF0F00000u, 0x88880000u, 0xCCCC0000u, 0xAAAA0000u, 0xFFFF0000u,
+    0x80008000u, 0xC000C000u, 0xA000A000u, 0xF000F000u, 0x88008800u, 0xCC00CC00u, 0xAA00AA00u, 0xFF00FF00u,
+    0x80808080u, 0xC0C0C0C0u, 0xA0A0A0A0u, 0xF0F0F0F0u, 0x88888888u, 0xCCCCCCCCu, 0xAAAAAAAAu, 0xFFFFFFFFu,
+    0x80000000u, 0xC0000000u, 0x60000000u, 0x90000000u, 0xE8000000u, 0x5C000000u, 0x8E000000u, 0xC5000000u,
+    0x68800000u, 0x9CC00000u, 0xEE600000u, 0x55900000u, 0x80680000u, 0xC09C0000u, 0x60EE0000u, 0x90550000u,
+    0xE8808000u, 0x5CC0C000u, 0x8E606000u, 0xC5909000u, 0x6868E800u, 0x9C9C5C00u, 0xEEEE8E00u, 0x5555C500u,
+    0x8000E880u, 0xC0005CC0u, 0x60008E60u, 0x9000C590u, 0xE8006868u, 0x5C009C9Cu, 0x8E00EEEEu, 0xC5005555u,
+    0x80000000u, 0xC0000000u, 0x20000000u, 0x50000000u, 0xF8000000u, 0x74000000u, 0xA2000000u, 0x93000000u,
+    0xD8800000u, 0x25400000u, 0x59E00000u, 0xE6D00000u, 0x78080000u, 0xB40C0000u, 0x82020000u, 0xC3050000u,
+    0x208F8000u, 0x51474000u, 0xFBEA2000u, 0x75D93000u, 0xA0858800u, 0x914E5400u, 0xDBE79E00u, 0x25DB6D00u,
+    0x58800080u, 0xE54000C0u, 0x79E00020u, 0xB6D00050u, 0x800800F8u, 0xC00C0074u, 0x200200A2u, 0x50050093u
+);
+
+/**
+* @brief        Owen scrambling by hashing, every bit is flipped depending on the bits above it.
+* @param x      Integer to scramble.
+* @param seed   Seed of the scrambling.
+* @return       Scrambled integer.
+*/
+uint nested_uniform_scramble(in uint x, in uint seed)
+{
+    x = bitfieldReverse(x);
+    x += seed;
+    x ^= x * 0x6C50B47Cu;
+    x ^= x * 0xB82F1E52u;
+    x ^= x * 0xC7AFE638u;
+    x ^= x * 0x8D22F6E6u;
+    return bitfieldReverse(x);
+}
+
+/**
+* @brief            Returns one dimension of an Owen-scrambled Sobol sequence, same as pt::sobol_owen.
+* @param index      Index of the sample.
+* @param dimension  Dimension of the sample, every 4 dimensions form a set with its own scrambling.
+* @param seed       Seed of the scrambling.
+* @return           Sample in [0, 2^32).
+*/
+uint sobol_owen(in uint index, in uint dimension, in uint seed)
+{
+    const uint set_seed = hash(seed ^ hash(dimension / 4));
+    uint shuffled = nested_uniform_scramble(index, set_seed);
+    uint x = 0;
+    for(uint bit = (dimension % 4) * 32; shuffled != 0; bit++, shuffled >>= 1)
+        if((shuffled & 1) != 0) x ^= SOBOL_MATRICES[bit];
+    return nested_uniform_scramble(x, hash(set_seed ^ (dimension % 4 + 1)));
+}
+
+/**
+* @brief            Returns a sample of a pixel. The sequence is the same in all pixels, but every pixel and
+*                   dimension rotates it by another rank of the blue noise tile, so the error is blue noise.
+* @param pixel      Position of the pixel inside of the frame.
+* @param index      Index of the sample.
+* @param dimension  Dimension of the sample.
+* @return           Sample in [0, 1).
+*/
+float get_sample(in uvec2 pixel, in uint index, in uint dimension)
+{
+    const uint offset = hash(dimension ^ 0x2C1B3C6Du);
+    const uvec2 p = (pixel + uvec2(offset & 0xFFFFu, offset >> 16)) & (BLUE_NOISE_SIZE - 1u);
+    const uint rank = blue_noise.rank[p.y * BLUE_NOISE_SIZE + p.x];
+    const uint rotation = (rank << (32 - BLUE_NOISE_BITS)) | (1u << (31 - BLUE_NOISE_BITS));
+    return float((sobol_owen(index, dimension, 0) + rotation) >> 8) / float(1 << 24);
+}
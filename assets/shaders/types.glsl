@@ -3,20 +3,75 @@
 struct payload_t
 {
     vec3 color;
+    vec3 albedo;    // albedo of the hit surface, the color of the environment if the ray missed
+    vec3 normal;    // normal of the hit surface, zero if the ray missed
+    float depth;    // distance to the hit, infinite if the ray missed
+    uint geometry_id;   // geometry ID of the hit mesh, see pt::RecordParameter, 0xFFFFFFFF if the ray missed
+    uint material_id;   // material ID of the hit mesh, 0xFFFFFFFF if the ray missed
+    uvec2 pixel;        // pixel inside of the frame, the samples of the path depend on it
+    uint sample_index;  // index of the sample of the pixel
+    uint dimension;     // next dimension of the samples of the path, see get_sample
 };
 
+// payload of the shadow rays, the miss shader of the shadow rays clears the flag
+struct shadow_payload_t
+{
+    bool occluded;
+};
+
+// ray types, same order as pt::RayType, the hit groups of a geometry and the miss records are stored in this order
+const uint RAY_TYPE_RADIANCE = 0;
+const uint RAY_TYPE_SHADOW = 1;
+const uint RAY_TYPE_COUNT = 2;
+
 struct ray_t
 {
     vec3 origin;
     vec3 direction;
 };
 
+// camera parameters, same layout as pt::CameraData
+struct camera_t
+{
+    vec4 origin;    // position of the camera, w: radius of the lens
+    vec4 forward;   // unit view direction, w: focus distance
+    vec4 right;     // unit right direction, w: half width of the image plane at distance 1
+    vec4 up;        // unit up direction, w: half height of the image plane at distance 1
+};
+
+// vertex attribute, same layout as pt::ObjMesh::ATTRIBUTE_COMPONENTS, the buffers use the scalar layout
 struct attribute_t
 {
     vec3 normal;
+    uint tangent;   // packed tangent frame, see pt::ObjMesh::TANGENT_VALID
     vec2 texcoord;
 };
 
+// bits of the packed tangent frame, same as pt::ObjMesh::TANGENT_VALID and pt::ObjMesh::TANGENT_FLIP
+const uint TANGENT_VALID = 0x80000000u;
+const uint TANGENT_FLIP = 0x40000000u;
+
+// bucket of an alias table, same layout as pt::AliasEntry
+struct alias_t
+{
+    float threshold;    // the entry is taken if the remainder of the random number is below, otherwise its alias
+    uint alias;
+    float probability;
+};
+
+// emissive triangle of the light table, same layout as pt::LightEntry
+struct light_t
+{
+    vec3 p0;
+    uint geometry_id;   // geometry and material of the mesh the triangle is part of
+    vec3 p1;
+    uint primitive;     // index of the triangle inside of the mesh
+    vec3 p2;
+    uint material_id;
+    alias_t choice;     // bucket of the alias table that chooses the light
+    float area;
+};
+
 struct material_t
 {
     float ior;
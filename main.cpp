@@ -1,25 +1,108 @@
-#define STB_IMAGE_WRITE_IMPLEMENTATION
 #define TINYOBJLOADER_IMPLEMENTATION
 #define VKA_IMPLEMENTATION
 
+#include <cmath>
+#include <csignal>
+#include <iomanip>
 #include <iostream>
+#include <random>
 #include <stb/stb_image_write.h>
 #include "src/application.h"
 
 void on_model_load(const std::string& path);
 void on_texture_load(const std::string& path);
+void on_info(const std::string& msg);
+void on_batch_progress(const std::string& msg);
+void on_daemon_log(const std::string& msg);
+void on_coordinator_progress(const std::string& msg);
+int submit(const std::string& socket_path, const std::string& request);
+int coordinate(int argc, char** argv, int first);
+int benchmark_samplers(uint32_t max_spp);
+int benchmark_host(const std::string& path, uint32_t spp);
+int check_samplers(uint64_t samples);
+int benchmark_denoiser(uint32_t thread_count);
+uint64_t parse_count(const std::string& arg, const std::string& name, uint64_t min, uint64_t max);
 
-int main()
+// set by SIGINT and SIGTERM, the batch writes the checkpoint of the current job and stops
+static std::atomic<bool> interrupted(false);
+extern "C" void on_interrupt(int)
+{
+    interrupted = true;
+}
+
+// usage:
+// PathTracer [--batch <job list>]                      renders the default scene, in batch mode all jobs of the job list
+// PathTracer --daemon <socket> [--cache <MiB>]         serves render requests on a local socket
+// PathTracer --submit <socket> <key=value>...          sends one request to a daemon, "shutdown" stops the daemon
+// PathTracer --coordinate <socket>[,<socket>...] [--tile <pixels>] [--pass <samples>] [--timeout <seconds>] <key=value>...
+//                                                      renders one frame with multiple daemons
+// PathTracer --benchmark-samplers [<max spp>]          compares the convergence of the samplers, no GPU is used
+// PathTracer --benchmark-host <object file> [<spp>]    compares the per-pixel and the wavefront host integrator and the cost of
+//                                                      shadow rays, no GPU is used
+// PathTracer --check-samplers [<samples>]              tests the environment and the light sampler against their densities,
+//                                                      no GPU is used, fails if a test fails
+// PathTracer --benchmark-denoiser [<threads>]          denoises a synthetic 4K frame with one and with multiple threads,
+//                                                      no GPU is used
+int main(int argc, char** argv)
 {
     pt::Setup setup;
     pt::PathTracer path_tracer;
+    pt::BatchRenderer batch;
 
     try
     {
+        const std::string usage = "usage: PathTracer [--batch <job list>] | --daemon <socket> [--cache <MiB>] | --submit <socket> <key=value>... | --coordinate <sockets> [options] <key=value>... | --benchmark-samplers [<max spp>] | --benchmark-host <object file> [<spp>] | --check-samplers [<samples>] | --benchmark-denoiser [<threads>]";
+        bool batch_mode = false;
+        std::string daemon_socket;
+        size_t cache_budget = size_t(4096) << 20;
+        for(int i = 1; i < argc; i++)
+        {
+            const std::string arg = argv[i];
+            if(arg == "--batch" && i + 1 < argc)
+            {
+                batch.load_jobs(argv[++i]);
+                batch_mode = true;
+            }
+            else if(arg == "--daemon" && i + 1 < argc)
+                daemon_socket = argv[++i];
+            else if(arg == "--cache" && i + 1 < argc)
+                cache_budget = static_cast<size_t>(parse_count(argv[++i], "cache budget in MiB", 1, SIZE_MAX >> 20)) << 20;
+            else if(arg == "--submit" && i + 2 < argc)
+            {
+                // the client does not need the GPU, the remaining arguments are the request
+                std::string request = argv[i + 2];
+                for(int j = i + 3; j < argc; j++)
+                    request += std::string(" ") + argv[j];
+                return submit(argv[i + 1], request);
+            }
+            else if(arg == "--coordinate" && i + 2 < argc)
+                return coordinate(argc, argv, i + 1);
+            else if(arg == "--benchmark-samplers")
+                return benchmark_samplers((i + 1 < argc) ? static_cast<uint32_t>(parse_count(argv[i + 1], "maximum spp", 1, 1u << 16)) : 256);
+            else if(arg == "--benchmark-host" && i + 1 < argc)
+                return benchmark_host(argv[i + 1], (i + 2 < argc) ? static_cast<uint32_t>(parse_count(argv[i + 2], "spp", 1, 1u << 16)) : 16);
+            else if(arg == "--check-samplers")
+                return check_samplers((i + 1 < argc) ? parse_count(argv[i + 1], "number of samples", 1, 1ull << 40) : (1ull << 22));
+            else if(arg == "--benchmark-denoiser")
+                return benchmark_denoiser((i + 1 < argc) ? static_cast<uint32_t>(parse_count(argv[i + 1], "number of threads", 0, 1024)) : 0);
+            else
+                throw std::invalid_argument("Unknown argument \"" + arg + "\", " + usage);
+        }
+        if(batch_mode && batch.get_jobs().empty())
+            throw std::runtime_error("The job list does not contain any jobs.");
+        if(batch_mode && !daemon_socket.empty())
+            throw std::invalid_argument("The batch mode and the daemon mode can't be combined, " + usage);
+
         pt::Settings settings = {};
         settings.rt_width = 3840;
         settings.rt_height = 2160;
         settings.iterations = 5;
+        // the render target is created for the first job, so it is not recreated before the first trace
+        if(batch_mode)
+        {
+            settings.rt_width = batch.get_jobs().front().width;
+            settings.rt_height = batch.get_jobs().front().height;
+        }
 
         // information for setup
         pt::SetupCreateInfo setup_ci = {};
@@ -47,14 +130,20 @@ int main()
         setup.enable_device_extension(VK_KHR_MAINTENANCE1_EXTENSION_NAME);
         setup.enable_device_extension(VK_KHR_GET_MEMORY_REQUIREMENTS_2_EXTENSION_NAME);
         setup.enable_device_extension(VK_KHR_MAINTENANCE3_EXTENSION_NAME);
+        setup.enable_device_extension(VK_EXT_SCALAR_BLOCK_LAYOUT_EXTENSION_NAME);
 
         // set callbacks
         path_tracer.set_model_load_callback(on_model_load);
         path_tracer.set_texture_load_callback(on_texture_load);
+        path_tracer.set_info_callback(on_info);
 
-        // load models and environment map
-        path_tracer.load_environment("../assets/environment/environment3.hdr");
-        path_tracer.load_model("../assets/models/test.obj");
+        // load models and environment map while the device is created, the daemon loads the scenes of the requests
+        if(daemon_socket.empty())
+        {
+            path_tracer.set_load_settings(&settings);
+            path_tracer.load_environment("../assets/environment/environment3.hdr");
+            path_tracer.load_model("../assets/models/test.obj");
+        }
 
         // initialize setup
         setup.init(setup_ci);
@@ -77,18 +166,42 @@ int main()
         std::cout << "Max triangle count:          " << setup.get_rt_properties().maxTriangleCount << std::endl;
         std::cout << "Max acceleration structures: " << setup.get_rt_properties().maxDescriptorSetAccelerationStructures << std::endl;
 
-        // initialize path tracer application
-        path_tracer.init(&setup);
+        if(!daemon_socket.empty())
+        {
+            pt::RenderDaemon daemon(&setup, cache_budget);
+            daemon.set_log_callback(on_daemon_log);
+            daemon.serve(daemon_socket);
+        }
+        else
+        {
+            // initialize path tracer application
+            path_tracer.init(&setup);
 
-        // run the path tracer, it returns the rendering time in nanoseconds
-        uint64_t exectime = path_tracer.run();
-        std::cout << "Rendering took: " << exectime / 1e6 << "ms" << std::endl;
+            if(batch_mode)
+            {
+                batch.set_progress_callback(on_batch_progress);
+                batch.set_cancel_flag(&interrupted);
+                std::signal(SIGINT, on_interrupt);
+                std::signal(SIGTERM, on_interrupt);
+                const pt::BatchStatistics stats = batch.render(path_tracer);
+                if(stats.cancelled)
+                    std::cout << "The batch was interrupted, jobs with a checkpoint continue when the batch is started again." << std::endl;
+                std::cout << "Rendered " << stats.frames << " frames in " << stats.wall_ns / 1e6 << "ms (tracing: " << stats.render_ns / 1e6 << "ms, denoising: " << stats.denoise_ns / 1e6 << "ms)" << std::endl;
+                std::cout << "Throughput: " << stats.frames_per_hour << " frames per hour" << std::endl;
+            }
+            else
+            {
+                // run the path tracer, it returns the rendering time in nanoseconds
+                uint64_t exectime = path_tracer.run();
+                std::cout << "Rendering took: " << exectime / 1e6 << "ms" << std::endl;
 
-        // write image pixel data to file
-        size_t stride;
-        uint32_t comp;
-        const uint8_t* pixels = path_tracer.map_image(stride, comp);
-        stbi_write_png("path_tracer_output.png", settings.rt_width, settings.rt_height, comp, pixels, stride);
+                // write image pixel data to file
+                size_t stride;
+                uint32_t comp;
+                const uint8_t* pixels = path_tracer.map_image(stride, comp);
+                stbi_write_png("path_tracer_output.png", settings.rt_width, settings.rt_height, comp, pixels, stride);
+            }
+        }
     }
     catch(const std::exception& e)
     {
@@ -111,3 +224,325 @@ void on_texture_load(const std::string& path)
     if(path.size() == 0) return;
     std::cout << "[PathTracer | Info]: Loaded texture \"" << path << "\"" << std::endl;
 }
+void on_info(const std::string& msg)
+{
+    std::cout << "[PathTracer | Info]: " << msg << std::endl;
+}
+void on_batch_progress(const std::string& msg)
+{
+    std::cout << "[PathTracer | Batch]: " << msg << std::endl;
+}
+void on_daemon_log(const std::string& msg)
+{
+    std::cout << "[PathTracer | Daemon]: " << msg << std::endl;
+}
+void on_coordinator_progress(const std::string& msg)
+{
+    std::cout << "[PathTracer | Coordinator]: " << msg << std::endl;
+}
+
+int submit(const std::string& socket_path, const std::string& request)
+{
+    try
+    {
+        pt::RenderClient client;
+        client.connect(socket_path);
+        if(request == "shutdown")
+        {
+            client.shutdown();
+            return 0;
+        }
+
+        const pt::RenderReply reply = client.submit(request);
+        std::cout << "Rendered " << reply.width << "x" << reply.height << " (" << reply.samples << " spp) in " << reply.render_ns / 1e6 << "ms"
+            << (reply.cached ? " (cached scene)" : " (scene loaded in " + std::to_string(reply.load_ns / 1000000) + "ms)") << std::endl;
+        // the mean of the samples (format=rgba32f) can't be stored as PNG
+        if(!reply.pixels.empty() && reply.component_size == 1)
+            stbi_write_png("streamed_output.png", reply.width, reply.height, reply.component_count, reply.pixels.data(), reply.width * reply.component_count);
+    }
+    catch(const std::exception& e)
+    {
+        std::cerr << e.what() << '\n';
+        return 1;
+    }
+    return 0;
+}
+
+int coordinate(int argc, char** argv, int first)
+{
+    try
+    {
+        // the workers are separated by commas
+        std::vector<std::string> workers;
+        const std::string sockets = argv[first];
+        for(size_t begin = 0; begin <= sockets.size();)
+        {
+            const size_t end = std::min(sockets.find(',', begin), sockets.size());
+            if(end > begin) workers.push_back(sockets.substr(begin, end - begin));
+            begin = end + 1;
+        }
+
+        pt::DistributedFrame frame = {};
+        frame.tile_size = 256;
+        frame.pass_samples = 16;
+        uint32_t timeout_s = 600;
+        std::string request;
+        for(int i = first + 1; i < argc; i++)
+        {
+            const std::string arg = argv[i];
+            if(arg == "--tile" && i + 1 < argc)             frame.tile_size = static_cast<uint32_t>(parse_count(argv[++i], "tile size", 1, 1u << 16));
+            else if(arg == "--pass" && i + 1 < argc)        frame.pass_samples = static_cast<uint32_t>(parse_count(argv[++i], "samples per pass", 1, UINT32_MAX));
+            else if(arg == "--timeout" && i + 1 < argc)     timeout_s = static_cast<uint32_t>(parse_count(argv[++i], "timeout in seconds", 1, UINT32_MAX / 1000));
+            else request += arg + " ";
+        }
+        frame.request.job = pt::BatchRenderer::default_job();
+        frame.request.job.output = "path_tracer_output.png";
+        pt::parse_render_request(request, frame.request, true, "[coordinate]: ");
+
+        pt::TileCoordinator coordinator(workers, timeout_s * 1000);
+        coordinator.set_progress_callback(on_coordinator_progress);
+        const pt::DistributedStatistics stats = coordinator.render(frame);
+        std::cout << "Rendered " << stats.units << " units in " << stats.wall_ns / 1e6 << "ms (" << stats.reissued << " reissued, "
+            << stats.failed_workers << " of " << workers.size() << " workers failed)" << std::endl;
+    }
+    catch(const std::exception& e)
+    {
+        std::cerr << e.what() << '\n';
+        return 1;
+    }
+    return 0;
+}
+
+int benchmark_samplers(uint32_t max_spp)
+{
+    try
+    {
+        // one blue noise tile of pixels, the tile of the shaders
+        constexpr uint32_t SIZE = pt::BlueNoiseTile::SIZE;
+        pt::ThreadPool pool;
+        pool.start(0);
+        pt::BlueNoiseTile tile;
+        tile.build(SIZE, 0);
+
+        const char* names[] = { "independent", "sobol", "blue noise" };
+        const std::vector<pt::SamplerConvergence> results = pt::benchmark_samplers(pool, tile, SIZE, SIZE, max_spp);
+        std::cout << std::left << std::setw(14) << "integrand" << std::setw(14) << "sampler" << std::setw(7) << "spp"
+            << std::right << std::setw(10) << "rmse" << std::setw(14) << "3x3 filtered" << std::endl;
+        for(const pt::SamplerConvergence& r : results)
+        {
+            std::cout << std::left << std::setw(14) << r.integrand << std::setw(14) << names[r.type] << std::setw(7) << r.samples
+                << std::right << std::scientific << std::setprecision(3) << std::setw(10) << r.rmse << std::setw(14) << r.filtered_rmse
+                << std::defaultfloat << std::endl;
+        }
+
+        // The rmse of independent samples falls with spp^-0.5. The order is the least squares slope of log(rmse) over log(spp),
+        // the gain is the rmse of the independent samples divided by the rmse of the sampler at the maximum spp.
+        std::cout << '\n' << std::left << std::setw(14) << "integrand" << std::setw(14) << "sampler"
+            << std::right << std::setw(8) << "order" << std::setw(8) << "gain" << std::setw(16) << "filtered gain" << std::endl;
+        for(size_t first = 0; first < results.size();)
+        {
+            size_t last = first;
+            double sx = 0.0, sy = 0.0, sxx = 0.0, sxy = 0.0;
+            for(; last < results.size() && results[last].integrand == results[first].integrand && results[last].type == results[first].type; last++)
+            {
+                const double x = std::log(static_cast<double>(results[last].samples)), y = std::log(std::max(results[last].rmse, 1e-300));
+                sx += x; sy += y; sxx += x * x; sxy += x * y;
+            }
+            const double n = static_cast<double>(last - first);
+            const double order = (n > 1.0) ? (n * sxy - sx * sy) / (n * sxx - sx * sx) : 0.0;
+
+            // the independent sampler of the same integrand at the same spp
+            const pt::SamplerConvergence& r = results[last - 1];
+            double gain = 1.0, filtered_gain = 1.0;
+            for(const pt::SamplerConvergence& reference : results)
+            {
+                if(reference.integrand != r.integrand || reference.type != pt::Sampler::INDEPENDENT || reference.samples != r.samples) continue;
+                gain = reference.rmse / std::max(r.rmse, 1e-300);
+                filtered_gain = reference.filtered_rmse / std::max(r.filtered_rmse, 1e-300);
+            }
+            std::cout << std::left << std::setw(14) << r.integrand << std::setw(14) << names[r.type] << std::right << std::fixed
+                << std::setprecision(2) << std::setw(8) << -order << std::setw(8) << gain << std::setw(16) << filtered_gain << std::defaultfloat << std::endl;
+            first = last;
+        }
+    }
+    catch(const std::exception& e)
+    {
+        std::cerr << e.what() << '\n';
+        return 1;
+    }
+    return 0;
+}
+
+int benchmark_host(const std::string& path, uint32_t spp)
+{
+    try
+    {
+        pt::ThreadPool pool;
+        pool.start(0);
+        pt::HostScene scene;
+        scene.load(pool, { path });
+
+        // the camera looks at the center of the scene from the front, far enough away to see all of it
+        float bounds[6];
+        scene.get_bounds(bounds);
+        float center[3], radius = 0.0f;
+        for(uint32_t k = 0; k < 3; k++)
+        {
+            center[k] = (bounds[k] + bounds[k + 3]) * 0.5f;
+            radius = std::max(radius, (bounds[k + 3] - bounds[k]) * 0.5f);
+        }
+        pt::Camera camera = {};
+        camera.position = glm2::vec3(center[0], center[1] + radius * 0.5f, center[2] + radius * 2.5f);
+        camera.target = glm2::vec3(center[0], center[1], center[2]);
+        camera.up = glm2::vec3(0.0f, 1.0f, 0.0f);
+        camera.fov = 60.0f;
+
+        pt::HostRenderSettings settings = {};
+        settings.width = 512;
+        settings.height = 512;
+        settings.samples = spp;
+        settings.max_depth = 8;
+        settings.wave_size = 1u << 20;
+        settings.background[0] = settings.background[1] = settings.background[2] = 1.0f;
+        const pt::CameraData data = pt::make_camera_data(camera, 1.0f);
+        pt::BlueNoiseTile tile;
+        tile.build(pt::BlueNoiseTile::SIZE, 0);
+        const pt::Sampler sampler(pt::Sampler::BLUE_NOISE, 0, &tile);
+
+        std::vector<float> per_pixel(settings.width * settings.height * 3), wavefront(per_pixel.size());
+        const pt::HostRenderStatistics a = pt::render_per_pixel(pool, scene, data, sampler, settings, per_pixel.data());
+        const pt::HostRenderStatistics b = pt::render_wavefront(pool, scene, data, sampler, settings, wavefront.data());
+        float difference = 0.0f;
+        for(size_t i = 0; i < per_pixel.size(); i++)
+            difference = std::max(difference, std::abs(per_pixel[i] - wavefront[i]));
+
+        std::cout << scene.triangle_count() << " triangles, " << scene.get_materials().size() << " materials, " << spp << " spp, " << pool.size() << " threads" << std::endl;
+        std::cout << std::left << std::setw(11) << "integrator" << std::right << std::setw(10) << "time [ms]" << std::setw(13) << "Mrays/s"
+            << std::setw(13) << "trace [ms]" << std::setw(13) << "sort [ms]" << std::setw(13) << "shade [ms]" << std::endl;
+        std::cout << std::fixed << std::left << std::setw(11) << "per-pixel" << std::right << std::setprecision(1) << std::setw(10) << a.render_ns / 1e6
+            << std::setprecision(2) << std::setw(13) << a.rays_per_second / 1e6 << std::setw(13) << "-" << std::setw(13) << "-" << std::setw(13) << "-" << std::endl;
+        std::cout << std::left << std::setw(11) << "wavefront" << std::right << std::setprecision(1) << std::setw(10) << b.render_ns / 1e6
+            << std::setprecision(2) << std::setw(13) << b.rays_per_second / 1e6 << std::setprecision(1) << std::setw(13) << b.intersect_ns / 1e6
+            << std::setw(13) << b.sort_ns / 1e6 << std::setw(13) << b.shade_ns / 1e6 << std::defaultfloat << std::endl;
+        std::cout << b.waves << " waves, largest difference of the images: " << difference << std::endl;
+
+        // shadow rays of the camera hits to a point light above the scene
+        const float light[3] = { center[0] + radius, center[1] + radius * 3.0f, center[2] + radius };
+        const pt::HostShadowStatistics c = pt::measure_shadow_rays(pool, scene, data, sampler, settings, light);
+        std::cout << std::left << std::setw(11) << "query" << std::right << std::setw(10) << "ns/ray" << std::setw(13) << "relative" << std::endl;
+        std::cout << std::fixed << std::left << std::setw(11) << "camera" << std::right << std::setprecision(1) << std::setw(10) << c.camera_ns
+            << std::setprecision(2) << std::setw(13) << 1.0 << std::endl;
+        std::cout << std::left << std::setw(11) << "shadow" << std::right << std::setprecision(1) << std::setw(10) << c.closest_hit_ns
+            << std::setprecision(2) << std::setw(13) << c.closest_hit_ns / c.camera_ns << std::endl;
+        std::cout << std::left << std::setw(11) << "occlusion" << std::right << std::setprecision(1) << std::setw(10) << c.occlusion_ns
+            << std::setprecision(2) << std::setw(13) << c.occlusion_ns / c.camera_ns << std::defaultfloat << std::endl;
+        std::cout << c.rays << " shadow rays, " << c.occluded << " occluded, " << c.mismatches << " mismatches" << std::endl;
+    }
+    catch(const std::exception& e)
+    {
+        std::cerr << e.what() << '\n';
+        return 1;
+    }
+    return 0;
+}
+
+int check_samplers(uint64_t samples)
+{
+    // a test fails if its samples are unlikely to follow the density, or if the density of the samples
+    // differs from the density of the check more often than directions on the border of two pixels do
+    constexpr double SIGNIFICANCE = 0.01;
+    constexpr double MAX_MISMATCH_RATE = 1e-3;
+    try
+    {
+        pt::ThreadPool pool;
+        pool.start(0);
+        const pt::SamplerCheck checks[] = { pt::check_environment_sampler(pool, samples), pt::check_light_sampler(pool, samples) };
+
+        bool passed = true;
+        std::cout << std::left << std::setw(13) << "sampler" << std::right << std::setw(12) << "samples" << std::setw(8) << "bins"
+            << std::setw(14) << "chi-square" << std::setw(10) << "p-value" << std::setw(12) << "mismatches" << "  result" << std::endl;
+        for(const pt::SamplerCheck& c : checks)
+        {
+            const bool ok = c.p_value >= SIGNIFICANCE && static_cast<double>(c.pdf_mismatches) <= MAX_MISMATCH_RATE * static_cast<double>(c.samples);
+            passed = passed && ok;
+            std::cout << std::left << std::setw(13) << c.sampler << std::right << std::setw(12) << c.samples << std::setw(8) << c.bins
+                << std::setw(14) << std::fixed << std::setprecision(1) << c.chi_square << std::setw(10) << std::setprecision(4) << c.p_value
+                << std::setw(12) << c.pdf_mismatches << "  " << (ok ? "passed" : "FAILED") << std::endl;
+        }
+        return passed ? 0 : 1;
+    }
+    catch(const std::exception& e)
+    {
+        std::cerr << e.what() << '\n';
+        return 1;
+    }
+}
+
+int benchmark_denoiser(uint32_t thread_count)
+{
+    constexpr uint32_t WIDTH = 3840, HEIGHT = 2160, SAMPLES = 16, RUNS = 3;
+    try
+    {
+        // a noisy gradient on a striped albedo, the normals have edges along the stripes
+        const size_t pixel_count = static_cast<size_t>(WIDTH) * HEIGHT;
+        std::vector<float> color(pixel_count * 4), albedo(pixel_count * 4), normals(pixel_count * 4), rgba(pixel_count * 4);
+        std::vector<uint32_t> counts(pixel_count, SAMPLES);
+        std::mt19937 rng(1);
+        std::uniform_real_distribution<float> noise(0.5f, 1.5f);
+        for(uint32_t y = 0; y < HEIGHT; y++)
+        {
+            for(uint32_t x = 0; x < WIDTH; x++)
+            {
+                const size_t i = static_cast<size_t>(y) * WIDTH + x;
+                const bool stripe = ((x / 64) & 1) != 0;
+                const float a = stripe ? 0.8f : 0.2f;
+                const float c = a * (static_cast<float>(x) / WIDTH) * noise(rng);
+                for(uint32_t k = 0; k < 3; k++)
+                {
+                    color[i * 4 + k] = c;
+                    albedo[i * 4 + k] = a;
+                }
+                color[i * 4 + 3] = c * c * 1.1f;
+                albedo[i * 4 + 3] = static_cast<float>(SAMPLES);
+                normals[i * 4 + 0] = stripe ? 0.6f : 0.0f;
+                normals[i * 4 + 1] = 0.0f;
+                normals[i * 4 + 2] = stripe ? 0.8f : 1.0f;
+                normals[i * 4 + 3] = 0.0f;
+            }
+        }
+
+        // the fastest of some runs, the first run also starts the threads
+        const uint32_t configurations[] = { 1, thread_count };
+        std::cout << std::left << std::setw(10) << "threads" << std::right << std::setw(12) << "time [ms]" << std::setw(10) << "speedup" << std::endl;
+        double single_ms = 0.0;
+        for(uint32_t c = 0; c < 2; c++)
+        {
+            pt::Denoiser denoiser(configurations[c]);
+            uint64_t best_ns = UINT64_MAX;
+            for(uint32_t r = 0; r < RUNS; r++)
+                best_ns = std::min(best_ns, denoiser.denoise(WIDTH, HEIGHT, color.data(), counts.data(), albedo.data(), normals.data(), rgba.data()));
+            const double ms = static_cast<double>(best_ns) / 1e6;
+            if(c == 0) single_ms = ms;
+            const std::string threads = (configurations[c] == 0) ? "all (" + std::to_string(std::thread::hardware_concurrency()) + ")" : std::to_string(configurations[c]);
+            std::cout << std::left << std::setw(10) << threads << std::right << std::fixed << std::setprecision(1) << std::setw(12) << ms
+                << std::setprecision(2) << std::setw(10) << single_ms / ms << std::endl;
+        }
+        std::cout << WIDTH << "x" << HEIGHT << ", " << pt::Denoiser::default_settings().iterations << " passes" << std::endl;
+    }
+    catch(const std::exception& e)
+    {
+        std::cerr << e.what() << '\n';
+        return 1;
+    }
+    return 0;
+}
+
+uint64_t parse_count(const std::string& arg, const std::string& name, uint64_t min, uint64_t max)
+{
+    // std::stoull accepts signs and trailing characters, a negative number wraps around
+    const bool digits = !arg.empty() && arg.size() <= 19 && arg.find_first_not_of("0123456789") == std::string::npos;
+    const uint64_t value = digits ? std::stoull(arg) : 0;
+    if(!digits || value < min || value > max)
+        throw std::invalid_argument("The " + name + " must be an integer from " + std::to_string(min) + " to " + std::to_string(max) + ", not \"" + arg + "\".");
+    return value;
+}
@@ -2,3 +2,5 @@ mkdir "./assets/shaders/out"
 C:/VulkanSDK/1.2.170.0/Bin/glslangValidator.exe -V ../assets/shaders/main.rgen -o ./assets/shaders/out/main.rgen.spv
 C:/VulkanSDK/1.2.170.0/Bin/glslangValidator.exe -V ../assets/shaders/main.rmiss -o ./assets/shaders/out/main.rmiss.spv
 C:/VulkanSDK/1.2.170.0/Bin/glslangValidator.exe -V ../assets/shaders/main.rchit -o ./assets/shaders/out/main.rchit.spv
+C:/VulkanSDK/1.2.170.0/Bin/glslangValidator.exe -V ../assets/shaders/shadow.rmiss -o ./assets/shaders/out/shadow.rmiss.spv
+C:/VulkanSDK/1.2.170.0/Bin/glslangValidator.exe -V ../assets/shaders/alpha.rahit -o ./assets/shaders/out/alpha.rahit.spv
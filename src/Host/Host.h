@@ -0,0 +1,249 @@
+#pragma once
+
+namespace pt
+{
+    // Ray of the host engine. The direction does not need to be normalized, the distances are in units of its length.
+    struct HostRay
+    {
+        float origin[3];
+        float tmin;         // hits closer than tmin are ignored
+        float direction[3];
+        float tmax;         // hits further away than tmax are ignored
+    };
+
+    // Closest hit of a host ray.
+    struct HostHit
+    {
+        float t;            // distance of the hit
+        float u;            // barycentric weight of the second vertex
+        float v;            // barycentric weight of the third vertex
+        uint32_t triangle;  // index of the triangle inside of the scene, MISS if nothing was hit
+
+        constexpr static uint32_t MISS = UINT32_MAX;
+    };
+
+    // Node of the bounding volume hierarchy of a host scene, 32 bytes so two nodes share a cache line.
+    struct BvhNode
+    {
+        float min[3];
+        uint32_t first;     // inner node: index of the first child, the second child follows it
+                            // leaf: index of the first triangle
+        float max[3];
+        uint32_t count;     // number of triangles of a leaf, 0 for an inner node
+    };
+
+    // Triangle of a host scene in the layout of the intersection test.
+    struct HostTriangle
+    {
+        float p0[3];
+        float e1[3];        // p1 - p0
+        float e2[3];        // p2 - p0
+    };
+
+    // Vertex attributes of the three vertices of a triangle, same content as the attribute buffers of the GPU.
+    struct HostTriangleAttributes
+    {
+        float normals[3][3];
+        float texcoords[3][2];
+    };
+
+    // Diffuse material of the host engine.
+    struct HostMaterial
+    {
+        float albedo[3];                // diffuse color of the material library, used if there is no albedo map
+        float emission[3];
+        uint32_t texture_width;         // size of the albedo map, 0 if the material has no albedo map
+        uint32_t texture_height;
+        std::vector<float> texture;     // linear RGB of the albedo map, three floats per texel
+    };
+
+    /**
+     * Scene of the host engine. The triangles of all meshes are stored in the order of the leaves of one
+     * bounding volume hierarchy, every triangle has the record of its mesh, so the material IDs are the
+     * material IDs of the SBT records of the GPU. Meshes are not deduplicated, the geometry ID is the index of the mesh.
+     */
+    class HostScene
+    {
+    private:
+        std::vector<HostTriangle> triangles;
+        std::vector<HostTriangleAttributes> attributes;
+        std::vector<uint32_t> triangle_meshes;      // mesh of every triangle
+        std::vector<RecordParameter> records;       // record of every mesh
+        std::vector<HostMaterial> materials;
+        std::vector<BvhNode> nodes;                 // the root is the first node
+
+        void build_bvh(void);
+
+    public:
+        // largest number of triangles of a leaf
+        constexpr static uint32_t MAX_LEAF_SIZE = 4;
+        // depth of the traversal stack, deeper nodes are never built
+        constexpr static uint32_t MAX_DEPTH = 64;
+
+        HostScene(void) = default;
+        virtual ~HostScene(void) = default;
+
+        HostScene(const HostScene&) = delete;
+        HostScene& operator= (const HostScene&) = delete;
+
+        HostScene(HostScene&&) = default;
+        HostScene& operator= (HostScene&&) = default;
+
+        /**
+         * @brief       Loads object files and builds the bounding volume hierarchy. Only materials that are referenced
+         *              by a mesh are loaded, the material IDs are compact like the material IDs of the path tracer.
+         * @param pool  Pool that parses the files and decodes the albedo maps, if it is not started the calling thread does it.
+         * @param paths Paths to the object files.
+         * @throw       runtime_error if a file or an albedo map could not be loaded.
+         */
+        void load(ThreadPool& pool, const std::vector<std::string>& paths);
+
+        /**
+         * @brief Frees all triangles, materials and nodes.
+         */
+        void clear(void) noexcept;
+
+        /**
+         * @brief       Finds the closest hit of a ray.
+         * @param ray   Ray to intersect.
+         * @param hit   Receives the closest hit, the triangle is MISS if there is none.
+         * @return      True if a triangle was hit.
+         */
+        bool intersect(const HostRay& ray, HostHit& hit) const noexcept;
+
+        /**
+         * @brief       Finds the closest hits of a stream of rays.
+         * @param pool  Pool that intersects blocks of the stream, if it is not started the calling thread intersects them.
+         * @param rays  Rays to intersect.
+         * @param hits  Receives the closest hit of every ray.
+         * @param count Number of rays.
+         */
+        void intersect(ThreadPool& pool, const HostRay* rays, HostHit* hits, size_t count) const;
+
+        /**
+         * @brief       Tests if a ray hits any triangle, the query of shadow and visibility rays. The traversal ends at the
+         *              first triangle that is hit, neither the closest hit nor its attributes are computed.
+         * @param ray   Ray to test, only hits between tmin and tmax occlude it.
+         * @return      True if a triangle was hit.
+         */
+        bool occluded(const HostRay& ray) const noexcept;
+
+        /**
+         * @brief           Tests if the rays of a stream hit any triangle.
+         * @param pool      Pool that tests blocks of the stream, if it is not started the calling thread tests them.
+         * @param rays      Rays to test.
+         * @param occluded  Receives 1 for every ray that hits a triangle, otherwise 0.
+         * @param count     Number of rays.
+         */
+        void occluded(ThreadPool& pool, const HostRay* rays, uint8_t* occluded, size_t count) const;
+
+        /**
+         * @brief           Interpolates the attributes of a hit.
+         * @param hit       Hit, must not be a miss.
+         * @param normal    Receives the interpolated normal, not normalized.
+         * @param texcoord  Receives the interpolated texture coordinate.
+         */
+        void interpolate(const HostHit& hit, float normal[3], float texcoord[2]) const noexcept;
+
+        /**
+         * @param bounds    Receives the minimum (XYZ) and maximum (XYZ) of all triangles, zero if the scene is empty.
+         */
+        void get_bounds(float bounds[6]) const noexcept;
+
+        inline uint32_t material_id(uint32_t triangle) const noexcept
+        { return this->records[this->triangle_meshes[triangle]].materialID; }
+
+        inline const HostTriangle& get_triangle(uint32_t triangle) const noexcept
+        { return this->triangles[triangle]; }
+
+        inline const std::vector<HostMaterial>& get_materials(void) const noexcept
+        { return this->materials; }
+
+        inline const std::vector<BvhNode>& get_nodes(void) const noexcept
+        { return this->nodes; }
+
+        inline size_t triangle_count(void) const noexcept
+        { return this->triangles.size(); }
+    };
+
+    // Parameters of a host rendering.
+    struct HostRenderSettings
+    {
+        uint32_t width;         // resolution of the image
+        uint32_t height;
+        uint32_t samples;       // samples per pixel
+        uint32_t max_depth;     // maximum number of hits of a path
+        uint32_t wave_size;     // wavefront: largest number of paths in flight, at most one path per pixel is in flight
+        float background[3];    // radiance of the rays that leave the scene
+    };
+
+    // Measurements of a host rendering.
+    struct HostRenderStatistics
+    {
+        uint64_t render_ns;     // time of the whole rendering
+        uint64_t intersect_ns;  // wavefront: time of the stream intersections
+        uint64_t sort_ns;       // wavefront: time of sorting the hits into the material queues
+        uint64_t shade_ns;      // wavefront: time of shading the queues, including the generation of the camera rays
+        uint64_t rays;          // number of rays that were intersected
+        uint32_t waves;         // wavefront: number of intersected streams
+        double rays_per_second;
+    };
+
+    // Measurements of the shadow rays of 'measure_shadow_rays'.
+    struct HostShadowStatistics
+    {
+        uint64_t rays;              // number of shadow rays, one for every camera ray that hit the scene
+        uint64_t occluded;          // number of shadow rays that hit a triangle before the light
+        uint64_t mismatches;        // number of shadow rays where the occlusion query and the closest hit disagree, should be 0
+        double camera_ns;           // mean time of a closest hit query of a camera ray
+        double closest_hit_ns;      // mean time of a closest hit query of a shadow ray
+        double occlusion_ns;        // mean time of an occlusion query of a shadow ray
+    };
+
+    /**
+     * @brief           Measures the cost of shadow rays: every camera ray that hits the scene gets a shadow ray from its hit
+     *                  to a point light, which is tested once with the closest hit query and once with the occlusion query.
+     * @param pool      Pool that intersects the streams, if it is not started the calling thread intersects them.
+     * @param scene     Scene to intersect.
+     * @param camera    Camera, the rays are the rays of the ray generation shader.
+     * @param sampler   Samples of the lens.
+     * @param settings  Resolution and samples per pixel of the camera rays, the other parameters are not used.
+     * @param light     Position of the point light.
+     * @return          Measurements of the queries.
+     * @throw           invalid_argument if the resolution or the samples is 0.
+     */
+    HostShadowStatistics measure_shadow_rays(ThreadPool& pool, const HostScene& scene, const CameraData& camera, const Sampler& sampler,
+        const HostRenderSettings& settings, const float light[3]);
+
+    /**
+     * @brief           Renders a diffuse path tracing of a host scene with one path after another, every thread
+     *                  renders whole rows. The paths shade the materials in the order they hit them.
+     * @param pool      Pool that renders the rows, if it is not started the calling thread renders them.
+     * @param scene     Scene to render.
+     * @param camera    Camera, the rays are the rays of the ray generation shader.
+     * @param sampler   Samples of the paths.
+     * @param settings  Parameters of the rendering.
+     * @param rgb       Receives the mean of the samples, three floats per pixel.
+     * @return          Measurements of the rendering.
+     * @throw           invalid_argument if the resolution, the samples or the depth is 0.
+     */
+    HostRenderStatistics render_per_pixel(ThreadPool& pool, const HostScene& scene, const CameraData& camera, const Sampler& sampler,
+        const HostRenderSettings& settings, float* rgb);
+
+    /**
+     * @brief           Renders the same image as 'render_per_pixel' as a wavefront: the rays of all paths in flight are
+     *                  intersected as one stream, the hits are sorted by the material ID with a parallel counting sort
+     *                  and every material queue is shaded in bulk, before the rays of the next bounce are intersected.
+     *                  The paths use the same samples, so both images are equal.
+     * @param pool      Pool that intersects, sorts and shades blocks of the paths, if it is not started the calling thread does it.
+     * @param scene     Scene to render.
+     * @param camera    Camera, the rays are the rays of the ray generation shader.
+     * @param sampler   Samples of the paths.
+     * @param settings  Parameters of the rendering.
+     * @param rgb       Receives the mean of the samples, three floats per pixel.
+     * @return          Measurements of the rendering.
+     * @throw           invalid_argument if the resolution, the samples, the depth or the wave size is 0.
+     */
+    HostRenderStatistics render_wavefront(ThreadPool& pool, const HostScene& scene, const CameraData& camera, const Sampler& sampler,
+        const HostRenderSettings& settings, float* rgb);
+}
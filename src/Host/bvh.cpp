@@ -0,0 +1,349 @@
+#include "../application.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+namespace
+{
+    constexpr uint32_t BIN_COUNT = 16;      // candidate splits per axis are the borders of the bins
+    constexpr float TRAVERSAL_COST = 1.0f;  // cost of visiting a node relative to intersecting a triangle
+    constexpr size_t STREAM_BLOCK = 4096;   // rays per task of a stream intersection
+
+    struct Bounds
+    {
+        float min[3];
+        float max[3];
+
+        static Bounds empty(void) noexcept
+        { return { { FLT_MAX, FLT_MAX, FLT_MAX }, { -FLT_MAX, -FLT_MAX, -FLT_MAX } }; }
+
+        void grow(const float* p) noexcept
+        {
+            for(uint32_t k = 0; k < 3; k++)
+            {
+                this->min[k] = std::min(this->min[k], p[k]);
+                this->max[k] = std::max(this->max[k], p[k]);
+            }
+        }
+
+        void grow(const Bounds& b) noexcept
+        {
+            for(uint32_t k = 0; k < 3; k++)
+            {
+                this->min[k] = std::min(this->min[k], b.min[k]);
+                this->max[k] = std::max(this->max[k], b.max[k]);
+            }
+        }
+
+        // half of the surface area, the factor cancels out in the cost
+        float area(void) const noexcept
+        {
+            if(this->min[0] > this->max[0]) return 0.0f;
+            const float dx = this->max[0] - this->min[0], dy = this->max[1] - this->min[1], dz = this->max[2] - this->min[2];
+            return dx * dy + dy * dz + dz * dx;
+        }
+    };
+
+    struct Bin
+    {
+        Bounds bounds;
+        uint32_t count;
+    };
+
+    // distance where the ray enters the box, FLT_MAX if it misses the box or enters it after tmax
+    inline float enter_box(const pt::BvhNode& node, const float* origin, const float* inv_dir, float tmin, float tmax) noexcept
+    {
+        for(uint32_t k = 0; k < 3; k++)
+        {
+            const float t0 = (node.min[k] - origin[k]) * inv_dir[k];
+            const float t1 = (node.max[k] - origin[k]) * inv_dir[k];
+            tmin = std::max(tmin, std::min(t0, t1));
+            tmax = std::min(tmax, std::max(t0, t1));
+        }
+        return (tmin <= tmax) ? tmin : FLT_MAX;
+    }
+
+    // Möller-Trumbore test, the hit is updated if the triangle is closer
+    inline bool intersect_triangle(const pt::HostTriangle& tri, const pt::HostRay& ray, pt::HostHit& hit) noexcept
+    {
+        const float* d = ray.direction;
+        const float pvec[3] = {
+            d[1] * tri.e2[2] - d[2] * tri.e2[1],
+            d[2] * tri.e2[0] - d[0] * tri.e2[2],
+            d[0] * tri.e2[1] - d[1] * tri.e2[0]
+        };
+        const float det = tri.e1[0] * pvec[0] + tri.e1[1] * pvec[1] + tri.e1[2] * pvec[2];
+        if(det == 0.0f) return false;
+        const float inv_det = 1.0f / det;
+
+        const float tvec[3] = { ray.origin[0] - tri.p0[0], ray.origin[1] - tri.p0[1], ray.origin[2] - tri.p0[2] };
+        const float u = (tvec[0] * pvec[0] + tvec[1] * pvec[1] + tvec[2] * pvec[2]) * inv_det;
+        if(u < 0.0f || u > 1.0f) return false;
+
+        const float qvec[3] = {
+            tvec[1] * tri.e1[2] - tvec[2] * tri.e1[1],
+            tvec[2] * tri.e1[0] - tvec[0] * tri.e1[2],
+            tvec[0] * tri.e1[1] - tvec[1] * tri.e1[0]
+        };
+        const float v = (d[0] * qvec[0] + d[1] * qvec[1] + d[2] * qvec[2]) * inv_det;
+        if(v < 0.0f || u + v > 1.0f) return false;
+
+        const float t = (tri.e2[0] * qvec[0] + tri.e2[1] * qvec[1] + tri.e2[2] * qvec[2]) * inv_det;
+        if(!(t > ray.tmin && t < hit.t)) return false;
+        hit.t = t;
+        hit.u = u;
+        hit.v = v;
+        return true;
+    }
+}
+
+void pt::HostScene::build_bvh(void)
+{
+    std::vector<BvhNode>().swap(this->nodes);
+    const uint32_t n = static_cast<uint32_t>(this->triangles.size());
+    if(n == 0) return;
+
+    // bounds and centroid of every triangle
+    std::vector<Bounds> bounds(n);
+    std::vector<float> centroids(static_cast<size_t>(n) * 3);
+    for(uint32_t i = 0; i < n; i++)
+    {
+        const HostTriangle& tri = this->triangles[i];
+        const float p1[3] = { tri.p0[0] + tri.e1[0], tri.p0[1] + tri.e1[1], tri.p0[2] + tri.e1[2] };
+        const float p2[3] = { tri.p0[0] + tri.e2[0], tri.p0[1] + tri.e2[1], tri.p0[2] + tri.e2[2] };
+        bounds[i] = Bounds::empty();
+        bounds[i].grow(tri.p0);
+        bounds[i].grow(p1);
+        bounds[i].grow(p2);
+        for(uint32_t k = 0; k < 3; k++)
+            centroids[i * 3 + k] = (bounds[i].min[k] + bounds[i].max[k]) * 0.5f;
+    }
+
+    std::vector<uint32_t> order(n);
+    for(uint32_t i = 0; i < n; i++) order[i] = i;
+
+    // The nodes are split top-down, the children of a node are appended next to each other.
+    // Every entry of the stack is a node and its depth.
+    this->nodes.reserve(2 * static_cast<size_t>(n));
+    this->nodes.push_back({ {}, 0, {}, n });
+    std::vector<std::pair<uint32_t, uint32_t>> stack = { { 0, 0 } };
+    while(!stack.empty())
+    {
+        const uint32_t node_index = stack.back().first;
+        const uint32_t depth = stack.back().second;
+        stack.pop_back();
+        const uint32_t first = this->nodes[node_index].first;
+        const uint32_t count = this->nodes[node_index].count;
+
+        Bounds box = Bounds::empty(), centroid_box = Bounds::empty();
+        for(uint32_t i = first; i < first + count; i++)
+        {
+            box.grow(bounds[order[i]]);
+            centroid_box.grow(centroids.data() + order[i] * 3);
+        }
+        std::copy_n(box.min, 3, this->nodes[node_index].min);
+        std::copy_n(box.max, 3, this->nodes[node_index].max);
+        if(count <= MAX_LEAF_SIZE || depth + 1 >= MAX_DEPTH) continue;
+
+        // Binned SAH (Wald 2007): the centroids are sorted into bins along every axis,
+        // the cost of every border between two bins is the area times the triangle count of both sides.
+        float best_cost = FLT_MAX;
+        uint32_t best_axis = 0, best_split = 0;
+        for(uint32_t axis = 0; axis < 3; axis++)
+        {
+            const float extent = centroid_box.max[axis] - centroid_box.min[axis];
+            if(!(extent > 0.0f)) continue;
+            const float scale = static_cast<float>(BIN_COUNT) / extent;
+
+            Bin bins[BIN_COUNT];
+            for(Bin& bin : bins) bin = { Bounds::empty(), 0 };
+            for(uint32_t i = first; i < first + count; i++)
+            {
+                const float c = centroids[order[i] * 3 + axis];
+                const uint32_t b = std::min(static_cast<uint32_t>((c - centroid_box.min[axis]) * scale), BIN_COUNT - 1);
+                bins[b].bounds.grow(bounds[order[i]]);
+                bins[b].count++;
+            }
+
+            // sweep from the right to get the cost of the right sides, then from the left
+            float right_cost[BIN_COUNT];
+            Bounds right = Bounds::empty();
+            uint32_t right_count = 0;
+            for(uint32_t b = BIN_COUNT - 1; b > 0; b--)
+            {
+                right.grow(bins[b].bounds);
+                right_count += bins[b].count;
+                right_cost[b] = right.area() * static_cast<float>(right_count);
+            }
+            Bounds left = Bounds::empty();
+            uint32_t left_count = 0;
+            for(uint32_t b = 1; b < BIN_COUNT; b++)
+            {
+                left.grow(bins[b - 1].bounds);
+                left_count += bins[b - 1].count;
+                const float cost = left.area() * static_cast<float>(left_count) + right_cost[b];
+                if(left_count > 0 && left_count < count && cost < best_cost)
+                {
+                    best_cost = cost;
+                    best_axis = axis;
+                    best_split = b;
+                }
+            }
+        }
+
+        // A small node stays a leaf if intersecting all of its triangles is cheaper than the split.
+        // Triangles with the same centroid can't be binned, those are split in the middle of the node.
+        uint32_t mid;
+        if(best_cost < FLT_MAX)
+        {
+            const float area = box.area();
+            if(count <= 2 * MAX_LEAF_SIZE && area > 0.0f && TRAVERSAL_COST + best_cost / area >= static_cast<float>(count))
+                continue;
+            const float extent = centroid_box.max[best_axis] - centroid_box.min[best_axis];
+            const float scale = static_cast<float>(BIN_COUNT) / extent;
+            const auto it = std::partition(order.begin() + first, order.begin() + first + count, [&](uint32_t i) {
+                const float c = centroids[i * 3 + best_axis];
+                return std::min(static_cast<uint32_t>((c - centroid_box.min[best_axis]) * scale), BIN_COUNT - 1) < best_split;
+            });
+            mid = static_cast<uint32_t>(it - order.begin());
+        }
+        else mid = first + count / 2;
+
+        const uint32_t left_index = static_cast<uint32_t>(this->nodes.size());
+        this->nodes.push_back({ {}, first, {}, mid - first });
+        this->nodes.push_back({ {}, mid, {}, first + count - mid });
+        this->nodes[node_index].first = left_index;
+        this->nodes[node_index].count = 0;
+        stack.push_back({ left_index + 1, depth + 1 });
+        stack.push_back({ left_index, depth + 1 });
+    }
+
+    // the triangles are stored in the order of the leaves
+    std::vector<HostTriangle> triangles(n);
+    std::vector<HostTriangleAttributes> attributes(n);
+    std::vector<uint32_t> meshes(n);
+    for(uint32_t i = 0; i < n; i++)
+    {
+        triangles[i] = this->triangles[order[i]];
+        attributes[i] = this->attributes[order[i]];
+        meshes[i] = this->triangle_meshes[order[i]];
+    }
+    this->triangles = std::move(triangles);
+    this->attributes = std::move(attributes);
+    this->triangle_meshes = std::move(meshes);
+}
+
+bool pt::HostScene::intersect(const HostRay& ray, HostHit& hit) const noexcept
+{
+    hit.t = ray.tmax;
+    hit.u = hit.v = 0.0f;
+    hit.triangle = HostHit::MISS;
+    if(this->nodes.empty()) return false;
+
+    // a zero component would turn the slab test into 0 * inf, the tiny direction has the same result without a NaN
+    float inv_dir[3];
+    for(uint32_t k = 0; k < 3; k++)
+        inv_dir[k] = 1.0f / ((ray.direction[k] != 0.0f) ? ray.direction[k] : 1e-30f);
+
+    if(enter_box(this->nodes[0], ray.origin, inv_dir, ray.tmin, hit.t) == FLT_MAX) return false;
+
+    // The closer child is visited first and the other one is pushed, nodes that start behind the closest hit are skipped.
+    uint32_t stack[MAX_DEPTH];
+    uint32_t size = 0;
+    uint32_t current = 0;
+    for(;;)
+    {
+        const BvhNode& node = this->nodes[current];
+        if(node.count != 0)
+        {
+            for(uint32_t i = node.first; i < node.first + node.count; i++)
+                if(intersect_triangle(this->triangles[i], ray, hit)) hit.triangle = i;
+        }
+        else
+        {
+            const float t0 = enter_box(this->nodes[node.first], ray.origin, inv_dir, ray.tmin, hit.t);
+            const float t1 = enter_box(this->nodes[node.first + 1], ray.origin, inv_dir, ray.tmin, hit.t);
+            if(t0 != FLT_MAX && t1 != FLT_MAX)
+            {
+                current = (t0 <= t1) ? node.first : node.first + 1;
+                stack[size++] = (t0 <= t1) ? node.first + 1 : node.first;
+                continue;
+            }
+            if(t0 != FLT_MAX || t1 != FLT_MAX)
+            {
+                current = (t0 != FLT_MAX) ? node.first : node.first + 1;
+                continue;
+            }
+        }
+
+        // the pushed node may start behind a hit that was found after it was pushed
+        bool found = false;
+        while(size > 0 && !found)
+        {
+            current = stack[--size];
+            found = enter_box(this->nodes[current], ray.origin, inv_dir, ray.tmin, hit.t) != FLT_MAX;
+        }
+        if(!found) break;
+    }
+    return hit.triangle != HostHit::MISS;
+}
+
+void pt::HostScene::intersect(ThreadPool& pool, const HostRay* rays, HostHit* hits, size_t count) const
+{
+    std::vector<std::future<void>> tasks;
+    for(size_t first = 0; first < count; first += STREAM_BLOCK)
+    {
+        const size_t last = std::min(first + STREAM_BLOCK, count);
+        tasks.push_back(pool.submit([this, rays, hits, first, last]() {
+            for(size_t i = first; i < last; i++)
+                this->intersect(rays[i], hits[i]);
+        }));
+    }
+    pool.wait_all(tasks);
+}
+
+bool pt::HostScene::occluded(const HostRay& ray) const noexcept
+{
+    if(this->nodes.empty()) return false;
+
+    float inv_dir[3];
+    for(uint32_t k = 0; k < 3; k++)
+        inv_dir[k] = 1.0f / ((ray.direction[k] != 0.0f) ? ray.direction[k] : 1e-30f);
+
+    // Any hit ends the query, so the children are not ordered and the interval of the ray never shrinks.
+    // The traversal neither sorts the children nor tests the pushed nodes again.
+    uint32_t stack[MAX_DEPTH];
+    uint32_t size = 0;
+    if(enter_box(this->nodes[0], ray.origin, inv_dir, ray.tmin, ray.tmax) != FLT_MAX) stack[size++] = 0;
+    while(size > 0)
+    {
+        const BvhNode& node = this->nodes[stack[--size]];
+        if(node.count != 0)
+        {
+            for(uint32_t i = node.first; i < node.first + node.count; i++)
+            {
+                HostHit hit;
+                hit.t = ray.tmax;
+                if(intersect_triangle(this->triangles[i], ray, hit)) return true;
+            }
+            continue;
+        }
+        if(enter_box(this->nodes[node.first + 1], ray.origin, inv_dir, ray.tmin, ray.tmax) != FLT_MAX) stack[size++] = node.first + 1;
+        if(enter_box(this->nodes[node.first], ray.origin, inv_dir, ray.tmin, ray.tmax) != FLT_MAX) stack[size++] = node.first;
+    }
+    return false;
+}
+
+void pt::HostScene::occluded(ThreadPool& pool, const HostRay* rays, uint8_t* occluded, size_t count) const
+{
+    std::vector<std::future<void>> tasks;
+    for(size_t first = 0; first < count; first += STREAM_BLOCK)
+    {
+        const size_t last = std::min(first + STREAM_BLOCK, count);
+        tasks.push_back(pool.submit([this, rays, occluded, first, last]() {
+            for(size_t i = first; i < last; i++)
+                occluded[i] = this->occluded(rays[i]) ? 1 : 0;
+        }));
+    }
+    pool.wait_all(tasks);
+}
@@ -0,0 +1,424 @@
+#include "../application.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+namespace
+{
+    constexpr float PI = 3.14159265358979f;
+    constexpr uint32_t CAMERA_DIMENSIONS = 2;   // lens sample, same as the ray generation shader
+    constexpr uint32_t BOUNCE_DIMENSIONS = 3;   // direction and russian roulette of every hit
+    constexpr uint32_t ROULETTE_DEPTH = 3;      // paths with fewer hits are not terminated by russian roulette
+    constexpr size_t BLOCK_SIZE = 4096;         // paths per task of the wavefront
+
+    // State of a path between two bounces.
+    struct PathState
+    {
+        float throughput[3];
+        uint32_t pixel;
+        uint32_t sample;
+        uint32_t depth;     // number of hits so far
+    };
+
+    // Hit of a path inside of its material queue, the sort moves the whole path so the queues are read in order.
+    struct QueuedHit
+    {
+        PathState path;
+        pt::HostRay ray;
+        pt::HostHit hit;
+        uint32_t queue;
+    };
+
+    void validate(const pt::HostRenderSettings& settings, const char* function)
+    {
+        if(settings.width == 0 || settings.height == 0 || settings.samples == 0 || settings.max_depth == 0)
+            throw std::invalid_argument(std::string("[") + function + "]: The resolution, the samples and the depth must not be 0.");
+    }
+
+    uint64_t elapsed_ns(std::chrono::steady_clock::time_point begin)
+    {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin).count());
+    }
+
+    // camera ray through the corner of the pixel, same as generate_ray of the ray generation shader
+    PathState start_path(const pt::CameraData& camera, const pt::Sampler& sampler, const pt::HostRenderSettings& settings,
+        uint32_t pixel, uint32_t sample, pt::HostRay& ray) noexcept
+    {
+        const uint32_t x = pixel % settings.width, y = pixel / settings.width;
+        const float ndc_x = static_cast<float>(x) / static_cast<float>(settings.width) * 2.0f - 1.0f;
+        const float ndc_y = static_cast<float>(y) / static_cast<float>(settings.height) * 2.0f - 1.0f;
+        camera.generate_ray(ndc_x, ndc_y, sampler.get(x, y, sample, 0), sampler.get(x, y, sample, 1), ray.origin, ray.direction);
+        ray.tmin = 0.0f;
+        ray.tmax = 10000.0f;
+        return { { 1.0f, 1.0f, 1.0f }, pixel, sample, 0 };
+    }
+
+    // nearest texel with repeating texture coordinates, like the samplers of the albedo maps
+    void lookup_albedo(const pt::HostMaterial& mtl, const float uv[2], float albedo[3]) noexcept
+    {
+        if(mtl.texture_width == 0)
+        {
+            std::copy_n(mtl.albedo, 3, albedo);
+            return;
+        }
+        const float s = uv[0] - std::floor(uv[0]), t = uv[1] - std::floor(uv[1]);
+        const uint32_t x = std::min(static_cast<uint32_t>(s * static_cast<float>(mtl.texture_width)), mtl.texture_width - 1);
+        const uint32_t y = std::min(static_cast<uint32_t>(t * static_cast<float>(mtl.texture_height)), mtl.texture_height - 1);
+        std::copy_n(mtl.texture.data() + (static_cast<size_t>(y) * mtl.texture_width + x) * 3, 3, albedo);
+    }
+
+    void miss(const pt::HostRenderSettings& settings, const PathState& path, float* rgb) noexcept
+    {
+        float* pixel = rgb + static_cast<size_t>(path.pixel) * 3;
+        for(uint32_t k = 0; k < 3; k++)
+            pixel[k] += path.throughput[k] * settings.background[k];
+    }
+
+    // Adds the emission of the hit to the pixel and continues the path with a cosine distributed direction
+    // of the diffuse material. Both integrators call this function, so they compute the same paths.
+    bool shade(const pt::HostScene& scene, const pt::HostMaterial& mtl, const pt::Sampler& sampler, const pt::HostRenderSettings& settings,
+        const pt::HostRay& ray, const pt::HostHit& hit, PathState& path, pt::HostRay& next, float* rgb) noexcept
+    {
+        float* pixel = rgb + static_cast<size_t>(path.pixel) * 3;
+        for(uint32_t k = 0; k < 3; k++)
+            pixel[k] += path.throughput[k] * mtl.emission[k];
+        if(++path.depth >= settings.max_depth) return false;
+
+        const uint32_t x = path.pixel % settings.width, y = path.pixel / settings.width;
+        const uint32_t dimension = CAMERA_DIMENSIONS + (path.depth - 1) * BOUNCE_DIMENSIONS;
+        const float u0 = sampler.get(x, y, path.sample, dimension);
+        const float u1 = sampler.get(x, y, path.sample, dimension + 1);
+        const float u2 = sampler.get(x, y, path.sample, dimension + 2);
+
+        // the geometric normal faces the ray, the shading normal is on the same side
+        const pt::HostTriangle& tri = scene.get_triangle(hit.triangle);
+        float ng[3] = {
+            tri.e1[1] * tri.e2[2] - tri.e1[2] * tri.e2[1],
+            tri.e1[2] * tri.e2[0] - tri.e1[0] * tri.e2[2],
+            tri.e1[0] * tri.e2[1] - tri.e1[1] * tri.e2[0]
+        };
+        const float ng_len = std::sqrt(ng[0] * ng[0] + ng[1] * ng[1] + ng[2] * ng[2]);
+        const float ng_sign = (ng[0] * ray.direction[0] + ng[1] * ray.direction[1] + ng[2] * ray.direction[2] > 0.0f) ? -1.0f : 1.0f;
+        for(uint32_t k = 0; k < 3; k++) ng[k] *= ng_sign / ng_len;
+
+        float n[3], uv[2];
+        scene.interpolate(hit, n, uv);
+        const float n_len = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        if(n_len > 0.0f)
+        {
+            const float n_sign = (n[0] * ng[0] + n[1] * ng[1] + n[2] * ng[2] < 0.0f) ? -1.0f : 1.0f;
+            for(uint32_t k = 0; k < 3; k++) n[k] *= n_sign / n_len;
+        }
+        else std::copy_n(ng, 3, n);
+
+        // the cosine and the pdf cancel out, the weight of a diffuse bounce is its albedo
+        float albedo[3];
+        lookup_albedo(mtl, uv, albedo);
+        float q = 0.0f;
+        for(uint32_t k = 0; k < 3; k++)
+        {
+            path.throughput[k] *= albedo[k];
+            q = std::max(q, path.throughput[k]);
+        }
+        if(!(q > 0.0f)) return false;
+        if(path.depth >= ROULETTE_DEPTH)
+        {
+            q = std::min(q, 0.95f);
+            if(u2 >= q) return false;
+            for(uint32_t k = 0; k < 3; k++) path.throughput[k] /= q;
+        }
+
+        // cosine distributed direction around the normal (Malley), the basis of Duff et al. 2017
+        const float sign = std::copysign(1.0f, n[2]);
+        const float a = -1.0f / (sign + n[2]);
+        const float b = n[0] * n[1] * a;
+        const float tangent[3] = { 1.0f + sign * n[0] * n[0] * a, sign * b, -sign * n[0] };
+        const float bitangent[3] = { b, sign + n[1] * n[1] * a, -n[1] };
+        const float r = std::sqrt(u0), phi = 2.0f * PI * u1;
+        const float lx = r * std::cos(phi), ly = r * std::sin(phi), lz = std::sqrt(std::max(0.0f, 1.0f - u0));
+        float cos_g = 0.0f;
+        for(uint32_t k = 0; k < 3; k++)
+        {
+            next.direction[k] = lx * tangent[k] + ly * bitangent[k] + lz * n[k];
+            cos_g += next.direction[k] * ng[k];
+        }
+        // an interpolated normal can send the direction below the surface
+        if(!(cos_g > 0.0f)) return false;
+
+        // the origin is moved away from the surface relative to the magnitude of the position, so the ray does not hit the same triangle
+        float scale = 1.0f;
+        for(uint32_t k = 0; k < 3; k++)
+        {
+            next.origin[k] = ray.origin[k] + ray.direction[k] * hit.t;
+            scale = std::max(scale, std::abs(next.origin[k]));
+        }
+        for(uint32_t k = 0; k < 3; k++)
+            next.origin[k] += ng[k] * scale * 1e-4f;
+        next.tmin = 0.0f;
+        next.tmax = FLT_MAX;
+        return true;
+    }
+
+    pt::HostRenderStatistics finish(const pt::HostRenderSettings& settings, std::chrono::steady_clock::time_point begin, pt::HostRenderStatistics stats, float* rgb)
+    {
+        const size_t count = static_cast<size_t>(settings.width) * settings.height * 3;
+        const float scale = 1.0f / static_cast<float>(settings.samples);
+        for(size_t i = 0; i < count; i++) rgb[i] *= scale;
+        stats.render_ns = elapsed_ns(begin);
+        stats.rays_per_second = static_cast<double>(stats.rays) / (static_cast<double>(std::max<uint64_t>(stats.render_ns, 1)) * 1e-9);
+        return stats;
+    }
+}
+
+pt::HostRenderStatistics pt::render_per_pixel(ThreadPool& pool, const HostScene& scene, const CameraData& camera, const Sampler& sampler,
+    const HostRenderSettings& settings, float* rgb)
+{
+    validate(settings, "pt::render_per_pixel");
+    const auto begin = std::chrono::steady_clock::now();
+    std::fill_n(rgb, static_cast<size_t>(settings.width) * settings.height * 3, 0.0f);
+
+    // every path is traced from the camera until it ends, before the next one starts
+    const std::vector<HostMaterial>& materials = scene.get_materials();
+    std::atomic<uint64_t> rays(0);
+    std::vector<std::future<void>> tasks;
+    for(uint32_t y = 0; y < settings.height; y++)
+    {
+        tasks.push_back(pool.submit([&, y]() {
+            uint64_t row_rays = 0;
+            for(uint32_t x = 0; x < settings.width; x++)
+            {
+                for(uint32_t s = 0; s < settings.samples; s++)
+                {
+                    HostRay ray, next;
+                    HostHit hit;
+                    PathState path = start_path(camera, sampler, settings, y * settings.width + x, s, ray);
+                    for(;;)
+                    {
+                        row_rays++;
+                        if(!scene.intersect(ray, hit))
+                        {
+                            miss(settings, path, rgb);
+                            break;
+                        }
+                        if(!shade(scene, materials[scene.material_id(hit.triangle)], sampler, settings, ray, hit, path, next, rgb)) break;
+                        ray = next;
+                    }
+                }
+            }
+            rays += row_rays;
+        }));
+    }
+    pool.wait_all(tasks);
+
+    HostRenderStatistics stats = {};
+    stats.rays = rays.load();
+    return finish(settings, begin, stats, rgb);
+}
+
+pt::HostRenderStatistics pt::render_wavefront(ThreadPool& pool, const HostScene& scene, const CameraData& camera, const Sampler& sampler,
+    const HostRenderSettings& settings, float* rgb)
+{
+    validate(settings, "pt::render_wavefront");
+    if(settings.wave_size == 0)
+        throw std::invalid_argument("[pt::render_wavefront]: The wave size must not be 0.");
+    const auto begin = std::chrono::steady_clock::now();
+    const size_t pixel_count = static_cast<size_t>(settings.width) * settings.height;
+    std::fill_n(rgb, pixel_count * 3, 0.0f);
+
+    // The paths are started in the order of their index, index = sample * pixels + pixel. A wave is never larger than the
+    // image, so every pixel has at most one path in flight and the shading tasks add to the pixels without a race.
+    // The samples of a pixel are added in the same order as by the per-pixel integrator.
+    const size_t wave = std::min(static_cast<size_t>(settings.wave_size), pixel_count);
+    const uint64_t path_count = static_cast<uint64_t>(pixel_count) * settings.samples;
+    const std::vector<HostMaterial>& materials = scene.get_materials();
+    const uint32_t miss_queue = static_cast<uint32_t>(materials.size()); // the rays that missed get the last queue
+    const uint32_t queue_count = miss_queue + 1;
+
+    std::vector<HostRay> rays(wave);
+    std::vector<PathState> paths(wave);
+    std::vector<HostHit> hits(wave);
+    std::vector<uint32_t> keys(wave);
+    std::vector<QueuedHit> queues(wave);    // hits sorted by their queue
+    std::vector<uint32_t> histograms;       // one histogram of the queues per block
+    std::vector<uint32_t> survivors;        // number of continued paths per block
+    std::vector<std::future<void>> tasks;
+    HostRenderStatistics stats = {};
+
+    for(uint64_t first_path = 0; first_path < path_count;)
+    {
+        size_t count = static_cast<size_t>(std::min<uint64_t>(wave, path_count - first_path));
+        auto phase = std::chrono::steady_clock::now();
+        for(size_t first = 0; first < count; first += BLOCK_SIZE)
+        {
+            tasks.push_back(pool.submit([&, first, first_path]() {
+                for(size_t i = first; i < std::min(first + BLOCK_SIZE, count); i++)
+                {
+                    const uint64_t index = first_path + i;
+                    paths[i] = start_path(camera, sampler, settings, static_cast<uint32_t>(index % pixel_count),
+                        static_cast<uint32_t>(index / pixel_count), rays[i]);
+                }
+            }));
+        }
+        pool.wait_all(tasks);
+        first_path += count;
+        stats.shade_ns += elapsed_ns(phase);
+
+        while(count > 0)
+        {
+            phase = std::chrono::steady_clock::now();
+            scene.intersect(pool, rays.data(), hits.data(), count);
+            stats.rays += count;
+            stats.waves++;
+            stats.intersect_ns += elapsed_ns(phase);
+
+            // Counting sort of the hits by their material: every block counts its keys, the exclusive prefix sum in the order
+            // (queue, block) gives the position of the first hit of every block inside of every queue, then the blocks scatter.
+            phase = std::chrono::steady_clock::now();
+            const size_t block_count = (count + BLOCK_SIZE - 1) / BLOCK_SIZE;
+            histograms.assign(block_count * queue_count, 0);
+            for(size_t b = 0; b < block_count; b++)
+            {
+                tasks.push_back(pool.submit([&, b]() {
+                    uint32_t* histogram = histograms.data() + b * queue_count;
+                    for(size_t i = b * BLOCK_SIZE; i < std::min((b + 1) * BLOCK_SIZE, count); i++)
+                    {
+                        keys[i] = (hits[i].triangle == HostHit::MISS) ? miss_queue : scene.material_id(hits[i].triangle);
+                        histogram[keys[i]]++;
+                    }
+                }));
+            }
+            pool.wait_all(tasks);
+
+            uint32_t offset = 0;
+            for(uint32_t q = 0; q < queue_count; q++)
+            {
+                for(size_t b = 0; b < block_count; b++)
+                {
+                    const uint32_t n = histograms[b * queue_count + q];
+                    histograms[b * queue_count + q] = offset;
+                    offset += n;
+                }
+            }
+            for(size_t b = 0; b < block_count; b++)
+            {
+                tasks.push_back(pool.submit([&, b]() {
+                    uint32_t* histogram = histograms.data() + b * queue_count;
+                    for(size_t i = b * BLOCK_SIZE; i < std::min((b + 1) * BLOCK_SIZE, count); i++)
+                        queues[histogram[keys[i]]++] = { paths[i], rays[i], hits[i], keys[i] };
+                }));
+            }
+            pool.wait_all(tasks);
+            stats.sort_ns += elapsed_ns(phase);
+
+            // The queues are shaded in blocks, so one task shades long runs of the same material. The continued
+            // paths of a block are written to the start of the block and compacted afterwards.
+            phase = std::chrono::steady_clock::now();
+            survivors.assign(block_count, 0);
+            for(size_t b = 0; b < block_count; b++)
+            {
+                tasks.push_back(pool.submit([&, b]() {
+                    uint32_t alive = 0;
+                    for(size_t j = b * BLOCK_SIZE; j < std::min((b + 1) * BLOCK_SIZE, count); j++)
+                    {
+                        const QueuedHit& queued = queues[j];
+                        if(queued.queue == miss_queue)
+                        {
+                            miss(settings, queued.path, rgb);
+                            continue;
+                        }
+                        const size_t dst = b * BLOCK_SIZE + alive;
+                        paths[dst] = queued.path;
+                        if(shade(scene, materials[queued.queue], sampler, settings, queued.ray, queued.hit, paths[dst], rays[dst], rgb)) alive++;
+                    }
+                    survivors[b] = alive;
+                }));
+            }
+            pool.wait_all(tasks);
+
+            // the blocks only move towards the front, so they are moved in ascending order
+            size_t next_count = 0;
+            for(size_t b = 0; b < block_count; b++)
+            {
+                if(next_count != b * BLOCK_SIZE)
+                {
+                    std::copy_n(paths.begin() + b * BLOCK_SIZE, survivors[b], paths.begin() + next_count);
+                    std::copy_n(rays.begin() + b * BLOCK_SIZE, survivors[b], rays.begin() + next_count);
+                }
+                next_count += survivors[b];
+            }
+            count = next_count;
+            stats.shade_ns += elapsed_ns(phase);
+        }
+    }
+    return finish(settings, begin, stats, rgb);
+}
+
+pt::HostShadowStatistics pt::measure_shadow_rays(ThreadPool& pool, const HostScene& scene, const CameraData& camera, const Sampler& sampler,
+    const HostRenderSettings& settings, const float light[3])
+{
+    if(settings.width == 0 || settings.height == 0 || settings.samples == 0)
+        throw std::invalid_argument("[pt::measure_shadow_rays]: The resolution and the samples must not be 0.");
+    const size_t pixel_count = static_cast<size_t>(settings.width) * settings.height;
+    const size_t count = pixel_count * settings.samples;
+
+    std::vector<HostRay> rays(count);
+    std::vector<HostHit> hits(count);
+    for(size_t i = 0; i < count; i++)
+        start_path(camera, sampler, settings, static_cast<uint32_t>(i % pixel_count), static_cast<uint32_t>(i / pixel_count), rays[i]);
+
+    HostShadowStatistics stats = {};
+    auto phase = std::chrono::steady_clock::now();
+    scene.intersect(pool, rays.data(), hits.data(), count);
+    stats.camera_ns = static_cast<double>(elapsed_ns(phase)) / static_cast<double>(count);
+
+    // The shadow ray goes from the hit to the light, its direction is not normalized, so the light is at t = 1.
+    // The origin is moved to the side of the light like the origin of a bounce.
+    std::vector<HostRay> shadow_rays;
+    shadow_rays.reserve(count);
+    for(size_t i = 0; i < count; i++)
+    {
+        if(hits[i].triangle == HostHit::MISS) continue;
+        const HostTriangle& tri = scene.get_triangle(hits[i].triangle);
+        const float ng[3] = {
+            tri.e1[1] * tri.e2[2] - tri.e1[2] * tri.e2[1],
+            tri.e1[2] * tri.e2[0] - tri.e1[0] * tri.e2[2],
+            tri.e1[0] * tri.e2[1] - tri.e1[1] * tri.e2[0]
+        };
+        HostRay shadow;
+        float scale = 1.0f, cos_l = 0.0f, ng_len = 0.0f;
+        for(uint32_t k = 0; k < 3; k++)
+        {
+            shadow.origin[k] = rays[i].origin[k] + rays[i].direction[k] * hits[i].t;
+            scale = std::max(scale, std::abs(shadow.origin[k]));
+            cos_l += ng[k] * (light[k] - shadow.origin[k]);
+            ng_len += ng[k] * ng[k];
+        }
+        const float offset = std::copysign(scale * 1e-4f, cos_l) / std::sqrt(ng_len);
+        for(uint32_t k = 0; k < 3; k++)
+        {
+            shadow.origin[k] += ng[k] * offset;
+            shadow.direction[k] = light[k] - shadow.origin[k];
+        }
+        shadow.tmin = 0.0f;
+        shadow.tmax = 0.999f;
+        shadow_rays.push_back(shadow);
+    }
+    stats.rays = shadow_rays.size();
+    if(stats.rays == 0) return stats;
+
+    std::vector<HostHit> shadow_hits(shadow_rays.size());
+    std::vector<uint8_t> occluded(shadow_rays.size());
+    phase = std::chrono::steady_clock::now();
+    scene.intersect(pool, shadow_rays.data(), shadow_hits.data(), shadow_rays.size());
+    stats.closest_hit_ns = static_cast<double>(elapsed_ns(phase)) / static_cast<double>(stats.rays);
+    phase = std::chrono::steady_clock::now();
+    scene.occluded(pool, shadow_rays.data(), occluded.data(), shadow_rays.size());
+    stats.occlusion_ns = static_cast<double>(elapsed_ns(phase)) / static_cast<double>(stats.rays);
+
+    for(size_t i = 0; i < shadow_rays.size(); i++)
+    {
+        stats.occluded += occluded[i];
+        if((occluded[i] != 0) != (shadow_hits[i].triangle != HostHit::MISS)) stats.mismatches++;
+    }
+    return stats;
+}
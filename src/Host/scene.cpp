@@ -0,0 +1,164 @@
+#include "../application.h"
+#include <algorithm>
+#include <cmath>
+#include <stb/stb_image.h>
+
+namespace
+{
+    // the albedo maps of the GPU are sRGB textures, the host converts them once when they are decoded
+    float srgb_to_linear(uint8_t c) noexcept
+    {
+        const float x = static_cast<float>(c) / 255.0f;
+        return (x <= 0.04045f) ? x / 12.92f : std::pow((x + 0.055f) / 1.055f, 2.4f);
+    }
+
+    void decode_albedo_map(const std::string& path, pt::HostMaterial& mtl)
+    {
+        // stb allocates from the scratch arena of this thread, the scope releases it
+        pt::ScratchScope scratch;
+        int w, h;
+        const uint8_t* data = stbi_load(path.c_str(), &w, &h, nullptr, 3);
+        if(data == nullptr)
+            throw std::runtime_error("[pt::HostScene::load]: Failed to load albedo map: " + path);
+
+        float lut[256];
+        for(uint32_t i = 0; i < 256; i++)
+            lut[i] = srgb_to_linear(static_cast<uint8_t>(i));
+        const size_t count = static_cast<size_t>(w) * h * 3;
+        mtl.texture.resize(count);
+        for(size_t i = 0; i < count; i++)
+            mtl.texture[i] = lut[data[i]];
+        mtl.texture_width = static_cast<uint32_t>(w);
+        mtl.texture_height = static_cast<uint32_t>(h);
+    }
+}
+
+void pt::HostScene::load(ThreadPool& pool, const std::vector<std::string>& paths)
+{
+    this->clear();
+
+    // Every file is parsed by its own task. The meshes reference the attributes of their file,
+    // so the files are allocated once and never moved.
+    std::vector<std::unique_ptr<ObjFile>> files(paths.size());
+    std::vector<std::future<void>> tasks;
+    for(size_t i = 0; i < paths.size(); i++)
+    {
+        tasks.push_back(pool.submit([&, i]() {
+            files[i] = std::make_unique<ObjFile>();
+            files[i]->load(paths[i]);
+        }));
+    }
+    pool.wait_all(tasks);
+
+    std::vector<std::string> albedo_maps;
+    std::vector<float> vertices, attributes;
+    ObjMesh mesh;
+    for(const std::unique_ptr<ObjFile>& file : files)
+    {
+        // same compaction as the path tracer: the referenced materials are appended in the order of the material library
+        const std::vector<tinyobj::material_t>& mtls = file->materials();
+        std::vector<uint32_t> remap(mtls.size(), UINT32_MAX);
+        for(size_t i = 0; i < file->mesh_count(); i++)
+        {
+            const ObjMeshInfo& info = file->mesh_info(i);
+            const size_t mtl = (info.material < 0) ? 0 : static_cast<size_t>(info.material);
+            if(mtl >= mtls.size())
+                throw std::runtime_error("[pt::HostScene::load]: A mesh references a material that does not exist in the material library.");
+            remap[mtl] = 0;
+        }
+        for(size_t i = 0; i < mtls.size(); i++)
+        {
+            if(remap[i] == UINT32_MAX) continue;
+            remap[i] = static_cast<uint32_t>(this->materials.size());
+            HostMaterial hmtl = {};
+            std::copy_n(mtls[i].diffuse, 3, hmtl.albedo);
+            std::copy_n(mtls[i].emission, 3, hmtl.emission);
+            this->materials.push_back(std::move(hmtl));
+            albedo_maps.push_back(mtls[i].diffuse_texname);
+        }
+
+        for(size_t i = 0; i < file->mesh_count(); i++)
+        {
+            file->build_mesh(i, mesh);
+            RecordParameter record;
+            record.geometryID = static_cast<uint32_t>(this->records.size());
+            record.materialID = remap[mesh.material()];
+            this->records.push_back(record);
+
+            vertices.resize(static_cast<size_t>(mesh.vertex_count()) * ObjMesh::VERTEX_COMPONENTS);
+            attributes.resize(static_cast<size_t>(mesh.vertex_count()) * ObjMesh::ATTRIBUTE_COMPONENTS);
+            mesh.write_vertices(vertices.data(), 0, mesh.vertex_count());
+            mesh.write_attributes(attributes.data(), 0, mesh.vertex_count());
+
+            const uint32_t* idx = mesh.pindices();
+            for(uint32_t f = 0; f + 3 <= mesh.index_count(); f += 3)
+            {
+                HostTriangle triangle;
+                HostTriangleAttributes attribute;
+                const float* p[3];
+                for(uint32_t v = 0; v < 3; v++)
+                {
+                    p[v] = vertices.data() + static_cast<size_t>(idx[f + v]) * ObjMesh::VERTEX_COMPONENTS;
+                    const float* a = attributes.data() + static_cast<size_t>(idx[f + v]) * ObjMesh::ATTRIBUTE_COMPONENTS;
+                    std::copy_n(a, 3, attribute.normals[v]);
+                    std::copy_n(a + 4, 2, attribute.texcoords[v]);
+                }
+                for(uint32_t k = 0; k < 3; k++)
+                {
+                    triangle.p0[k] = p[0][k];
+                    triangle.e1[k] = p[1][k] - p[0][k];
+                    triangle.e2[k] = p[2][k] - p[0][k];
+                }
+                this->triangles.push_back(triangle);
+                this->attributes.push_back(attribute);
+                this->triangle_meshes.push_back(record.geometryID);
+            }
+        }
+        mesh.clear();
+        file->clear();
+    }
+
+    // materials without an albedo map keep the diffuse color of the material library
+    for(size_t i = 0; i < this->materials.size(); i++)
+    {
+        if(albedo_maps[i].empty()) continue;
+        tasks.push_back(pool.submit([this, &albedo_maps, i]() {
+            decode_albedo_map(albedo_maps[i], this->materials[i]);
+        }));
+    }
+    pool.wait_all(tasks);
+
+    this->build_bvh();
+}
+
+void pt::HostScene::clear(void) noexcept
+{
+    std::vector<HostTriangle>().swap(this->triangles);
+    std::vector<HostTriangleAttributes>().swap(this->attributes);
+    std::vector<uint32_t>().swap(this->triangle_meshes);
+    std::vector<RecordParameter>().swap(this->records);
+    std::vector<HostMaterial>().swap(this->materials);
+    std::vector<BvhNode>().swap(this->nodes);
+}
+
+void pt::HostScene::interpolate(const HostHit& hit, float normal[3], float texcoord[2]) const noexcept
+{
+    // same barycentric coordinates as get_attribute of the closest hit shader
+    const HostTriangleAttributes& a = this->attributes[hit.triangle];
+    const float w = 1.0f - hit.u - hit.v;
+    for(uint32_t k = 0; k < 3; k++)
+        normal[k] = a.normals[0][k] * w + a.normals[1][k] * hit.u + a.normals[2][k] * hit.v;
+    for(uint32_t k = 0; k < 2; k++)
+        texcoord[k] = a.texcoords[0][k] * w + a.texcoords[1][k] * hit.u + a.texcoords[2][k] * hit.v;
+}
+
+void pt::HostScene::get_bounds(float bounds[6]) const noexcept
+{
+    if(this->nodes.empty())
+    {
+        std::fill_n(bounds, 6, 0.0f);
+        return;
+    }
+    std::copy_n(this->nodes[0].min, 3, bounds);
+    std::copy_n(this->nodes[0].max, 3, bounds + 3);
+}
@@ -13,9 +13,18 @@ namespace pt
     {
         VkAccelerationStructureNV as;   // client-side acceleration structure handle
         VkDeviceMemory memory;          // memory that is bound to the acceleration structure
+        VkDeviceSize size;              // size of the memory in bytes
         uint64_t handle;                // device-side acceleration structure handle
     };
 
+    // Ray types of the SBT, every geometry has one hit group per ray type and there is one miss record per ray type, in this order.
+    enum RayType
+    {
+        RAY_TYPE_RADIANCE = 0,  // scene rays, invoke the closest hit shader
+        RAY_TYPE_SHADOW,        // shadow rays, end at their first hit and only invoke the miss shader if nothing was hit
+        RAY_TYPE_COUNT
+    };
+
     struct ShaderBindingTable
     {
         vka::Buffer buff;       // SBT buffer
@@ -35,10 +44,14 @@ namespace pt
     // Per-geometry data is stored there.
     struct RecordParameter
     {
-        uint32_t geometryID;    // the ID of the geometry, this ID is unique
+        uint32_t geometryID;    // the ID of the geometry, this ID is unique per geometry content,
+                                // meshes with identical vertex and index data share one ID
         uint32_t materialID;    // the ID of the material the geometry uses
                                 // As one geometry equals one mesh, every geometry has one
-                                // material ID.
+                                // material ID. Only referenced materials are loaded, so the
+                                // material IDs are compact.
+        uint32_t opacityOffset; // index of the opacity of the first triangle of the mesh inside of the opacity buffer,
+                                // the opacity depends on the material, so meshes that share a geometry have their own
     };
 
     // Stored within this structure are all properties that are
@@ -50,14 +63,249 @@ namespace pt
         size_t vertex_stride;       // the size of one vertex
         uint32_t index_count;       // number of indices of the mesh
         RecordParameter record;     // Per-mesh/geometry parameter for the SBT record.
+        bool shared;                // If true, the mesh has the same content as an earlier mesh and does not own any buffers.
+                                    // The buffers are owned by the mesh with the same geometry ID.
+    };
+
+    // Describes one mesh of an object file. The faces of every shape are grouped by
+    // their material, therefore one mesh has exactly one material ID.
+    struct ObjMeshInfo
+    {
+        uint32_t shape;         // index of the shape the mesh is part of
+        int material;           // material ID within the object file
+        uint32_t face_count;    // number of triangles of the mesh
+    };
+
+    // Vertices and indices of one mesh of an object file. The vertex data itself
+    // is not copied, it is read from the attributes of the object file as it is written.
+    // Only the tangent frames are computed once when the mesh is built, they depend on the triangles.
+    class ObjMesh
+    {
+        friend class ObjFile;
+    private:
+        const tinyobj::attrib_t* attrib;
+        std::vector<tinyobj::index_t> refs; // unique vertices, references into the object file attributes
+        std::vector<uint32_t> idx;          // index buffer of the mesh
+        std::vector<uint32_t> tangents;     // packed tangent frame of every vertex, see TANGENT_VALID
+        int mtl;
+
+        /**
+         * @brief Computes the tangent frame of every vertex from the texture coordinates of the triangles around it.
+         */
+        void build_tangents(void);
+
+    public:
+        // layout of a vertex: position (XYZ) + one padding float
+        constexpr static uint32_t VERTEX_COMPONENTS = 4;
+        // layout of a vertex attribute: normal (XYZ) + packed tangent frame (bits of one float) + texture coordinate (UV)
+        constexpr static uint32_t ATTRIBUTE_COMPONENTS = 6;
+        // Packed tangent frame: bits 0-14 and 15-29 are the octahedral coordinates of the unit tangent (15 bit unorm),
+        // bit 30 is set if the bitangent is -cross(normal, tangent) and bit 31 is set if the vertex has a tangent at all.
+        // Vertices without texture coordinates or with only degenerate texture coordinates have no tangent (0).
+        constexpr static uint32_t TANGENT_VALID = 1u << 31;
+        constexpr static uint32_t TANGENT_FLIP = 1u << 30;
+
+        ObjMesh(void) : attrib(nullptr), mtl(0) {}
+
+        inline uint32_t vertex_count(void) const noexcept
+        { return static_cast<uint32_t>(this->refs.size()); }
+
+        inline uint32_t index_count(void) const noexcept
+        { return static_cast<uint32_t>(this->idx.size()); }
+
+        inline size_t indices_size(void) const noexcept
+        { return this->idx.size() * sizeof(uint32_t); }
+
+        inline const uint32_t* pindices(void) const noexcept
+        { return this->idx.data(); }
+
+        inline int material(void) const noexcept
+        { return this->mtl; }
+
+        /**
+         * @brief       Writes vertices [first, first + count) to dst.
+         * @param dst   Destination, must be large enough for count * VERTEX_COMPONENTS floats.
+         *              Can be any memory, e.g. mapped staging memory, no alignment is requiered.
+         */
+        void write_vertices(float* dst, uint32_t first, uint32_t count) const;
+
+        /**
+         * @brief       Writes vertex attributes [first, first + count) to dst.
+         * @param dst   Destination, must be large enough for count * ATTRIBUTE_COMPONENTS floats.
+         */
+        void write_attributes(float* dst, uint32_t first, uint32_t count) const;
+
+        /**
+         * @brief Frees the index and vertex reference data.
+         */
+        void clear(void) noexcept;
+    };
+
+    // Object file that is parsed from a memory mapping of the file. In contrast to
+    // vka::Model, the meshes are not built while loading, but one at a time
+    // with 'build_mesh'. This keeps only the parsed attributes resident, the
+    // vertices are merged directly into their destination memory.
+    // The attributes and shapes of the whole file stay resident until 'clear', the meshes
+    // reference them, so the peak memory of a model is its parsed file plus its built meshes.
+    class ObjFile
+    {
+    private:
+        tinyobj::attrib_t attrib;
+        std::vector<tinyobj::shape_t> shapes;
+        std::vector<tinyobj::material_t> mtls;
+        std::vector<ObjMeshInfo> infos;
+
+    public:
+        /**
+         * @brief       Parses an object file and its material library.
+         * @param path  Path to the object file.
+         * @throw       runtime_error if the file could not be mapped or parsed.
+         */
+        void load(const std::string& path);
+
+        /**
+         * @brief Frees all parsed data.
+         */
+        void clear(void) noexcept;
+
+        /**
+         * @brief       Builds the vertices and indices of a mesh.
+         * @param i     Index of the mesh.
+         * @param mesh  Mesh to build, the mesh references this object file.
+         */
+        void build_mesh(size_t i, ObjMesh& mesh) const;
+
+        inline size_t mesh_count(void) const noexcept
+        { return this->infos.size(); }
+
+        inline const ObjMeshInfo& mesh_info(size_t i) const
+        { return this->infos.at(i); }
+
+        inline const std::vector<tinyobj::material_t>& materials(void) const noexcept
+        { return this->mtls; }
+    };
+
+    // Object file with all of its meshes built and hashed. The meshes reference the
+    // attributes of the object file, so a parsed model must not be moved after parsing.
+    // Streamed loading only parses the file and builds its meshes one at a time.
+    struct ParsedModel
+    {
+        ObjFile obj;
+        std::vector<ObjMesh> meshes;
+        std::vector<Hash128> hashes;
     };
 
+    // Fixed size host-visible staging buffer. Data that is written into the window
+    // is copied into its destination buffers as soon as the window is full, so
+    // arbitrary large uploads only require the memory of the window.
+    class StagingWindow
+    {
+    private:
+        const Setup* setup;
+        VkCommandPool cmd_pool;
+        std::mutex* queue_mtx;
+        vka::Buffer buff;
+        uint8_t* map;
+        VkDeviceSize used;
+        std::vector<std::pair<VkBuffer, VkBufferCopy>> pending;
+
+    public:
+        StagingWindow(void) : setup(nullptr), cmd_pool(VK_NULL_HANDLE), queue_mtx(nullptr), map(nullptr), used(0) {}
+        virtual ~StagingWindow(void)
+        { this->destroy(); }
+
+        StagingWindow(const StagingWindow&) = delete;
+        StagingWindow& operator= (const StagingWindow&) = delete;
+
+        /**
+         * @brief           Creates and maps the staging buffer.
+         * @param setup     Setup to use.
+         * @param cmd_pool  Command pool where the copy commands are allocated from.
+         * @param queue_mtx Mutex that guards the command pool and the queue, can be nullptr.
+         * @param size      Size of the window in bytes.
+         */
+        void init(const Setup* setup, VkCommandPool cmd_pool, std::mutex* queue_mtx, VkDeviceSize size);
+
+        /**
+         * @brief Destroys the staging buffer. Pending copies are discarded, 'flush' must be called before
+         *        if they should reach their destination. This way an upload that failed can be dropped.
+         */
+        void destroy(void);
+
+        /**
+         * @brief               Reserves memory inside the window that is copied to a destination buffer.
+         * @param dst           Destination buffer.
+         * @param dst_offset    Offset inside the destination buffer.
+         * @param size          Number of bytes to reserve, must not exceed the capacity of the window.
+         * @return              Pointer to the reserved memory, valid until the next call to 'stage' or 'flush'.
+         */
+        void* stage(VkBuffer dst, VkDeviceSize dst_offset, VkDeviceSize size);
+
+        /**
+         * @brief Executes all pending copies and waits until they are finished.
+         */
+        void flush(void);
+
+        inline VkDeviceSize capacity(void) const noexcept
+        { return this->buff.size(); }
+    };
+
+    // Decoded image that is not uploaded yet. The data is allocated
+    // from the scratch arena of the thread that decoded the image.
+    struct HostImage
+    {
+        void* data;
+        VkExtent3D extent;
+    };
+
+    /**
+     * Opacity of the triangles of a mesh, classified from the alpha map of its material. Every triangle is split
+     * into SUBDIVISION^2 micro-triangles (rows along the second barycentric coordinate, same order as the any hit
+     * shader), a triangle whose micro-triangles are not all of one state stores the 2 bit state of every micro-triangle.
+     * Only the micro-triangles that are partly cut out need the alpha map while tracing.
+     */
+    struct MeshOpacity
+    {
+        enum State
+        {
+            STATE_TRANSPARENT = 0,  // every texel the triangle can read is cut out
+            STATE_OPAQUE = 1,       // no texel the triangle can read is cut out
+            STATE_UNKNOWN = 2,      // micro-triangle that is partly cut out, the any hit shader reads the alpha map
+            STATE_MIXED = 3         // triangle that has a mask of its micro-triangles
+        };
+
+        // micro-triangles along every edge of a triangle
+        constexpr static uint32_t SUBDIVISION = 8;
+        // number of 32 bit words of the mask of a mixed triangle
+        constexpr static uint32_t MASK_WORDS = SUBDIVISION * SUBDIVISION * 2 / 32;
+
+        std::vector<uint32_t> states;   // the state of every triangle in the upper 2 bits, the lower 30 bits of a mixed triangle
+                                        // are the index of its mask inside of this vector, the masks follow the triangles
+        bool opaque;                    // no triangle is cut out, the mesh is opaque and skips the any hit shader
+    };
+
+    /**
+     * @brief                   Classifies the triangles of a mesh by the alpha map of its material. The bilinear filter of the
+     *                          any hit shader reads texels up to one texel outside of the texture coordinates of a triangle,
+     *                          those are included, so only the micro-triangles of STATE_UNKNOWN need the alpha map.
+     *                          Texels with an alpha of at least 0.5 are opaque.
+     * @param texcoords         Texture coordinates of the corners of every triangle, six floats per triangle. Can be nullptr,
+     *                          then the triangles of an alpha map that is partly cut out are STATE_UNKNOWN.
+     * @param triangle_count    Number of triangles.
+     * @param rma               Roughness, metallic and alpha map of the material, four bytes per texel, the alpha is the third byte.
+     * @param opacity           Receives the opacity of the triangles.
+     * @return                  True if the alpha map is partly cut out, only then the texture coordinates are read.
+     */
+    bool classify_opacity(const float* texcoords, uint32_t triangle_count, const HostImage& rma, MeshOpacity& opacity);
+
     struct RenderMesh
     {
         vka::Buffer vectices;       // vertex position data
         vka::Buffer attributes;     // vertex attributes like normals and texture coordinates
         vka::Buffer indices;        // index buffer
         MeshProperties properties;
+        Hash128 hash;               // content hash, meshes are deduplicated again if a model is reloaded
+        MeshOpacity opacity;        // opacity of the triangles with the alpha map of the material of the mesh
     };
 
     // Stored within this structure are all properties that are
@@ -102,6 +350,103 @@ namespace pt
         //                  (unused [A], is needed for the format)
         //                  8bit image format
         vka::Texture rman;
+
+        // device memory of the textures in bytes, including the mip levels
+        size_t albedo_size;
+        size_t emission_size;
+        size_t rman_size;
+    };
+
+    // Decoded images of one material, same layout as RenderMaterialTexture.
+    struct RenderMaterialImages
+    {
+        HostImage albedo;
+        HostImage emission;
+        HostImage rman[2];
+    };
+
+    // Background loading of one file, shared between the loading task and the handles.
+    struct LoadJob
+    {
+        std::string path;
+        std::atomic<bool> cancelled;
+        std::atomic<bool> started;          // set once the loading task is submitted
+        std::promise<void> promise;         // fulfilled by the loading task
+        std::shared_future<void> done;      // exists before the job is published, it is never reassigned
+
+        LoadJob(const std::string& path) : path(path), cancelled(false), started(false), done(promise.get_future().share()) {}
+        virtual ~LoadJob(void) = default;
+
+        /**
+         * @brief       Submits the loading task, only the first call of a job submits it.
+         * @param pool  Thread pool that runs the task.
+         * @param task  Loads the file, its result or exception is stored in 'done'.
+         * @return      True if the task was submitted by this call.
+         */
+        template<typename F>
+        bool start(ThreadPool& pool, F&& task)
+        {
+            if(this->started.exchange(true)) return false;
+            // the task owns the job through its capture, so 'this' outlives it
+            pool.submit([this, task = std::forward<F>(task)]() {
+                try
+                {
+                    task();
+                    this->promise.set_value();
+                }
+                catch(...)
+                {
+                    this->promise.set_exception(std::current_exception());
+                }
+            });
+            return true;
+        }
+    };
+
+    struct ModelLoadJob : public LoadJob
+    {
+        ParsedModel model;
+        using LoadJob::LoadJob;
+    };
+
+    struct EnvironmentLoadJob : public LoadJob
+    {
+        HostImage image;
+        using LoadJob::LoadJob;
+    };
+
+    /**
+     * Handle of a model or environment map that is loaded in the background.
+     * Copies of a handle refer to the same loading task.
+     */
+    class LoadHandle
+    {
+    private:
+        std::shared_ptr<LoadJob> job;
+
+    public:
+        LoadHandle(void) = default;
+        explicit LoadHandle(std::shared_ptr<LoadJob> job) : job(std::move(job)) {}
+
+        /**
+         * @brief Waits until the file is loaded.
+         * @throw The exception that was thrown while loading the file.
+         */
+        void wait(void) const;
+
+        /**
+         * @return True if loading has finished, successfully or not.
+         */
+        bool ready(void) const;
+
+        /**
+         * @brief   Cancels loading. A model that is cancelled is not part of the scene,
+         *          cancelling the environment map makes 'init' fail.
+         */
+        void cancel(void) noexcept;
+
+        inline bool is_cancelled(void) const noexcept
+        { return this->job != nullptr && this->job->cancelled.load(); }
     };
 
     struct RenderMaterial
@@ -109,8 +454,659 @@ namespace pt
         RenderMaterialUniform uniform;
         RenderMaterialTexture texture;
         MaterialProperties properties;
+        RenderMaterialImages images;    // only valid while the scene is loaded
+        float emission_luminance;       // mean luminance of the emission, the lights are weighted by it
+    };
+
+    // Statistics of merging one unique geometry into the staging memory.
+    struct MergeStatistics
+    {
+        uint32_t geometryID;    // geometry that was merged
+        size_t bytes_saved;     // size of the intermediate vertex and attribute arrays that are not requiered anymore
+        uint64_t merge_ns;      // time it took to write the vertices and attributes into the staging memory
+        bool hashed;            // true if the content hash was computed while merging, a separate hash pass would have merged the data again
+        uint64_t hash_ns;       // time it took to hash the merged data, part of the merge time, 0 if the mesh was hashed while parsing
+    };
+
+    // Statistics that are gathered while loading the scene.
+    struct LoadStatistics
+    {
+        uint32_t mesh_count;        // number of meshes of all models
+        uint32_t geometry_count;    // number of unique geometries, only those are stored on the GPU
+        size_t deduplicated_bytes;  // size of the vertex, attribute and index data that was not stored, because it was a duplicate
+        std::vector<MergeStatistics> merges;    // one entry per unique geometry
+        uint32_t skipped_materials;             // materials of the material libraries that no mesh references, they are not loaded
+        uint32_t skipped_textures;              // texture images of the skipped materials
+        size_t scratch_allocations;             // number of scratch arena allocations of the whole loading phase
+        size_t scratch_peak_bytes;              // highest amount of scratch memory in use, summed over all threads
+        std::vector<TaskTiming> init_timings;   // execution of every step of the initialization
+        uint64_t init_critical_path_ns;         // longest chain of dependent initialization steps
+        uint64_t init_ns;                       // time from the start of the initialization until it is ready to trace
+    };
+
+    // Pinhole or thin lens camera. The camera can be changed between two calls
+    // of 'run', the scene does not need to be loaded again.
+    struct Camera
+    {
+        glm2::vec3 position;    // position of the camera (center of the lens)
+        glm2::vec3 target;      // point the camera looks at
+        glm2::vec3 up;          // up direction, must not be parallel to the view direction
+        float fov;              // vertical field of view in degrees, in the range (0, 180)
+        float aspect;           // width / height of the image plane, if 0 the aspect of the render target is used
+        float aperture;         // diameter of the lens, if 0 the camera is a pinhole camera
+        float focus_distance;   // distance of the plane that is in focus, only used if the aperture is not 0
+    };
+
+    // Basis of a camera in the layout of the push constants of the ray generation shader.
+    // The same rays are generated on the host with 'generate_ray'.
+    struct CameraData
+    {
+        float origin[4];    // position of the camera, w: radius of the lens
+        float forward[4];   // unit view direction, w: focus distance
+        float right[4];     // unit right direction, w: half width of the image plane at distance 1
+        float up[4];        // unit up direction, w: half height of the image plane at distance 1
+
+        /**
+         * @brief               Generates the camera ray through a point of the image plane.
+         * @param ndc_x         Horizontal position on the image plane in [-1, 1], -1 is the left border.
+         * @param ndc_y         Vertical position on the image plane in [-1, 1], -1 is the upper border.
+         * @param lens_u        First sample on the lens in [0, 1), not used by a pinhole camera.
+         * @param lens_v        Second sample on the lens in [0, 1), not used by a pinhole camera.
+         * @param ray_origin    Receives the origin of the ray (XYZ).
+         * @param ray_direction Receives the normalized direction of the ray (XYZ).
+         */
+        void generate_ray(float ndc_x, float ndc_y, float lens_u, float lens_v, float* ray_origin, float* ray_direction) const noexcept;
+    };
+
+    /**
+     * @brief           Computes the basis of a camera.
+     * @param camera    Camera, the position must not equal the target and the up direction must not be parallel to the view direction.
+     * @param aspect    Width / height of the image plane, the aspect of the camera is not used.
+     * @return          Basis of the camera.
+     */
+    CameraData make_camera_data(const Camera& camera, float aspect);
+
+    // Push constants of the ray generation shader.
+    struct PushConstants
+    {
+        CameraData camera;
+        uint32_t tile_offset[2];    // position of the render images inside of the frame in pixels
+        uint32_t frame_extent[2];   // size of the whole frame in pixels
+        uint32_t sample_index;      // index of the sample, it selects the random numbers of the sample
+        uint32_t sample_count;      // number of samples per pixel that are already accumulated,
+                                    // the first sample overwrites the accumulation image
+        uint32_t adaptive;          // if 1, the tiles that are disabled by the tile mask are not traced
+        uint32_t features;          // if 1, the features of the first hit are written, see 'PathTracer::set_features'
+    };
+
+    // Snapshot of a progressive rendering, it is restored to continue the rendering. The random numbers
+    // of a sample only depend on the pixel and the index of the sample, so the first sample and the
+    // number of accumulated samples are the whole state of the random number generator.
+    struct Checkpoint
+    {
+        uint32_t width;                 // resolution of the render images
+        uint32_t height;
+        uint32_t frame_width;           // frame the render images are a tile of, see 'PathTracer::set_tile'
+        uint32_t frame_height;
+        uint32_t tile_x;
+        uint32_t tile_y;
+        uint32_t first_sample;
+        uint32_t accumulated_samples;
+        uint64_t elapsed_ns;            // time the budgeted calls of 'run' took to trace the accumulated samples
+        CameraData camera;              // a checkpoint can only be restored with the same camera
+        std::vector<float> accumulation;        // see 'PathTracer::read_accumulation'
+        std::vector<uint32_t> sample_counts;    // see 'PathTracer::read_sample_counts'
     };
 
+    /**
+     * @brief               Writes a checkpoint to a binary file. The file is written under a temporary name and
+     *                      renamed afterwards, so a killed process leaves the previous checkpoint intact.
+     *                      The sample counts are omitted if every pixel has the same count.
+     * @param path          Path of the file.
+     * @param checkpoint    Checkpoint to write.
+     * @throw               runtime_error if the file could not be written.
+     */
+    void write_checkpoint(const std::string& path, const Checkpoint& checkpoint);
+
+    /**
+     * @brief               Reads a checkpoint that was written by 'write_checkpoint'.
+     * @param path          Path of the file.
+     * @param checkpoint    Receives the checkpoint.
+     * @return              False if the file does not exist.
+     * @throw               runtime_error if the file is not a valid checkpoint or was damaged.
+     */
+    bool read_checkpoint(const std::string& path, Checkpoint& checkpoint);
+
+    /**
+     * Writes the checkpoints of one rendering on a background thread. There are two buffers: the
+     * renderer fills one while the other one is written. If both are still written, a periodic
+     * checkpoint is skipped, so the rendering never waits for the disk.
+     */
+    class CheckpointWriter
+    {
+    private:
+        ThreadPool pool;
+        std::string path;
+        Checkpoint buffers[2];
+        std::future<void> pending[2];   // write of the buffer, invalid if the buffer is free
+        uint32_t next;                  // buffer that is filled next, the other one was submitted last
+        uint32_t written;
+        uint32_t skipped;
+
+    public:
+        explicit CheckpointWriter(const std::string& path);
+        virtual ~CheckpointWriter(void);
+
+        CheckpointWriter(const CheckpointWriter&) = delete;
+        CheckpointWriter& operator= (const CheckpointWriter&) = delete;
+
+        CheckpointWriter(CheckpointWriter&&) = delete;
+        CheckpointWriter& operator= (CheckpointWriter&&) = delete;
+
+        /**
+         * @brief       Returns the buffer that is filled next.
+         * @param wait  If true and both buffers are written, waits for the older write.
+         * @return      Buffer to fill and pass to 'submit', nullptr if both buffers are written and 'wait' is false.
+         * @throw       runtime_error if a previous checkpoint could not be written.
+         */
+        Checkpoint* acquire(bool wait);
+
+        /**
+         * @brief               Queues a filled buffer to be written.
+         * @param checkpoint    Buffer that was returned by the last call of 'acquire'.
+         */
+        void submit(Checkpoint* checkpoint);
+
+        /**
+         * @brief Waits until all checkpoints are written.
+         * @throw runtime_error if a checkpoint could not be written.
+         */
+        void flush(void);
+
+        /**
+         * @brief Waits until all checkpoints are written and deletes the file, e.g. after the rendering finished.
+         */
+        void remove(void);
+
+        inline const std::string& get_path(void) const noexcept
+        { return this->path; }
+
+        inline uint32_t get_written(void) const noexcept
+        { return this->written; }
+
+        inline uint32_t get_skipped(void) const noexcept
+        { return this->skipped; }
+    };
+
+    // Limits of a budgeted call of 'run', the rendering stops as soon as one limit is reached.
+    // A limit of 0 is not used, but at least one limit must be set.
+    struct RenderBudget
+    {
+        uint32_t max_samples;           // samples per pixel to trace
+        uint64_t time_ns;               // wall-clock time of the call, a submission is not started if it would exceed it
+        float target_noise;             // mean relative standard error of the pixel luminances, see 'estimate_noise'
+        uint32_t batch_samples;         // maximum samples per submission, the limits are checked between submissions
+        const std::atomic<bool>* cancel;// optional, if another thread sets it the rendering stops after the current submission
+        bool adaptive;                  // if true, tiles whose noise is below the target noise are not traced anymore,
+                                        // the rendering stops when every tile reached it
+        CheckpointWriter* checkpoints;  // optional, receives periodic checkpoints and a last one if the rendering is cancelled
+        uint64_t checkpoint_interval_ns;// time between two periodic checkpoints
+    };
+
+    // Outcome of a budgeted call of 'run', the render target contains the mean of all accumulated samples.
+    struct RenderResult
+    {
+        enum StopReason
+        {
+            SAMPLES,        // the maximum number of samples is traced
+            TIME,           // the time budget is used up
+            NOISE,          // the target noise is reached
+            CANCELLED       // the cancel flag was set
+        };
+
+        StopReason reason;
+        uint32_t samples;       // samples per pixel that were traced by the call, the maximum of all pixels with adaptive sampling
+        uint32_t accumulated;   // samples per pixel in the image, including those of earlier calls
+        uint64_t pixel_samples; // samples that were traced by the call summed over all pixels
+        float noise;            // last estimated noise, negative if it was not estimated
+        uint64_t render_ns;     // time spent tracing on the GPU
+        uint64_t wall_ns;       // time of the whole call, including the noise estimation
+        uint32_t checkpoints;   // checkpoints that were queued for writing
+    };
+
+    // Parameters of the edge-avoiding filter of the 'Denoiser'.
+    struct DenoiserSettings
+    {
+        uint32_t iterations;        // passes of the filter, pass i has a footprint of 2^(i + 2) + 1 pixels
+        float sigma_luminance;      // luminance differences are compared to sigma_luminance standard errors of the pixel
+        uint32_t normal_exponent;   // exponent of the cosine between two normals, higher values keep more geometric edges
+        float sigma_albedo;         // albedo differences larger than this separate two pixels
+    };
+
+    /**
+     * Edge-avoiding a-trous wavelet filter (Dammertz et al. 2010) with the variance guided luminance
+     * weight of SVGF (Schied et al. 2017). The color is divided by the first-hit albedo before it is
+     * filtered, so textures stay sharp, and the weights of the taps stop the filter at differences of
+     * the first-hit normals and albedos. The filter runs on the CPU: the rows are split between the
+     * threads of the pool and every thread filters 8 pixels at once with AVX2.
+     */
+    class Denoiser
+    {
+    private:
+        ThreadPool pool;            // started by the first call of 'denoise'
+        uint32_t thread_count;
+        DenoiserSettings settings;
+        std::vector<float> signal;      // irradiance and variance planes, two sets that the passes alternate between
+        std::vector<uint16_t> features; // normal and albedo planes as half floats
+
+        void for_each_row_block(uint32_t height, const std::function<void(uint32_t, uint32_t)>& f);
+
+    public:
+        /**
+         * @param thread_count  Number of worker threads, if 0 one thread per hardware thread is started.
+         */
+        explicit Denoiser(uint32_t thread_count = 0);
+        virtual ~Denoiser(void);
+
+        Denoiser(const Denoiser&) = delete;
+        Denoiser& operator= (const Denoiser&) = delete;
+
+        Denoiser(Denoiser&&) = delete;
+        Denoiser& operator= (Denoiser&&) = delete;
+
+        /**
+         * @return 5 iterations, sigma_luminance 4, normal_exponent 128 and sigma_albedo 0.1.
+         */
+        static DenoiserSettings default_settings(void);
+
+        /**
+         * @throw invalid_argument if the iterations are not in [1, 16] or a sigma is not greater than 0.
+         */
+        void set_settings(const DenoiserSettings& settings);
+
+        inline const DenoiserSettings& get_settings(void) const noexcept
+        { return this->settings; }
+
+        /**
+         * @brief           Denoises the mean of the accumulated samples. The buffers are laid out like those
+         *                  of 'PathTracer::read_accumulation', 'read_sample_counts' and 'read_features'.
+         * @param width     Width of the images in pixels.
+         * @param height    Height of the images in pixels.
+         * @param color     Mean color, A is the mean of the squared luminance.
+         * @param counts    Samples per pixel, the variance of a pixel is estimated from them.
+         * @param albedo    Albedo of the first hit.
+         * @param normals   Normal of the first hit.
+         * @param rgba      Receives the denoised color, A is 1. Must not overlap the other buffers.
+         * @return          Time of the denoising in nano seconds.
+         * @throw           invalid_argument if the resolution is 0 or a buffer is missing.
+         */
+        uint64_t denoise(uint32_t width, uint32_t height, const float* color, const uint32_t* counts, const float* albedo, const float* normals, float* rgba);
+    };
+
+    // Bucket of an alias table, same layout as alias_t of the shaders.
+    struct AliasEntry
+    {
+        float threshold;    // the entry is taken if the remainder of the random number is below, otherwise its alias
+        uint32_t alias;     // entry that fills the rest of the bucket
+        float probability;  // probability of the entry, used to compute the pdf of a sample in O(1)
+    };
+
+    /**
+     * @brief           Builds an alias table (Vose 1991) that chooses every entry with a probability proportional to its weight.
+     *                  If all weights are 0, every entry has the same probability.
+     * @param weights   Non-negative weights of the entries.
+     * @param count     Number of entries.
+     * @param sum       Sum of the weights.
+     * @param table     Receives 'count' entries.
+     */
+    void build_alias_table(const float* weights, size_t count, double sum, AliasEntry* table);
+
+    /**
+     * @brief       Chooses an entry of an alias table, same as sample_alias of the closest hit shader.
+     * @param table Alias table built by 'build_alias_table'.
+     * @param count Number of entries of the table, must not be 0.
+     * @param u     Random number in [0, 1), receives the remainder of the choice rescaled to [0, 1).
+     * @return      Index of the chosen entry.
+     */
+    uint32_t sample_alias(const AliasEntry* table, uint32_t count, float& u) noexcept;
+
+    /**
+     * Importance sampling of an equirectangular environment map. A pixel is chosen with a probability proportional
+     * to its luminance times the solid angle it covers, first its row by the alias table of the rows and then the
+     * pixel by the alias table of the row, so a sample costs two lookups. The direction is uniformly distributed
+     * inside of the pixel, with the same mapping as the environment lookup of the shaders.
+     */
+    class EnvironmentSampler
+    {
+    private:
+        uint32_t width;
+        uint32_t height;
+        std::vector<AliasEntry> table;  // alias table of the rows, followed by the alias tables of the pixels of every row
+
+    public:
+        EnvironmentSampler(void) : width(0), height(0) {}
+        virtual ~EnvironmentSampler(void) = default;
+
+        EnvironmentSampler(const EnvironmentSampler&) = delete;
+        EnvironmentSampler& operator= (const EnvironmentSampler&) = delete;
+
+        EnvironmentSampler(EnvironmentSampler&&) = default;
+        EnvironmentSampler& operator= (EnvironmentSampler&&) = default;
+
+        /**
+         * @brief           Builds the distribution of an environment map. The weights of the pixels are summed up
+         *                  by a parallel prefix sum and the rows are built by the tasks of the pool.
+         * @param pool      Pool that builds the rows, if it is not started the calling thread builds them.
+         * @param rgba      Pixels of the environment map, 4 floats per pixel, the rows are not padded.
+         * @param width     Width of the environment map in pixels.
+         * @param height    Height of the environment map in pixels.
+         * @throw           invalid_argument if the resolution is 0 or the map has more than 2^32 pixels.
+         */
+        void build(ThreadPool& pool, const float* rgba, uint32_t width, uint32_t height);
+
+        /**
+         * @brief           Samples a direction.
+         * @param u0        Random number in [0, 1) that chooses the row and the latitude inside of it.
+         * @param u1        Random number in [0, 1) that chooses the pixel and the longitude inside of it.
+         * @param direction Receives the unit direction.
+         * @return          Probability density of the direction with respect to the solid angle, 0 if the sampler is not built.
+         */
+        float sample(float u0, float u1, float direction[3]) const noexcept;
+
+        /**
+         * @param direction Unit direction.
+         * @return          Probability density of 'sample' to return the direction, with respect to the solid angle.
+         *                  0 if the sampler is not built.
+         */
+        float pdf(const float direction[3]) const noexcept;
+
+        inline uint32_t get_width(void) const noexcept
+        { return this->width; }
+
+        inline uint32_t get_height(void) const noexcept
+        { return this->height; }
+
+        // Alias table of the rows (height entries), followed by the alias tables of the rows (width entries per row).
+        inline const std::vector<AliasEntry>& get_table(void) const noexcept
+        { return this->table; }
+    };
+
+    // Triangle of a mesh with an emissive material, collected while the vertices of the mesh are on the host.
+    struct EmissiveTriangle
+    {
+        float vertices[3][3];   // positions of the corners, the instances of the scene are not transformed
+        uint32_t mesh;          // index of the mesh inside of its model
+        uint32_t primitive;     // index of the triangle inside of the mesh, same as gl_PrimitiveID
+    };
+
+    // Emissive triangle of the light table, same layout as light_t of the shaders.
+    struct LightEntry
+    {
+        float p0[3];
+        uint32_t geometryID;    // geometry and material of the mesh, they are resolved when the table is built
+        float p1[3];
+        uint32_t primitive;
+        float p2[3];
+        uint32_t materialID;
+        AliasEntry choice;      // bucket of the alias table that chooses the light
+        float area;
+    };
+
+    /**
+     * Next event estimation of emissive triangles. A triangle is chosen with a probability proportional to its area
+     * times the mean luminance of its emission by an alias table that is stored inside of the triangles, and a point
+     * is uniformly distributed over its area. A sample costs one lookup, independent of the number of emitters.
+     */
+    class LightSampler
+    {
+    private:
+        std::vector<LightEntry> lights;
+
+    public:
+        LightSampler(void) = default;
+        virtual ~LightSampler(void) = default;
+
+        LightSampler(const LightSampler&) = delete;
+        LightSampler& operator= (const LightSampler&) = delete;
+
+        LightSampler(LightSampler&&) = default;
+        LightSampler& operator= (LightSampler&&) = default;
+
+        /**
+         * @brief               Builds the distribution of the emissive triangles.
+         * @param lights        Candidate triangles, their area and alias bucket are set by the call. Triangles
+         *                      without area or emission are removed, they would never be chosen.
+         * @param luminances    Mean luminance of the emission of every material, indexed by the material ID.
+         * @throw               invalid_argument if a triangle references a material that does not exist.
+         */
+        void build(std::vector<LightEntry>&& lights, const std::vector<float>& luminances);
+
+        /**
+         * @brief       Samples a point on an emissive triangle.
+         * @param u0    Random number in [0, 1) that chooses the triangle.
+         * @param u1    Random number in [0, 1), the first barycentric coordinate.
+         * @param u2    Random number in [0, 1), the second barycentric coordinate.
+         * @param point Receives the point on the triangle.
+         * @param light Receives the index of the chosen triangle.
+         * @return      Probability density of the point with respect to the area, 0 if there are no lights.
+         */
+        float sample(float u0, float u1, float u2, float point[3], uint32_t& light) const noexcept;
+
+        /**
+         * @param light Index of a triangle.
+         * @return      Probability density of 'sample' to return any point of the triangle, with respect to the area.
+         */
+        float pdf(uint32_t light) const noexcept;
+
+        inline const std::vector<LightEntry>& get_lights(void) const noexcept
+        { return this->lights; }
+    };
+
+    /**
+     * @brief           Returns one dimension of an Owen-scrambled Sobol sequence (Burley 2020). The dimensions are
+     *                  grouped into 4D Sobol sets, every set has its own scrambling and its own shuffle of the index.
+     *                  Same as sobol_owen of the shaders.
+     * @param index     Index of the sample.
+     * @param dimension Dimension of the sample, any dimension can be used.
+     * @param seed      Seed of the scrambling.
+     * @return          Sample in [0, 2^32), divide by 2^32 to get [0, 1).
+     */
+    uint32_t sobol_owen(uint32_t index, uint32_t dimension, uint32_t seed) noexcept;
+
+    /**
+     * @brief   Integer hash of the samplers and the blue noise tile, the same as hash of the shaders.
+     * @param x Value to hash.
+     * @return  Hashed value, every bit of x changes about half of the bits.
+     */
+    inline uint32_t hash_uint(uint32_t x) noexcept
+    {
+        x ^= x >> 16;
+        x *= 0x7FEB352Du;
+        x ^= x >> 15;
+        x *= 0x846CA68Bu;
+        x ^= x >> 16;
+        return x;
+    }
+
+    /**
+     * Tile of blue noise ranks, built by void-and-cluster (Ulichney 1993). Every rank from 0 to size^2 - 1 exists once
+     * and a threshold at any rank leaves a blue noise pattern. The tile repeats over the image, the shaders read it from
+     * a buffer.
+     */
+    class BlueNoiseTile
+    {
+    private:
+        uint32_t size;
+        std::vector<uint16_t> ranks;    // size * size ranks, the rows are not padded
+
+    public:
+        // width and height of the tile of the shaders
+        constexpr static uint32_t SIZE = 64;
+
+        BlueNoiseTile(void) : size(0) {}
+        virtual ~BlueNoiseTile(void) = default;
+
+        BlueNoiseTile(const BlueNoiseTile&) = delete;
+        BlueNoiseTile& operator= (const BlueNoiseTile&) = delete;
+
+        BlueNoiseTile(BlueNoiseTile&&) = default;
+        BlueNoiseTile& operator= (BlueNoiseTile&&) = default;
+
+        /**
+         * @brief       Builds the tile, the result only depends on the parameters.
+         * @param size  Width and height of the tile, must be a power of 2 between 4 and 256.
+         * @param seed  Seed of the initial random pattern.
+         * @throw       invalid_argument if the size is not supported.
+         */
+        void build(uint32_t size, uint32_t seed);
+
+        /**
+         * @param x     Horizontal position, the tile repeats.
+         * @param y     Vertical position, the tile repeats.
+         * @return      Rank of the position in [0, size^2).
+         */
+        inline uint32_t rank(uint32_t x, uint32_t y) const noexcept
+        { return this->ranks[(y & (this->size - 1)) * this->size + (x & (this->size - 1))]; }
+
+        inline uint32_t get_size(void) const noexcept
+        { return this->size; }
+
+        inline const std::vector<uint16_t>& get_ranks(void) const noexcept
+        { return this->ranks; }
+    };
+
+    /**
+     * Samples of the integrator, indexed by pixel, sample and dimension. A sample only depends on its indices,
+     * so any thread can generate any sample without shared state.
+     *  INDEPENDENT:    hashed uniform random numbers, the reference for the other types
+     *  SOBOL:          Owen-scrambled Sobol sequence with one scrambling seed per pixel
+     *  BLUE_NOISE:     Owen-scrambled Sobol sequence that is the same in all pixels, rotated per pixel and dimension
+     *                  by the blue noise tile (Georgiev and Fajardo 2016), so the error is distributed as blue noise.
+     *                  This is the sampler of the shaders.
+     */
+    class Sampler
+    {
+    public:
+        enum Type
+        {
+            INDEPENDENT,
+            SOBOL,
+            BLUE_NOISE
+        };
+
+    private:
+        Type type;
+        uint32_t seed;
+        const BlueNoiseTile* tile;
+
+    public:
+        /**
+         * @param type  Type of the samples.
+         * @param seed  Seed of the samples, the shaders use 0.
+         * @param tile  Blue noise tile, must be built and outlive the sampler if the type is BLUE_NOISE.
+         * @throw       invalid_argument if the type is BLUE_NOISE and the tile is not built.
+         */
+        Sampler(Type type, uint32_t seed, const BlueNoiseTile* tile = nullptr);
+
+        /**
+         * @param x         Horizontal position of the pixel inside of the frame.
+         * @param y         Vertical position of the pixel inside of the frame.
+         * @param index     Index of the sample of the pixel.
+         * @param dimension Dimension of the sample.
+         * @return          Sample in [0, 1).
+         */
+        float get(uint32_t x, uint32_t y, uint32_t index, uint32_t dimension) const noexcept;
+
+        inline Type get_type(void) const noexcept
+        { return this->type; }
+    };
+
+    // Error of one sampler at one sample count, see 'benchmark_samplers'.
+    struct SamplerConvergence
+    {
+        std::string integrand;  // name of the integrand
+        Sampler::Type type;
+        uint32_t samples;       // samples per pixel
+        double rmse;            // root mean squared error of the pixels
+        double filtered_rmse;   // root mean squared error after a 3x3 box filter, blue noise errors cancel out
+    };
+
+    /**
+     * @brief           Integrates functions with known integrals in every pixel of an image, with every sampler
+     *                  type and with the powers of 2 up to the maximum number of samples per pixel.
+     * @param pool      Pool that integrates the rows of the image, if it is not started the calling thread integrates them.
+     * @param tile      Blue noise tile of the BLUE_NOISE sampler.
+     * @param width     Width of the image.
+     * @param height    Height of the image.
+     * @param max_spp   Maximum number of samples per pixel.
+     * @return          One entry per integrand, sampler type and sample count.
+     */
+    std::vector<SamplerConvergence> benchmark_samplers(ThreadPool& pool, const BlueNoiseTile& tile, uint32_t width, uint32_t height, uint32_t max_spp);
+
+    // Result of a chi-square test of the samples of a sampler against its density, see 'check_environment_sampler'.
+    struct SamplerCheck
+    {
+        std::string sampler;    // name of the sampler
+        uint64_t samples;       // number of samples that were drawn
+        uint32_t bins;          // bins of the test, bins with small expected counts are merged into one
+        double chi_square;      // Pearson's chi-square statistic of the observed counts of the bins
+        double p_value;         // probability of a statistic at least this large if the samples follow the density
+        uint64_t pdf_mismatches;    // samples whose density returned by 'sample' differs from the density of the check
+    };
+
+    /**
+     * @brief           Samples an environment map with a smooth sky, a black band and a small bright sun, and compares
+     *                  the number of directions in bins of a quarter pixel with the integral of 'EnvironmentSampler::pdf'
+     *                  over the bins. The density returned by 'sample' is compared with 'pdf' of the sampled direction.
+     * @param pool      Pool that draws the samples, if it is not started the calling thread draws them.
+     * @param samples   Number of samples.
+     * @return          Result of the test.
+     * @throw           invalid_argument if the number of samples is 0.
+     */
+    SamplerCheck check_environment_sampler(ThreadPool& pool, uint64_t samples);
+
+    /**
+     * @brief           Samples emissive triangles of different sizes and emissions, some of them degenerated or black, and compares
+     *                  how often 'LightSampler' chooses every triangle with the probability of its alias entry. The density
+     *                  returned by 'sample' and 'pdf' is compared with that probability divided by the area of the triangle.
+     * @param pool      Pool that draws the samples, if it is not started the calling thread draws them.
+     * @param samples   Number of samples.
+     * @return          Result of the test.
+     * @throw           invalid_argument if the number of samples is 0.
+     */
+    SamplerCheck check_light_sampler(ThreadPool& pool, uint64_t samples);
+
+    // File that a part of the scene was loaded from.
+    struct WatchedAsset
+    {
+        enum Type
+        {
+            MODEL,          // object file of a model
+            ENVIRONMENT,    // environment map
+            ALBEDO,         // albedo map of a material
+            EMISSION,       // emission map of a material
+            RMAN            // roughness, metallic, alpha or normal map of a material
+        };
+
+        Type type;
+        size_t index;   // index of the model or the material, unused for the environment map
+    };
+
+    // First mesh of a geometry, meshes with the same content hash are only deduplicated if their content is equal.
+    struct CachedGeometry
+    {
+        uint32_t geometryID;
+        uint32_t vertex_count;
+        uint32_t index_count;
+        const ObjMesh* mesh;    // content of the geometry, nullptr if it is only stored on the device
+        uint32_t previousID;    // geometry ID of a mesh that was uploaded by a previous load, NO_ID for meshes of this load
+
+        constexpr static uint32_t NO_ID = ~0u;
+    };
+
+    // Maps the content hash of a mesh to the geometries with that hash, colliding geometries have their own entries.
+    using geometry_cache_t = std::unordered_multimap<Hash128, CachedGeometry, Hash128Hasher>;
+
     // One model contains multiple meshes, the the scene can contain
     // multiple models. To keep things organized, meshes are stored
     // inside a 2D array.
@@ -127,20 +1123,60 @@ namespace pt
     private:
         bool initialized;
         const Setup* setup;
-        std::string environment_path;
-        std::vector<std::string> model_paths;
+        const Settings* load_settings;  // settings of the loading before 'init', nullptr if they are not known yet
+        std::shared_ptr<EnvironmentLoadJob> environment_job;   // environment map that is loaded in the background
+        std::vector<std::shared_ptr<ModelLoadJob>> model_jobs; // models that are loaded in the background, in the order they were added
+        std::vector<std::shared_ptr<LoadJob>> cancelled_jobs;  // cancelled jobs that may still run, they decode into the scratch arenas
         loadmsg_callback_t texture_load_callback;
         loadmsg_callback_t model_load_callback;
+        loadmsg_callback_t info_callback;
+        std::mutex callback_mtx;    // the callbacks are called from multiple threads, but never at the same time
+        LoadStatistics load_stats;
 
         RtImage render_target;      // render target image of the shaders
+        RtImage accumulation_image; // mean of all samples per pixel, 32bit image format
+        RtImage sample_count_image; // samples per pixel, 32bit unsigned integer, adaptive sampling traces the pixels unequally
+        RtImage albedo_image;       // mean albedo of the first hit, 16bit image format, guides the denoiser
+        RtImage normal_image;       // mean normal of the first hit, 16bit image format, guides the denoiser
+        RtImage first_hit_image;    // depth, geometry ID and material ID of the first hit, 32bit unsigned integer
+        bool features;              // true if the feature images are written, only the denoiser and the AOVs read them
+        vka::Buffer tile_mask;      // one integer per tile of ADAPTIVE_TILE_SIZE^2 pixels, 0 if the tile is not traced, host visible
+        bool tile_mask_valid;       // true if adaptive sampling wrote the tile mask for the accumulated samples
+        uint64_t accumulated_ns;    // time the budgeted calls of 'run' took to trace the accumulated samples
+        size_t active_pixels;       // pixels of the tiles that are enabled by the tile mask
         RtImage output_image;       // rendered image that is written to a file
+        VkExtent2D render_extent;   // size of the render images
+        uint32_t accumulated_samples;   // samples per pixel in the accumulation image
+        uint32_t first_sample;          // index of the first sample in the accumulation image
+        VkExtent2D frame_extent;        // size of the frame the render images are a tile of, {0, 0} if they are the whole frame
+        VkOffset2D tile_offset;         // position of the render images inside of the frame
 
         model_array_t models;
         material_array_t materials; // all the texture-materials
         vka::Texture environment;   // environment map (equirectangular map), 32bit image format
+        HostImage environment_image;
+        EnvironmentSampler environment_sampler; // importance sampling of the environment map
+        vka::Buffer environment_alias;          // alias tables of the environment sampler
+        size_t environment_size;    // device memory of the environment map and its alias tables in bytes
+        std::vector<std::vector<EmissiveTriangle>> emitters;    // emissive triangles of every model, in the same order as the models
+        LightSampler light_sampler; // next event estimation of the emissive triangles
+        vka::Buffer light_buffer;   // number of lights, followed by the light table of the light sampler
+        std::vector<std::vector<std::vector<float>>> texcoords; // texture coordinates of the corners of every triangle of every mesh of every model,
+                                                                // six floats per triangle, the meshes are classified again if an alpha map is reloaded,
+                                                                // empty for meshes whose alpha map is completely opaque or cut out
+        vka::Buffer opacity_buffer; // opacity of the triangles of all meshes, see MeshOpacity
+        BlueNoiseTile blue_noise;       // rotates the samples of every pixel, see Sampler
+        vka::Buffer blue_noise_buffer;  // ranks of the blue noise tile, one 32bit integer per rank
+        Camera camera;
+        std::vector<std::string> model_paths;   // object files of the models, in the same order as the models
+        std::string environment_path;
+        FileWatcher watcher;                    // watches the files of the scene for hot reloading
+        std::vector<WatchedAsset> watched;      // asset of every file of the watcher, indexed by the ID of the file
         vka::Buffer mtl_buffer;     // all the single-value-materials
         vka::Buffer tlibo;          // buffer object that holds the instances for the tlas
 
+        ThreadPool loaders;         // worker threads that parse and merge the models
+        std::mutex queue_mtx;       // guards the command pool and the queue while the initialization runs concurrently
         VkCommandPool cmd_pool;
         VkQueryPool timer_query_pool;
         AccelerationStructure blas, tlas;
@@ -153,7 +1189,12 @@ namespace pt
 
         void create_pools(void);
         void create_render_images(void);
-        void create_render_models(void);
+        void write_render_image_descriptors(void);
+        void create_storage_image(RtImage& img, VkFormat format, VkImageUsageFlags usage);
+        void destroy_render_images(void);
+        void parse_render_models(void);
+        void upload_render_models(void);
+        void decode_render_materials(void);
         void create_render_materials(void);
         void create_acceleration_structure(void);
         void create_shaders(void);
@@ -162,12 +1203,44 @@ namespace pt
         void create_pipeline(void);
         void create_sbt(void);
 
-        void load_render_mesh(const vka::Mesh& mesh, RenderMesh& rmesh);
+        void append_materials(const ObjFile& obj, std::vector<RenderMesh>& rmeshes);
+        void collect_emitters(const ObjMesh& mesh, uint32_t index, const RenderMesh& rmesh, std::vector<EmissiveTriangle>& emitters) const;
+        void collect_texcoords(const ObjMesh& mesh, std::vector<float>& texcoords) const;
+
+        void create_streamed_models(void);
+        void wait_for_models(void);
+        void submit_loading(void);
+        void submit_environment(void);
+        void log_deduplication(void);
+        void log_merge(const MergeStatistics& stats);
+        void log_materials(void);
+        void release_scratch(void);
+        void init_steps(void);
+        void log_init_timings(void);
+        void notify(loadmsg_callback_t callback, const std::string& msg);
+        void cancel_loading(void);
+        void wait_for_cancelled(void);
+        bool deduplicate_mesh(const Hash128& hash, const ObjMesh* mesh, geometry_cache_t& cache, MeshProperties& properties);
+        void init_render_mesh(const ObjMesh& mesh, RenderMesh& rmesh);
+        MergeStatistics stage_render_mesh(const ObjMesh& mesh, vka::Buffer* staging, Hash128& hash) const;
+        void upload_render_mesh(RenderMesh& rmesh, vka::Buffer* staging);
+        void stream_render_mesh(const ObjMesh& mesh, RenderMesh& rmesh, StagingWindow& window);
+        void init_device_buffer(vka::Buffer& buff, VkBufferUsageFlags usage, VkDeviceSize size);
+        void get_geometry_owners(std::vector<const RenderMesh*>& owners) const;
         void load_mtl_buffer(const material_array_t& mtlarray);
+        void decode_albedo_image(RenderMaterial& mtl);
+        void decode_emissive_image(RenderMaterial& mtl);
+        void decode_rman_image(RenderMaterial& mtl);
+        void decode_environment_image(void);
         void load_albedo_texture(RenderMaterial& mtl);
         void load_emissive_texture(RenderMaterial& mtl);
         void load_rman_texture(RenderMaterial& mtl);
         void load_environment_texture(void);
+        void load_environment_distribution(void);
+        void load_light_table(void);
+        void classify_meshes(const std::vector<bool>& decoded);
+        void load_opacity_buffer(void);
+        void load_blue_noise(void);
         void load_geometry(std::vector<VkGeometryNV>& geometry);
         void load_instances(const AccelerationStructure& blas);
         void load_blas(const std::vector<VkGeometryNV>& geometry, AccelerationStructure& blas);
@@ -175,8 +1248,20 @@ namespace pt
 
         void init_texture(vka::Texture& tex);
 
-        VkCommandBuffer record(void);
+        void watch_assets(void);
+        void reload_environment(void);
+        void reload_textures(std::vector<WatchedAsset>& textures);
+        void reload_models(const std::vector<size_t>& ids);
+        void decode_materials(size_t first);
+        void upload_materials(size_t first);
+        void compact_materials(void);
+        void destroy_acceleration_structure(void);
+        void destroy_pipeline(void);
+
+        VkCommandBuffer record(uint32_t samples);
         void trace(VkCommandBuffer cbo);
+        void read_render_image(VkImage image, VkDeviceSize pixel_size, void* dst);
+        float analyze_noise(float threshold, bool update_mask);
 
         static inline glm2::mat4 identity_transform(void)
         {
@@ -197,9 +1282,15 @@ namespace pt
         }
 
     public:
+        // width and height of the tiles of adaptive sampling, same as in the ray generation shader
+        constexpr static uint32_t ADAPTIVE_TILE_SIZE = 8;
+
         PathTracer(void);
         virtual ~PathTracer(void)
-        { this->destroy(); }
+        {
+            this->destroy();
+            this->cancel_loading();
+        }
 
         PathTracer(const PathTracer&) = delete;
         PathTracer& operator= (const PathTracer&) = delete;
@@ -209,6 +1300,13 @@ namespace pt
 
         void set_model_load_callback(loadmsg_callback_t callback);
         void set_texture_load_callback(loadmsg_callback_t callback);
+        void set_info_callback(loadmsg_callback_t callback);
+
+        /**
+         * @return Statistics of the last scene that was loaded.
+         */
+        inline const LoadStatistics& get_load_statistics(void) const noexcept
+        { return this->load_stats; }
 
         /**
          * @brief initializes the path tracer
@@ -221,28 +1319,223 @@ namespace pt
         void destroy(void);
         
         /**
-         * @brief       Loads an environment map.
+         * @brief           Sets the settings that are used to load in the background before 'init', so loading overlaps with
+         *                  the creation of the device. Without them, everything that is loaded before 'init' is only queued
+         *                  and starts loading in 'init', because the number of loading threads is not known.
+         * @param settings  Settings of the setup that is passed to 'init', they must stay valid until then.
+         * @throw           invalid_argument if the settings are a nullptr.
+         */
+        void set_load_settings(const Settings* settings);
+
+        /**
+         * @brief       Starts loading an environment map in the background.
          * @param path  Path to the environment image.
+         * @return      Handle to wait for or cancel loading.
          * @note        The environment map is requiered for this application.
          *              If you decide not to load one, the application won't start.
          *              Additionally, only one environment map will be loaded.
-         *              If 'load_environment' is called multiple times, only the 
-         *              path to the file will be overwritten.
+         *              If 'load_environment' is called multiple times, the previous
+         *              environment map is cancelled.
          *              The environment map must be an equirectangular map in the HDR image format.
          */
-        void load_environment(const std::string& path);
+        LoadHandle load_environment(const std::string& path);
 
         /**
-         * @brief       Loads a model from an object file.
+         * @brief       Starts loading a model from an object file in the background.
+         *              'init' uploads the model as soon as it is parsed. With a stream budget, the
+         *              object files are parsed one after another by 'init', so only one is resident.
          * @param path  Path to the object file.
+         * @return      Handle to wait for or cancel loading.
          */
-        void load_model(const std::string& path);
+        LoadHandle load_model(const std::string& path);
+
+        /**
+         * @brief           Sets the camera that is used by the next calls of 'run'.
+         * @param camera    New camera.
+         * @throw           invalid_argument if the camera parameters are invalid.
+         */
+        void set_camera(const Camera& camera);
+
+        inline const Camera& get_camera(void) const noexcept
+        { return this->camera; }
+
+        /**
+         * @return  Basis of the current camera, the rays of the shaders can be reproduced with it on the host.
+         * @throw   runtime_error if the camera uses the aspect of the render target, but no resolution is set yet.
+         */
+        CameraData get_camera_data(void) const;
+
+        /**
+         * @brief           Changes the size of the rendered image, the scene is not loaded again.
+         *                  The accumulated samples are discarded.
+         * @param width     Width of the image in pixels.
+         * @param height    Height of the image in pixels.
+         */
+        void set_resolution(uint32_t width, uint32_t height);
+
+        inline VkExtent2D get_resolution(void) const noexcept
+        { return this->render_extent; }
+
+        /**
+         * @brief               Renders only a tile of a larger frame. The render images cover the pixels
+         *                      [x, x + width) x [y, y + height) of the frame, where width and height are the
+         *                      resolution, and get the same rays as these pixels of the whole frame.
+         *                      A tile may exceed the right and bottom border of the frame, the pixels
+         *                      outside of the frame are padding and should be cropped.
+         *                      The accumulated samples are discarded.
+         * @param x             Horizontal position of the tile inside of the frame in pixels.
+         * @param y             Vertical position of the tile inside of the frame in pixels.
+         * @param frame_width   Width of the frame in pixels, if 0 the render images are the whole frame.
+         * @param frame_height  Height of the frame in pixels, if 0 the render images are the whole frame.
+         */
+        void set_tile(uint32_t x, uint32_t y, uint32_t frame_width, uint32_t frame_height);
+
+        /**
+         * @brief               Discards the accumulated samples, the next call of 'run' starts a new image.
+         *                      Changing the camera, the resolution, the tile or the scene does this automatically.
+         * @param first_sample  Index of the first sample of the new image. Images of disjoint sample ranges
+         *                      use different random numbers, so their means can be merged weighted by their
+         *                      sample counts.
+         */
+        inline void reset_accumulation(uint32_t first_sample = 0) noexcept
+        {
+            this->accumulated_samples = 0;
+            this->tile_mask_valid = false;
+            this->accumulated_ns = 0;
+            this->first_sample = first_sample;
+        }
+
+        inline uint32_t get_accumulated_samples(void) const noexcept
+        { return this->accumulated_samples; }
+
+        /**
+         * @brief           Enables the feature images of the first hit, see 'read_features' and 'read_first_hit'.
+         *                  They cost memory bandwidth for every sample, so they are disabled by default.
+         *                  Changing it discards the accumulated samples, the features must cover all of them.
+         * @param enabled   True if the features are written.
+         */
+        inline void set_features(bool enabled) noexcept
+        {
+            if(enabled == this->features) return;
+            this->features = enabled;
+            this->reset_accumulation();
+        }
+
+        inline bool get_features(void) const noexcept
+        { return this->features; }
+
+        /**
+         * @brief   Reloads the files of the scene that changed since the last call. A changed texture is decoded
+         *          and uploaded again only for the materials that use it, a changed object file is parsed and
+         *          uploaded on its own. Afterwards the acceleration structures, descriptors, pipeline and SBT are
+         *          rebuilt. Must not be called while tracing.
+         * @return  Number of changed files.
+         * @throw   runtime_error if a changed file could not be loaded. Files are loaded before any part
+         *          of the scene is replaced, so the previous scene can still be traced.
+         */
+        uint32_t reload_changed(void);
+
+        /**
+         * @brief           Extecutes the path tracer. The samples are added to the samples that are
+         *                  already accumulated, so an image can be refined over multiple calls.
+         * @param samples   Number of samples per pixel to trace, must be at least 1.
+         * @return          Execution time in nano seconds.
+         */
+        uint64_t run(uint32_t samples = 1);
+
+        /**
+         * @brief           Traces samples until one limit of the budget is reached. Like 'run', the samples are
+         *                  added to the accumulated samples. The samples are traced in submissions whose size adapts
+         *                  to the measured time per sample, so a time budget or a cancellation is noticed in time.
+         *                  With adaptive sampling, the noise of every tile of ADAPTIVE_TILE_SIZE^2 pixels is estimated
+         *                  at the noise checks. Tiles with at least 16 samples whose noisiest pixel reached the target
+         *                  noise are not traced anymore, the samples go to the remaining tiles.
+         * @param budget    Limits of the rendering.
+         * @return          Reason of the stop and the achieved samples. The render target contains the mean of
+         *                  all accumulated samples, even if the rendering was cancelled.
+         * @throw           invalid_argument if no limit is set or adaptive sampling has no target noise.
+         */
+        RenderResult run(const RenderBudget& budget);
+
+        /**
+         * @brief   Estimates the noise of the accumulated samples as the mean of the relative standard errors of the
+         *          pixel luminances. The error of a pixel is relative to its luminance but at least 0.01, so dark pixels
+         *          don't dominate. Halving the noise takes about four times the samples.
+         * @return  Estimated noise, negative if less than two samples are accumulated.
+         */
+        float estimate_noise(void);
+
+        /**
+         * @brief           Copies the number of samples of every pixel to the host, see 'RenderBudget::adaptive'.
+         * @param counts    Receives width * height integers, the rows are not padded.
+         * @throw           runtime_error if no sample is accumulated.
+         */
+        void read_sample_counts(uint32_t* counts);
+
+        /**
+         * @brief           Copies the features of the first hit to the host, they guide the 'Denoiser'. The features are
+         *                  averaged over the samples like the color, but only since the last restored checkpoint.
+         * @param albedo    Optional, receives width * height pixels of 4 floats: RGB is the mean albedo, the color
+         *                  of the environment if the camera ray missed, A the number of feature samples (at most 1024).
+         * @param normals   Optional, receives width * height pixels of 4 floats: XYZ is the mean normal, zero if the
+         *                  camera ray missed, shorter than 1 if the normals of the samples differ. W is 0.
+         * @throw           runtime_error if no sample is accumulated or the features are disabled.
+         */
+        void read_features(float* albedo, float* normals);
+
+        /**
+         * @brief               Copies the first hit of every pixel to the host, it is taken from the first sample
+         *                      since the last restored checkpoint. Every parameter is optional and receives
+         *                      width * height values, the rows are not padded.
+         * @param depth         Receives the distance from the camera to the hit, infinity if the camera ray missed.
+         * @param geometry_ids  Receives the geometry ID of the hit mesh, 0xFFFFFFFF if the camera ray missed.
+         * @param material_ids  Receives the material ID of the hit mesh, 0xFFFFFFFF if the camera ray missed.
+         * @throw               runtime_error if no sample is accumulated or the features are disabled.
+         */
+        void read_first_hit(float* depth, uint32_t* geometry_ids, uint32_t* material_ids);
+
+        /**
+         * @brief               Copies the state of the accumulation to a checkpoint, the buffers of the
+         *                      checkpoint are reused.
+         * @param checkpoint    Receives the state.
+         * @throw               runtime_error if no sample is accumulated.
+         */
+        void capture_checkpoint(Checkpoint& checkpoint);
+
+        /**
+         * @brief               Restores the accumulation of a checkpoint, the next call of 'run' continues it.
+         *                      The resolution, the tile and the camera must be set as they were when the
+         *                      checkpoint was captured. The render target receives the restored image.
+         * @param checkpoint    Checkpoint to restore.
+         * @throw               invalid_argument if the checkpoint does not match the settings of the path tracer.
+         */
+        void restore_checkpoint(const Checkpoint& checkpoint);
+
+        /**
+         * @return  Device memory of the scene in bytes: geometry, textures, material buffer and acceleration structures.
+         *          The render images are not included, they depend on the resolution.
+         */
+        size_t get_scene_memory_size(void) const noexcept;
+
+        // Importance sampling of the environment map, the closest hit shader samples the same distribution.
+        inline const EnvironmentSampler& get_environment_sampler(void) const noexcept
+        { return this->environment_sampler; }
+
+        // Blue noise tile of the shaders, a Sampler of type BLUE_NOISE with seed 0 generates the same samples.
+        inline const BlueNoiseTile& get_blue_noise(void) const noexcept
+        { return this->blue_noise; }
+
+        // Importance sampling of the emissive triangles, the closest hit shader samples the same distribution.
+        inline const LightSampler& get_light_sampler(void) const noexcept
+        { return this->light_sampler; }
 
         /**
-         * @brief   Extecutes the path tracer.
-         * @return  Execution time in nano seconds.
+         * @brief       Copies the mean of the accumulated samples to the host.
+         * @param rgba  Receives width * height pixels of 4 floats, the rows are not padded.
+         *              RGB is the mean color, A the mean of the squared luminance (used to estimate the noise).
+         * @throw       runtime_error if no sample is accumulated.
          */
-        uint64_t run(void);
+        void read_accumulation(float* rgba);
 
         const uint8_t* map_image(size_t& row_stride, uint32_t& component_count) const;
 
@@ -12,20 +12,27 @@ void pt::PathTracer::create_acceleration_structure(void)
 
 void pt::PathTracer::load_geometry(std::vector<VkGeometryNV>& geometry)
 {
+    // Shared meshes don't own any buffers, their data is stored in the
+    // buffers of the mesh that owns their geometry ID.
+    std::vector<const RenderMesh*> owners;
+    this->get_geometry_owners(owners);
+
     // create one geometry for every mesh
     for(const auto& model : this->models)
     {
         for(const RenderMesh& mesh : model)
         {
+            const RenderMesh& storage = *owners.at(mesh.properties.record.geometryID);
+
             VkGeometryTrianglesNV triangles = {};
             triangles.sType = VK_STRUCTURE_TYPE_GEOMETRY_TRIANGLES_NV;
             triangles.pNext = nullptr;
-            triangles.vertexData = mesh.vectices.handle();
+            triangles.vertexData = storage.vectices.handle();
             triangles.vertexOffset = 0;
             triangles.vertexCount = mesh.properties.vertex_count;
             triangles.vertexStride = mesh.properties.vertex_stride;
             triangles.vertexFormat = mesh.properties.vertex_format;
-            triangles.indexData = mesh.indices.handle();
+            triangles.indexData = storage.indices.handle();
             triangles.indexOffset = 0;
             triangles.indexCount = mesh.properties.index_count;
             triangles.indexType = VK_INDEX_TYPE_UINT32;
@@ -42,7 +49,8 @@ void pt::PathTracer::load_geometry(std::vector<VkGeometryNV>& geometry)
             geom.pNext = nullptr;
             geom.geometryType = VK_GEOMETRY_TYPE_TRIANGLES_NV;
             geom.geometry = data;
-            geom.flags = VK_GEOMETRY_OPAQUE_BIT_NV;
+            // the any hit shader only runs for meshes with cut out triangles, see MeshOpacity
+            geom.flags = mesh.opacity.opaque ? VK_GEOMETRY_OPAQUE_BIT_NV : 0;
 
             geometry.push_back(geom);
         }
@@ -54,7 +62,7 @@ void pt::PathTracer::load_instances(const AccelerationStructure& blas)
     // there is only one instance of the blas
     VkAccelerationStructureInstanceNV instance;
     instance.transform = glm2transformNV(identity_transform());
-    instance.flags = VK_GEOMETRY_INSTANCE_FORCE_OPAQUE_BIT_NV;
+    instance.flags = 0;                 // the geometries decide if they are opaque
     instance.mask = 0xFF;
     instance.instanceCustomIndex = 0;   // instanceID of this geometry is 0
     instance.instanceShaderBindingTableRecordOffset = 0; // the first hit group of this instance is the first in the SBT
@@ -81,6 +89,7 @@ void pt::PathTracer::load_instances(const AccelerationStructure& blas)
     tmp.unmap();
     
     // copy staging buffer to instance buffer
+    std::lock_guard<std::mutex> lock(this->queue_mtx);
     VkCommandBuffer cbo = vka::Buffer::enqueue_copy(this->setup->get_device(), this->cmd_pool, 1, &tmp, &this->tlibo);
     if(vka::utility::execute_scb(this->setup->get_device(), this->cmd_pool, this->setup->get_rt_queue(), 1, &cbo) != VK_SUCCESS)
         throw std::runtime_error("[pt::PathTracer::load_instances]: Failed to create copy staging buffer to instance buffer.");
@@ -136,6 +145,7 @@ void pt::PathTracer::load_blas(const std::vector<VkGeometryNV>& geometry, Accele
     mem_ai.memoryTypeIndex = vka::utility::find_memory_type_index(this->setup->get_physical_device(), object_req.memoryRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
     if(vkAllocateMemory(this->setup->get_device(), &mem_ai, nullptr, &blas.memory) != VK_SUCCESS)
         throw std::runtime_error("[pt::PathTracer::load_blas]: Failed to allocate memory for blas.");
+    blas.size = mem_ai.allocationSize;
     
     VkBindAccelerationStructureMemoryInfoNV bind_info = {};
     bind_info.sType = VK_STRUCTURE_TYPE_BIND_ACCELERATION_STRUCTURE_MEMORY_INFO_NV;
@@ -160,6 +170,7 @@ void pt::PathTracer::load_blas(const std::vector<VkGeometryNV>& geometry, Accele
         throw std::runtime_error("[pt::PathTracer::load_blas]: Failed to create scratch memory for blas.");
 
     // allocate command buffer for blas build
+    std::lock_guard<std::mutex> lock(this->queue_mtx);
     VkCommandBuffer cbo;
     VkCommandBufferAllocateInfo cbo_ai = {};
     cbo_ai.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
@@ -256,6 +267,7 @@ void pt::PathTracer::load_tlas(AccelerationStructure& tlas)
     mem_ai.memoryTypeIndex = vka::utility::find_memory_type_index(this->setup->get_physical_device(), object_req.memoryRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
     if(vkAllocateMemory(this->setup->get_device(), &mem_ai, nullptr, &tlas.memory) != VK_SUCCESS)
         throw std::runtime_error("[pt::PathTracer::load_tlas]: Failed to allocate memory for tlas.");
+    tlas.size = mem_ai.allocationSize;
     
     VkBindAccelerationStructureMemoryInfoNV bind_info = {};
     bind_info.sType = VK_STRUCTURE_TYPE_BIND_ACCELERATION_STRUCTURE_MEMORY_INFO_NV;
@@ -280,6 +292,7 @@ void pt::PathTracer::load_tlas(AccelerationStructure& tlas)
         throw std::runtime_error("[pt::PathTracer::load_tlas]: Failed to create scratch memory for tlas.");
 
     // allocate command buffer for tlas build
+    std::lock_guard<std::mutex> lock(this->queue_mtx);
     VkCommandBuffer cbo;
     VkCommandBufferAllocateInfo cbo_ai = {};
     cbo_ai.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
@@ -0,0 +1,147 @@
+#include "../application.h"
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+    constexpr float SIGMA = 1.5f;   // standard deviation of the energy filter in pixels, as proposed by Ulichney
+
+    // Energy of a binary pattern: every set pixel adds a gaussian that wraps around the tile.
+    class EnergyField
+    {
+    private:
+        uint32_t size;
+        std::vector<float> kernel;  // gaussian at every offset, indexed like the tile
+        std::vector<float> energy;
+        std::vector<uint8_t> pattern;
+
+    public:
+        explicit EnergyField(uint32_t size) : size(size), kernel(size * size), energy(size * size, 0.0f), pattern(size * size, 0)
+        {
+            for(uint32_t y = 0; y < size; y++)
+            {
+                for(uint32_t x = 0; x < size; x++)
+                {
+                    const float dx = static_cast<float>(std::min(x, size - x));
+                    const float dy = static_cast<float>(std::min(y, size - y));
+                    this->kernel[y * size + x] = std::exp(-(dx * dx + dy * dy) / (2.0f * SIGMA * SIGMA));
+                }
+            }
+        }
+
+        void set(uint32_t p, bool value) noexcept
+        {
+            const float sign = value ? 1.0f : -1.0f;
+            const uint32_t mask = this->size - 1;
+            const uint32_t px = p % this->size, py = p / this->size;
+            this->pattern[p] = value ? 1 : 0;
+            for(uint32_t y = 0; y < this->size; y++)
+            {
+                const float* k = this->kernel.data() + ((y - py) & mask) * this->size;
+                float* e = this->energy.data() + y * this->size;
+                for(uint32_t x = 0; x < this->size; x++)
+                    e[x] += sign * k[(x - px) & mask];
+            }
+        }
+
+        bool get(uint32_t p) const noexcept
+        { return this->pattern[p] != 0; }
+
+        // set pixel with the highest energy
+        uint32_t tightest_cluster(void) const noexcept
+        {
+            uint32_t best = UINT32_MAX;
+            for(uint32_t p = 0; p < this->energy.size(); p++)
+                if(this->pattern[p] && (best == UINT32_MAX || this->energy[p] > this->energy[best])) best = p;
+            return best;
+        }
+
+        // pixel that is not set with the lowest energy
+        uint32_t largest_void(void) const noexcept
+        {
+            uint32_t best = UINT32_MAX;
+            for(uint32_t p = 0; p < this->energy.size(); p++)
+                if(!this->pattern[p] && (best == UINT32_MAX || this->energy[p] < this->energy[best])) best = p;
+            return best;
+        }
+    };
+}
+
+void pt::BlueNoiseTile::build(uint32_t size, uint32_t seed)
+{
+    if(size < 4 || size > 256 || (size & (size - 1)) != 0)
+        throw std::invalid_argument("[pt::BlueNoiseTile::build]: The size must be a power of 2 between 4 and 256.");
+    const uint32_t n = size * size;
+
+    // a tenth of the pixels are set at random
+    EnergyField initial(size);
+    const uint32_t ones = std::max(n / 10, 1u);
+    for(uint32_t i = 0, count = 0; count < ones; i++)
+    {
+        const uint32_t p = hash_uint(seed ^ hash_uint(i)) % n;
+        if(initial.get(p)) continue;
+        initial.set(p, true);
+        count++;
+    }
+
+    // The set pixels are distributed evenly by moving the tightest cluster into the largest void,
+    // until the pixel that is removed is the same pixel that would be set again.
+    for(uint32_t i = 0; i < n; i++)
+    {
+        const uint32_t cluster = initial.tightest_cluster();
+        initial.set(cluster, false);
+        const uint32_t hole = initial.largest_void();
+        initial.set(hole, true);
+        if(hole == cluster) break;
+    }
+
+    // The initial pixels get the ranks below 'ones' by removing the tightest clusters, the other pixels get
+    // the ranks above by filling the largest voids. After half of the pixels are set, the largest void of the
+    // set pixels is also the tightest cluster of the pixels that are not set, so one rule fills the whole tile.
+    this->ranks.assign(n, 0);
+    EnergyField removing = initial;
+    for(uint32_t rank = ones; rank-- > 0;)
+    {
+        const uint32_t cluster = removing.tightest_cluster();
+        removing.set(cluster, false);
+        this->ranks[cluster] = static_cast<uint16_t>(rank);
+    }
+    for(uint32_t rank = ones; rank < n; rank++)
+    {
+        const uint32_t hole = initial.largest_void();
+        initial.set(hole, true);
+        this->ranks[hole] = static_cast<uint16_t>(rank);
+    }
+    this->size = size;
+}
+
+void pt::PathTracer::load_blue_noise(void)
+{
+    // the tile only depends on its size and seed, it is built once
+    if(this->blue_noise.get_size() == 0)
+        this->blue_noise.build(BlueNoiseTile::SIZE, 0);
+
+    const std::vector<uint16_t>& ranks = this->blue_noise.get_ranks();
+    const VkDeviceSize size = ranks.size() * sizeof(uint32_t);
+    this->init_device_buffer(this->blue_noise_buffer, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, size);
+
+    vka::Buffer staging(this->setup->get_physical_device(), this->setup->get_device());
+    staging.set_create_flags(0);
+    staging.set_create_size(size);
+    staging.set_create_usage(VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
+    staging.set_create_sharing_mode(VK_SHARING_MODE_EXCLUSIVE);
+    staging.set_create_queue_families(&this->setup->get_rt_queue_info().queueFamilyIndex, 1);
+    staging.set_memory_properties(VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    if(staging.create() != VK_SUCCESS)
+        throw std::runtime_error("[pt::PathTracer::load_blue_noise]: Failed to create blue noise staging buffer.");
+
+    std::copy(ranks.begin(), ranks.end(), static_cast<uint32_t*>(staging.map(size, 0)));
+    staging.unmap();
+
+    std::lock_guard<std::mutex> lock(this->queue_mtx);
+    VkCommandBuffer cbo = vka::Buffer::enqueue_copy(this->setup->get_device(), this->cmd_pool, 1, &staging, &this->blue_noise_buffer);
+    const VkResult result = vka::utility::execute_scb(this->setup->get_device(), this->cmd_pool, this->setup->get_rt_queue(), 1, &cbo);
+    vkFreeCommandBuffers(this->setup->get_device(), this->cmd_pool, 1, &cbo);
+    if(result != VK_SUCCESS)
+        throw std::runtime_error("[pt::PathTracer::load_blue_noise]: Failed to copy staging buffer.");
+}
@@ -0,0 +1,153 @@
+#include "../application.h"
+#include <cmath>
+
+namespace
+{
+    constexpr float PI = 3.14159265358979f;
+
+    inline void cross(const float* a, const float* b, float* dst) noexcept
+    {
+        dst[0] = a[1] * b[2] - a[2] * b[1];
+        dst[1] = a[2] * b[0] - a[0] * b[2];
+        dst[2] = a[0] * b[1] - a[1] * b[0];
+    }
+
+    // returns the length of the vector before normalization
+    inline float normalize(float* v) noexcept
+    {
+        const float len = std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+        if(len > 0.0f)
+        {
+            v[0] /= len;
+            v[1] /= len;
+            v[2] /= len;
+        }
+        return len;
+    }
+
+    // Maps a uniform sample of the unit square to a uniform sample of the unit disk
+    // (concentric mapping by Shirley and Chiu), the same mapping is used by the ray generation shader.
+    inline void sample_disk(float u, float v, float& x, float& y) noexcept
+    {
+        const float a = 2.0f * u - 1.0f;
+        const float b = 2.0f * v - 1.0f;
+        if(a == 0.0f && b == 0.0f)
+        {
+            x = y = 0.0f;
+            return;
+        }
+
+        float r, phi;
+        if(std::abs(a) > std::abs(b))
+        {
+            r = a;
+            phi = (PI / 4.0f) * (b / a);
+        }
+        else
+        {
+            r = b;
+            phi = (PI / 2.0f) - (PI / 4.0f) * (a / b);
+        }
+        x = r * std::cos(phi);
+        y = r * std::sin(phi);
+    }
+}
+
+pt::CameraData pt::make_camera_data(const Camera& camera, float aspect)
+{
+    // glm2::vec3 stores 4 components
+    float position[4], target[4], up[4];
+    camera.position.store(position);
+    camera.target.store(target);
+    camera.up.store(up);
+
+    CameraData data;
+    for(uint32_t i = 0; i < 3; i++)
+    {
+        data.origin[i] = position[i];
+        data.forward[i] = target[i] - position[i];
+    }
+    normalize(data.forward);
+
+    // same orientation as the original camera of the ray generation shader:
+    // right = up x forward, the image Y axis points downwards
+    cross(up, data.forward, data.right);
+    normalize(data.right);
+    cross(data.forward, data.right, data.up);
+
+    const float half_height = std::tan(camera.fov * (PI / 180.0f) * 0.5f);
+    data.origin[3] = camera.aperture * 0.5f;
+    data.forward[3] = camera.focus_distance;
+    data.right[3] = half_height * aspect;
+    data.up[3] = half_height;
+    return data;
+}
+
+void pt::CameraData::generate_ray(float ndc_x, float ndc_y, float lens_u, float lens_v, float* ray_origin, float* ray_direction) const noexcept
+{
+    // direction through the image plane at distance 1
+    float d[3];
+    for(uint32_t i = 0; i < 3; i++)
+        d[i] = this->forward[i] + ndc_x * this->right[3] * this->right[i] - ndc_y * this->up[3] * this->up[i];
+
+    if(this->origin[3] == 0.0f)
+    {
+        for(uint32_t i = 0; i < 3; i++) ray_origin[i] = this->origin[i];
+        normalize(d);
+        for(uint32_t i = 0; i < 3; i++) ray_direction[i] = d[i];
+        return;
+    }
+
+    // Thin lens: all rays through the same point of the image plane meet on the focus plane.
+    float lx, ly;
+    sample_disk(lens_u, lens_v, lx, ly);
+    for(uint32_t i = 0; i < 3; i++)
+    {
+        const float focus = this->origin[i] + d[i] * this->forward[3];
+        ray_origin[i] = this->origin[i] + this->origin[3] * (lx * this->right[i] + ly * this->up[i]);
+        ray_direction[i] = focus - ray_origin[i];
+    }
+    normalize(ray_direction);
+}
+
+void pt::PathTracer::set_camera(const Camera& camera)
+{
+    if(!(camera.fov > 0.0f && camera.fov < 180.0f))
+        throw std::invalid_argument("[pt::PathTracer::set_camera]: The field of view must be in the range (0, 180) degrees.");
+    if(!(camera.aspect >= 0.0f))
+        throw std::invalid_argument("[pt::PathTracer::set_camera]: The aspect must not be negative.");
+    if(!(camera.aperture >= 0.0f))
+        throw std::invalid_argument("[pt::PathTracer::set_camera]: The aperture must not be negative.");
+    if(camera.aperture > 0.0f && !(camera.focus_distance > 0.0f))
+        throw std::invalid_argument("[pt::PathTracer::set_camera]: The focus distance must be greater than 0 if the aperture is not 0.");
+
+    // the basis is degenerated if the camera looks at its own position or along the up direction
+    const CameraData data = make_camera_data(camera, 1.0f);
+    float forward_len = 0.0f, right_len = 0.0f;
+    for(uint32_t i = 0; i < 3; i++)
+    {
+        forward_len += data.forward[i] * data.forward[i];
+        right_len += data.right[i] * data.right[i];
+    }
+    if(!(forward_len > 0.5f))
+        throw std::invalid_argument("[pt::PathTracer::set_camera]: The position and the target of the camera must not be equal.");
+    if(!(right_len > 0.5f))
+        throw std::invalid_argument("[pt::PathTracer::set_camera]: The up direction must not be parallel to the view direction.");
+
+    this->camera = camera;
+    this->reset_accumulation();
+}
+
+pt::CameraData pt::PathTracer::get_camera_data(void) const
+{
+    float aspect = this->camera.aspect;
+    if(aspect == 0.0f)
+    {
+        // a tile uses the aspect of its frame
+        const VkExtent2D extent = (this->frame_extent.width != 0) ? this->frame_extent : this->render_extent;
+        if(extent.width == 0 || extent.height == 0)
+            throw std::runtime_error("[pt::PathTracer::get_camera_data]: The aspect of the render target is not known before the path tracer is initialized.");
+        aspect = static_cast<float>(extent.width) / static_cast<float>(extent.height);
+    }
+    return make_camera_data(this->camera, aspect);
+}
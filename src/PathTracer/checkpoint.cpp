@@ -0,0 +1,365 @@
+#include "../application.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+namespace
+{
+    constexpr char CHECKPOINT_MAGIC[4] = { 'P', 'T', 'C', 'K' };
+    constexpr uint32_t CHECKPOINT_VERSION = 1;
+    constexpr uint32_t UNIFORM_SAMPLE_COUNTS = 0x1; // the sample counts are not stored, every pixel has 'accumulated_samples'
+
+    // Fixed size part of a checkpoint file, the accumulation and the sample counts follow without padding.
+    // The file is written in the byte order of the host.
+    struct CheckpointHeader
+    {
+        char magic[4];
+        uint32_t version;
+        uint32_t flags;
+        uint32_t width;
+        uint32_t height;
+        uint32_t frame_width;
+        uint32_t frame_height;
+        uint32_t tile_x;
+        uint32_t tile_y;
+        uint32_t first_sample;
+        uint32_t accumulated_samples;
+        uint32_t reserved;
+        uint64_t elapsed_ns;
+        pt::CameraData camera;
+        pt::Hash128 payload_hash;   // hash of the accumulation and the stored sample counts
+    };
+    static_assert(sizeof(CheckpointHeader) == 136, "The checkpoint header must not contain padding.");
+
+    bool has_uniform_counts(const pt::Checkpoint& checkpoint)
+    {
+        return std::all_of(checkpoint.sample_counts.begin(), checkpoint.sample_counts.end(),
+            [&checkpoint](uint32_t n) { return n == checkpoint.accumulated_samples; });
+    }
+}
+
+void pt::write_checkpoint(const std::string& path, const Checkpoint& checkpoint)
+{
+    const size_t pixel_count = static_cast<size_t>(checkpoint.width) * checkpoint.height;
+    if(checkpoint.accumulation.size() != pixel_count * 4 || checkpoint.sample_counts.size() != pixel_count)
+        throw std::invalid_argument("[pt::write_checkpoint]: The size of the buffers does not match the resolution.");
+
+    CheckpointHeader header = {};
+    std::memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic));
+    header.version = CHECKPOINT_VERSION;
+    header.flags = has_uniform_counts(checkpoint) ? UNIFORM_SAMPLE_COUNTS : 0;
+    header.width = checkpoint.width;
+    header.height = checkpoint.height;
+    header.frame_width = checkpoint.frame_width;
+    header.frame_height = checkpoint.frame_height;
+    header.tile_x = checkpoint.tile_x;
+    header.tile_y = checkpoint.tile_y;
+    header.first_sample = checkpoint.first_sample;
+    header.accumulated_samples = checkpoint.accumulated_samples;
+    header.elapsed_ns = checkpoint.elapsed_ns;
+    header.camera = checkpoint.camera;
+
+    ContentHasher hasher;
+    hasher.update(checkpoint.accumulation.data(), checkpoint.accumulation.size() * sizeof(float));
+    if((header.flags & UNIFORM_SAMPLE_COUNTS) == 0)
+        hasher.update(checkpoint.sample_counts.data(), checkpoint.sample_counts.size() * sizeof(uint32_t));
+    header.payload_hash = hasher.digest();
+
+    // the previous checkpoint is only replaced by a complete file
+    const std::string temp_path = path + ".tmp";
+    {
+        std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+        if(!file.is_open())
+            throw std::runtime_error("[pt::write_checkpoint]: Failed to create \"" + temp_path + "\".");
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(checkpoint.accumulation.data()), checkpoint.accumulation.size() * sizeof(float));
+        if((header.flags & UNIFORM_SAMPLE_COUNTS) == 0)
+            file.write(reinterpret_cast<const char*>(checkpoint.sample_counts.data()), checkpoint.sample_counts.size() * sizeof(uint32_t));
+        file.close();
+        if(!file)
+        {
+            std::remove(temp_path.c_str());
+            throw std::runtime_error("[pt::write_checkpoint]: Failed to write \"" + temp_path + "\".");
+        }
+    }
+
+    // replaces an existing checkpoint in one step on every platform, so there is always a complete checkpoint
+    std::error_code ec;
+    std::filesystem::rename(temp_path, path, ec);
+    if(ec)
+    {
+        std::remove(temp_path.c_str());
+        throw std::runtime_error("[pt::write_checkpoint]: Failed to rename \"" + temp_path + "\" to \"" + path + "\": " + ec.message());
+    }
+}
+
+bool pt::read_checkpoint(const std::string& path, Checkpoint& checkpoint)
+{
+    if(!std::ifstream(path, std::ios::binary).is_open())
+        return false;
+
+    MappedFile file(path);
+    CheckpointHeader header;
+    if(file.size() < sizeof(header))
+        throw std::runtime_error("[pt::read_checkpoint]: \"" + path + "\" is too small to be a checkpoint.");
+    std::memcpy(&header, file.data(), sizeof(header));
+    if(std::memcmp(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic)) != 0 || header.version != CHECKPOINT_VERSION)
+        throw std::runtime_error("[pt::read_checkpoint]: \"" + path + "\" is not a checkpoint of this version.");
+
+    const bool uniform = (header.flags & UNIFORM_SAMPLE_COUNTS) != 0;
+    const size_t pixel_count = static_cast<size_t>(header.width) * header.height;
+    const size_t accumulation_size = pixel_count * 4 * sizeof(float);
+    const size_t counts_size = uniform ? 0 : pixel_count * sizeof(uint32_t);
+    if(file.size() != sizeof(header) + accumulation_size + counts_size)
+        throw std::runtime_error("[pt::read_checkpoint]: The size of \"" + path + "\" does not match its resolution.");
+
+    const char* payload = file.data() + sizeof(header);
+    ContentHasher hasher;
+    hasher.update(payload, accumulation_size + counts_size);
+    if(hasher.digest() != header.payload_hash)
+        throw std::runtime_error("[pt::read_checkpoint]: \"" + path + "\" is damaged.");
+
+    checkpoint.width = header.width;
+    checkpoint.height = header.height;
+    checkpoint.frame_width = header.frame_width;
+    checkpoint.frame_height = header.frame_height;
+    checkpoint.tile_x = header.tile_x;
+    checkpoint.tile_y = header.tile_y;
+    checkpoint.first_sample = header.first_sample;
+    checkpoint.accumulated_samples = header.accumulated_samples;
+    checkpoint.elapsed_ns = header.elapsed_ns;
+    checkpoint.camera = header.camera;
+    checkpoint.accumulation.resize(pixel_count * 4);
+    std::memcpy(checkpoint.accumulation.data(), payload, accumulation_size);
+    if(uniform)
+        checkpoint.sample_counts.assign(pixel_count, header.accumulated_samples);
+    else
+    {
+        checkpoint.sample_counts.resize(pixel_count);
+        std::memcpy(checkpoint.sample_counts.data(), payload + accumulation_size, counts_size);
+    }
+    return true;
+}
+
+pt::CheckpointWriter::CheckpointWriter(const std::string& path)
+    : path(path), next(0), written(0), skipped(0)
+{
+    if(this->path.empty())
+        throw std::invalid_argument("[pt::CheckpointWriter::CheckpointWriter]: The path must not be empty.");
+    // one thread keeps the checkpoints in order, a newer checkpoint is never replaced by an older one
+    this->pool.start(1);
+}
+
+pt::CheckpointWriter::~CheckpointWriter(void)
+{
+    // the pool finishes the queued checkpoints before it stops, errors can't be reported anymore
+    this->pool.stop();
+}
+
+pt::Checkpoint* pt::CheckpointWriter::acquire(bool wait)
+{
+    // the buffer that is filled next was submitted before the other one, so it is written first
+    std::future<void>& write = this->pending[this->next];
+    if(write.valid())
+    {
+        if(!wait && write.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+        {
+            this->skipped++;
+            return nullptr;
+        }
+        write.get();
+    }
+    return &this->buffers[this->next];
+}
+
+void pt::CheckpointWriter::submit(Checkpoint* checkpoint)
+{
+    if(checkpoint != &this->buffers[this->next] || this->pending[this->next].valid())
+        throw std::invalid_argument("[pt::CheckpointWriter::submit]: The checkpoint was not acquired from this writer.");
+
+    const std::string path = this->path;
+    this->pending[this->next] = this->pool.submit([path, checkpoint]() {
+        write_checkpoint(path, *checkpoint);
+    });
+    this->next ^= 1;
+    this->written++;
+}
+
+void pt::CheckpointWriter::flush(void)
+{
+    // every checkpoint is waited for, even if an earlier one failed
+    std::exception_ptr error;
+    for(uint32_t i = 0; i < 2; i++)
+    {
+        std::future<void>& write = this->pending[this->next ^ i];
+        if(!write.valid()) continue;
+        try
+        {
+            write.get();
+        }
+        catch(...)
+        {
+            if(!error) error = std::current_exception();
+        }
+    }
+    if(error)
+        std::rethrow_exception(error);
+}
+
+void pt::CheckpointWriter::remove(void)
+{
+    this->flush();
+    std::remove(this->path.c_str());
+}
+
+void pt::PathTracer::capture_checkpoint(Checkpoint& checkpoint)
+{
+    if(this->accumulated_samples == 0)
+        throw std::runtime_error("[pt::PathTracer::capture_checkpoint]: No sample is accumulated.");
+
+    const size_t pixel_count = static_cast<size_t>(this->render_extent.width) * this->render_extent.height;
+    checkpoint.width = this->render_extent.width;
+    checkpoint.height = this->render_extent.height;
+    checkpoint.frame_width = this->frame_extent.width;
+    checkpoint.frame_height = this->frame_extent.height;
+    checkpoint.tile_x = static_cast<uint32_t>(this->tile_offset.x);
+    checkpoint.tile_y = static_cast<uint32_t>(this->tile_offset.y);
+    checkpoint.first_sample = this->first_sample;
+    checkpoint.accumulated_samples = this->accumulated_samples;
+    checkpoint.elapsed_ns = this->accumulated_ns;
+    checkpoint.camera = this->get_camera_data();
+    checkpoint.accumulation.resize(pixel_count * 4);
+    checkpoint.sample_counts.resize(pixel_count);
+    this->read_accumulation(checkpoint.accumulation.data());
+    this->read_sample_counts(checkpoint.sample_counts.data());
+}
+
+void pt::PathTracer::restore_checkpoint(const Checkpoint& checkpoint)
+{
+    if(!this->initialized)
+        throw std::runtime_error("[pt::PathTracer::restore_checkpoint]: The path tracer is not initialized.");
+    if(checkpoint.width != this->render_extent.width || checkpoint.height != this->render_extent.height)
+        throw std::invalid_argument("[pt::PathTracer::restore_checkpoint]: The resolution of the checkpoint does not match.");
+    if(checkpoint.frame_width != this->frame_extent.width || checkpoint.frame_height != this->frame_extent.height
+        || checkpoint.tile_x != static_cast<uint32_t>(this->tile_offset.x) || checkpoint.tile_y != static_cast<uint32_t>(this->tile_offset.y))
+        throw std::invalid_argument("[pt::PathTracer::restore_checkpoint]: The tile of the checkpoint does not match.");
+    const CameraData camera = this->get_camera_data();
+    if(std::memcmp(&camera, &checkpoint.camera, sizeof(camera)) != 0)
+        throw std::invalid_argument("[pt::PathTracer::restore_checkpoint]: The camera of the checkpoint does not match.");
+
+    const size_t pixel_count = static_cast<size_t>(this->render_extent.width) * this->render_extent.height;
+    if(checkpoint.accumulated_samples == 0 || checkpoint.accumulation.size() != pixel_count * 4 || checkpoint.sample_counts.size() != pixel_count)
+        throw std::invalid_argument("[pt::PathTracer::restore_checkpoint]: The checkpoint is incomplete.");
+
+    // the staging buffer contains the accumulation, the sample counts and the 8 bit image
+    const VkDeviceSize accumulation_size = pixel_count * 4 * sizeof(float);
+    const VkDeviceSize counts_size = pixel_count * sizeof(uint32_t);
+    const VkDeviceSize image_size = pixel_count * 4;
+    vka::Buffer staging;
+    staging.set_device(this->setup->get_device());
+    staging.set_physical_device(this->setup->get_physical_device());
+    staging.set_create_flags(0);
+    staging.set_create_size(accumulation_size + counts_size + image_size);
+    staging.set_create_usage(VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
+    staging.set_create_sharing_mode(VK_SHARING_MODE_EXCLUSIVE);
+    staging.set_create_queue_families(&this->setup->get_rt_queue_info().queueFamilyIndex, 1);
+    staging.set_memory_properties(VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    if(staging.create() != VK_SUCCESS)
+        throw std::runtime_error("[pt::PathTracer::restore_checkpoint]: Failed to create staging buffer.");
+
+    uint8_t* map = static_cast<uint8_t*>(staging.map(staging.size(), 0));
+    std::memcpy(map, checkpoint.accumulation.data(), accumulation_size);
+    std::memcpy(map + accumulation_size, checkpoint.sample_counts.data(), counts_size);
+    // same conversion as the store of the ray generation shader to the render target
+    uint8_t* rgba = map + accumulation_size + counts_size;
+    for(size_t i = 0; i < pixel_count * 4; i++)
+    {
+        const float v = ((i & 3) == 3) ? 1.0f : std::min(std::max(checkpoint.accumulation[i], 0.0f), 1.0f);
+        rgba[i] = static_cast<uint8_t>(v * 255.0f + 0.5f);
+    }
+    staging.unmap();
+
+    VkBufferImageCopy copies[4] = {};
+    for(uint32_t i = 0; i < 4; i++)
+    {
+        copies[i].bufferRowLength = 0;      // tightly packed
+        copies[i].bufferImageHeight = 0;
+        copies[i].imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        copies[i].imageSubresource.mipLevel = 0;
+        copies[i].imageSubresource.baseArrayLayer = 0;
+        copies[i].imageSubresource.layerCount = 1;
+        copies[i].imageOffset = { 0, 0, 0 };
+        copies[i].imageExtent = { this->render_extent.width, this->render_extent.height, 1 };
+    }
+    copies[0].bufferOffset = 0;
+    copies[1].bufferOffset = accumulation_size;
+    copies[2].bufferOffset = accumulation_size + counts_size;
+    copies[3].bufferOffset = accumulation_size + counts_size;
+
+    // the storage images stay in the general layout, the copies wait for the last sample
+    VkMemoryBarrier render2copy_barrier = {};
+    render2copy_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    render2copy_barrier.pNext = nullptr;
+    render2copy_barrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_READ_BIT;
+    render2copy_barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+
+    // the next sample reads the restored images, the host may map the output image
+    VkMemoryBarrier copy2render_barrier = {};
+    copy2render_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    copy2render_barrier.pNext = nullptr;
+    copy2render_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    copy2render_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_HOST_READ_BIT;
+
+    VkCommandBuffer cbo;
+    VkCommandBufferAllocateInfo ai = {};
+    ai.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    ai.pNext = nullptr;
+    ai.commandPool = this->cmd_pool;
+    ai.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    ai.commandBufferCount = 1;
+    if(vkAllocateCommandBuffers(this->setup->get_device(), &ai, &cbo) != VK_SUCCESS)
+        throw std::runtime_error("[pt::PathTracer::restore_checkpoint]: Failed to allocate command buffer.");
+
+    VkCommandBufferBeginInfo bi = {};
+    bi.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    bi.pNext = nullptr;
+    bi.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    bi.pInheritanceInfo = nullptr;
+    if(vkBeginCommandBuffer(cbo, &bi) != VK_SUCCESS)
+    {
+        vkFreeCommandBuffers(this->setup->get_device(), this->cmd_pool, 1, &cbo);
+        throw std::runtime_error("[pt::PathTracer::restore_checkpoint]: Failed to start recording command buffer.");
+    }
+    vkCmdPipelineBarrier(cbo, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_NV | VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &render2copy_barrier, 0, nullptr, 0, nullptr);
+    vkCmdCopyBufferToImage(cbo, staging.handle(), this->accumulation_image.image, VK_IMAGE_LAYOUT_GENERAL, 1, copies + 0);
+    vkCmdCopyBufferToImage(cbo, staging.handle(), this->sample_count_image.image, VK_IMAGE_LAYOUT_GENERAL, 1, copies + 1);
+    vkCmdCopyBufferToImage(cbo, staging.handle(), this->render_target.image, VK_IMAGE_LAYOUT_GENERAL, 1, copies + 2);
+    vkCmdCopyBufferToImage(cbo, staging.handle(), this->output_image.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, copies + 3);
+    // the features are not part of the checkpoint, they start again with the next sample
+    const VkClearColorValue no_feature = {};
+    VkImageSubresourceRange feature_range = {};
+    feature_range.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    feature_range.baseMipLevel = 0;
+    feature_range.levelCount = 1;
+    feature_range.baseArrayLayer = 0;
+    feature_range.layerCount = 1;
+    vkCmdClearColorImage(cbo, this->albedo_image.image, VK_IMAGE_LAYOUT_GENERAL, &no_feature, 1, &feature_range);
+    vkCmdClearColorImage(cbo, this->normal_image.image, VK_IMAGE_LAYOUT_GENERAL, &no_feature, 1, &feature_range);
+    vkCmdPipelineBarrier(cbo, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_NV | VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &copy2render_barrier, 0, nullptr, 0, nullptr);
+    if(vkEndCommandBuffer(cbo) != VK_SUCCESS)
+    {
+        vkFreeCommandBuffers(this->setup->get_device(), this->cmd_pool, 1, &cbo);
+        throw std::runtime_error("[pt::PathTracer::restore_checkpoint]: Failed to stop recording command buffer.");
+    }
+    // trace frees the command buffer, also if it fails
+    this->trace(cbo);
+
+    // the tile mask is rebuilt by the next noise check of adaptive sampling
+    this->accumulated_samples = checkpoint.accumulated_samples;
+    this->first_sample = checkpoint.first_sample;
+    this->accumulated_ns = checkpoint.elapsed_ns;
+    this->tile_mask_valid = false;
+}
@@ -0,0 +1,384 @@
+#include "../application.h"
+#include <immintrin.h>
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+    // B3 spline, the weights of the 5 taps of one dimension of the a-trous kernel
+    constexpr float KERNEL[5] = { 1.0f / 16.0f, 1.0f / 4.0f, 3.0f / 8.0f, 1.0f / 4.0f, 1.0f / 16.0f };
+    constexpr float LUMINANCE[3] = { 0.2126f, 0.7152f, 0.0722f };
+    // Taylor polynomial of 2^f for f in [0, 1), the relative error is below 2e-4
+    constexpr float EXP2_POLY[6] = { 1.0f, 0.693147181f, 0.240226507f, 0.0555041087f, 0.00961812911f, 0.00133335581f };
+    constexpr float ALBEDO_EPSILON = 0.001f;    // keeps the demodulation finite on black surfaces
+    constexpr float LUMINANCE_EPSILON = 1e-6f;  // keeps the luminance weight finite if a pixel has no variance
+    constexpr uint32_t ROWS_PER_TASK = 16;
+
+    // planes of the filtered signal, the color is filtered as irradiance (color / albedo)
+    enum SignalPlane
+    {
+        IR, IG, IB,
+        VARIANCE,           // variance of the mean luminance of the irradiance
+        SIGNAL_PLANE_COUNT
+    };
+
+    // planes of the features, stored as half floats
+    enum FeaturePlane
+    {
+        NX, NY, NZ,
+        AR, AG, AB,
+        FEATURE_PLANE_COUNT
+    };
+
+    // One pass of the filter, the rows of a pass are filtered concurrently.
+    struct FilterPass
+    {
+        const float* src[SIGNAL_PLANE_COUNT];
+        float* dst[SIGNAL_PLANE_COUNT];
+        const uint16_t* features[FEATURE_PLANE_COUNT];
+        uint32_t width;
+        uint32_t height;
+        int step;                   // distance of two taps in pixels
+        float sigma_luminance;
+        float inv_sigma_albedo2;
+        uint32_t normal_exponent;
+    };
+
+    // exp(x) for x <= 0, the same approximation as the vector version
+    inline float exp_neg(float x)
+    {
+        const float t = std::max(x, -80.0f) * 1.44269504f;
+        const float i = std::floor(t);
+        const float f = t - i;
+        float p = EXP2_POLY[5];
+        for(int k = 4; k >= 0; k--)
+            p = p * f + EXP2_POLY[k];
+        return std::ldexp(p, static_cast<int>(i));
+    }
+
+    inline __m256 exp_neg(__m256 x)
+    {
+        const __m256 t = _mm256_mul_ps(_mm256_max_ps(x, _mm256_set1_ps(-80.0f)), _mm256_set1_ps(1.44269504f));
+        const __m256 i = _mm256_floor_ps(t);
+        const __m256 f = _mm256_sub_ps(t, i);
+        __m256 p = _mm256_set1_ps(EXP2_POLY[5]);
+        for(int k = 4; k >= 0; k--)
+            p = _mm256_fmadd_ps(p, f, _mm256_set1_ps(EXP2_POLY[k]));
+        // 2^i is built in the exponent bits, i is at least -116
+        const __m256i e = _mm256_slli_epi32(_mm256_add_epi32(_mm256_cvtps_epi32(i), _mm256_set1_epi32(127)), 23);
+        return _mm256_mul_ps(p, _mm256_castsi256_ps(e));
+    }
+
+    // cosine^exponent by squaring, the exponent is the same for all pixels
+    inline float power(float x, uint32_t exponent)
+    {
+        float result = 1.0f;
+        for(; exponent != 0; exponent >>= 1, x *= x)
+            if(exponent & 1) result *= x;
+        return result;
+    }
+
+    inline __m256 power(__m256 x, uint32_t exponent)
+    {
+        __m256 result = _mm256_set1_ps(1.0f);
+        for(; exponent != 0; exponent >>= 1, x = _mm256_mul_ps(x, x))
+            if(exponent & 1) result = _mm256_mul_ps(result, x);
+        return result;
+    }
+
+    inline __m256 load_half(const uint16_t* src)
+    {
+        return _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src)));
+    }
+
+    inline uint32_t clamp_row(int y, uint32_t height)
+    {
+        return static_cast<uint32_t>(std::min(std::max(y, 0), static_cast<int>(height) - 1));
+    }
+
+    // SVGF smooths the variance with a 3x3 gaussian before it scales the luminance weight,
+    // the variance of a single pixel is too noisy itself
+    float blurred_variance(const FilterPass& pass, uint32_t x, uint32_t y)
+    {
+        constexpr float WEIGHTS[3] = { 0.25f, 0.5f, 0.25f };
+        float v = 0.0f;
+        for(int dy = -1; dy <= 1; dy++)
+        {
+            const float* row = pass.src[VARIANCE] + static_cast<size_t>(clamp_row(static_cast<int>(y) + dy, pass.height)) * pass.width;
+            for(int dx = -1; dx <= 1; dx++)
+                v += WEIGHTS[dy + 1] * WEIGHTS[dx + 1] * row[clamp_row(static_cast<int>(x) + dx, pass.width)];
+        }
+        return v;
+    }
+
+    void filter_pixel(const FilterPass& pass, uint32_t x, uint32_t y)
+    {
+        const size_t i = static_cast<size_t>(y) * pass.width + x;
+        const float c[3] = { pass.src[IR][i], pass.src[IG][i], pass.src[IB][i] };
+        const float luminance = LUMINANCE[0] * c[0] + LUMINANCE[1] * c[1] + LUMINANCE[2] * c[2];
+        const float inv_luminance = 1.0f / (pass.sigma_luminance * std::sqrt(blurred_variance(pass, x, y)) + LUMINANCE_EPSILON);
+        float f[FEATURE_PLANE_COUNT];
+        for(uint32_t k = 0; k < FEATURE_PLANE_COUNT; k++)
+            f[k] = _cvtsh_ss(pass.features[k][i]);
+
+        // the center tap always has its full weight, so pixels without a normal keep their value
+        const float hc = KERNEL[2] * KERNEL[2];
+        float sum[3] = { hc * c[0], hc * c[1], hc * c[2] };
+        float variance = hc * hc * pass.src[VARIANCE][i];
+        float weight_sum = hc;
+        for(int dy = -2; dy <= 2; dy++)
+        {
+            const int yy = static_cast<int>(y) + dy * pass.step;
+            if(yy < 0 || yy >= static_cast<int>(pass.height)) continue;
+            for(int dx = -2; dx <= 2; dx++)
+            {
+                const int xx = static_cast<int>(x) + dx * pass.step;
+                if((dx == 0 && dy == 0) || xx < 0 || xx >= static_cast<int>(pass.width)) continue;
+
+                const size_t j = static_cast<size_t>(yy) * pass.width + static_cast<size_t>(xx);
+                float g[FEATURE_PLANE_COUNT];
+                for(uint32_t k = 0; k < FEATURE_PLANE_COUNT; k++)
+                    g[k] = _cvtsh_ss(pass.features[k][j]);
+                const float cq[3] = { pass.src[IR][j], pass.src[IG][j], pass.src[IB][j] };
+                const float lq = LUMINANCE[0] * cq[0] + LUMINANCE[1] * cq[1] + LUMINANCE[2] * cq[2];
+
+                const float cosine = std::max(f[NX] * g[NX] + f[NY] * g[NY] + f[NZ] * g[NZ], 0.0f);
+                const float da = (f[AR] - g[AR]) * (f[AR] - g[AR]) + (f[AG] - g[AG]) * (f[AG] - g[AG]) + (f[AB] - g[AB]) * (f[AB] - g[AB]);
+                const float dl = std::abs(luminance - lq) * inv_luminance;
+                const float w = KERNEL[dy + 2] * KERNEL[dx + 2] * power(cosine, pass.normal_exponent) * exp_neg(-(dl + da * pass.inv_sigma_albedo2));
+
+                for(uint32_t k = 0; k < 3; k++)
+                    sum[k] += w * cq[k];
+                variance += w * w * pass.src[VARIANCE][j];
+                weight_sum += w;
+            }
+        }
+
+        const float inv_weight = 1.0f / weight_sum;
+        pass.dst[IR][i] = sum[0] * inv_weight;
+        pass.dst[IG][i] = sum[1] * inv_weight;
+        pass.dst[IB][i] = sum[2] * inv_weight;
+        pass.dst[VARIANCE][i] = variance * inv_weight * inv_weight;
+    }
+
+    // Same as 'filter_pixel' for the pixels [x, x + 8), all taps of all pixels must be inside of the row.
+    void filter_block(const FilterPass& pass, uint32_t x, uint32_t y)
+    {
+        const size_t i = static_cast<size_t>(y) * pass.width + x;
+        const __m256 l0 = _mm256_set1_ps(LUMINANCE[0]);
+        const __m256 l1 = _mm256_set1_ps(LUMINANCE[1]);
+        const __m256 l2 = _mm256_set1_ps(LUMINANCE[2]);
+        const __m256 sign = _mm256_set1_ps(-0.0f);
+        const __m256 zero = _mm256_setzero_ps();
+
+        const __m256 cr = _mm256_loadu_ps(pass.src[IR] + i);
+        const __m256 cg = _mm256_loadu_ps(pass.src[IG] + i);
+        const __m256 cb = _mm256_loadu_ps(pass.src[IB] + i);
+        const __m256 luminance = _mm256_fmadd_ps(cr, l0, _mm256_fmadd_ps(cg, l1, _mm256_mul_ps(cb, l2)));
+
+        __m256 blurred = zero;
+        for(int dy = -1; dy <= 1; dy++)
+        {
+            const float* row = pass.src[VARIANCE] + static_cast<size_t>(clamp_row(static_cast<int>(y) + dy, pass.height)) * pass.width + x;
+            const __m256 h = _mm256_fmadd_ps(_mm256_loadu_ps(row), _mm256_set1_ps(0.5f), _mm256_mul_ps(_mm256_add_ps(_mm256_loadu_ps(row - 1), _mm256_loadu_ps(row + 1)), _mm256_set1_ps(0.25f)));
+            blurred = _mm256_fmadd_ps(h, _mm256_set1_ps(dy == 0 ? 0.5f : 0.25f), blurred);
+        }
+        const __m256 inv_luminance = _mm256_div_ps(_mm256_set1_ps(1.0f),
+            _mm256_fmadd_ps(_mm256_set1_ps(pass.sigma_luminance), _mm256_sqrt_ps(blurred), _mm256_set1_ps(LUMINANCE_EPSILON)));
+
+        __m256 f[FEATURE_PLANE_COUNT];
+        for(uint32_t k = 0; k < FEATURE_PLANE_COUNT; k++)
+            f[k] = load_half(pass.features[k] + i);
+
+        const float hc = KERNEL[2] * KERNEL[2];
+        __m256 sum_r = _mm256_mul_ps(_mm256_set1_ps(hc), cr);
+        __m256 sum_g = _mm256_mul_ps(_mm256_set1_ps(hc), cg);
+        __m256 sum_b = _mm256_mul_ps(_mm256_set1_ps(hc), cb);
+        __m256 variance = _mm256_mul_ps(_mm256_set1_ps(hc * hc), _mm256_loadu_ps(pass.src[VARIANCE] + i));
+        __m256 weight_sum = _mm256_set1_ps(hc);
+        for(int dy = -2; dy <= 2; dy++)
+        {
+            const int yy = static_cast<int>(y) + dy * pass.step;
+            if(yy < 0 || yy >= static_cast<int>(pass.height)) continue;
+            for(int dx = -2; dx <= 2; dx++)
+            {
+                if(dx == 0 && dy == 0) continue;
+                const size_t j = static_cast<size_t>(yy) * pass.width + static_cast<size_t>(static_cast<int>(x) + dx * pass.step);
+
+                const __m256 qr = _mm256_loadu_ps(pass.src[IR] + j);
+                const __m256 qg = _mm256_loadu_ps(pass.src[IG] + j);
+                const __m256 qb = _mm256_loadu_ps(pass.src[IB] + j);
+                const __m256 lq = _mm256_fmadd_ps(qr, l0, _mm256_fmadd_ps(qg, l1, _mm256_mul_ps(qb, l2)));
+
+                __m256 cosine = _mm256_mul_ps(f[NX], load_half(pass.features[NX] + j));
+                cosine = _mm256_fmadd_ps(f[NY], load_half(pass.features[NY] + j), cosine);
+                cosine = _mm256_max_ps(_mm256_fmadd_ps(f[NZ], load_half(pass.features[NZ] + j), cosine), zero);
+                const __m256 ar = _mm256_sub_ps(f[AR], load_half(pass.features[AR] + j));
+                const __m256 ag = _mm256_sub_ps(f[AG], load_half(pass.features[AG] + j));
+                const __m256 ab = _mm256_sub_ps(f[AB], load_half(pass.features[AB] + j));
+                const __m256 da = _mm256_fmadd_ps(ar, ar, _mm256_fmadd_ps(ag, ag, _mm256_mul_ps(ab, ab)));
+                const __m256 dl = _mm256_mul_ps(_mm256_andnot_ps(sign, _mm256_sub_ps(luminance, lq)), inv_luminance);
+                const __m256 e = exp_neg(_mm256_sub_ps(zero, _mm256_fmadd_ps(da, _mm256_set1_ps(pass.inv_sigma_albedo2), dl)));
+                const __m256 w = _mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(KERNEL[dy + 2] * KERNEL[dx + 2]), power(cosine, pass.normal_exponent)), e);
+
+                sum_r = _mm256_fmadd_ps(w, qr, sum_r);
+                sum_g = _mm256_fmadd_ps(w, qg, sum_g);
+                sum_b = _mm256_fmadd_ps(w, qb, sum_b);
+                variance = _mm256_fmadd_ps(_mm256_mul_ps(w, w), _mm256_loadu_ps(pass.src[VARIANCE] + j), variance);
+                weight_sum = _mm256_add_ps(weight_sum, w);
+            }
+        }
+
+        const __m256 inv_weight = _mm256_div_ps(_mm256_set1_ps(1.0f), weight_sum);
+        _mm256_storeu_ps(pass.dst[IR] + i, _mm256_mul_ps(sum_r, inv_weight));
+        _mm256_storeu_ps(pass.dst[IG] + i, _mm256_mul_ps(sum_g, inv_weight));
+        _mm256_storeu_ps(pass.dst[IB] + i, _mm256_mul_ps(sum_b, inv_weight));
+        _mm256_storeu_ps(pass.dst[VARIANCE] + i, _mm256_mul_ps(variance, _mm256_mul_ps(inv_weight, inv_weight)));
+    }
+
+    void filter_rows(const FilterPass& pass, uint32_t first, uint32_t last)
+    {
+        // the borders, where taps fall outside of the row, are filtered per pixel
+        const uint32_t reach = 2 * static_cast<uint32_t>(pass.step);
+        for(uint32_t y = first; y < last; y++)
+        {
+            uint32_t x = 0;
+            while(x < pass.width)
+            {
+                if(x >= reach && x + 8 + reach <= pass.width)
+                {
+                    filter_block(pass, x, y);
+                    x += 8;
+                }
+                else filter_pixel(pass, x++, y);
+            }
+        }
+    }
+}
+
+pt::Denoiser::Denoiser(uint32_t thread_count)
+{
+    this->thread_count = thread_count;
+    this->settings = default_settings();
+}
+
+pt::Denoiser::~Denoiser(void)
+{
+    this->pool.stop();
+}
+
+pt::DenoiserSettings pt::Denoiser::default_settings(void)
+{
+    DenoiserSettings settings;
+    settings.iterations = 5;
+    settings.sigma_luminance = 4.0f;
+    settings.normal_exponent = 128;
+    settings.sigma_albedo = 0.1f;
+    return settings;
+}
+
+void pt::Denoiser::set_settings(const DenoiserSettings& settings)
+{
+    if(settings.iterations == 0 || settings.iterations > 16)
+        throw std::invalid_argument("[pt::Denoiser::set_settings]: The number of iterations must be in [1, 16].");
+    if(!(settings.sigma_luminance > 0.0f) || !(settings.sigma_albedo > 0.0f))
+        throw std::invalid_argument("[pt::Denoiser::set_settings]: The sigmas must be greater than 0.");
+    this->settings = settings;
+}
+
+void pt::Denoiser::for_each_row_block(uint32_t height, const std::function<void(uint32_t, uint32_t)>& f)
+{
+    std::vector<std::future<void>> tasks;
+    tasks.reserve((height + ROWS_PER_TASK - 1) / ROWS_PER_TASK);
+    for(uint32_t first = 0; first < height; first += ROWS_PER_TASK)
+    {
+        const uint32_t last = std::min(first + ROWS_PER_TASK, height);
+        tasks.push_back(this->pool.submit([&f, first, last]() { f(first, last); }));
+    }
+    this->pool.wait_all(tasks);
+}
+
+uint64_t pt::Denoiser::denoise(uint32_t width, uint32_t height, const float* color, const uint32_t* counts, const float* albedo, const float* normals, float* rgba)
+{
+    if(width == 0 || height == 0)
+        throw std::invalid_argument("[pt::Denoiser::denoise]: The resolution must not be 0.");
+    if(color == nullptr || counts == nullptr || albedo == nullptr || normals == nullptr || rgba == nullptr)
+        throw std::invalid_argument("[pt::Denoiser::denoise]: All images are requiered.");
+
+    // a renderer that never denoises does not keep idle threads
+    this->pool.start(this->thread_count);
+    const auto begin = std::chrono::steady_clock::now();
+    const size_t pixel_count = static_cast<size_t>(width) * height;
+    // two sets of signal planes, the passes alternate between them
+    this->signal.resize(2 * SIGNAL_PLANE_COUNT * pixel_count);
+    this->features.resize(FEATURE_PLANE_COUNT * pixel_count);
+    float* signal_planes[2][SIGNAL_PLANE_COUNT];
+    for(uint32_t s = 0; s < 2; s++)
+        for(uint32_t k = 0; k < SIGNAL_PLANE_COUNT; k++)
+            signal_planes[s][k] = this->signal.data() + (s * SIGNAL_PLANE_COUNT + k) * pixel_count;
+    uint16_t* feature_planes[FEATURE_PLANE_COUNT];
+    for(uint32_t k = 0; k < FEATURE_PLANE_COUNT; k++)
+        feature_planes[k] = this->features.data() + k * pixel_count;
+
+    // The color is divided by the albedo, so the filter does not blur textures, and the
+    // pixels are split into planes, so the filter loads 8 neighbouring pixels at once.
+    this->for_each_row_block(height, [&](uint32_t first, uint32_t last) {
+        for(size_t i = static_cast<size_t>(first) * width; i < static_cast<size_t>(last) * width; i++)
+        {
+            const float* c = color + 4 * i;
+            const float* a = albedo + 4 * i;
+            const float* n = normals + 4 * i;
+            float d[3];
+            for(uint32_t k = 0; k < 3; k++)
+            {
+                d[k] = std::max(a[k], 0.0f) + ALBEDO_EPSILON;
+                signal_planes[0][IR + k][i] = c[k] / d[k];
+                feature_planes[NX + k][i] = _cvtss_sh(n[k], 0);
+                feature_planes[AR + k][i] = _cvtss_sh(a[k], 0);
+            }
+
+            // the alpha channel of the accumulation is the mean of the squared luminance, a pixel
+            // with less than two samples is assumed to have an error as large as its luminance
+            const float luminance = LUMINANCE[0] * c[0] + LUMINANCE[1] * c[1] + LUMINANCE[2] * c[2];
+            const float variance = (counts[i] >= 2) ? std::max(c[3] - luminance * luminance, 0.0f) / static_cast<float>(counts[i] - 1) : luminance * luminance;
+            const float scale = LUMINANCE[0] * d[0] + LUMINANCE[1] * d[1] + LUMINANCE[2] * d[2];
+            signal_planes[0][VARIANCE][i] = variance / (scale * scale);
+        }
+    });
+
+    // every pass doubles the distance of the taps, so 5 passes cover 125 pixels with 25 taps each
+    FilterPass pass;
+    pass.width = width;
+    pass.height = height;
+    pass.sigma_luminance = this->settings.sigma_luminance;
+    pass.inv_sigma_albedo2 = 1.0f / (this->settings.sigma_albedo * this->settings.sigma_albedo);
+    pass.normal_exponent = this->settings.normal_exponent;
+    for(uint32_t k = 0; k < FEATURE_PLANE_COUNT; k++)
+        pass.features[k] = feature_planes[k];
+    uint32_t current = 0;
+    for(uint32_t iteration = 0; iteration < this->settings.iterations; iteration++)
+    {
+        pass.step = 1 << iteration;
+        for(uint32_t k = 0; k < SIGNAL_PLANE_COUNT; k++)
+        {
+            pass.src[k] = signal_planes[current][k];
+            pass.dst[k] = signal_planes[current ^ 1][k];
+        }
+        this->for_each_row_block(height, [&pass](uint32_t first, uint32_t last) {
+            filter_rows(pass, first, last);
+        });
+        current ^= 1;
+    }
+
+    // the albedo is multiplied again
+    this->for_each_row_block(height, [&](uint32_t first, uint32_t last) {
+        for(size_t i = static_cast<size_t>(first) * width; i < static_cast<size_t>(last) * width; i++)
+        {
+            for(uint32_t k = 0; k < 3; k++)
+                rgba[4 * i + k] = signal_planes[current][IR + k][i] * (std::max(albedo[4 * i + k], 0.0f) + ALBEDO_EPSILON);
+            rgba[4 * i + 3] = 1.0f;
+        }
+    });
+
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin).count());
+}
@@ -6,67 +6,75 @@ void pt::PathTracer::create_descriptors(void)
     this->descriptors.set_device(this->setup->get_device());
     this->descriptors.set_descriptor_set_count(2);
 
-    // count number of meshes
-    uint32_t mesh_count = 0;
-    for(size_t i = 0; i < this->models.size(); i++) mesh_count += this->models[i].size();
+    // Only the unique geometries have buffers, they are indexed by the geometry ID.
+    std::vector<const RenderMesh*> owners;
+    this->get_geometry_owners(owners);
+    const uint32_t geometry_count = static_cast<uint32_t>(owners.size());
 
-    // The first set (set = 0) contains the acceleration structure and the output image
+    // The first set (set = 0) contains the acceleration structure, the output image and the images of the accumulation
     this->descriptors.add_binding(0, 0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_RAYGEN_BIT_NV);
     this->descriptors.add_binding(0, 1, VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_NV, 1, VK_SHADER_STAGE_RAYGEN_BIT_NV | VK_SHADER_STAGE_CLOSEST_HIT_BIT_NV);
+    this->descriptors.add_binding(0, 2, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_RAYGEN_BIT_NV);
+    this->descriptors.add_binding(0, 3, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_RAYGEN_BIT_NV);
+    this->descriptors.add_binding(0, 4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_RAYGEN_BIT_NV);
+    this->descriptors.add_binding(0, 5, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_RAYGEN_BIT_NV);
+    this->descriptors.add_binding(0, 6, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_RAYGEN_BIT_NV);
+    this->descriptors.add_binding(0, 7, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_RAYGEN_BIT_NV);
+    this->descriptors.add_binding(0, 8, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_RAYGEN_BIT_NV | VK_SHADER_STAGE_CLOSEST_HIT_BIT_NV);
 
     // The second set (set = 1) contains the scene description, like vertices, vertex attributes and the materials
-    this->descriptors.add_binding(1, 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, mesh_count, VK_SHADER_STAGE_CLOSEST_HIT_BIT_NV);
-    this->descriptors.add_binding(1, 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, mesh_count, VK_SHADER_STAGE_CLOSEST_HIT_BIT_NV);
+    this->descriptors.add_binding(1, 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, geometry_count, VK_SHADER_STAGE_CLOSEST_HIT_BIT_NV | VK_SHADER_STAGE_ANY_HIT_BIT_NV);
+    this->descriptors.add_binding(1, 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, geometry_count, VK_SHADER_STAGE_CLOSEST_HIT_BIT_NV | VK_SHADER_STAGE_ANY_HIT_BIT_NV);
     this->descriptors.add_binding(1, 2, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_CLOSEST_HIT_BIT_NV);
     this->descriptors.add_binding(1, 3, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, this->materials.size(), VK_SHADER_STAGE_CLOSEST_HIT_BIT_NV);
     this->descriptors.add_binding(1, 4, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, this->materials.size(), VK_SHADER_STAGE_CLOSEST_HIT_BIT_NV);
-    this->descriptors.add_binding(1, 5, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, this->materials.size(), VK_SHADER_STAGE_CLOSEST_HIT_BIT_NV);
+    this->descriptors.add_binding(1, 5, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, this->materials.size(), VK_SHADER_STAGE_CLOSEST_HIT_BIT_NV | VK_SHADER_STAGE_ANY_HIT_BIT_NV);
     this->descriptors.add_binding(1, 6, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, this->materials.size(), VK_SHADER_STAGE_CLOSEST_HIT_BIT_NV);
-    this->descriptors.add_binding(1, 7, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_MISS_BIT_NV);
+    this->descriptors.add_binding(1, 7, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_MISS_BIT_NV | VK_SHADER_STAGE_CLOSEST_HIT_BIT_NV);
+    this->descriptors.add_binding(1, 8, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_CLOSEST_HIT_BIT_NV);
+    this->descriptors.add_binding(1, 9, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_CLOSEST_HIT_BIT_NV);
+    this->descriptors.add_binding(1, 10, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_ANY_HIT_BIT_NV);
     if(this->descriptors.init() != VK_SUCCESS)
         throw std::runtime_error("[pt::PathTracer::create_descriptors]: Failed to initialize descriptors.");
     
     /* WRITE SET = 0 */
-    // location (set = 0, binding = 0) contains the output image of the path tracer
-    VkDescriptorImageInfo out_image_info = {};
-    out_image_info.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
-    out_image_info.imageView = this->render_target.view;
-    out_image_info.sampler = VK_NULL_HANDLE;
-    this->descriptors.write_image_info(0, 0, 0, 1, &out_image_info);
-
+    // location (set = 0, bindings = 0 and 2 to 7) contain the render images, see write_render_image_descriptors
     // location (set = 0, binding = 1) contains the tlas acceleration structure
     this->descriptors.write_acceleration_structure_NV(0, 1, 0, 1, &this->tlas.as);
 
+    // location (set = 0, binding = 8) contains the ranks of the blue noise tile
+    VkDescriptorBufferInfo blue_noise_info = {};
+    blue_noise_info.buffer = this->blue_noise_buffer.handle();
+    blue_noise_info.offset = 0;
+    blue_noise_info.range = this->blue_noise_buffer.size();
+    this->descriptors.write_buffer_info(0, 8, 0, 1, &blue_noise_info);
+
     /* WRITE SET = 1 */
     // location (set = 1, binding = 0) contains all the vertex attribute buffers of or meshes,
     // like normal vectors and texture coordinates
     // location (set = 1, binding = 1) contains all the index buffers of our meshes
     std::vector<VkDescriptorBufferInfo> attribute_infos, index_infos;
-    for(const auto& model : this->models)
+    for(const RenderMesh* mesh : owners)
     {
-        for(const RenderMesh& mesh : model)
-        {   
-            // attribute buffer
-            VkDescriptorBufferInfo bi;
-            bi.buffer = mesh.attributes.handle();
-            bi.offset = 0;
-            bi.range = mesh.attributes.size();
-            attribute_infos.push_back(bi);
-
-            // index buffer
-            bi.buffer = mesh.indices.handle();
-            bi.offset = 0;
-            bi.range = mesh.indices.size();
-            index_infos.push_back(bi);
-        }
+        // every geometry ID must have an owner
+        if(mesh == nullptr)
+            throw std::runtime_error("[pt::PathTracer::create_descriptors]: A geometry ID has no mesh that stores its buffers.");
+
+        // attribute buffer
+        VkDescriptorBufferInfo bi;
+        bi.buffer = mesh->attributes.handle();
+        bi.offset = 0;
+        bi.range = mesh->attributes.size();
+        attribute_infos.push_back(bi);
+
+        // index buffer
+        bi.buffer = mesh->indices.handle();
+        bi.offset = 0;
+        bi.range = mesh->indices.size();
+        index_infos.push_back(bi);
     }
-
-    // only to make sure that the number of descriptors matches the number of meshes
-    if(attribute_infos.size() != mesh_count || index_infos.size() != mesh_count)
-        throw std::runtime_error("[pt::PathTracer::create_descriptors]: The number of meshes do not match the number of "
-                                 "vertex-buffer,  vertex-attribute or index descriptors.");
-    this->descriptors.write_buffer_info(1, 0, 0, mesh_count, attribute_infos.data());
-    this->descriptors.write_buffer_info(1, 1, 0, mesh_count, index_infos.data());
+    this->descriptors.write_buffer_info(1, 0, 0, geometry_count, attribute_infos.data());
+    this->descriptors.write_buffer_info(1, 1, 0, geometry_count, index_infos.data());
 
     // location (set = 1, binding = 2) contains the buffer of all uniform materials
     VkDescriptorBufferInfo umtl_buffer_info = {};
@@ -130,6 +138,85 @@ void pt::PathTracer::create_descriptors(void)
     environment_info.sampler = this->environment.sampler();
     this->descriptors.write_image_info(1, 7, 0, 1, &environment_info);
 
+    // location (set = 1, binding = 8) contains the alias tables of the environment map
+    VkDescriptorBufferInfo environment_alias_info = {};
+    environment_alias_info.buffer = this->environment_alias.handle();
+    environment_alias_info.offset = 0;
+    environment_alias_info.range = this->environment_alias.size();
+    this->descriptors.write_buffer_info(1, 8, 0, 1, &environment_alias_info);
+
+    // location (set = 1, binding = 9) contains the emissive triangles and their alias table
+    VkDescriptorBufferInfo light_info = {};
+    light_info.buffer = this->light_buffer.handle();
+    light_info.offset = 0;
+    light_info.range = this->light_buffer.size();
+    this->descriptors.write_buffer_info(1, 9, 0, 1, &light_info);
+
+    // location (set = 1, binding = 10) contains the opacity of the triangles and their micro-triangles
+    VkDescriptorBufferInfo opacity_info = {};
+    opacity_info.buffer = this->opacity_buffer.handle();
+    opacity_info.offset = 0;
+    opacity_info.range = this->opacity_buffer.size();
+    this->descriptors.write_buffer_info(1, 10, 0, 1, &opacity_info);
+
+    // update descriptors
+    this->descriptors.update();
+    this->write_render_image_descriptors();
+}
+
+void pt::PathTracer::write_render_image_descriptors(void)
+{
+    // The render images depend on the resolution, the layouts and the other descriptors do not.
+    // The descriptors are updated here, while the image infos are still alive.
+    // location (set = 0, binding = 0) contains the output image of the path tracer
+    VkDescriptorImageInfo out_image_info = {};
+    out_image_info.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+    out_image_info.imageView = this->render_target.view;
+    out_image_info.sampler = VK_NULL_HANDLE;
+    this->descriptors.write_image_info(0, 0, 0, 1, &out_image_info);
+
+    // location (set = 0, binding = 2) contains the accumulation image
+    VkDescriptorImageInfo accumulation_info = {};
+    accumulation_info.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+    accumulation_info.imageView = this->accumulation_image.view;
+    accumulation_info.sampler = VK_NULL_HANDLE;
+    this->descriptors.write_image_info(0, 2, 0, 1, &accumulation_info);
+
+    // location (set = 0, binding = 3) contains the sample count image
+    VkDescriptorImageInfo sample_count_info = {};
+    sample_count_info.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+    sample_count_info.imageView = this->sample_count_image.view;
+    sample_count_info.sampler = VK_NULL_HANDLE;
+    this->descriptors.write_image_info(0, 3, 0, 1, &sample_count_info);
+
+    // location (set = 0, binding = 4) contains the tile mask of adaptive sampling
+    VkDescriptorBufferInfo tile_mask_info = {};
+    tile_mask_info.buffer = this->tile_mask.handle();
+    tile_mask_info.offset = 0;
+    tile_mask_info.range = this->tile_mask.size();
+    this->descriptors.write_buffer_info(0, 4, 0, 1, &tile_mask_info);
+
+    // location (set = 0, binding = 5) contains the albedo of the first hit
+    VkDescriptorImageInfo albedo_info = {};
+    albedo_info.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+    albedo_info.imageView = this->albedo_image.view;
+    albedo_info.sampler = VK_NULL_HANDLE;
+    this->descriptors.write_image_info(0, 5, 0, 1, &albedo_info);
+
+    // location (set = 0, binding = 6) contains the normal of the first hit
+    VkDescriptorImageInfo normal_info = {};
+    normal_info.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+    normal_info.imageView = this->normal_image.view;
+    normal_info.sampler = VK_NULL_HANDLE;
+    this->descriptors.write_image_info(0, 6, 0, 1, &normal_info);
+
+    // location (set = 0, binding = 7) contains the depth and the IDs of the first hit
+    VkDescriptorImageInfo first_hit_info = {};
+    first_hit_info.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+    first_hit_info.imageView = this->first_hit_image.view;
+    first_hit_info.sampler = VK_NULL_HANDLE;
+    this->descriptors.write_image_info(0, 7, 0, 1, &first_hit_info);
+
     // update descriptors
     this->descriptors.update();
 }
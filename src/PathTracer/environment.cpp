@@ -0,0 +1,219 @@
+#include "../application.h"
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+    constexpr float PI = 3.14159265358979f;
+    constexpr float LUMINANCE[3] = { 0.2126f, 0.7152f, 0.0722f };
+    constexpr float ONE_MINUS_EPSILON = 0x1.fffffep-1f;
+    constexpr uint32_t ROWS_PER_TASK = 16;
+
+    // cosine of the latitude of the center of a row, the solid angle of a pixel is proportional to it
+    float row_cosine(uint32_t row, uint32_t height) noexcept
+    {
+        return std::cos(((static_cast<float>(row) + 0.5f) / static_cast<float>(height) - 0.5f) * PI);
+    }
+}
+
+uint32_t pt::sample_alias(const AliasEntry* table, uint32_t count, float& u) noexcept
+{
+    const float x = u * static_cast<float>(count);
+    uint32_t i = std::min(static_cast<uint32_t>(x), count - 1);
+    float t = std::min(x - static_cast<float>(i), ONE_MINUS_EPSILON);
+    const float threshold = table[i].threshold;
+    if(t < threshold)
+    {
+        t = t / threshold;
+    }
+    else
+    {
+        t = (t - threshold) / (1.0f - threshold);
+        i = table[i].alias;
+    }
+    u = std::min(std::max(t, 0.0f), ONE_MINUS_EPSILON);
+    return i;
+}
+
+void pt::build_alias_table(const float* weights, size_t count, double sum, AliasEntry* table)
+{
+    if(count == 0) return;
+    if(!(sum > 0.0))
+    {
+        for(size_t i = 0; i < count; i++)
+            table[i] = { 1.0f, static_cast<uint32_t>(i), 1.0f / static_cast<float>(count) };
+        return;
+    }
+
+    // Every bucket holds the probability 1 / count: an entry with less probability is topped up by an entry with more.
+    std::vector<double> scaled(count);
+    std::vector<uint32_t> small, large;
+    small.reserve(count);
+    large.reserve(count);
+    for(size_t i = 0; i < count; i++)
+    {
+        scaled[i] = static_cast<double>(weights[i]) * static_cast<double>(count) / sum;
+        table[i].probability = static_cast<float>(static_cast<double>(weights[i]) / sum);
+        (scaled[i] < 1.0 ? small : large).push_back(static_cast<uint32_t>(i));
+    }
+    while(!small.empty() && !large.empty())
+    {
+        const uint32_t s = small.back();
+        const uint32_t l = large.back();
+        small.pop_back();
+        table[s].threshold = static_cast<float>(scaled[s]);
+        table[s].alias = l;
+        scaled[l] = (scaled[l] + scaled[s]) - 1.0;
+        if(scaled[l] < 1.0)
+        {
+            large.pop_back();
+            small.push_back(l);
+        }
+    }
+    // the remaining entries fill their buckets up to rounding errors
+    for(uint32_t i : large)
+        table[i] = { 1.0f, i, table[i].probability };
+    for(uint32_t i : small)
+        table[i] = { 1.0f, i, table[i].probability };
+}
+
+void pt::EnvironmentSampler::build(ThreadPool& pool, const float* rgba, uint32_t width, uint32_t height)
+{
+    if(width == 0 || height == 0)
+        throw std::invalid_argument("[pt::EnvironmentSampler::build]: The resolution must not be 0.");
+    const size_t pixel_count = static_cast<size_t>(width) * height;
+    if(pixel_count + height > UINT32_MAX)
+        throw std::invalid_argument("[pt::EnvironmentSampler::build]: The environment map has too many pixels, the shaders index the tables with 32 bit.");
+
+    std::vector<float> weights(pixel_count);
+    std::vector<double> prefix(pixel_count);
+    auto for_each_row_block = [&pool, height](const std::function<void(uint32_t, uint32_t)>& f) {
+        std::vector<std::future<void>> tasks;
+        for(uint32_t first = 0; first < height; first += ROWS_PER_TASK)
+        {
+            const uint32_t last = std::min(first + ROWS_PER_TASK, height);
+            tasks.push_back(pool.submit([&f, first, last]() { f(first, last); }));
+        }
+        pool.wait_all(tasks);
+    };
+
+    // the luminance of a pixel is weighted by the solid angle it covers, the rows at the poles are compressed
+    for_each_row_block([&](uint32_t first, uint32_t last) {
+        for(uint32_t y = first; y < last; y++)
+        {
+            const float c = row_cosine(y, height);
+            for(uint32_t x = 0; x < width; x++)
+            {
+                const float* p = rgba + (static_cast<size_t>(y) * width + x) * 4;
+                const float l = LUMINANCE[0] * p[0] + LUMINANCE[1] * p[1] + LUMINANCE[2] * p[2];
+                // NaN and negative values of broken images don't get any sample
+                weights[static_cast<size_t>(y) * width + x] = (l > 0.0f && std::isfinite(l)) ? l * c : 0.0f;
+            }
+        }
+    });
+    double sum = parallel_prefix_sum(pool, weights.data(), prefix.data(), pixel_count);
+
+    // a black environment is sampled uniformly over the sphere
+    if(!(sum > 0.0))
+    {
+        for_each_row_block([&](uint32_t first, uint32_t last) {
+            for(uint32_t y = first; y < last; y++)
+                std::fill_n(weights.data() + static_cast<size_t>(y) * width, width, row_cosine(y, height));
+        });
+        sum = parallel_prefix_sum(pool, weights.data(), prefix.data(), pixel_count);
+    }
+
+    // the sum of a row is the difference of the prefix sums at its ends
+    std::vector<double> row_sums(height);
+    std::vector<float> row_weights(height);
+    for(uint32_t y = 0; y < height; y++)
+    {
+        const double before = (y > 0) ? prefix[static_cast<size_t>(y) * width - 1] : 0.0;
+        row_sums[y] = std::max(prefix[static_cast<size_t>(y + 1) * width - 1] - before, 0.0);
+        row_weights[y] = static_cast<float>(row_sums[y]);
+    }
+    prefix = {};
+
+    this->table.resize(pixel_count + height);
+    build_alias_table(row_weights.data(), height, sum, this->table.data());
+    for_each_row_block([&](uint32_t first, uint32_t last) {
+        for(uint32_t y = first; y < last; y++)
+            build_alias_table(weights.data() + static_cast<size_t>(y) * width, width, row_sums[y], this->table.data() + height + static_cast<size_t>(y) * width);
+    });
+    this->width = width;
+    this->height = height;
+}
+
+float pt::EnvironmentSampler::sample(float u0, float u1, float direction[3]) const noexcept
+{
+    if(this->table.empty())
+    {
+        direction[0] = 0.0f;
+        direction[1] = 1.0f;
+        direction[2] = 0.0f;
+        return 0.0f;
+    }
+    const uint32_t y = sample_alias(this->table.data(), this->height, u0);
+    const AliasEntry* row = this->table.data() + this->height + static_cast<size_t>(y) * this->width;
+    const uint32_t x = sample_alias(row, this->width, u1);
+
+    // same mapping as the environment lookup of the shaders: u = atan(z, x) / 2pi + 0.5, v = asin(y) / pi + 0.5
+    const float u = (static_cast<float>(x) + u1) / static_cast<float>(this->width);
+    const float v = (static_cast<float>(y) + u0) / static_cast<float>(this->height);
+    const float phi = (u - 0.5f) * 2.0f * PI;
+    const float latitude = (v - 0.5f) * PI;
+    const float cos_latitude = std::cos(latitude);
+    direction[0] = cos_latitude * std::cos(phi);
+    direction[1] = std::sin(latitude);
+    direction[2] = cos_latitude * std::sin(phi);
+    if(cos_latitude <= 0.0f) return 0.0f;
+
+    // the density is constant in (u, v), a pixel covers 2pi^2 cos(latitude) / (width * height) of the sphere
+    const float p = this->table[y].probability * row[x].probability;
+    return p * static_cast<float>(this->width) * static_cast<float>(this->height) / (2.0f * PI * PI * cos_latitude);
+}
+
+float pt::EnvironmentSampler::pdf(const float direction[3]) const noexcept
+{
+    const float d1 = std::min(std::max(direction[1], -1.0f), 1.0f);
+    const float cos_latitude = std::sqrt(std::max(1.0f - d1 * d1, 0.0f));
+    if(cos_latitude <= 0.0f || this->table.empty()) return 0.0f;
+
+    const float u = std::atan2(direction[2], direction[0]) / (2.0f * PI) + 0.5f;
+    const float v = std::asin(d1) / PI + 0.5f;
+    const uint32_t x = std::min(static_cast<uint32_t>(std::max(u, 0.0f) * static_cast<float>(this->width)), this->width - 1);
+    const uint32_t y = std::min(static_cast<uint32_t>(std::max(v, 0.0f) * static_cast<float>(this->height)), this->height - 1);
+    const float p = this->table[y].probability * this->table[this->height + static_cast<size_t>(y) * this->width + x].probability;
+    return p * static_cast<float>(this->width) * static_cast<float>(this->height) / (2.0f * PI * PI * cos_latitude);
+}
+
+void pt::PathTracer::load_environment_distribution(void)
+{
+    const VkExtent3D extent = this->environment_image.extent;
+    this->environment_sampler.build(this->loaders, static_cast<const float*>(this->environment_image.data), extent.width, extent.height);
+
+    const std::vector<AliasEntry>& table = this->environment_sampler.get_table();
+    const VkDeviceSize size = table.size() * sizeof(AliasEntry);
+    this->init_device_buffer(this->environment_alias, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, size);
+
+    vka::Buffer staging(this->setup->get_physical_device(), this->setup->get_device());
+    staging.set_create_flags(0);
+    staging.set_create_size(size);
+    staging.set_create_usage(VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
+    staging.set_create_sharing_mode(VK_SHARING_MODE_EXCLUSIVE);
+    staging.set_create_queue_families(&this->setup->get_rt_queue_info().queueFamilyIndex, 1);
+    staging.set_memory_properties(VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    if(staging.create() != VK_SUCCESS)
+        throw std::runtime_error("[pt::PathTracer::load_environment_distribution]: Failed to create alias table staging buffer.");
+
+    std::copy(table.begin(), table.end(), static_cast<AliasEntry*>(staging.map(size, 0)));
+    staging.unmap();
+
+    std::lock_guard<std::mutex> lock(this->queue_mtx);
+    VkCommandBuffer cbo = vka::Buffer::enqueue_copy(this->setup->get_device(), this->cmd_pool, 1, &staging, &this->environment_alias);
+    const VkResult result = vka::utility::execute_scb(this->setup->get_device(), this->cmd_pool, this->setup->get_rt_queue(), 1, &cbo);
+    vkFreeCommandBuffers(this->setup->get_device(), this->cmd_pool, 1, &cbo);
+    if(result != VK_SUCCESS)
+        throw std::runtime_error("[pt::PathTracer::load_environment_distribution]: Failed to copy staging buffer.");
+    this->environment_size += size;
+}
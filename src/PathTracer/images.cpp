@@ -1,77 +1,142 @@
 #include "../application.h"
 
-void pt::PathTracer::create_render_images(void)
+void pt::PathTracer::create_storage_image(RtImage& img, VkFormat format, VkImageUsageFlags usage)
 {
-    constexpr VkFormat ROP_FORMAT = VK_FORMAT_R8G8B8A8_UNORM;
-    constexpr VkFormat OUT_FORMAT = VK_FORMAT_R8G8B8A8_UNORM;
-
-    VkExtent3D rop_extent = {
-        this->setup->get_settings()->rt_width,
-        this->setup->get_settings()->rt_height,
-        1
-    };
-
-    /* CREATE ROP IMAGE */
     VkImageCreateInfo image_ci = {};
     image_ci.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
     image_ci.pNext = nullptr;
     image_ci.flags = 0;
     image_ci.imageType = VK_IMAGE_TYPE_2D;
-    image_ci.format = ROP_FORMAT;
-    image_ci.extent = rop_extent;
+    image_ci.format = format;
+    image_ci.extent = { this->render_extent.width, this->render_extent.height, 1 };
     image_ci.mipLevels = 1;
     image_ci.arrayLayers = 1;
     image_ci.samples = VK_SAMPLE_COUNT_1_BIT;
     image_ci.tiling = VK_IMAGE_TILING_OPTIMAL;
-    image_ci.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+    image_ci.usage = VK_IMAGE_USAGE_STORAGE_BIT | usage;
     image_ci.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
     image_ci.queueFamilyIndexCount = 1;
     image_ci.pQueueFamilyIndices = &this->setup->get_rt_queue_info().queueFamilyIndex;
     image_ci.initialLayout = VK_IMAGE_LAYOUT_PREINITIALIZED;
 
-    if(vkCreateImage(this->setup->get_device(), &image_ci, nullptr, &this->render_target.image) != VK_SUCCESS)
-        throw std::runtime_error("[pt::PathTracer::create_ropi]: Failed to create rop image.");
+    if(vkCreateImage(this->setup->get_device(), &image_ci, nullptr, &img.image) != VK_SUCCESS)
+        throw std::runtime_error("[pt::PathTracer::create_storage_image]: Failed to create storage image.");
 
     // get memory requierements for the image
-    VkMemoryRequirements rop_req;
-    vkGetImageMemoryRequirements(this->setup->get_device(), this->render_target.image, &rop_req);
+    VkMemoryRequirements req;
+    vkGetImageMemoryRequirements(this->setup->get_device(), img.image, &req);
 
-    // allocate acutal memory for rops
+    // allocate acutal memory for the image
     VkMemoryAllocateInfo mem_ai = {};
     mem_ai.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
     mem_ai.pNext = nullptr;
-    mem_ai.allocationSize = rop_req.size;
-    mem_ai.memoryTypeIndex = vka::utility::find_memory_type_index(this->setup->get_physical_device(), rop_req.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    mem_ai.allocationSize = req.size;
+    mem_ai.memoryTypeIndex = vka::utility::find_memory_type_index(this->setup->get_physical_device(), req.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 
-    if(vkAllocateMemory(this->setup->get_device(), &mem_ai, nullptr, &this->render_target.mem) != VK_SUCCESS)
-        throw std::runtime_error("[pt::PathTracer::create_ropi]: Failed to allocate memory for rop image.");
+    if(vkAllocateMemory(this->setup->get_device(), &mem_ai, nullptr, &img.mem) != VK_SUCCESS)
+        throw std::runtime_error("[pt::PathTracer::create_storage_image]: Failed to allocate memory for storage image.");
 
     // associate image with its memory
-    if(vkBindImageMemory(this->setup->get_device(), this->render_target.image, this->render_target.mem, 0) != VK_SUCCESS)
-        throw std::runtime_error("[pt::PathTracer::create_ropi]: Failed to bind memory to rop image.");
+    if(vkBindImageMemory(this->setup->get_device(), img.image, img.mem, 0) != VK_SUCCESS)
+        throw std::runtime_error("[pt::PathTracer::create_storage_image]: Failed to bind memory to storage image.");
 
     // create image view
-    VkImageViewCreateInfo ropv_ci = {};
-    ropv_ci.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-    ropv_ci.pNext = nullptr;
-    ropv_ci.flags = 0;
-    ropv_ci.image = this->render_target.image;
-    ropv_ci.viewType = VK_IMAGE_VIEW_TYPE_2D;
-    ropv_ci.format = ROP_FORMAT;
-    ropv_ci.components = {};
-    ropv_ci.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    ropv_ci.subresourceRange.baseMipLevel = 0;
-    ropv_ci.subresourceRange.levelCount = 1;
-    ropv_ci.subresourceRange.baseArrayLayer = 0;
-    ropv_ci.subresourceRange.layerCount = 1;
-
-    if(vkCreateImageView(this->setup->get_device(), &ropv_ci, nullptr, &this->render_target.view) != VK_SUCCESS)
-        throw std::runtime_error("[pt::PathTracer::create_ropi]: Failed to create rop image view.");
+    VkImageViewCreateInfo view_ci = {};
+    view_ci.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    view_ci.pNext = nullptr;
+    view_ci.flags = 0;
+    view_ci.image = img.image;
+    view_ci.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    view_ci.format = format;
+    view_ci.components = {};
+    view_ci.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    view_ci.subresourceRange.baseMipLevel = 0;
+    view_ci.subresourceRange.levelCount = 1;
+    view_ci.subresourceRange.baseArrayLayer = 0;
+    view_ci.subresourceRange.layerCount = 1;
+
+    if(vkCreateImageView(this->setup->get_device(), &view_ci, nullptr, &img.view) != VK_SUCCESS)
+        throw std::runtime_error("[pt::PathTracer::create_storage_image]: Failed to create storage image view.");
+}
+
+void pt::PathTracer::create_render_images(void)
+{
+    constexpr VkFormat ROP_FORMAT = VK_FORMAT_R8G8B8A8_UNORM;
+    constexpr VkFormat ACCUMULATION_FORMAT = VK_FORMAT_R32G32B32A32_SFLOAT;
+    constexpr VkFormat SAMPLE_COUNT_FORMAT = VK_FORMAT_R32_UINT;
+    constexpr VkFormat FEATURE_FORMAT = VK_FORMAT_R16G16B16A16_SFLOAT;
+    constexpr VkFormat FIRST_HIT_FORMAT = VK_FORMAT_R32G32B32A32_UINT;
+    constexpr VkFormat OUT_FORMAT = VK_FORMAT_R8G8B8A8_UNORM;
+
+    VkExtent3D rop_extent = {
+        this->render_extent.width,
+        this->render_extent.height,
+        1
+    };
+
+    /* CREATE ROP IMAGE */
+    this->create_storage_image(this->render_target, ROP_FORMAT, VK_IMAGE_USAGE_TRANSFER_SRC_BIT);
+
+    /* CREATE ACCUMULATION IMAGE */
+    // Holds the mean of all samples per pixel in full precision, the render target
+    // only receives the 8 bit result.
+    this->create_storage_image(this->accumulation_image, ACCUMULATION_FORMAT, VK_IMAGE_USAGE_TRANSFER_SRC_BIT);
+
+    /* CREATE SAMPLE COUNT IMAGE */
+    // Adaptive sampling traces the pixels a different number of times,
+    // the mean of a pixel is updated with its own sample count.
+    this->create_storage_image(this->sample_count_image, SAMPLE_COUNT_FORMAT, VK_IMAGE_USAGE_TRANSFER_SRC_BIT);
+
+    /* CREATE FEATURE IMAGES */
+    // Albedo and normal of the first hit guide the denoiser. Half precision is enough for them,
+    // the alpha channel counts the samples of the features, see main.rgen.
+    this->create_storage_image(this->albedo_image, FEATURE_FORMAT, VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT);
+    this->create_storage_image(this->normal_image, FEATURE_FORMAT, VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT);
+
+    /* CREATE FIRST HIT IMAGE */
+    // Depth and IDs of the first sample of a pixel, written as output variables next to the color.
+    this->create_storage_image(this->first_hit_image, FIRST_HIT_FORMAT, VK_IMAGE_USAGE_TRANSFER_SRC_BIT);
+
+    /* CREATE TILE MASK */
+    // The host writes the mask between two submissions, so it stays in host visible memory.
+    const uint32_t tiles_x = (this->render_extent.width + ADAPTIVE_TILE_SIZE - 1) / ADAPTIVE_TILE_SIZE;
+    const uint32_t tiles_y = (this->render_extent.height + ADAPTIVE_TILE_SIZE - 1) / ADAPTIVE_TILE_SIZE;
+    this->tile_mask.set_device(this->setup->get_device());
+    this->tile_mask.set_physical_device(this->setup->get_physical_device());
+    this->tile_mask.set_create_flags(0);
+    this->tile_mask.set_create_size(static_cast<VkDeviceSize>(tiles_x) * tiles_y * sizeof(uint32_t));
+    this->tile_mask.set_create_usage(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+    this->tile_mask.set_create_sharing_mode(VK_SHARING_MODE_EXCLUSIVE);
+    this->tile_mask.set_create_queue_families(&this->setup->get_rt_queue_info().queueFamilyIndex, 1);
+    this->tile_mask.set_memory_properties(VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    if(this->tile_mask.create() != VK_SUCCESS)
+        throw std::runtime_error("[pt::PathTracer::create_ropi]: Failed to create tile mask.");
+    this->tile_mask_valid = false;
+
+    VkImageSubresourceRange subresource_range = {};
+    subresource_range.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    subresource_range.baseMipLevel = 0;
+    subresource_range.levelCount = 1;
+    subresource_range.baseArrayLayer = 0;
+    subresource_range.layerCount = 1;
 
     /* CREATE OUTPUT IMAGE */
+    VkImageCreateInfo image_ci = {};
+    image_ci.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    image_ci.pNext = nullptr;
+    image_ci.flags = 0;
+    image_ci.imageType = VK_IMAGE_TYPE_2D;
     image_ci.format = OUT_FORMAT;
+    image_ci.extent = rop_extent;
+    image_ci.mipLevels = 1;
+    image_ci.arrayLayers = 1;
+    image_ci.samples = VK_SAMPLE_COUNT_1_BIT;
     image_ci.tiling = VK_IMAGE_TILING_LINEAR;
     image_ci.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    image_ci.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    image_ci.queueFamilyIndexCount = 1;
+    image_ci.pQueueFamilyIndices = &this->setup->get_rt_queue_info().queueFamilyIndex;
+    image_ci.initialLayout = VK_IMAGE_LAYOUT_PREINITIALIZED;
 
     if(vkCreateImage(this->setup->get_device(), &image_ci, nullptr, &this->output_image.image) != VK_SUCCESS)
         throw std::runtime_error("[pt::PathTracer::create_ropi]: Failed to create output image.");
@@ -80,6 +145,9 @@ void pt::PathTracer::create_render_images(void)
     VkMemoryRequirements out_req;
     vkGetImageMemoryRequirements(this->setup->get_device(), this->output_image.image, &out_req);
 
+    VkMemoryAllocateInfo mem_ai = {};
+    mem_ai.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    mem_ai.pNext = nullptr;
     mem_ai.allocationSize = out_req.size;
     mem_ai.memoryTypeIndex = vka::utility::find_memory_type_index(this->setup->get_physical_device(), out_req.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
 
@@ -90,8 +158,9 @@ void pt::PathTracer::create_render_images(void)
     if(vkBindImageMemory(this->setup->get_device(), this->output_image.image, this->output_image.mem, 0) != VK_SUCCESS)
         throw std::runtime_error("[pt::PathTracer::create_ropi]: Failed to bind memory to output image.");
 
-    // make a layout transicon for both images
-    // both images need a VK_IMAGE_LAYOUT_GENERAL
+    // make a layout transicon for all images
+    // the storage images need a VK_IMAGE_LAYOUT_GENERAL
+    std::lock_guard<std::mutex> lock(this->queue_mtx);
     VkCommandBufferAllocateInfo ai = {};
     ai.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
     ai.pNext = nullptr;
@@ -112,7 +181,7 @@ void pt::PathTracer::create_render_images(void)
     if(vkBeginCommandBuffer(cmdbuff, &bi) != VK_SUCCESS)
         throw std::runtime_error("[pt::PathTracer::create_ropi]: Failed to record command buffer for ROP's image layout transicon.");
 
-    VkImageMemoryBarrier barriers[2];
+    VkImageMemoryBarrier barriers[7];
     barriers[0].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
     barriers[0].pNext = nullptr;
     barriers[0].srcAccessMask = VK_ACCESS_NONE_KHR;         // there was no access before
@@ -122,18 +191,35 @@ void pt::PathTracer::create_render_images(void)
     barriers[0].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
     barriers[0].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
     barriers[0].image = this->render_target.image;
-    barriers[0].subresourceRange = ropv_ci.subresourceRange;
-
-    barriers[1].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-    barriers[1].pNext = nullptr;
-    barriers[1].srcAccessMask = VK_ACCESS_NONE_KHR;             // there was no access before
-    barriers[1].dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;   // we want to write to the image in the curse of the copy operation
-    barriers[1].oldLayout = VK_IMAGE_LAYOUT_PREINITIALIZED;
-    barriers[1].newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-    barriers[1].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-    barriers[1].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-    barriers[1].image = this->output_image.image;
-    barriers[1].subresourceRange = ropv_ci.subresourceRange;
+    barriers[0].subresourceRange = subresource_range;
+
+    // the accumulation image is read and written by the ray generation shader
+    barriers[1] = barriers[0];
+    barriers[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    barriers[1].image = this->accumulation_image.image;
+
+    // so is the sample count image
+    barriers[2] = barriers[1];
+    barriers[2].image = this->sample_count_image.image;
+
+    // and the feature images
+    barriers[3] = barriers[1];
+    barriers[3].image = this->albedo_image.image;
+    barriers[4] = barriers[1];
+    barriers[4].image = this->normal_image.image;
+    barriers[5] = barriers[1];
+    barriers[5].image = this->first_hit_image.image;
+
+    barriers[6].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barriers[6].pNext = nullptr;
+    barriers[6].srcAccessMask = VK_ACCESS_NONE_KHR;             // there was no access before
+    barriers[6].dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;   // we want to write to the image in the curse of the copy operation
+    barriers[6].oldLayout = VK_IMAGE_LAYOUT_PREINITIALIZED;
+    barriers[6].newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barriers[6].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barriers[6].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barriers[6].image = this->output_image.image;
+    barriers[6].subresourceRange = subresource_range;
 
     vkCmdPipelineBarrier(
         cmdbuff, 
@@ -144,7 +230,7 @@ void pt::PathTracer::create_render_images(void)
         nullptr,
         0,
         nullptr,
-        1,
+        6,
         barriers + 0
     );
 
@@ -158,7 +244,7 @@ void pt::PathTracer::create_render_images(void)
         0,
         nullptr,
         1,
-        barriers + 1
+        barriers + 6
     );
 
     if(vkEndCommandBuffer(cmdbuff) != VK_SUCCESS)
@@ -183,3 +269,31 @@ void pt::PathTracer::create_render_images(void)
         throw std::runtime_error("[pt::PathTracer::create_ropi]: Failed to wait for queue.");
     vkFreeCommandBuffers(this->setup->get_device(), this->cmd_pool, 1, &cmdbuff);
 }
+
+void pt::PathTracer::destroy_render_images(void)
+{
+    vkDestroyImageView(this->setup->get_device(), this->render_target.view, nullptr);
+    vkDestroyImageView(this->setup->get_device(), this->accumulation_image.view, nullptr);
+    vkDestroyImageView(this->setup->get_device(), this->sample_count_image.view, nullptr);
+    vkDestroyImageView(this->setup->get_device(), this->albedo_image.view, nullptr);
+    vkDestroyImageView(this->setup->get_device(), this->normal_image.view, nullptr);
+    vkDestroyImageView(this->setup->get_device(), this->first_hit_image.view, nullptr);
+    vkFreeMemory(this->setup->get_device(), this->render_target.mem, nullptr);
+    vkFreeMemory(this->setup->get_device(), this->accumulation_image.mem, nullptr);
+    vkFreeMemory(this->setup->get_device(), this->sample_count_image.mem, nullptr);
+    vkFreeMemory(this->setup->get_device(), this->albedo_image.mem, nullptr);
+    vkFreeMemory(this->setup->get_device(), this->normal_image.mem, nullptr);
+    vkFreeMemory(this->setup->get_device(), this->first_hit_image.mem, nullptr);
+    vkFreeMemory(this->setup->get_device(), this->output_image.mem, nullptr);
+    vkDestroyImage(this->setup->get_device(), this->render_target.image, nullptr);
+    vkDestroyImage(this->setup->get_device(), this->accumulation_image.image, nullptr);
+    vkDestroyImage(this->setup->get_device(), this->sample_count_image.image, nullptr);
+    vkDestroyImage(this->setup->get_device(), this->albedo_image.image, nullptr);
+    vkDestroyImage(this->setup->get_device(), this->normal_image.image, nullptr);
+    vkDestroyImage(this->setup->get_device(), this->first_hit_image.image, nullptr);
+    vkDestroyImage(this->setup->get_device(), this->output_image.image, nullptr);
+    for(RtImage* img : { &this->render_target, &this->accumulation_image, &this->sample_count_image, &this->albedo_image,
+                         &this->normal_image, &this->first_hit_image, &this->output_image })
+        *img = {};
+    this->tile_mask.clear();
+}
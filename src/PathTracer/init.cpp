@@ -1,11 +1,64 @@
 #include "../application.h"
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+    // a submission that takes longer delays the check of the limits
+    constexpr uint64_t TARGET_SUBMISSION_NS = 50000000;
+    // the noise is estimated again after the samples grew by this factor, the estimation reads back the whole image
+    constexpr double NOISE_CHECK_GROWTH = 1.25;
+    // the variance of fewer samples is too unreliable to stop tracing a tile
+    constexpr uint32_t ADAPTIVE_MIN_SAMPLES = 16;
+
+    inline uint64_t elapsed_ns(std::chrono::steady_clock::time_point begin)
+    {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin).count());
+    }
+}
 
 pt::PathTracer::PathTracer(void)
 {
     this->initialized = false;
     this->setup = nullptr;
+    this->load_settings = nullptr;
     this->model_load_callback = nullptr;
     this->texture_load_callback = nullptr;
+    this->info_callback = nullptr;
+    this->load_stats = {};
+    this->environment_image = {};
+    this->environment_size = 0;
+    // the handles are null until they are created, so 'destroy' can release a partial initialization
+    this->render_target = {};
+    this->accumulation_image = {};
+    this->sample_count_image = {};
+    this->albedo_image = {};
+    this->normal_image = {};
+    this->first_hit_image = {};
+    this->output_image = {};
+    this->cmd_pool = VK_NULL_HANDLE;
+    this->timer_query_pool = VK_NULL_HANDLE;
+    this->blas = {};
+    this->tlas = {};
+    this->rtp = {};
+    this->render_extent = {0, 0};
+    this->accumulated_samples = 0;
+    this->first_sample = 0;
+    this->tile_mask_valid = false;
+    this->features = false;
+    this->accumulated_ns = 0;
+    this->active_pixels = 0;
+    this->frame_extent = {0, 0};
+    this->tile_offset = {0, 0};
+
+    // same view as the camera that was hard-coded into the ray generation shader before
+    this->camera.position = glm2::vec3(0.0f, 0.0f, -5.0f);
+    this->camera.target = glm2::vec3(0.0f, 0.0f, 0.0f);
+    this->camera.up = glm2::vec3(0.0f, 1.0f, 0.0f);
+    this->camera.fov = 90.0f;
+    this->camera.aspect = 0.0f;
+    this->camera.aperture = 0.0f;
+    this->camera.focus_distance = 1.0f;
 }
 
 void pt::PathTracer::set_model_load_callback(loadmsg_callback_t callback)
@@ -17,26 +70,149 @@ void pt::PathTracer::set_texture_load_callback(loadmsg_callback_t callback)
     this->texture_load_callback = callback;
 }
 
+void pt::PathTracer::set_info_callback(loadmsg_callback_t callback)
+{
+    this->info_callback = callback;
+}
+
+void pt::PathTracer::set_load_settings(const Settings* settings)
+{
+    if(settings == nullptr)
+        throw std::invalid_argument("[pt::PathTracer::set_load_settings]: The settings must not be a nullptr.");
+    this->load_settings = settings;
+    this->submit_loading();
+}
+
 void pt::PathTracer::init(const Setup* setup)
 {
     if(this->initialized) return;
     if(setup == nullptr)
         throw std::invalid_argument("[pt::PathTracer::init]: Setup in pt::PathTracer::init must not be a nullptr.");
     this->setup = setup;
+    this->render_extent = {setup->get_settings()->rt_width, setup->get_settings()->rt_height};
+    this->reset_accumulation();
 
-    this->create_pools();
-    this->create_render_images();
-    this->create_render_models();
-    this->create_render_materials();
-    this->create_acceleration_structure();
-    this->create_shaders();
-    this->create_shader_groups();
-    this->create_descriptors();
-    this->create_pipeline();
-    this->create_sbt();
+    const auto init_begin = std::chrono::steady_clock::now();
+    if(this->load_settings != nullptr && this->load_settings->load_threads != setup->get_settings()->load_threads)
+        this->notify(this->info_callback, "The loading threads were started with the load settings, the number of loading threads of the setup is not used.");
+    this->load_settings = setup->get_settings();
+    try
+    {
+        this->init_steps();
+    }
+    catch(...)
+    {
+        // the steps that finished created device objects, they are released as if the initialization was complete
+        this->initialized = true;
+        this->destroy();
+        throw;
+    }
+
+    this->load_stats.init_ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - init_begin).count());
+    this->log_init_timings();
+    this->release_scratch();
+    this->watch_assets();
     this->initialized = true;
 }
 
+void pt::PathTracer::init_steps(void)
+{
+    this->create_pools();
+    this->submit_loading();
+
+    // The initialization steps are executed as soon as the steps they depend on are finished.
+    // Decoding the textures, uploading the models and building the acceleration structures,
+    // and compiling the shaders are independent chains that overlap.
+    TaskGraph graph;
+    const size_t images         = graph.add("render images",            [this]() { this->create_render_images(); });
+    const size_t parse          = graph.add("parse models",             [this]() { this->parse_render_models(); });
+    const size_t environment    = graph.add("decode environment",       [this]() { this->decode_environment_image(); });
+    const size_t decode         = graph.add("decode textures",          [this]() { this->decode_render_materials(); }, { parse });
+    const size_t models         = graph.add("upload models",            [this]() { this->upload_render_models(); }, { parse });
+    const size_t opacity        = graph.add("opacity masks",            [this]() {
+        this->classify_meshes(std::vector<bool>(this->materials.size(), true));
+        this->load_opacity_buffer();
+    }, { decode });
+    const size_t materials      = graph.add("upload textures",          [this]() { this->create_render_materials(); }, { decode, environment, opacity });
+    const size_t as             = graph.add("acceleration structures",  [this]() { this->create_acceleration_structure(); }, { models, opacity });
+    const size_t lights         = graph.add("light table",              [this]() { this->load_light_table(); }, { decode, models });
+    const size_t shaders        = graph.add("shaders",                  [this]() { this->create_shaders(); });
+    const size_t blue_noise     = graph.add("blue noise",               [this]() { this->load_blue_noise(); });
+    const size_t groups         = graph.add("shader groups",            [this]() { this->create_shader_groups(); }, { shaders, opacity });
+    const size_t descriptors    = graph.add("descriptors",              [this]() { this->create_descriptors(); }, { images, materials, as, lights, blue_noise, opacity });
+    const size_t pipeline       = graph.add("pipeline",                 [this]() { this->create_pipeline(); }, { descriptors, groups });
+    graph.add("shader binding table", [this]() { this->create_sbt(); }, { pipeline });
+    graph.run(this->loaders);
+
+    this->load_stats.init_timings = graph.timings();
+    this->load_stats.init_critical_path_ns = graph.critical_path_ns();
+}
+
+void pt::PathTracer::cancel_loading(void)
+{
+    // Tasks that are already running finish in the background, they only reference their jobs. They still
+    // allocate from the scratch arenas, so the jobs are kept until they are waited for before the arenas are reset.
+    for(const auto& job : this->model_jobs)
+    {
+        job->cancelled = true;
+        this->cancelled_jobs.push_back(job);
+    }
+    if(this->environment_job != nullptr)
+    {
+        this->environment_job->cancelled = true;
+        this->cancelled_jobs.push_back(this->environment_job);
+    }
+    this->model_jobs.clear();
+    this->environment_job.reset();
+}
+
+void pt::PathTracer::wait_for_cancelled(void)
+{
+    // The results of cancelled jobs are not used, so their errors are ignored.
+    for(const auto& job : this->cancelled_jobs)
+        if(job->started) this->loaders.wait(job->done);
+    this->cancelled_jobs.clear();
+}
+
+void pt::PathTracer::notify(loadmsg_callback_t callback, const std::string& msg)
+{
+    if(callback == nullptr) return;
+    std::lock_guard<std::mutex> lock(this->callback_mtx);
+    callback(msg);
+}
+
+void pt::PathTracer::log_init_timings(void)
+{
+    uint64_t sum = 0;
+    for(const TaskTiming& t : this->load_stats.init_timings)
+    {
+        sum += t.end_ns - t.begin_ns;
+        this->notify(this->info_callback,
+            "Init step \"" + t.name + "\" ran from " + std::to_string(t.begin_ns / 1000000) + " ms to " +
+            std::to_string(t.end_ns / 1000000) + " ms."
+        );
+    }
+    this->notify(this->info_callback,
+        "Initialization took " + std::to_string(this->load_stats.init_ns / 1000000) + " ms, the longest chain of steps took " +
+        std::to_string(this->load_stats.init_critical_path_ns / 1000000) + " ms and all steps together took " + std::to_string(sum / 1000000) + " ms."
+    );
+}
+
+void pt::PathTracer::release_scratch(void)
+{
+    // the scratch memory is only used while loading, after the initialization it is returned to the heap
+    const ScratchStatistics stats = ScratchArena::statistics();
+    this->load_stats.scratch_allocations = stats.allocation_count;
+    this->load_stats.scratch_peak_bytes = stats.peak_bytes;
+    this->wait_for_cancelled();
+    ScratchArena::reset_all();
+
+    this->notify(this->info_callback,
+        "Loading made " + std::to_string(stats.allocation_count) + " scratch allocations, peak scratch memory was " +
+        std::to_string(stats.peak_bytes) + " bytes."
+    );
+}
+
 void pt::PathTracer::destroy(void)
 {
     if(!this->initialized) return;
@@ -44,25 +220,14 @@ void pt::PathTracer::destroy(void)
     // wait for device to finish all operations before destroying objects
     vkDeviceWaitIdle(this->setup->get_device());
 
-    // destroy SBT
-    this->sbt.buff.clear();
-
-    // destroy pipeline
-    vkDestroyPipelineLayout(this->setup->get_device(), this->rtp.layout, nullptr);
-    vkDestroyPipeline(this->setup->get_device(), this->rtp.pipeline, nullptr);
-
-    // destroy descriptors
-    this->descriptors.clear();
+    // destroy SBT, pipeline and descriptors
+    this->destroy_pipeline();
 
     // destroy shaders
     this->stages.clear();
 
     // destroy acceleration structures
-    this->tlibo.clear();
-    vkFreeMemory(this->setup->get_device(), this->blas.memory, nullptr);
-    vkFreeMemory(this->setup->get_device(), this->tlas.memory, nullptr);
-    detail::vkDestroyAccelerationStructureNV(this->setup->get_device(), this->blas.as, nullptr);
-    detail::vkDestroyAccelerationStructureNV(this->setup->get_device(), this->tlas.as, nullptr);
+    this->destroy_acceleration_structure();
 
     // destroy render materials
     this->mtl_buffer.clear();
@@ -73,6 +238,10 @@ void pt::PathTracer::destroy(void)
         mtl.texture.rman.clear();
     }
     this->environment.clear();
+    this->environment_alias.clear();
+    this->light_buffer.clear();
+    this->opacity_buffer.clear();
+    this->blue_noise_buffer.clear();
 
     // destroy render models
     for(auto& model : this->models)
@@ -86,22 +255,81 @@ void pt::PathTracer::destroy(void)
     }
 
     // destroy render images
-    vkDestroyImageView(this->setup->get_device(), this->render_target.view, nullptr);
-    vkFreeMemory(this->setup->get_device(), this->render_target.mem, nullptr);
-    vkFreeMemory(this->setup->get_device(), this->output_image.mem, nullptr);
-    vkDestroyImage(this->setup->get_device(), this->render_target.image, nullptr);
-    vkDestroyImage(this->setup->get_device(), this->output_image.image, nullptr);
+    this->destroy_render_images();
 
     // destroy pool(s)
     vkDestroyQueryPool(this->setup->get_device(), this->timer_query_pool, nullptr);
     vkDestroyCommandPool(this->setup->get_device(), this->cmd_pool, nullptr);
+    this->timer_query_pool = VK_NULL_HANDLE;
+    this->cmd_pool = VK_NULL_HANDLE;
+    this->loaders.stop();
+    this->watcher.clear();
+    this->watched.clear();
     this->initialized = false;
 }
 
-uint64_t pt::PathTracer::run(void)
+void pt::PathTracer::destroy_pipeline(void)
+{
+    // the SBT contains the shader group handles of the pipeline and the pipeline layout contains the descriptor set layouts
+    this->sbt.buff.clear();
+    vkDestroyPipelineLayout(this->setup->get_device(), this->rtp.layout, nullptr);
+    vkDestroyPipeline(this->setup->get_device(), this->rtp.pipeline, nullptr);
+    this->rtp = {};
+    this->descriptors.clear();
+}
+
+void pt::PathTracer::destroy_acceleration_structure(void)
+{
+    this->tlibo.clear();
+    vkFreeMemory(this->setup->get_device(), this->blas.memory, nullptr);
+    vkFreeMemory(this->setup->get_device(), this->tlas.memory, nullptr);
+    detail::vkDestroyAccelerationStructureNV(this->setup->get_device(), this->blas.as, nullptr);
+    detail::vkDestroyAccelerationStructureNV(this->setup->get_device(), this->tlas.as, nullptr);
+    this->blas = {};
+    this->tlas = {};
+}
+
+void pt::PathTracer::set_resolution(uint32_t width, uint32_t height)
+{
+    if(width == 0 || height == 0)
+        throw std::invalid_argument("[pt::PathTracer::set_resolution]: The resolution must not be 0.");
+    this->reset_accumulation();
+    if(width == this->render_extent.width && height == this->render_extent.height) return;
+
+    this->render_extent = {width, height};
+    if(!this->initialized) return;
+
+    // Only the descriptors of the render images are written again, the layouts of the descriptors
+    // don't depend on the resolution, so the pipeline and the SBT stay valid.
+    vkDeviceWaitIdle(this->setup->get_device());
+    this->destroy_render_images();
+    this->create_render_images();
+    this->write_render_image_descriptors();
+}
+
+void pt::PathTracer::set_tile(uint32_t x, uint32_t y, uint32_t frame_width, uint32_t frame_height)
+{
+    // the tile is checked against the resolution when it is traced, the resolution may change in between
+    if(frame_width == 0 || frame_height == 0)
+    {
+        this->frame_extent = {0, 0};
+        this->tile_offset = {0, 0};
+    }
+    else
+    {
+        this->frame_extent = {frame_width, frame_height};
+        this->tile_offset = {static_cast<int32_t>(x), static_cast<int32_t>(y)};
+    }
+    this->reset_accumulation();
+}
+
+uint64_t pt::PathTracer::run(uint32_t samples)
 {
-    VkCommandBuffer cbo = this->record();
+    if(samples == 0)
+        throw std::invalid_argument("[pt::PathTracer::run]: At least one sample must be traced.");
+    VkCommandBuffer cbo = this->record(samples);
     this->trace(cbo);
+    this->accumulated_samples += samples;
     
     // time_stamps[0]: start time
     // time_stamps[1]: end time
@@ -129,12 +357,206 @@ uint64_t pt::PathTracer::run(void)
     return time_diff * static_cast<uint64_t>(properties.limits.timestampPeriod);
 }
 
+pt::RenderResult pt::PathTracer::run(const RenderBudget& budget)
+{
+    if(budget.max_samples == 0 && budget.time_ns == 0 && budget.target_noise <= 0.0f && budget.cancel == nullptr)
+        throw std::invalid_argument("[pt::PathTracer::run]: The budget has no limit.");
+    if(budget.adaptive && budget.target_noise <= 0.0f)
+        throw std::invalid_argument("[pt::PathTracer::run]: Adaptive sampling requires a target noise.");
+    // the tile mask of an earlier adaptive run must not skip tiles of this one
+    if(!budget.adaptive)
+        this->tile_mask_valid = false;
+
+    const auto begin = std::chrono::steady_clock::now();
+    const uint64_t previous_ns = this->accumulated_ns;
+    auto last_checkpoint = begin;
+    RenderResult result = {};
+    result.noise = -1.0f;
+
+    uint64_t ns_per_sample = 0;     // wall-clock time of one sample, including the submission
+    uint32_t next_noise_check = std::max(this->accumulated_samples + 1, 2u);
+    for(;;)
+    {
+        if(budget.max_samples != 0 && result.samples >= budget.max_samples)
+        {
+            result.reason = RenderResult::SAMPLES;
+            break;
+        }
+        if(budget.cancel != nullptr && budget.cancel->load())
+        {
+            result.reason = RenderResult::CANCELLED;
+            break;
+        }
+        const uint64_t elapsed = elapsed_ns(begin);
+        if(budget.time_ns != 0 && elapsed + ns_per_sample > budget.time_ns)
+        {
+            result.reason = RenderResult::TIME;
+            break;
+        }
+
+        // the first submission traces one sample to measure the time per sample
+        uint64_t batch = 1;
+        if(ns_per_sample > 0)
+        {
+            batch = std::max<uint64_t>(TARGET_SUBMISSION_NS / ns_per_sample, 1);
+            if(budget.time_ns != 0)
+                batch = std::min(batch, (budget.time_ns - elapsed) / ns_per_sample);
+        }
+        if(budget.batch_samples != 0)
+            batch = std::min<uint64_t>(batch, budget.batch_samples);
+        if(budget.max_samples != 0)
+            batch = std::min<uint64_t>(batch, budget.max_samples - result.samples);
+        if(budget.target_noise > 0.0f)
+            batch = std::min<uint64_t>(batch, next_noise_check - this->accumulated_samples);
+        batch = std::max<uint64_t>(batch, 1);
+
+        // the time per sample shrinks with the traced tiles, it is measured again for every submission
+        const size_t traced_pixels = this->tile_mask_valid ? this->active_pixels : static_cast<size_t>(this->render_extent.width) * this->render_extent.height;
+        const auto submission_begin = std::chrono::steady_clock::now();
+        result.render_ns += this->run(static_cast<uint32_t>(batch));
+        result.samples += static_cast<uint32_t>(batch);
+        result.pixel_samples += traced_pixels * batch;
+        ns_per_sample = std::max<uint64_t>(elapsed_ns(submission_begin) / batch, 1);
+
+        if(budget.target_noise > 0.0f && this->accumulated_samples >= next_noise_check)
+        {
+            result.noise = this->analyze_noise(budget.target_noise, budget.adaptive);
+            next_noise_check = std::max(this->accumulated_samples + 1, static_cast<uint32_t>(std::ceil(this->accumulated_samples * NOISE_CHECK_GROWTH)));
+            // adaptive sampling continues until every tile reached the target, not only the mean
+            const bool converged = budget.adaptive ? (this->active_pixels == 0) : (result.noise >= 0.0f && result.noise <= budget.target_noise);
+            if(converged)
+            {
+                result.reason = RenderResult::NOISE;
+                break;
+            }
+        }
+
+        // a checkpoint is skipped if the writer is still busy with the previous ones
+        if(budget.checkpoints != nullptr && elapsed_ns(last_checkpoint) >= budget.checkpoint_interval_ns)
+        {
+            last_checkpoint = std::chrono::steady_clock::now();
+            Checkpoint* checkpoint = budget.checkpoints->acquire(false);
+            if(checkpoint != nullptr)
+            {
+                this->accumulated_ns = previous_ns + elapsed_ns(begin);
+                this->capture_checkpoint(*checkpoint);
+                budget.checkpoints->submit(checkpoint);
+                result.checkpoints++;
+            }
+        }
+    }
+
+    this->accumulated_ns = previous_ns + elapsed_ns(begin);
+    // a cancelled rendering is continued later, so its last state must not be skipped
+    if(result.reason == RenderResult::CANCELLED && budget.checkpoints != nullptr && this->accumulated_samples > 0)
+    {
+        Checkpoint* checkpoint = budget.checkpoints->acquire(true);
+        this->capture_checkpoint(*checkpoint);
+        budget.checkpoints->submit(checkpoint);
+        result.checkpoints++;
+    }
+
+    result.accumulated = this->accumulated_samples;
+    result.wall_ns = elapsed_ns(begin);
+    return result;
+}
+
+float pt::PathTracer::estimate_noise(void)
+{
+    if(this->accumulated_samples < 2) return -1.0f;
+    return this->analyze_noise(0.0f, false);
+}
+
+float pt::PathTracer::analyze_noise(float threshold, bool update_mask)
+{
+    const uint32_t width = this->render_extent.width;
+    const uint32_t height = this->render_extent.height;
+    const size_t pixel_count = static_cast<size_t>(width) * height;
+    std::vector<float> rgba(pixel_count * 4);
+    std::vector<uint32_t> counts(pixel_count);
+    this->read_accumulation(rgba.data());
+    this->read_sample_counts(counts.data());
+
+    // a tile is as noisy as its noisiest pixel
+    const uint32_t tiles_x = (width + ADAPTIVE_TILE_SIZE - 1) / ADAPTIVE_TILE_SIZE;
+    const uint32_t tiles_y = (height + ADAPTIVE_TILE_SIZE - 1) / ADAPTIVE_TILE_SIZE;
+    std::vector<float> tile_noise(static_cast<size_t>(tiles_x) * tiles_y, 0.0f);
+
+    // the alpha channel contains the mean of the squared luminance, see main.rgen
+    double sum = 0.0;
+    size_t estimated = 0;
+    for(uint32_t y = 0; y < height; y++)
+    {
+        for(uint32_t x = 0; x < width; x++)
+        {
+            const size_t i = static_cast<size_t>(y) * width + x;
+            const uint32_t n = counts[i];
+            float& tile = tile_noise[(y / ADAPTIVE_TILE_SIZE) * tiles_x + x / ADAPTIVE_TILE_SIZE];
+            if(n < 2)
+            {
+                tile = HUGE_VALF;
+                continue;
+            }
+
+            const float* p = rgba.data() + i * 4;
+            const double mean = 0.2126 * p[0] + 0.7152 * p[1] + 0.0722 * p[2];
+            const double variance = std::max(static_cast<double>(p[3]) - mean * mean, 0.0) * n / (n - 1);
+            const double noise = std::sqrt(variance / n) / std::max(mean, 0.01);
+            sum += noise;
+            estimated++;
+            tile = std::max(tile, (n < ADAPTIVE_MIN_SAMPLES) ? HUGE_VALF : static_cast<float>(noise));
+        }
+    }
+
+    if(update_mask)
+    {
+        // a disabled tile gets no samples, so its noise does not change and it stays disabled
+        uint32_t* mask = static_cast<uint32_t*>(this->tile_mask.map(this->tile_mask.size(), 0));
+        this->active_pixels = 0;
+        for(uint32_t ty = 0; ty < tiles_y; ty++)
+        {
+            for(uint32_t tx = 0; tx < tiles_x; tx++)
+            {
+                const size_t t = static_cast<size_t>(ty) * tiles_x + tx;
+                mask[t] = (tile_noise[t] > threshold) ? 1 : 0;
+                if(mask[t] != 0)
+                {
+                    this->active_pixels += static_cast<size_t>(std::min(ADAPTIVE_TILE_SIZE, width - tx * ADAPTIVE_TILE_SIZE))
+                        * std::min(ADAPTIVE_TILE_SIZE, height - ty * ADAPTIVE_TILE_SIZE);
+                }
+            }
+        }
+        this->tile_mask.unmap();
+        this->tile_mask_valid = true;
+    }
+    return (estimated > 0) ? static_cast<float>(sum / static_cast<double>(estimated)) : -1.0f;
+}
+
+size_t pt::PathTracer::get_scene_memory_size(void) const noexcept
+{
+    if(!this->initialized) return 0;
+
+    size_t size = this->mtl_buffer.size() + this->tlibo.size() + this->blas.size + this->tlas.size + this->environment_size + this->light_buffer.size() + this->opacity_buffer.size();
+    for(const std::vector<RenderMesh>& model : this->models)
+    {
+        for(const RenderMesh& rmesh : model)
+        {
+            // shared meshes use the buffers of the mesh with the same geometry ID
+            if(rmesh.properties.shared) continue;
+            size += rmesh.vectices.size() + rmesh.attributes.size() + rmesh.indices.size();
+        }
+    }
+    for(const RenderMaterial& mtl : this->materials)
+        size += mtl.texture.albedo_size + mtl.texture.emission_size + mtl.texture.rman_size;
+    return size;
+}
+
 const uint8_t* pt::PathTracer::map_image(size_t& row_stride, uint32_t& component_count) const
 {
     void* map;
     if(vkMapMemory(this->setup->get_device(), this->output_image.mem, 0, VK_WHOLE_SIZE, 0, &map) != VK_SUCCESS)
         throw std::runtime_error("[pt::PathTracer::map_image]: Failed to map output image.");
-    row_stride = this->setup->get_settings()->rt_width * vka::utility::format_sizeof(VK_FORMAT_R8G8B8A8_UNORM);
+    row_stride = this->render_extent.width * vka::utility::format_sizeof(VK_FORMAT_R8G8B8A8_UNORM);
     component_count = 4;
     return reinterpret_cast<uint8_t*>(map);
 }
@@ -0,0 +1,148 @@
+#include "../application.h"
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+    constexpr float ONE_MINUS_EPSILON = 0x1.fffffep-1f;
+
+    // header of the light buffer, the lights follow with the alignment of light_t
+    struct LightHeader
+    {
+        uint32_t count;
+        uint32_t pad[3];
+    };
+    static_assert(sizeof(pt::LightEntry) == 64, "The light table must have the std430 layout of light_t.");
+
+    float triangle_area(const float* p0, const float* p1, const float* p2) noexcept
+    {
+        const float e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+        const float e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+        const float c[3] = {
+            e1[1] * e2[2] - e1[2] * e2[1],
+            e1[2] * e2[0] - e1[0] * e2[2],
+            e1[0] * e2[1] - e1[1] * e2[0]
+        };
+        return 0.5f * std::sqrt(c[0] * c[0] + c[1] * c[1] + c[2] * c[2]);
+    }
+}
+
+void pt::LightSampler::build(std::vector<LightEntry>&& lights, const std::vector<float>& luminances)
+{
+    std::vector<float> weights;
+    weights.reserve(lights.size());
+    double sum = 0.0;
+    size_t count = 0;
+    for(LightEntry& light : lights)
+    {
+        if(light.materialID >= luminances.size())
+            throw std::invalid_argument("[pt::LightSampler::build]: A light references a material that does not exist.");
+        light.area = triangle_area(light.p0, light.p1, light.p2);
+        const float weight = light.area * luminances[light.materialID];
+        // degenerated triangles and black emission maps don't get any sample
+        if(!(weight > 0.0f) || !std::isfinite(weight)) continue;
+        lights[count++] = light;
+        weights.push_back(weight);
+        sum += weight;
+    }
+    lights.resize(count);
+
+    std::vector<AliasEntry> table(count);
+    build_alias_table(weights.data(), count, sum, table.data());
+    for(size_t i = 0; i < count; i++)
+        lights[i].choice = table[i];
+    this->lights = std::move(lights);
+}
+
+float pt::LightSampler::sample(float u0, float u1, float u2, float point[3], uint32_t& light) const noexcept
+{
+    if(this->lights.empty())
+    {
+        std::fill_n(point, 3, 0.0f);
+        light = 0;
+        return 0.0f;
+    }
+
+    // the alias table is stored inside of the lights, AliasEntry is the bucket of every light
+    const uint32_t count = static_cast<uint32_t>(this->lights.size());
+    const float x = u0 * static_cast<float>(count);
+    uint32_t i = std::min(static_cast<uint32_t>(x), count - 1);
+    if(std::min(x - static_cast<float>(i), ONE_MINUS_EPSILON) >= this->lights[i].choice.threshold)
+        i = this->lights[i].choice.alias;
+    light = i;
+
+    // uniform point on the triangle, the square root warps the first random number so the density is constant over the area
+    const LightEntry& l = this->lights[i];
+    const float s = std::sqrt(u1);
+    const float b0 = 1.0f - s;
+    const float b1 = u2 * s;
+    const float b2 = 1.0f - b0 - b1;
+    for(uint32_t k = 0; k < 3; k++)
+        point[k] = b0 * l.p0[k] + b1 * l.p1[k] + b2 * l.p2[k];
+    return l.choice.probability / l.area;
+}
+
+float pt::LightSampler::pdf(uint32_t light) const noexcept
+{
+    if(light >= this->lights.size()) return 0.0f;
+    const LightEntry& l = this->lights[light];
+    return l.choice.probability / l.area;
+}
+
+void pt::PathTracer::load_light_table(void)
+{
+    // The IDs change if models are reloaded and the materials are compacted, so they are resolved from the meshes every time.
+    std::vector<LightEntry> lights;
+    for(size_t i = 0; i < this->emitters.size(); i++)
+    {
+        for(const EmissiveTriangle& triangle : this->emitters[i])
+        {
+            const RecordParameter& record = this->models.at(i).at(triangle.mesh).properties.record;
+            LightEntry light = {};
+            std::copy_n(triangle.vertices[0], 3, light.p0);
+            std::copy_n(triangle.vertices[1], 3, light.p1);
+            std::copy_n(triangle.vertices[2], 3, light.p2);
+            light.geometryID = record.geometryID;
+            light.materialID = record.materialID;
+            light.primitive = triangle.primitive;
+            lights.push_back(light);
+        }
+    }
+    std::vector<float> luminances(this->materials.size());
+    for(size_t i = 0; i < this->materials.size(); i++)
+        luminances[i] = this->materials[i].emission_luminance;
+    this->light_sampler.build(std::move(lights), luminances);
+
+    // a scene without lights still gets the header, a buffer must not be empty
+    const std::vector<LightEntry>& table = this->light_sampler.get_lights();
+    const VkDeviceSize size = sizeof(LightHeader) + table.size() * sizeof(LightEntry);
+    this->light_buffer.clear();
+    this->init_device_buffer(this->light_buffer, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, size);
+
+    vka::Buffer staging(this->setup->get_physical_device(), this->setup->get_device());
+    staging.set_create_flags(0);
+    staging.set_create_size(size);
+    staging.set_create_usage(VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
+    staging.set_create_sharing_mode(VK_SHARING_MODE_EXCLUSIVE);
+    staging.set_create_queue_families(&this->setup->get_rt_queue_info().queueFamilyIndex, 1);
+    staging.set_memory_properties(VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    if(staging.create() != VK_SUCCESS)
+        throw std::runtime_error("[pt::PathTracer::load_light_table]: Failed to create light staging buffer.");
+
+    uint8_t* map = static_cast<uint8_t*>(staging.map(size, 0));
+    LightHeader header = {};
+    header.count = static_cast<uint32_t>(table.size());
+    std::copy_n(reinterpret_cast<const uint8_t*>(&header), sizeof(LightHeader), map);
+    std::copy(table.begin(), table.end(), reinterpret_cast<LightEntry*>(map + sizeof(LightHeader)));
+    staging.unmap();
+    this->notify(this->info_callback,
+        "Sampling " + std::to_string(table.size()) + " emissive triangles for next event estimation."
+    );
+
+    std::lock_guard<std::mutex> lock(this->queue_mtx);
+    VkCommandBuffer cbo = vka::Buffer::enqueue_copy(this->setup->get_device(), this->cmd_pool, 1, &staging, &this->light_buffer);
+    const VkResult result = vka::utility::execute_scb(this->setup->get_device(), this->cmd_pool, this->setup->get_rt_queue(), 1, &cbo);
+    vkFreeCommandBuffers(this->setup->get_device(), this->cmd_pool, 1, &cbo);
+    if(result != VK_SUCCESS)
+        throw std::runtime_error("[pt::PathTracer::load_light_table]: Failed to copy staging buffer.");
+}
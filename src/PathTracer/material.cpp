@@ -1,5 +1,12 @@
 #include "../application.h"
+#include <algorithm>
+#include <cmath>
 #define STB_IMAGE_IMPLEMENTATION
+// decoded images only live until they are loaded into a texture, so they are allocated from the scratch arena
+// of the decoding thread, the arenas are released after the initialization
+#define STBI_MALLOC(size)                       pt::ScratchArena::local().allocate(size)
+#define STBI_REALLOC_SIZED(p, old_size, size)   pt::ScratchArena::local().reallocate(p, old_size, size)
+#define STBI_FREE(p)                            pt::ScratchArena::local().free(p)
 #ifdef __clang__	// suppress waring "empty body" for clang for include file stb_image.h
     #pragma clang diagnostic push
     #pragma clang diagnostic ignored "-Wempty-body"
@@ -9,9 +16,101 @@
     #include <stb/stb_image.h>
 #endif
 
-void pt::PathTracer::load_environment(const std::string& path)
+namespace
 {
-    this->environment_path = path;
+    constexpr float LUMINANCE[3] = { 0.2126f, 0.7152f, 0.0722f };
+
+    float luminance(const float* rgb) noexcept
+    {
+        return LUMINANCE[0] * rgb[0] + LUMINANCE[1] * rgb[1] + LUMINANCE[2] * rgb[2];
+    }
+
+    /**
+     * @brief           Decodes an image into its own scratch allocation, that is made before decoding. The buffers of the
+     *                  decoder are released by a scope right after decoding, so the scratch memory of a thread only grows
+     *                  by the decoded images and not by the temporaries of every image it decoded.
+     * @param path      Path to the image.
+     * @param channels  Number of channels of the decoded image.
+     * @param load      Decoder, 'stbi_load' or 'stbi_loadf'.
+     * @param w         Receives the width of the image.
+     * @param h         Receives the height of the image.
+     * @return          Decoded image, nullptr if it could not be decoded.
+     */
+    template<typename T, typename L>
+    T* decode_image(const std::string& path, int channels, L load, int& w, int& h)
+    {
+        if(stbi_info(path.c_str(), &w, &h, nullptr) == 0) return nullptr;
+        const size_t count = static_cast<size_t>(w) * h * channels;
+        T* image = pt::ScratchArena::local().allocate_array<T>(count);
+
+        pt::ScratchScope scratch;
+        int dw, dh;
+        const T* decoded = load(path.c_str(), &dw, &dh, nullptr, channels);
+        if(decoded == nullptr || dw != w || dh != h) return nullptr;
+        std::copy_n(decoded, count, image);
+        return image;
+    }
+
+    // size of a texture with a full mip chain
+    size_t texture_size(VkExtent3D extent, size_t pixel_size, uint32_t layers, bool mipmapped) noexcept
+    {
+        size_t size = 0;
+        uint32_t w = extent.width, h = extent.height;
+        for(;;)
+        {
+            size += static_cast<size_t>(w) * h * pixel_size * layers;
+            if(!mipmapped || (w == 1 && h == 1)) return size;
+            w = (w > 1) ? w / 2 : 1;
+            h = (h > 1) ? h / 2 : 1;
+        }
+    }
+}
+
+pt::LoadHandle pt::PathTracer::load_environment(const std::string& path)
+{
+    // Only one environment map is used, so the previous one does not need to be finished. It may
+    // already decode into a scratch arena, so it is waited for before the arenas are reset.
+    if(this->environment_job != nullptr)
+    {
+        this->environment_job->cancelled = true;
+        this->cancelled_jobs.push_back(this->environment_job);
+    }
+
+    std::shared_ptr<EnvironmentLoadJob> job = std::make_shared<EnvironmentLoadJob>(path);
+    job->image = {};
+    this->environment_job = job;
+    this->submit_loading();
+    return LoadHandle(job);
+}
+
+void pt::PathTracer::submit_environment(void)
+{
+    if(this->environment_job == nullptr) return;
+    std::shared_ptr<EnvironmentLoadJob> job = this->environment_job;
+    job->start(this->loaders, [job]() {
+        if(job->cancelled) return;
+        int w, h;
+        float* data = decode_image<float>(job->path, 4, stbi_loadf, w, h);
+        if(data == nullptr)
+            throw std::runtime_error("[pt::PathTracer::load_environment]: Failed to load environment image: " + job->path);
+        job->image.data = data;
+        job->image.extent = {static_cast<uint32_t>(w), static_cast<uint32_t>(h), 1};
+    });
+}
+
+void pt::PathTracer::decode_render_materials(void)
+{
+    // Decoding is independent per image, so every image of every material is decoded by its own task.
+    // The images stay in the scratch arena of the decoding thread until they are uploaded.
+    std::vector<std::future<void>> tasks;
+    tasks.reserve(this->materials.size() * 3);
+    for(RenderMaterial& mtl : this->materials)
+    {
+        tasks.push_back(this->loaders.submit([this, &mtl]() { this->decode_albedo_image(mtl); }));
+        tasks.push_back(this->loaders.submit([this, &mtl]() { this->decode_emissive_image(mtl); }));
+        tasks.push_back(this->loaders.submit([this, &mtl]() { this->decode_rman_image(mtl); }));
+    }
+    this->loaders.wait_all(tasks);
 }
 
 void pt::PathTracer::create_render_materials(void)
@@ -25,19 +124,155 @@ void pt::PathTracer::create_render_materials(void)
         this->load_albedo_texture(mtl);
         this->load_emissive_texture(mtl);
         this->load_rman_texture(mtl);
+        mtl.images = {};
+
+        // the texture paths are kept, they are watched for hot reloading
+    }
+
+    // load the environment map texture and its distribution for importance sampling
+    this->load_environment_texture();
+    this->load_environment_distribution();
+    this->environment_image = {};
+}
+
+void pt::PathTracer::decode_materials(size_t first)
+{
+    // same as 'decode_render_materials', but only for the materials that were appended by a reload
+    std::vector<std::future<void>> tasks;
+    for(size_t i = first; i < this->materials.size(); i++)
+    {
+        RenderMaterial& mtl = this->materials[i];
+        tasks.push_back(this->loaders.submit([this, &mtl]() { this->decode_albedo_image(mtl); }));
+        tasks.push_back(this->loaders.submit([this, &mtl]() { this->decode_emissive_image(mtl); }));
+        tasks.push_back(this->loaders.submit([this, &mtl]() { this->decode_rman_image(mtl); }));
+    }
+
+    try
+    {
+        this->loaders.wait_all(tasks);
+    }
+    catch(...)
+    {
+        // the materials were not uploaded yet, so the scene is unchanged without them
+        this->materials.resize(first);
+        throw;
+    }
+}
+
+void pt::PathTracer::upload_materials(size_t first)
+{
+    for(size_t i = first; i < this->materials.size(); i++)
+    {
+        RenderMaterial& mtl = this->materials[i];
+        this->load_albedo_texture(mtl);
+        this->load_emissive_texture(mtl);
+        this->load_rman_texture(mtl);
+        mtl.images = {};
+    }
+}
+
+void pt::PathTracer::compact_materials(void)
+{
+    // Removes the materials that are not referenced by any mesh, the material IDs stay in the same order.
+    std::vector<uint32_t> remap(this->materials.size(), UINT32_MAX);
+    for(const auto& model : this->models)
+        for(const RenderMesh& rmesh : model)
+            remap.at(rmesh.properties.record.materialID) = 0;
+
+    uint32_t count = 0;
+    for(size_t i = 0; i < this->materials.size(); i++)
+    {
+        RenderMaterial& mtl = this->materials[i];
+        if(remap[i] == UINT32_MAX)
+        {
+            mtl.texture.albedo.clear();
+            mtl.texture.emission.clear();
+            mtl.texture.rman.clear();
+            continue;
+        }
+        remap[i] = count;
+        if(i != count) std::swap(this->materials[count], mtl);
+        count++;
+    }
+    this->materials.resize(count);
+
+    for(auto& model : this->models)
+        for(RenderMesh& rmesh : model)
+            rmesh.properties.record.materialID = remap[rmesh.properties.record.materialID];
+}
 
-        // delete all texture string paths to free memory
-        mtl.properties.map_albedo.clear();
-        mtl.properties.map_alpha.clear();
-        mtl.properties.map_emission.clear();
-        mtl.properties.map_metallic.clear();
-        mtl.properties.map_normal.clear();
-        mtl.properties.map_roughness.clear();
+void pt::PathTracer::reload_textures(std::vector<WatchedAsset>& textures)
+{
+    // The images of a material are packed into three textures, every texture is reloaded
+    // once, even if multiple of its images changed.
+    std::sort(textures.begin(), textures.end(), [](const WatchedAsset& a, const WatchedAsset& b) {
+        return (a.index != b.index) ? (a.index < b.index) : (a.type < b.type);
+    });
+    textures.erase(std::unique(textures.begin(), textures.end(), [](const WatchedAsset& a, const WatchedAsset& b) {
+        return a.index == b.index && a.type == b.type;
+    }), textures.end());
+
+    // all images are decoded before any texture is replaced, so an image that can not be decoded leaves the scene unchanged
+    std::vector<std::future<void>> tasks;
+    for(const WatchedAsset& asset : textures)
+    {
+        RenderMaterial& mtl = this->materials.at(asset.index);
+        switch(asset.type)
+        {
+        case WatchedAsset::ALBEDO:
+            tasks.push_back(this->loaders.submit([this, &mtl]() { this->decode_albedo_image(mtl); }));
+            break;
+        case WatchedAsset::EMISSION:
+            tasks.push_back(this->loaders.submit([this, &mtl]() { this->decode_emissive_image(mtl); }));
+            break;
+        case WatchedAsset::RMAN:
+            tasks.push_back(this->loaders.submit([this, &mtl]() { this->decode_rman_image(mtl); }));
+            break;
+        default:
+            throw std::invalid_argument("[pt::PathTracer::reload_textures]: Asset is not a texture of a material.");
+        }
     }
+    this->loaders.wait_all(tasks);
+
+    // the opacity of the meshes depends on the alpha map, they are classified while it is decoded
+    std::vector<bool> decoded(this->materials.size(), false);
+    for(const WatchedAsset& asset : textures)
+        if(asset.type == WatchedAsset::RMAN) decoded[asset.index] = true;
+    this->classify_meshes(decoded);
+
+    for(const WatchedAsset& asset : textures)
+    {
+        RenderMaterial& mtl = this->materials[asset.index];
+        switch(asset.type)
+        {
+        case WatchedAsset::ALBEDO:
+            mtl.texture.albedo.clear();
+            this->load_albedo_texture(mtl);
+            break;
+        case WatchedAsset::EMISSION:
+            mtl.texture.emission.clear();
+            this->load_emissive_texture(mtl);
+            break;
+        default:
+            mtl.texture.rman.clear();
+            this->load_rman_texture(mtl);
+            break;
+        }
+    }
+    for(const WatchedAsset& asset : textures)
+        this->materials[asset.index].images = {};
+}
 
-    // load the environment map texture
+void pt::PathTracer::reload_environment(void)
+{
+    // decoded the same way as while loading the scene, the previous texture is kept if decoding fails
+    this->load_environment(this->environment_path);
+    this->decode_environment_image();
+    this->environment.clear();
+    this->environment_alias.clear();
     this->load_environment_texture();
-    this->environment_path.clear();
+    this->load_environment_distribution();
+    this->environment_image = {};
 }
 
 void pt::PathTracer::load_mtl_buffer(const material_array_t& mtlarray)
@@ -66,25 +301,29 @@ void pt::PathTracer::load_mtl_buffer(const material_array_t& mtlarray)
     staging.unmap();
 
     // copy buffer
+    std::lock_guard<std::mutex> lock(this->queue_mtx);
     VkCommandBuffer cbo = vka::Buffer::enqueue_copy(this->setup->get_device(), this->cmd_pool, 1, &staging, &this->mtl_buffer);
     if(vka::utility::execute_scb(this->setup->get_device(), this->cmd_pool, this->setup->get_rt_queue(), 1, &cbo) != VK_SUCCESS)
         throw std::runtime_error("[pt::PathTracer::load_mtl_buffer]: Failed to copy staging buffer.");
 }
 
-void pt::PathTracer::load_albedo_texture(RenderMaterial& mtl)
+void pt::PathTracer::decode_albedo_image(RenderMaterial& mtl)
 {
-    constexpr static VkFormat ALBEDO_FORMAT = VK_FORMAT_R8G8B8A8_SRGB; // albedo map uses SRGB non linear color space
-    vka::Texture& tex = mtl.texture.albedo;
-
-    VkExtent3D extent;
     int w, h;
-    uint8_t* data = stbi_load(mtl.properties.map_albedo.c_str(), &w, &h, nullptr, 4);
+    uint8_t* data = decode_image<uint8_t>(mtl.properties.map_albedo, 4, stbi_load, w, h);
     if(data == nullptr)
-        throw std::runtime_error("[pt::PathTracer::load_albedo_texture]: Failed to load albedo map: " + mtl.properties.map_emission);
+        throw std::runtime_error("[pt::PathTracer::decode_albedo_image]: Failed to load albedo map: " + mtl.properties.map_albedo);
+
+    mtl.images.albedo.data = data;
+    mtl.images.albedo.extent = {static_cast<uint32_t>(w), static_cast<uint32_t>(h), 1};
+    this->notify(this->texture_load_callback, mtl.properties.map_albedo);
+}
 
-    extent.width    = static_cast<uint32_t>(w);
-    extent.height   = static_cast<uint32_t>(h);
-    extent.depth    = 1;
+void pt::PathTracer::load_albedo_texture(RenderMaterial& mtl)
+{
+    constexpr static VkFormat ALBEDO_FORMAT = VK_FORMAT_R8G8B8A8_SRGB; // albedo map uses SRGB non linear color space
+    vka::Texture& tex = mtl.texture.albedo;
+    const VkExtent3D extent = mtl.images.albedo.extent;
 
     this->init_texture(tex);
     tex.set_image_format(ALBEDO_FORMAT);
@@ -109,45 +348,60 @@ void pt::PathTracer::load_albedo_texture(RenderMaterial& mtl)
     view.subresourceRange.layerCount = 1;
 
     tex.add_view(view);
-    if(tex.load(0, data) != VK_SUCCESS)
+    if(tex.load(0, mtl.images.albedo.data) != VK_SUCCESS)
         throw std::runtime_error("[pt::PathTracer::load_albedo_texture]: Failed to load emissive image into texture.");
-    stbi_image_free(data);
 
+    std::lock_guard<std::mutex> lock(this->queue_mtx);
     if(tex.create(true, VK_FILTER_NEAREST) != VK_SUCCESS)
         throw std::runtime_error("[pt::PathTracer::load_albedo_texture]: Failed to create emissive texture.");
-
-    if(this->texture_load_callback != nullptr) this->texture_load_callback(mtl.properties.map_albedo);
+    mtl.texture.albedo_size = texture_size(extent, 4, 1, true);
 }
 
-void pt::PathTracer::load_emissive_texture(RenderMaterial& mtl)
+void pt::PathTracer::decode_emissive_image(RenderMaterial& mtl)
 {
-    constexpr static VkFormat EMISSION_FORMAT = VK_FORMAT_R32G32B32A32_SFLOAT;
-    vka::Texture& tex = mtl.texture.emission;
-
     // load textue
     // If instead of a textrue there is only a single value,
     // there is still a texture loaded with an extent of 1x1x1.
     // Then this single pixel stored inside the texture contains the
     // HDR-color of the emission value.
     // If a path is set to a emission texture, the texture is loaded as usual
-    VkExtent3D extent;
     float* data;
     if(mtl.properties.map_emission.size() == 0)
     {
-        extent = {1, 1, 1};
-        data = new float[4];    // eventough the extent contains one pixel, there is one padding element requiered
-                                // for the glm2::vec3::load, as it has internally 4 components.
-                                // Loaded to the texture are still only 3 elements.
+        mtl.images.emission.extent = {1, 1, 1};
+        data = ScratchArena::local().allocate_array<float>(4);  // eventough the extent contains one pixel, there is one padding element requiered
+                                                                // for the glm2::vec3::load, as it has internally 4 components.
+                                                                // Loaded to the texture are still only 3 elements.
         mtl.properties.single_emission.store(data);
     }
     else
     {
         int w, h;
         // force load 4 channels as only RGBA textures can be created
-        data = stbi_loadf(mtl.properties.map_emission.c_str(), &w, &h, nullptr, 4);
+        data = decode_image<float>(mtl.properties.map_emission, 4, stbi_loadf, w, h);
         if(data == nullptr)
-            throw std::runtime_error("[pt::PathTracer::load_emissive_texture]: Failed to load emissive image: " + mtl.properties.map_emission);
+            throw std::runtime_error("[pt::PathTracer::decode_emissive_image]: Failed to load emissive image: " + mtl.properties.map_emission);
+        mtl.images.emission.extent = {static_cast<uint32_t>(w), static_cast<uint32_t>(h), 1};
+        this->notify(this->texture_load_callback, mtl.properties.map_emission);
     }
+    mtl.images.emission.data = data;
+
+    // the emissive triangles are weighted by the mean luminance, the variation inside of the map is not sampled
+    const size_t pixel_count = static_cast<size_t>(mtl.images.emission.extent.width) * mtl.images.emission.extent.height;
+    double sum = 0.0;
+    for(size_t i = 0; i < pixel_count; i++)
+    {
+        const float l = luminance(data + i * 4);
+        if(l > 0.0f && std::isfinite(l)) sum += l;
+    }
+    mtl.emission_luminance = static_cast<float>(sum / static_cast<double>(pixel_count));
+}
+
+void pt::PathTracer::load_emissive_texture(RenderMaterial& mtl)
+{
+    constexpr static VkFormat EMISSION_FORMAT = VK_FORMAT_R32G32B32A32_SFLOAT;
+    vka::Texture& tex = mtl.texture.emission;
+    const VkExtent3D extent = mtl.images.emission.extent;
 
     this->init_texture(tex);
     tex.set_image_format(EMISSION_FORMAT);   // emission map is a HDR texture
@@ -172,31 +426,32 @@ void pt::PathTracer::load_emissive_texture(RenderMaterial& mtl)
     view.subresourceRange.layerCount = 1;
 
     tex.add_view(view);
-    if(tex.load(0, data) != VK_SUCCESS)
+    if(tex.load(0, mtl.images.emission.data) != VK_SUCCESS)
         throw std::runtime_error("[pt::PathTracer::load_emissive_texture]: Failed to load emissive image into texture.");
-    stbi_image_free(data);
 
+    std::lock_guard<std::mutex> lock(this->queue_mtx);
     if(tex.create(true, VK_FILTER_NEAREST) != VK_SUCCESS)
         throw std::runtime_error("[pt::PathTracer::load_emissive_texture]: Failed to create emissive texture.");
-
-    if(this->texture_load_callback != nullptr) this->texture_load_callback(mtl.properties.map_emission);
+    mtl.texture.emission_size = texture_size(extent, 16, 1, true);
 }
 
-void pt::PathTracer::load_rman_texture(RenderMaterial& mtl)
+void pt::PathTracer::decode_rman_image(RenderMaterial& mtl)
 {
-    constexpr static VkFormat RMAN_FORMAT = VK_FORMAT_R8G8B8A8_UNORM;
-    vka::Texture& tex = mtl.texture.rman;
-
     // data[0]: roughness, metallic, alpha image data
     // data[1]: normal image data
     uint8_t* data[2];
 
-    VkExtent3D extent;
     int w1, w2, h1, h2;
-    data[1] = stbi_load(mtl.properties.map_normal.c_str(), &w1, &h1, nullptr, 4);
+    data[1] = decode_image<uint8_t>(mtl.properties.map_normal, 4, stbi_load, w1, h1);
     if(data[1] == nullptr)
-        throw std::runtime_error("[pt::PathTracer::load_arman_texture]: Failed to load normal map: " + mtl.properties.map_normal);
-    if(this->texture_load_callback != nullptr) this->texture_load_callback(mtl.properties.map_normal);
+        throw std::runtime_error("[pt::PathTracer::decode_rman_image]: Failed to load normal map: " + mtl.properties.map_normal);
+    this->notify(this->texture_load_callback, mtl.properties.map_normal);
+
+    // the merged image is allocated before the single channel images, so those can be released afterwards
+    const VkExtent3D extent = {static_cast<uint32_t>(w1), static_cast<uint32_t>(h1), 1};
+    data[0] = ScratchArena::local().allocate_array<uint8_t>(extent.width * extent.height * 4);
+
+    ScratchScope scratch;  // releases the single channel images
 
     // tmp[0] = roughnes image data
     // tmp[1] = metallic image data
@@ -204,35 +459,44 @@ void pt::PathTracer::load_rman_texture(RenderMaterial& mtl)
     uint8_t* tmp[3];
     tmp[0] = stbi_load(mtl.properties.map_roughness.c_str(), &w2, &h2, nullptr, 1);
     if(tmp[0] == nullptr)
-        throw std::runtime_error("[pt::PathTracer::load_arman_texture]: Failed to load roughness map: " + mtl.properties.map_roughness);
+        throw std::runtime_error("[pt::PathTracer::decode_rman_image]: Failed to load roughness map: " + mtl.properties.map_roughness);
     if(w1 != w2 || h1 != h2)
-        throw std::runtime_error("[pt::PathTracer::load_arman_texture]: All images from the same material MUST have the same extent.");
-    if(this->texture_load_callback != nullptr) this->texture_load_callback(mtl.properties.map_roughness);
+        throw std::runtime_error("[pt::PathTracer::decode_rman_image]: All images from the same material MUST have the same extent.");
+    this->notify(this->texture_load_callback, mtl.properties.map_roughness);
 
     tmp[1] = stbi_load(mtl.properties.map_metallic.c_str(), &w2, &h2, nullptr, 1);
     if(tmp[1] == nullptr)
-        throw std::runtime_error("[pt::PathTracer::load_arman_texture]: Failed to load metallic map: " + mtl.properties.map_metallic);
+        throw std::runtime_error("[pt::PathTracer::decode_rman_image]: Failed to load metallic map: " + mtl.properties.map_metallic);
     if(w1 != w2 || h1 != h2)
-        throw std::runtime_error("[pt::PathTracer::load_arman_texture]: All images from the same material MUST have the same extent.");
-    if(this->texture_load_callback != nullptr) this->texture_load_callback(mtl.properties.map_metallic);
+        throw std::runtime_error("[pt::PathTracer::decode_rman_image]: All images from the same material MUST have the same extent.");
+    this->notify(this->texture_load_callback, mtl.properties.map_metallic);
 
     tmp[2] = stbi_load(mtl.properties.map_alpha.c_str(), &w2, &h2, nullptr, 1);
     if(tmp[2] == nullptr)
-        throw std::runtime_error("[pt::PathTracer::load_arman_texture]: Failed to load alpha map: " + mtl.properties.map_alpha);
+        throw std::runtime_error("[pt::PathTracer::decode_rman_image]: Failed to load alpha map: " + mtl.properties.map_alpha);
     if(w1 != w2 || h1 != h2)
-        throw std::runtime_error("[pt::PathTracer::load_arman_texture]: All images from the same material MUST have the same extent.");
-    if(this->texture_load_callback != nullptr) this->texture_load_callback(mtl.properties.map_alpha);
-    
-    extent = {static_cast<uint32_t>(w1), static_cast<uint32_t>(h1), 1};
+        throw std::runtime_error("[pt::PathTracer::decode_rman_image]: All images from the same material MUST have the same extent.");
+    this->notify(this->texture_load_callback, mtl.properties.map_alpha);
+
     // merge roughness, metallic and alpha
-    data[0] = new uint8_t[extent.width * extent.height * 4];
     for(uint32_t i = 0; i < 3; i++)
     {
         for(uint32_t j = 0; j < (extent.width * extent.height); j++)
             data[0][j * 4 + i] = tmp[i][j];
-        stbi_image_free(tmp[i]);
     }
 
+    mtl.images.rman[0].data = data[0];
+    mtl.images.rman[1].data = data[1];
+    mtl.images.rman[0].extent = extent;
+    mtl.images.rman[1].extent = extent;
+}
+
+void pt::PathTracer::load_rman_texture(RenderMaterial& mtl)
+{
+    constexpr static VkFormat RMAN_FORMAT = VK_FORMAT_R8G8B8A8_UNORM;
+    vka::Texture& tex = mtl.texture.rman;
+    const VkExtent3D extent = mtl.images.rman[0].extent;
+
     this->init_texture(tex);
     tex.set_image_format(RMAN_FORMAT);
     tex.set_image_extent(extent);
@@ -258,29 +522,37 @@ void pt::PathTracer::load_rman_texture(RenderMaterial& mtl)
     {
         view.subresourceRange.baseArrayLayer = i;
         tex.add_view(view);
-        if(tex.load(i, data[i]) != VK_SUCCESS)
+        if(tex.load(i, mtl.images.rman[i].data) != VK_SUCCESS)
             throw std::runtime_error("[pt::PathTracer::load_emissive_texture]: Failed to load rman maps into texture.");
-        stbi_image_free(data[i]);
     }
 
+    std::lock_guard<std::mutex> lock(this->queue_mtx);
     if(tex.create(true, VK_FILTER_NEAREST) != VK_SUCCESS)
         throw std::runtime_error("[pt::PathTracer::load_emissive_texture]: Failed to create rman texture.");
+    mtl.texture.rman_size = texture_size(extent, 4, 2, true);
 
 }
 
+void pt::PathTracer::decode_environment_image(void)
+{
+    // the environment map is decoded in the background since 'load_environment'
+    if(this->environment_job == nullptr)
+        throw std::runtime_error("[pt::PathTracer::decode_environment_image]: No environment map was loaded.");
+    this->loaders.wait(this->environment_job->done);
+    if(this->environment_job->cancelled)
+        throw std::runtime_error("[pt::PathTracer::decode_environment_image]: Loading of the environment map was cancelled.");
+    this->environment_job->done.get();
+
+    this->environment_image = this->environment_job->image;
+    this->environment_path = this->environment_job->path;
+    this->notify(this->texture_load_callback, this->environment_job->path);
+    this->environment_job.reset();
+}
+
 void pt::PathTracer::load_environment_texture(void)
 {
     constexpr static VkFormat ENVIRONMENT_FORMAT = VK_FORMAT_R32G32B32A32_SFLOAT; // environment map is an HDR image
-
-    VkExtent3D extent;
-    int w, h;
-    float* data = stbi_loadf(this->environment_path.c_str(), &w, &h, nullptr, 4);
-    if(data == nullptr)
-        throw std::runtime_error("[pt::PathTracer::load_environment_texture]: Failed to load environment image: " + this->environment_path);
-
-    extent.width    = static_cast<uint32_t>(w);
-    extent.height   = static_cast<uint32_t>(h);
-    extent.depth    = 1;
+    const VkExtent3D extent = this->environment_image.extent;
 
     this->init_texture(this->environment);
     this->environment.set_image_format(ENVIRONMENT_FORMAT);  
@@ -305,14 +577,13 @@ void pt::PathTracer::load_environment_texture(void)
     view.subresourceRange.layerCount = 1;
 
     this->environment.add_view(view);
-    if(this->environment.load(0, data) != VK_SUCCESS)
+    if(this->environment.load(0, this->environment_image.data) != VK_SUCCESS)
         throw std::runtime_error("[pt::PathTracer::load_emissive_texture]: Failed to load environment image into texture.");
-    stbi_image_free(data);
 
+    std::lock_guard<std::mutex> lock(this->queue_mtx);
     if(this->environment.create(false, VK_FILTER_NEAREST) != VK_SUCCESS)
         throw std::runtime_error("[pt::PathTracer::load_emissive_texture]: Failed to create environment texture.");
-
-    if(this->texture_load_callback != nullptr) this->texture_load_callback(this->environment_path);
+    this->environment_size = texture_size(extent, 16, 1, false);
 }
 
 void pt::PathTracer::init_texture(vka::Texture& tex)
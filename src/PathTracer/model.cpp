@@ -1,125 +1,703 @@
 #include "../application.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
 
-void pt::PathTracer::load_model(const std::string& path)
+namespace
 {
-    this->model_paths.push_back(path);
+    // The merged data is never stored in one piece on the host, so it is
+    // hashed in small parts that are merged into a buffer on the stack.
+    pt::Hash128 hash_mesh(const pt::ObjMesh& mesh)
+    {
+        constexpr static uint32_t HASH_CHUNK = 256;
+        float chunk[HASH_CHUNK * pt::ObjMesh::ATTRIBUTE_COMPONENTS];
+
+        pt::ContentHasher hasher;
+        for(uint32_t first = 0; first < mesh.vertex_count(); first += HASH_CHUNK)
+        {
+            const uint32_t count = std::min(HASH_CHUNK, mesh.vertex_count() - first);
+            mesh.write_vertices(chunk, first, count);
+            hasher.update(chunk, count * pt::ObjMesh::VERTEX_COMPONENTS * sizeof(float));
+        }
+        for(uint32_t first = 0; first < mesh.vertex_count(); first += HASH_CHUNK)
+        {
+            const uint32_t count = std::min(HASH_CHUNK, mesh.vertex_count() - first);
+            mesh.write_attributes(chunk, first, count);
+            hasher.update(chunk, count * pt::ObjMesh::ATTRIBUTE_COMPONENTS * sizeof(float));
+        }
+        hasher.update(mesh.pindices(), mesh.indices_size());
+        return hasher.digest();
+    }
+
+    // Compares the merged data of two meshes in the same parts as they are hashed.
+    bool equal_content(const pt::ObjMesh& a, const pt::ObjMesh& b)
+    {
+        constexpr static uint32_t COMPARE_CHUNK = 256;
+        float chunk_a[COMPARE_CHUNK * pt::ObjMesh::ATTRIBUTE_COMPONENTS];
+        float chunk_b[COMPARE_CHUNK * pt::ObjMesh::ATTRIBUTE_COMPONENTS];
+
+        if(a.vertex_count() != b.vertex_count() || a.index_count() != b.index_count()) return false;
+        if(!std::equal(a.pindices(), a.pindices() + a.index_count(), b.pindices())) return false;
+        for(uint32_t first = 0; first < a.vertex_count(); first += COMPARE_CHUNK)
+        {
+            const uint32_t count = std::min(COMPARE_CHUNK, a.vertex_count() - first);
+            a.write_vertices(chunk_a, first, count);
+            b.write_vertices(chunk_b, first, count);
+            if(std::memcmp(chunk_a, chunk_b, count * pt::ObjMesh::VERTEX_COMPONENTS * sizeof(float)) != 0) return false;
+            a.write_attributes(chunk_a, first, count);
+            b.write_attributes(chunk_b, first, count);
+            if(std::memcmp(chunk_a, chunk_b, count * pt::ObjMesh::ATTRIBUTE_COMPONENTS * sizeof(float)) != 0) return false;
+        }
+        return true;
+    }
+
+    // The parsed meshes of a model are released after it is uploaded, its geometries are only compared by their size afterwards.
+    inline void release_cached_meshes(pt::geometry_cache_t& cache)
+    {
+        for(auto& entry : cache)
+            entry.second.mesh = nullptr;
+    }
+
+    // Releases the content of the geometry that was added for 'mesh', it is only compared by its hash and size afterwards.
+    inline void release_cached_mesh(pt::geometry_cache_t& cache, const pt::Hash128& hash, const pt::ObjMesh* mesh)
+    {
+        const auto range = cache.equal_range(hash);
+        for(auto it = range.first; it != range.second; it++)
+            if(it->second.mesh == mesh) it->second.mesh = nullptr;
+    }
+
+    inline size_t mesh_size(const pt::MeshProperties& properties)
+    {
+        return properties.vertex_count * (pt::ObjMesh::VERTEX_COMPONENTS + pt::ObjMesh::ATTRIBUTE_COMPONENTS) * sizeof(float) + properties.index_count * sizeof(uint32_t);
+    }
+
+    inline void clear_render_mesh(pt::RenderMesh& rmesh)
+    {
+        rmesh.vectices.clear();
+        rmesh.attributes.clear();
+        rmesh.indices.clear();
+    }
+
+    // Staging buffers of one mesh that is merged but not copied yet.
+    struct MeshStaging
+    {
+        vka::Buffer buffers[3];
+        pt::MergeStatistics merge;
+    };
+
+    // Meshes that are uploaded through staging buffers are hashed while they are merged into them, reloaded
+    // meshes are deduplicated before they are uploaded and hashed here. Streamed models only parse the file.
+    void parse_model(pt::ModelLoadJob& job, bool hash)
+    {
+        pt::ParsedModel& model = job.model;
+        if(job.cancelled) return;
+        model.obj.load(job.path);   // if loading was not successful, obj.load() will throw an exception
+        model.meshes.resize(model.obj.mesh_count());
+        model.hashes.resize(model.obj.mesh_count());
+        for(size_t i = 0; i < model.obj.mesh_count(); i++)
+        {
+            if(job.cancelled) return;
+            model.obj.build_mesh(i, model.meshes[i]);
+            if(hash) model.hashes[i] = hash_mesh(model.meshes[i]);
+        }
+    }
+}
+
+pt::LoadHandle pt::PathTracer::load_model(const std::string& path)
+{
+    std::shared_ptr<ModelLoadJob> job = std::make_shared<ModelLoadJob>(path);
+    this->model_jobs.push_back(job);
+    this->submit_loading();
+    return LoadHandle(job);
+}
+
+void pt::PathTracer::submit_loading(void)
+{
+    // The pool is started as soon as the number of loading threads is known, until then the jobs are queued.
+    // The tasks only reference their jobs, not the path tracer.
+    if(this->load_settings == nullptr) return;
+    this->loaders.start(this->load_settings->load_threads);
+    this->submit_environment();
+
+    // streamed loading keeps only one object file resident, the files are parsed one after another while they are uploaded
+    if(this->load_settings->stream_budget != 0) return;
+    for(const std::shared_ptr<ModelLoadJob>& job : this->model_jobs)
+        job->start(this->loaders, [job]() { parse_model(*job, false); });
 }
 
-void pt::PathTracer::create_render_models(void)
+void pt::LoadHandle::wait(void) const
 {
+    if(this->job == nullptr)
+        throw std::invalid_argument("[pt::LoadHandle::wait]: Handle does not refer to a loading task.");
+    if(!this->job->started)
+        throw std::runtime_error("[pt::LoadHandle::wait]: Loading has not started yet, the file is loaded by 'init'.");
+    this->job->done.get();
+}
+
+bool pt::LoadHandle::ready(void) const
+{
+    if(this->job == nullptr || !this->job->started) return false;
+    return this->job->done.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+}
+
+void pt::LoadHandle::cancel(void) noexcept
+{
+    if(this->job != nullptr) this->job->cancelled = true;
+}
+
+void pt::PathTracer::wait_for_models(void)
+{
+    // Models that were cancelled are not part of the scene. The others are
+    // waited for in the order they were added, errors are rethrown here.
+    for(const auto& job : this->model_jobs)
+        this->loaders.wait(job->done);
+    this->model_jobs.erase(
+        std::remove_if(this->model_jobs.begin(), this->model_jobs.end(), [](const std::shared_ptr<ModelLoadJob>& job) { return job->cancelled.load(); }),
+        this->model_jobs.end()
+    );
+    for(const auto& job : this->model_jobs)
+        job->done.get();
+}
+
+void pt::PathTracer::parse_render_models(void)
+{
+    // streamed loading keeps only one object file resident, therefore it can not parse the files
+    // concurrently and it uploads the meshes while parsing
+    if(this->setup->get_settings()->stream_budget != 0)
+    {
+        this->create_streamed_models();
+        return;
+    }
+
     this->models.clear();
     this->materials.clear();
+    this->emitters.clear();
+    this->texcoords.clear();
+    this->model_paths.clear();
+    this->load_stats = {};
 
-    // create buffers for every mesh of every model
-    this->models.reserve(this->model_paths.size()); // allocate enough mesh vectors for every model
-    uint32_t gID = 0;
-    for(const std::string& path : this->model_paths)
-    {
-        vka::Model model;
-        model.load(path, vka::VKA_MODEL_LOAD_OPTION_FORCE_PER_MESH_MATERIAL);   // if loading was not successful, model.load() will throw an exception
-        this->models.resize(this->models.size() + 1);           // create a new vector of render meshes
-        this->models.back().reserve(model.meshes().size());     // allocate enough meshes inside the current mesh vector
+    // All object files are parsed concurrently since 'load_model', every task also builds the meshes of its file.
+    // This is the most expensive part of loading, so the scene loads in about the time of the largest file.
+    this->wait_for_models();
+    const std::vector<std::shared_ptr<ModelLoadJob>>& jobs = this->model_jobs;
 
-        for(const vka::Mesh& mesh : model.meshes())
-        {   
-            this->models.back().resize(this->models.back().size() + 1); // create a new mesh
-            RenderMesh& rmesh = this->models.back().back();
+    // The material IDs are assigned in model order, so they are exactly the same as if the models were
+    // loaded one after another. The geometry IDs are assigned while the meshes are uploaded.
+    this->models.resize(jobs.size());
+    this->emitters.resize(jobs.size());
+    this->texcoords.resize(jobs.size());
+    for(size_t i = 0; i < jobs.size(); i++)
+    {
+        this->models[i].resize(jobs[i]->model.meshes.size());
+        for(size_t j = 0; j < jobs[i]->model.meshes.size(); j++)
+            this->init_render_mesh(jobs[i]->model.meshes[j], this->models[i][j]);
 
-            // the current mesh is the last mesh allocated, and the current model is the last mesh vector allocated
-            this->load_render_mesh(mesh, rmesh);
+        // load material properties and assign the material IDs
+        this->append_materials(jobs[i]->model.obj, this->models[i]);
+        this->texcoords[i].resize(jobs[i]->model.meshes.size());
+        for(size_t j = 0; j < jobs[i]->model.meshes.size(); j++)
+        {
+            this->collect_emitters(jobs[i]->model.meshes[j], static_cast<uint32_t>(j), this->models[i][j], this->emitters[i]);
+            this->collect_texcoords(jobs[i]->model.meshes[j], this->texcoords[i][j]);
+        }
+        this->model_paths.push_back(jobs[i]->path);
+    }
+    this->log_materials();
+}
 
-            // the geometry IDs are a sequential number and are unique per mesh
-            rmesh.properties.record.geometryID = gID++;
+void pt::PathTracer::upload_render_models(void)
+{
+    // The meshes are merged into their staging buffers concurrently and hashed while they are merged. Creating
+    // and mapping buffers is thread-safe, but the command pool and the queue are not, so the meshes are
+    // deduplicated and the copies are submitted by this thread in model order as soon as all meshes of a model are merged.
+    // The staging buffers of duplicates are released without being copied.
+    // A model is only merged while the staging memory of the models in flight stays within the budget, the staging
+    // buffers of a model are released as soon as it is uploaded. A model that is larger than the budget is merged alone.
+    constexpr static VkDeviceSize STAGING_BUDGET = 256 * 1024 * 1024;
+    const std::vector<std::shared_ptr<ModelLoadJob>>& jobs = this->model_jobs;
+    std::vector<std::unique_ptr<MeshStaging[]>> staging(jobs.size());
+    std::vector<std::future<void>> tasks(jobs.size());
+    std::vector<VkDeviceSize> staging_size(jobs.size(), 0);
+    for(size_t i = 0; i < jobs.size(); i++)
+        for(const RenderMesh& rmesh : this->models[i]) staging_size[i] += mesh_size(rmesh.properties);
 
-            // However, multiple materials may have the same material ID.
-            // Those ID's are continued counting upwards across models, but inside a
-            // model the ID's start at 0. To get a unique range of material ID's
-            // per model, the ID's of the current model are offset by the sum of all materials of the
-            // models before. Moreover the material ID's can safely offset by this amount because
-            // there are as many unique material ID's are materials in the material vector of the model.
-            // However, this does only work if all meshes are loaded!!!
-            rmesh.properties.record.materialID = this->materials.size() + mesh.materials().at(0);
+    size_t submitted = 0;
+    VkDeviceSize in_flight = 0;
+    const auto submit_merges = [&]() {
+        while(submitted < jobs.size() && (in_flight == 0 || in_flight + staging_size[submitted] <= STAGING_BUDGET))
+        {
+            const size_t i = submitted++;
+            in_flight += staging_size[i];
+            staging[i].reset(new MeshStaging[jobs[i]->model.meshes.size()]);
+            tasks[i] = this->loaders.submit([this, &jobs, &staging, i]() {
+                ParsedModel& model = jobs[i]->model;
+                for(size_t j = 0; j < model.meshes.size(); j++)
+                    staging[i][j].merge = this->stage_render_mesh(model.meshes[j], staging[i][j].buffers, model.hashes[j]);
+            });
         }
+    };
 
-        // load material properties
-        for(const tinyobj::material_t& mtl : model.materials())
+    uint64_t saved_ns = 0;
+    geometry_cache_t geometry_cache;    // content hashes of all geometries that are already stored
+    try
+    {
+        for(size_t i = 0; i < jobs.size(); i++)
         {
-            this->materials.resize(this->materials.size() + 1);
-            RenderMaterial& rmtl = this->materials.back();
+            // all earlier models are released, so this model is always submitted
+            submit_merges();
+            this->loaders.wait(tasks[i]);
+            tasks[i].get();
+            for(size_t j = 0; j < jobs[i]->model.meshes.size(); j++)
+            {
+                // The geometry ID is a sequential number that is unique per geometry.
+                // Meshes with the same content share one geometry ID.
+                RenderMesh& rmesh = this->models[i][j];
+                rmesh.hash = jobs[i]->model.hashes[j];
+                if(this->deduplicate_mesh(rmesh.hash, &jobs[i]->model.meshes[j], geometry_cache, rmesh.properties)) continue;
+                this->upload_render_mesh(rmesh, staging[i][j].buffers);
 
-            // set all properties that are requiered to load the materials
-            rmtl.properties.single_emission = glm2::vec3(mtl.emission[0], mtl.emission[1], mtl.emission[2]);
-            rmtl.properties.map_albedo      = mtl.diffuse_texname;
-            rmtl.properties.map_emission    = mtl.emissive_texname;
-            rmtl.properties.map_roughness   = mtl.roughness_texname;
-            rmtl.properties.map_metallic    = mtl.metallic_texname;
-            rmtl.properties.map_alpha       = mtl.alpha_texname;
-            rmtl.properties.map_normal      = mtl.normal_texname;
+                MergeStatistics& merge = staging[i][j].merge;
+                merge.geometryID = rmesh.properties.record.geometryID;
+                saved_ns += merge.merge_ns - merge.hash_ns;
+                this->load_stats.merges.push_back(merge);
+                this->log_merge(merge);
+            }
+            staging[i].reset();
+            in_flight -= staging_size[i];
 
-            // the non-texture materials can also be set at this stage
-            rmtl.uniform.ior                = mtl.ior;
+            // call callback for model loading
+            this->notify(this->model_load_callback, jobs[i]->path);
         }
+    }
+    catch(...)
+    {
+        // the tasks reference the local vectors, they must be finished before those are destroyed
+        for(std::future<void>& task : tasks)
+            if(task.valid()) this->loaders.wait(task);
+        throw;
+    }
 
-        // call callback for model loading
-        if(this->model_load_callback != nullptr)
-            this->model_load_callback(path);
+    // The parsed models are kept until all meshes are deduplicated, so every mesh is compared with the content of
+    // its geometry. A handle can keep a job alive, so the parsed files are released explicitly.
+    for(const std::shared_ptr<ModelLoadJob>& job : jobs)
+    {
+        job->model.meshes.clear();
+        job->model.obj.clear();
     }
+    this->model_jobs.clear();
+    this->log_deduplication();
+    this->notify(this->info_callback,
+        "Hashing the meshes while merging them saved about " + std::to_string(saved_ns / 1000000) + " ms of separate merge passes."
+    );
+}
 
-    // the model paths are not needed anymore
+void pt::PathTracer::create_streamed_models(void)
+{
+    // The window must at least hold a few vertices, otherwise the number
+    // of copy submissions becomes ridiculous.
+    constexpr static size_t MIN_STREAM_BUDGET = 64 * 1024;
+    if(this->setup->get_settings()->stream_budget < MIN_STREAM_BUDGET)
+        throw std::invalid_argument("[pt::PathTracer::create_streamed_models]: The stream budget must be at least 64KiB.");
+
+    this->models.clear();
+    this->materials.clear();
+    this->emitters.clear();
+    this->texcoords.clear();
     this->model_paths.clear();
+    this->load_stats = {};
+    this->models.reserve(this->model_jobs.size());
+
+    // All meshes are uploaded through one staging window, every model is released as soon as it is uploaded.
+    StagingWindow window;
+    window.init(this->setup, this->cmd_pool, &this->queue_mtx, this->setup->get_settings()->stream_budget);
+
+    geometry_cache_t geometry_cache;
+    for(std::shared_ptr<ModelLoadJob>& job : this->model_jobs)
+    {
+        // Every file is parsed after the previous one is released, models that are cancelled are not part of the scene.
+        // Only the file is parsed in the background, its meshes are built one at a time while they are uploaded.
+        job->start(this->loaders, [job]() { if(!job->cancelled) job->model.obj.load(job->path); });
+        this->loaders.wait(job->done);
+        if(job->cancelled)
+        {
+            job.reset();
+            continue;
+        }
+        job->done.get();
+
+        ObjFile& obj = job->model.obj;
+        this->models.resize(this->models.size() + 1);
+        this->models.back().resize(obj.mesh_count());
+        this->emitters.resize(this->emitters.size() + 1);
+        this->texcoords.resize(this->texcoords.size() + 1);
+        this->texcoords.back().resize(obj.mesh_count());
+        this->append_materials(obj, this->models.back());
+
+        // Every mesh is built, hashed and streamed on its own and released before the next one is built,
+        // so only the parsed file and one mesh are resident. The data in the staging window does not depend on it.
+        ObjMesh mesh;
+        for(size_t i = 0; i < obj.mesh_count(); i++)
+        {
+            obj.build_mesh(i, mesh);
+            RenderMesh& rmesh = this->models.back()[i];
+            this->init_render_mesh(mesh, rmesh);
+            rmesh.hash = hash_mesh(mesh);
+            if(!this->deduplicate_mesh(rmesh.hash, &mesh, geometry_cache, rmesh.properties))
+                this->stream_render_mesh(mesh, rmesh, window);
+            this->collect_emitters(mesh, static_cast<uint32_t>(i), rmesh, this->emitters.back());
+            this->collect_texcoords(mesh, this->texcoords.back()[i]);
+            release_cached_mesh(geometry_cache, rmesh.hash, &mesh);
+        }
+        mesh.clear();
+        this->model_paths.push_back(job->path);
+
+        // A handle can keep the job alive, so the parsed file is released explicitly.
+        this->notify(this->model_load_callback, job->path);
+        obj.clear();
+        job.reset();
+    }
+
+    window.flush();
+    window.destroy();
+    this->model_jobs.clear();
+    this->log_deduplication();
+    this->log_materials();
 }
 
-void pt::PathTracer::load_render_mesh(const vka::Mesh& mesh, RenderMesh& rmesh)
+void pt::PathTracer::reload_models(const std::vector<size_t>& ids)
 {
-    static const std::vector<vka::VertexAttribute> merge_vertices = {
-        { vka::VKA_VERTEX_ATTRIBUTE_TYPE_POSITION, 1}   // vertex positions have 3 components, since vec3 inside storage buffers have an alignment of 16, one spacing float is requiered
-    };
+    // Models are uploaded through a staging window like streamed models, if no stream budget is set this size is used.
+    constexpr static VkDeviceSize RELOAD_WINDOW_SIZE = 16 * 1024 * 1024;
 
-    static const std::vector<vka::VertexAttribute> merge_attribs = {
-        { vka::VKA_VERTEX_ATTRIBUTE_TYPE_NORMAL, 1},    // normal vectors have 3 components, since vec3 inside storage buffers have an alignment of 16, one spacing float is requiered
-        { vka::VKA_VERTEX_ATTRIBUTE_TYPE_TEXTURE_COORDINATE, 0}
-    };
+    // A mesh of another model can share the buffers of a mesh of a reloaded model. Those buffers are
+    // destroyed, so the sharing model is reloaded as well. The owner of a geometry always comes before
+    // the meshes that share it, so one pass in model order finds all of them.
+    std::vector<bool> reload(this->models.size(), false);
+    for(size_t i : ids) reload.at(i) = true;
 
-    std::vector<float> vertices;
-    mesh.merge(vertices, merge_vertices);
-    const size_t vertex_size = vertices.size() * sizeof(float);
+    std::vector<size_t> owner_models;   // model of the owner of every geometry ID
+    for(size_t i = 0; i < this->models.size(); i++)
+    {
+        for(const RenderMesh& rmesh : this->models[i])
+        {
+            if(rmesh.properties.shared) continue;
+            const uint32_t id = rmesh.properties.record.geometryID;
+            if(owner_models.size() <= id) owner_models.resize(id + 1);
+            owner_models[id] = i;
+        }
+    }
+    for(size_t i = 0; i < this->models.size(); i++)
+    {
+        if(reload[i]) continue;
+        for(const RenderMesh& rmesh : this->models[i])
+        {
+            if(rmesh.properties.shared && reload[owner_models.at(rmesh.properties.record.geometryID)])
+            {
+                reload[i] = true;
+                break;
+            }
+        }
+    }
 
-    std::vector<float> vertex_attributes;
-    mesh.merge(vertex_attributes, merge_attribs);
-    const size_t attrib_size = vertex_attributes.size() * sizeof(float);
+    // The object files are parsed concurrently and the textures of their materials are decoded
+    // before anything of the scene is replaced. If a file can not be loaded, the scene stays unchanged.
+    std::vector<std::shared_ptr<ModelLoadJob>> jobs(this->models.size());
+    std::vector<std::future<void>> tasks;
+    for(size_t i = 0; i < this->models.size(); i++)
+    {
+        if(!reload[i]) continue;
+        jobs[i] = std::make_shared<ModelLoadJob>(this->model_paths.at(i));
+        tasks.push_back(this->loaders.submit([job = jobs[i]]() { parse_model(*job, true); }));
+    }
+    this->loaders.wait_all(tasks);
 
-    // init vertex buffer
-    rmesh.vectices.set_create_usage(VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
-    rmesh.vectices.set_memory_properties(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    // The new meshes are uploaded into their own buffers and the geometry IDs of the other meshes are assigned
+    // to copies of their properties. The scene is only changed after everything is uploaded, so if a step
+    // fails, the scene stays unchanged and the materials that were appended for the reloaded models are removed.
+    const size_t first_material = this->materials.size();
+    model_array_t reloaded(this->models.size());
+    std::vector<std::vector<EmissiveTriangle>> reloaded_emitters(this->models.size());
+    std::vector<std::vector<std::vector<float>>> reloaded_texcoords(this->models.size());
+    std::vector<std::vector<MeshProperties>> properties(this->models.size());
+    try
+    {
+        for(size_t i = 0; i < this->models.size(); i++)
+        {
+            if(!reload[i]) continue;
+            const ParsedModel& parsed = jobs[i]->model;
+            reloaded[i].resize(parsed.meshes.size());
+            reloaded_texcoords[i].resize(parsed.meshes.size());
+            this->append_materials(parsed.obj, reloaded[i]);
+            for(size_t j = 0; j < parsed.meshes.size(); j++)
+            {
+                this->collect_emitters(parsed.meshes[j], static_cast<uint32_t>(j), reloaded[i][j], reloaded_emitters[i]);
+                this->collect_texcoords(parsed.meshes[j], reloaded_texcoords[i][j]);
+            }
+        }
+        this->decode_materials(first_material);
 
-    // init attribute buffer
-    rmesh.attributes.set_create_usage(VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
-    rmesh.attributes.set_memory_properties(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        // The geometry IDs of the whole scene are assigned again. The content of the other models is only stored
+        // on the device, so they keep their buffers and their sharing. The reloaded meshes only share among each other.
+        const VkDeviceSize stream_budget = this->setup->get_settings()->stream_budget;
+        StagingWindow window;
+        window.init(this->setup, this->cmd_pool, &this->queue_mtx, (stream_budget != 0) ? stream_budget : RELOAD_WINDOW_SIZE);
 
-    // init index buffer
-    rmesh.indices.set_create_usage(VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
-    rmesh.indices.set_memory_properties(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        this->load_stats.mesh_count = 0;
+        this->load_stats.geometry_count = 0;
+        this->load_stats.deduplicated_bytes = 0;
+        geometry_cache_t geometry_cache;
+        for(size_t i = 0; i < this->models.size(); i++)
+        {
+            if(!reload[i])
+            {
+                for(const RenderMesh& rmesh : this->models[i])
+                {
+                    properties[i].push_back(rmesh.properties);
+                    this->deduplicate_mesh(rmesh.hash, nullptr, geometry_cache, properties[i].back());
+                }
+                continue;
+            }
+
+            const ParsedModel& parsed = jobs[i]->model;
+            for(size_t j = 0; j < parsed.meshes.size(); j++)
+            {
+                const ObjMesh& mesh = parsed.meshes[j];
+                RenderMesh& rmesh = reloaded[i][j];
+                this->init_render_mesh(mesh, rmesh);
+                rmesh.hash = parsed.hashes[j];
+                if(!this->deduplicate_mesh(parsed.hashes[j], &mesh, geometry_cache, rmesh.properties))
+                    this->stream_render_mesh(mesh, rmesh, window);
+            }
+            release_cached_meshes(geometry_cache);
+            jobs[i].reset();
+        }
+        window.flush();
+        window.destroy();
+    }
+    catch(...)
+    {
+        this->materials.erase(this->materials.begin() + first_material, this->materials.end());
+        throw;
+    }
+
+    // everything is uploaded, the buffers of the reloaded models are replaced and the other meshes get their new geometry IDs
+    for(size_t i = 0; i < this->models.size(); i++)
+    {
+        if(!reload[i])
+        {
+            for(size_t j = 0; j < this->models[i].size(); j++)
+                this->models[i][j].properties = properties[i][j];
+            continue;
+        }
+
+        for(RenderMesh& rmesh : this->models[i])
+            if(!rmesh.properties.shared) clear_render_mesh(rmesh);
+        this->models[i] = std::move(reloaded[i]);
+        this->emitters[i] = std::move(reloaded_emitters[i]);
+        this->texcoords[i] = std::move(reloaded_texcoords[i]);
+        this->notify(this->model_load_callback, this->model_paths[i]);
+    }
+    this->log_deduplication();
+
+    // the alpha maps of the appended materials are only decoded until they are uploaded
+    std::vector<bool> decoded(this->materials.size(), false);
+    std::fill(decoded.begin() + first_material, decoded.end(), true);
+    this->classify_meshes(decoded);
+
+    // the materials of the reloaded models are appended, the previous ones are removed if they are not used anymore
+    this->upload_materials(first_material);
+    this->compact_materials();
+    this->mtl_buffer.clear();
+    this->load_mtl_buffer(this->materials);
+    this->log_materials();
+}
+
+bool pt::PathTracer::deduplicate_mesh(const Hash128& hash, const ObjMesh* mesh, geometry_cache_t& cache, MeshProperties& properties)
+{
+    // The geometry IDs are handed out in the order in which the unique geometries
+    // are found, so the size of the cache is always the next free geometry ID.
+    // A mesh is only shared if its content equals the first mesh with the same hash. If that mesh
+    // was already released by this load, only the hash and the sizes are compared. A mesh of a
+    // previous load is passed without content, it only shares with the geometry it shared before.
+    this->load_stats.mesh_count++;
+    const auto range = cache.equal_range(hash);
+    for(auto it = range.first; it != range.second; it++)
+    {
+        const CachedGeometry& geometry = it->second;
+        if(geometry.vertex_count != properties.vertex_count || geometry.index_count != properties.index_count) continue;
+        if(mesh == nullptr && geometry.previousID != properties.record.geometryID) continue;
+        if(mesh != nullptr && geometry.previousID != CachedGeometry::NO_ID) continue;
+        if(mesh != nullptr && geometry.mesh != nullptr && !equal_content(*geometry.mesh, *mesh)) continue;
+
+        properties.record.geometryID = geometry.geometryID;
+        properties.shared = true;
+        this->load_stats.deduplicated_bytes += mesh_size(properties);
+        return true;
+    }
+
+    const uint32_t previousID = (mesh == nullptr) ? properties.record.geometryID : CachedGeometry::NO_ID;
+    const CachedGeometry geometry = { static_cast<uint32_t>(cache.size()), properties.vertex_count, properties.index_count, mesh, previousID };
+    cache.emplace(hash, geometry);
+    properties.record.geometryID = geometry.geometryID;
+    properties.shared = false;
+    this->load_stats.geometry_count++;
+    return false;
+}
+
+void pt::PathTracer::get_geometry_owners(std::vector<const RenderMesh*>& owners) const
+{
+    // The owner of a geometry ID is the only mesh with this ID that is not shared.
+    // The returned vector is indexed by the geometry ID.
+    owners.clear();
+    for(const auto& model : this->models)
+    {
+        for(const RenderMesh& mesh : model)
+        {
+            if(mesh.properties.shared) continue;
+            const uint32_t id = mesh.properties.record.geometryID;
+            if(owners.size() <= id) owners.resize(id + 1, nullptr);
+            owners[id] = &mesh;
+        }
+    }
+}
+
+void pt::PathTracer::log_deduplication(void)
+{
+    this->notify(this->info_callback,
+        "Stored " + std::to_string(this->load_stats.geometry_count) + " unique geometries for " +
+        std::to_string(this->load_stats.mesh_count) + " meshes, deduplication saved " +
+        std::to_string(this->load_stats.deduplicated_bytes) + " bytes."
+    );
+}
+
+void pt::PathTracer::log_merge(const MergeStatistics& stats)
+{
+    // the merge time without the hash time is what a separate hash pass would have spent merging the data again
+    std::string msg =
+        "Merged geometry " + std::to_string(stats.geometryID) + " directly into staging memory in " +
+        std::to_string(stats.merge_ns / 1000) + " us, saved " + std::to_string(stats.bytes_saved) + " bytes of intermediate copies";
+    if(stats.hashed)
+        msg += ", hashing it while merging took " + std::to_string(stats.hash_ns / 1000) + " us and saved about " +
+               std::to_string((stats.merge_ns - stats.hash_ns) / 1000) + " us of a separate merge pass";
+    this->notify(this->info_callback, msg + ".");
+}
+
+void pt::PathTracer::append_materials(const ObjFile& obj, std::vector<RenderMesh>& rmeshes)
+{
+    const std::vector<tinyobj::material_t>& mtls = obj.materials();
+
+    // Material libraries often contain many materials that no mesh uses, only the
+    // referenced materials are loaded. Their textures are the most expensive part.
+    // The material of a mesh is known before it is built, faces without a material use the first one, see 'build_mesh'.
+    std::vector<size_t> materials(obj.mesh_count());
+    std::vector<uint32_t> remap(mtls.size(), UINT32_MAX);
+    for(size_t i = 0; i < obj.mesh_count(); i++)
+    {
+        materials[i] = static_cast<size_t>(std::max(obj.mesh_info(i).material, 0));
+        if(materials[i] >= mtls.size())
+            throw std::runtime_error("[pt::PathTracer::append_materials]: A mesh references a material that does not exist in the material library.");
+        remap[materials[i]] = 0;
+    }
+
+    for(size_t i = 0; i < mtls.size(); i++)
+    {
+        const tinyobj::material_t& mtl = mtls[i];
+        if(remap[i] == UINT32_MAX)
+        {
+            // albedo, normal, roughness, metallic and alpha map are always loaded, the emission map only if it is set
+            this->load_stats.skipped_materials++;
+            this->load_stats.skipped_textures += mtl.emissive_texname.empty() ? 5 : 6;
+            continue;
+        }
+
+        // The material ID's are continued counting upwards across models. Inside a model the ID's start at 0,
+        // therefore they are remapped to the position of the material inside the material vector.
+        remap[i] = static_cast<uint32_t>(this->materials.size());
+        this->materials.resize(this->materials.size() + 1);
+        RenderMaterial& rmtl = this->materials.back();
+
+        // set all properties that are requiered to load the materials
+        rmtl.properties.single_emission = glm2::vec3(mtl.emission[0], mtl.emission[1], mtl.emission[2]);
+        rmtl.properties.map_albedo      = mtl.diffuse_texname;
+        rmtl.properties.map_emission    = mtl.emissive_texname;
+        rmtl.properties.map_roughness   = mtl.roughness_texname;
+        rmtl.properties.map_metallic    = mtl.metallic_texname;
+        rmtl.properties.map_alpha       = mtl.alpha_texname;
+        rmtl.properties.map_normal      = mtl.normal_texname;
+
+        // the non-texture materials can also be set at this stage
+        rmtl.uniform.ior                = mtl.ior;
+    }
 
+    // one mesh has exactly one material
+    for(size_t i = 0; i < obj.mesh_count(); i++)
+        rmeshes[i].properties.record.materialID = remap[materials[i]];
+}
+
+void pt::PathTracer::collect_emitters(const ObjMesh& mesh, uint32_t index, const RenderMesh& rmesh, std::vector<EmissiveTriangle>& emitters) const
+{
+    // Every triangle of a mesh with an emission value or an emission map is a candidate. Whether it emits any light
+    // is only known after the emission map is decoded, the light table skips the triangles without emission.
+    const MaterialProperties& properties = this->materials.at(rmesh.properties.record.materialID).properties;
+    float e[4];     // glm2::vec3 stores 4 components
+    properties.single_emission.store(e);
+    if(properties.map_emission.empty() && !(e[0] > 0.0f || e[1] > 0.0f || e[2] > 0.0f))
+        return;
+
+    std::vector<float> vertices(static_cast<size_t>(mesh.vertex_count()) * ObjMesh::VERTEX_COMPONENTS);
+    mesh.write_vertices(vertices.data(), 0, mesh.vertex_count());
+    const uint32_t* indices = mesh.pindices();
+    for(uint32_t t = 0; t < mesh.index_count() / 3; t++)
+    {
+        EmissiveTriangle triangle;
+        for(uint32_t k = 0; k < 3; k++)
+        {
+            const float* v = vertices.data() + static_cast<size_t>(indices[t * 3 + k]) * ObjMesh::VERTEX_COMPONENTS;
+            std::copy(v, v + 3, triangle.vertices[k]);
+        }
+        triangle.mesh = index;
+        triangle.primitive = t;
+        emitters.push_back(triangle);
+    }
+}
+
+void pt::PathTracer::log_materials(void)
+{
+    this->notify(this->info_callback,
+        "Loading " + std::to_string(this->materials.size()) + " referenced materials, skipped " +
+        std::to_string(this->load_stats.skipped_materials) + " unused materials with " +
+        std::to_string(this->load_stats.skipped_textures) + " textures."
+    );
+}
+
+void pt::PathTracer::init_render_mesh(const ObjMesh& mesh, RenderMesh& rmesh)
+{
     // partly initialize the mesh propertis, the other part is initialized inside create_render_buffers
     rmesh.properties.vertex_count       = mesh.vertex_count();
     rmesh.properties.vertex_format      = VK_FORMAT_R32G32B32_SFLOAT;
-    rmesh.properties.vertex_stride      = (1 + mesh.vertex_component_count()) * sizeof(float);
-    rmesh.properties.index_count        =  mesh.index_count();
-    // the vertex attribute consists of a normal vector (XYZ) and a texture coordinate (UV) and the size of one component = sizeof(float)
+    rmesh.properties.vertex_stride      = ObjMesh::VERTEX_COMPONENTS * sizeof(float);
+    rmesh.properties.index_count        = mesh.index_count();
+    // the vertex attribute consists of a normal vector (XYZ), a packed tangent frame and a texture coordinate (UV) and the size of one component = sizeof(float)
     // -> (size of attribute) = (number of components) * (size of one component)
+}
+
+pt::MergeStatistics pt::PathTracer::stage_render_mesh(const ObjMesh& mesh, vka::Buffer* staging, Hash128& hash) const
+{
+    const size_t vertex_size = mesh.vertex_count() * ObjMesh::VERTEX_COMPONENTS * sizeof(float);
+    const size_t attrib_size = mesh.vertex_count() * ObjMesh::ATTRIBUTE_COMPONENTS * sizeof(float);
 
     // create staging buffers
     // 0: staging buffer for vertices
     // 1: staging buffer for vertex attributes
     // 2: staging buffer for indices
-    vka::Buffer staging[3];
     for(uint32_t i = 0; i < 3; i++)
     {
         staging[i].set_create_flags(0);
         staging[i].set_create_usage(VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
         staging[i].set_create_sharing_mode(VK_SHARING_MODE_EXCLUSIVE);
         staging[i].set_create_queue_families(&this->setup->get_rt_queue_info().queueFamilyIndex, 1);
-        staging[i].set_memory_properties(VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+        // the merged data is read back by the hash, so the memory is cached, every selected device has such a memory type
+        staging[i].set_memory_properties(VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT);
         staging[i].set_device(this->setup->get_device());
         staging[i].set_physical_device(this->setup->get_physical_device());
     }
@@ -128,25 +706,78 @@ void pt::PathTracer::load_render_mesh(const vka::Mesh& mesh, RenderMesh& rmesh)
     staging[2].set_create_size(mesh.indices_size());
 
     if(staging[0].create() != VK_SUCCESS)
-        throw std::runtime_error("[pt::PathTracer::load_render_mesh]: Failed to create staging buffer for vertices.");
+        throw std::runtime_error("[pt::PathTracer::stage_render_mesh]: Failed to create staging buffer for vertices.");
     if(staging[1].create() != VK_SUCCESS)
-        throw std::runtime_error("[pt::PathTracer::load_render_mesh]: Failed to create staging buffer for vertex attributes.");
+        throw std::runtime_error("[pt::PathTracer::stage_render_mesh]: Failed to create staging buffer for vertex attributes.");
     if(staging[2].create() != VK_SUCCESS)
-        throw std::runtime_error("[pt::PathTracer::load_render_mesh]: Failed to create staging buffer for indices.");
+        throw std::runtime_error("[pt::PathTracer::stage_render_mesh]: Failed to create staging buffer for indices.");
 
     // stream data into the staging buffers
     void* map[3];
     #pragma unroll_completely
     for(uint32_t i = 0; i < 3; i++) map[i] = staging[i].map(staging[i].size(), 0);
 
-    memcpy(map[0], vertices.data(),             staging[0].size());
-    memcpy(map[1], vertex_attributes.data(),    staging[1].size());
-    memcpy(map[2], mesh.pindices(),             staging[2].size());
+    // The vertices and attributes are merged straight into the mapped memory in small parts, every part is
+    // hashed from the mapping while it is still in the cache. So every byte is written once and the hash needs
+    // no merge pass of its own. The parts are hashed in the same order as 'hash_mesh' does, so both paths produce the same hash.
+    constexpr static uint32_t MERGE_CHUNK = 1024;
+    float* vertices = reinterpret_cast<float*>(map[0]);
+    float* attributes = reinterpret_cast<float*>(map[1]);
+    ContentHasher hasher;
+    std::chrono::steady_clock::duration hash_time(0);
+    const auto merge_begin = std::chrono::steady_clock::now();
+    for(uint32_t first = 0; first < mesh.vertex_count(); first += MERGE_CHUNK)
+    {
+        const uint32_t count = std::min(MERGE_CHUNK, mesh.vertex_count() - first);
+        float* dst = vertices + static_cast<size_t>(first) * ObjMesh::VERTEX_COMPONENTS;
+        mesh.write_vertices(dst, first, count);
+        const auto hash_begin = std::chrono::steady_clock::now();
+        hasher.update(dst, count * ObjMesh::VERTEX_COMPONENTS * sizeof(float));
+        hash_time += std::chrono::steady_clock::now() - hash_begin;
+    }
+    for(uint32_t first = 0; first < mesh.vertex_count(); first += MERGE_CHUNK)
+    {
+        const uint32_t count = std::min(MERGE_CHUNK, mesh.vertex_count() - first);
+        float* dst = attributes + static_cast<size_t>(first) * ObjMesh::ATTRIBUTE_COMPONENTS;
+        mesh.write_attributes(dst, first, count);
+        const auto hash_begin = std::chrono::steady_clock::now();
+        hasher.update(dst, count * ObjMesh::ATTRIBUTE_COMPONENTS * sizeof(float));
+        hash_time += std::chrono::steady_clock::now() - hash_begin;
+    }
+    const auto merge_end = std::chrono::steady_clock::now();
+    memcpy(map[2], mesh.pindices(), staging[2].size());
+    hasher.update(mesh.pindices(), mesh.indices_size());
+    hash = hasher.digest();
 
     #pragma unroll_completely
     for(uint32_t i = 0; i < 3; i++) staging[i].unmap();
 
+    // the geometry ID is set by the caller
+    return {
+        0,
+        vertex_size + attrib_size,
+        static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(merge_end - merge_begin).count()),
+        true,
+        static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(hash_time).count())
+    };
+}
+
+void pt::PathTracer::upload_render_mesh(RenderMesh& rmesh, vka::Buffer* staging)
+{
+    // init vertex buffer
+    rmesh.vectices.set_create_usage(VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+    rmesh.vectices.set_memory_properties(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+    // init attribute buffer
+    rmesh.attributes.set_create_usage(VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+    rmesh.attributes.set_memory_properties(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+    // init index buffer
+    rmesh.indices.set_create_usage(VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+    rmesh.indices.set_memory_properties(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
     // secondary command buffers for copy operation
+    std::lock_guard<std::mutex> lock(this->queue_mtx);
     VkCommandBuffer cbo[3];
     cbo[0] = vka::Buffer::enqueue_copy(this->setup->get_device(), this->cmd_pool, 1, staging + 0, &rmesh.vectices);
     cbo[1] = vka::Buffer::enqueue_copy(this->setup->get_device(), this->cmd_pool, 1, staging + 1, &rmesh.attributes);
@@ -154,6 +785,68 @@ void pt::PathTracer::load_render_mesh(const vka::Mesh& mesh, RenderMesh& rmesh)
 
     // execute copy operations
     if(vka::utility::execute_scb(this->setup->get_device(), this->cmd_pool, this->setup->get_rt_queue(), 3, cbo) != VK_SUCCESS)
-        throw std::runtime_error("[pt::PathTracer::load_render_mesh]: Failed to copy staging buffers.");
+        throw std::runtime_error("[pt::PathTracer::upload_render_mesh]: Failed to copy staging buffers.");
     vkFreeCommandBuffers(this->setup->get_device(), this->cmd_pool, 3, cbo);
 }
+
+void pt::PathTracer::stream_render_mesh(const ObjMesh& mesh, RenderMesh& rmesh, StagingWindow& window)
+{
+    constexpr static VkDeviceSize VERTEX_SIZE = ObjMesh::VERTEX_COMPONENTS * sizeof(float);
+    constexpr static VkDeviceSize ATTRIBUTE_SIZE = ObjMesh::ATTRIBUTE_COMPONENTS * sizeof(float);
+
+    // In contrast to resident loading, the destination buffers are created before the
+    // data is copied, because the data arrives in multiple parts.
+    this->init_device_buffer(rmesh.vectices, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, mesh.vertex_count() * VERTEX_SIZE);
+    this->init_device_buffer(rmesh.attributes, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, mesh.vertex_count() * ATTRIBUTE_SIZE);
+    this->init_device_buffer(rmesh.indices, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, mesh.indices_size());
+
+    // the vertices and attributes are written into the window in chunks that fit into the window
+    // the time of the flushes inside 'stage' is not part of the merge time
+    std::chrono::steady_clock::duration merge_time(0);
+    const uint32_t vertex_chunk = static_cast<uint32_t>(window.capacity() / ATTRIBUTE_SIZE);
+    for(uint32_t first = 0; first < mesh.vertex_count(); first += vertex_chunk)
+    {
+        const uint32_t count = std::min(vertex_chunk, mesh.vertex_count() - first);
+        float* dst = reinterpret_cast<float*>(window.stage(rmesh.vectices.handle(), first * VERTEX_SIZE, count * VERTEX_SIZE));
+        auto merge_begin = std::chrono::steady_clock::now();
+        mesh.write_vertices(dst, first, count);
+        merge_time += std::chrono::steady_clock::now() - merge_begin;
+
+        dst = reinterpret_cast<float*>(window.stage(rmesh.attributes.handle(), first * ATTRIBUTE_SIZE, count * ATTRIBUTE_SIZE));
+        merge_begin = std::chrono::steady_clock::now();
+        mesh.write_attributes(dst, first, count);
+        merge_time += std::chrono::steady_clock::now() - merge_begin;
+    }
+
+    const MergeStatistics merge = {
+        rmesh.properties.record.geometryID,
+        mesh.vertex_count() * (VERTEX_SIZE + ATTRIBUTE_SIZE),
+        static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(merge_time).count()),
+        false,
+        0
+    };
+    this->load_stats.merges.push_back(merge);
+    this->log_merge(merge);
+
+    const VkDeviceSize index_chunk = window.capacity() / sizeof(uint32_t) * sizeof(uint32_t);
+    const uint8_t* indices = reinterpret_cast<const uint8_t*>(mesh.pindices());
+    for(VkDeviceSize offset = 0; offset < mesh.indices_size(); offset += index_chunk)
+    {
+        const VkDeviceSize size = std::min(index_chunk, mesh.indices_size() - offset);
+        memcpy(window.stage(rmesh.indices.handle(), offset, size), indices + offset, size);
+    }
+}
+
+void pt::PathTracer::init_device_buffer(vka::Buffer& buff, VkBufferUsageFlags usage, VkDeviceSize size)
+{
+    buff.set_device(this->setup->get_device());
+    buff.set_physical_device(this->setup->get_physical_device());
+    buff.set_create_flags(0);
+    buff.set_create_size(size);
+    buff.set_create_usage(usage);
+    buff.set_create_sharing_mode(VK_SHARING_MODE_EXCLUSIVE);
+    buff.set_create_queue_families(&this->setup->get_rt_queue_info().queueFamilyIndex, 1);
+    buff.set_memory_properties(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    if(buff.create() != VK_SUCCESS)
+        throw std::runtime_error("[pt::PathTracer::init_device_buffer]: Failed to create device buffer.");
+}
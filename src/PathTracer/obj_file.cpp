@@ -0,0 +1,317 @@
+#include "../application.h"
+#include <cmath>
+#include <cstring>
+#include <immintrin.h>
+#include <istream>
+#include <map>
+#include <unordered_map>
+
+namespace
+{
+    // Stream buffer that reads directly from the memory mapping of a file,
+    // so the object file is never copied into a string or a file buffer.
+    class MappedStreamBuffer : public std::streambuf
+    {
+    public:
+        MappedStreamBuffer(const char* data, size_t size)
+        {
+            char* begin = const_cast<char*>(data);  // the get area is never written to
+            this->setg(begin, begin, begin + size);
+        }
+    };
+
+    struct IndexHash
+    {
+        size_t operator() (const tinyobj::index_t& i) const noexcept
+        {
+            uint64_t h = static_cast<uint32_t>(i.vertex_index);
+            h = h * 0x9E3779B97F4A7C15ull ^ static_cast<uint32_t>(i.normal_index);
+            h = h * 0x9E3779B97F4A7C15ull ^ static_cast<uint32_t>(i.texcoord_index);
+            return static_cast<size_t>(h ^ (h >> 32));
+        }
+    };
+
+    struct IndexEqual
+    {
+        bool operator() (const tinyobj::index_t& a, const tinyobj::index_t& b) const noexcept
+        {
+            return a.vertex_index == b.vertex_index && a.normal_index == b.normal_index && a.texcoord_index == b.texcoord_index;
+        }
+    };
+
+    inline float dot3(const float a[3], const float b[3]) noexcept
+    {
+        return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+    }
+
+    inline void cross3(const float a[3], const float b[3], float r[3]) noexcept
+    {
+        r[0] = a[1] * b[2] - a[2] * b[1];
+        r[1] = a[2] * b[0] - a[0] * b[2];
+        r[2] = a[0] * b[1] - a[1] * b[0];
+    }
+
+    // Removes the part of v along the unit vector n and normalizes the rest, returns false if nothing is left.
+    inline bool orthonormalize(float v[3], const float n[3]) noexcept
+    {
+        const float d = dot3(v, n);
+        for(uint32_t k = 0; k < 3; k++) v[k] -= n[k] * d;
+        const float len = std::sqrt(dot3(v, v));
+        if(!(len > 1e-20f)) return false;
+        for(uint32_t k = 0; k < 3; k++) v[k] /= len;
+        return true;
+    }
+
+    // Packs a unit tangent into octahedral coordinates, the layout of pt::ObjMesh::TANGENT_VALID.
+    uint32_t pack_tangent(const float t[3], bool flip) noexcept
+    {
+        const float l1 = std::abs(t[0]) + std::abs(t[1]) + std::abs(t[2]);
+        float u = t[0] / l1, v = t[1] / l1;
+        if(t[2] < 0.0f)
+        {
+            const float fu = (1.0f - std::abs(v)) * (u >= 0.0f ? 1.0f : -1.0f);
+            const float fv = (1.0f - std::abs(u)) * (v >= 0.0f ? 1.0f : -1.0f);
+            u = fu;
+            v = fv;
+        }
+        const uint32_t qu = static_cast<uint32_t>(std::lround((std::min(std::max(u, -1.0f), 1.0f) * 0.5f + 0.5f) * 32767.0f));
+        const uint32_t qv = static_cast<uint32_t>(std::lround((std::min(std::max(v, -1.0f), 1.0f) * 0.5f + 0.5f) * 32767.0f));
+        return pt::ObjMesh::TANGENT_VALID | (flip ? pt::ObjMesh::TANGENT_FLIP : 0) | (qv << 15) | qu;
+    }
+}
+
+void pt::ObjFile::load(const std::string& path)
+{
+    this->clear();
+
+    // The mapping is only requiered while parsing, tinyobj copies the
+    // attributes into its own arrays.
+    MappedFile file(path);
+    MappedStreamBuffer sbuf(file.data(), file.size());
+    std::istream in(&sbuf);
+
+    // material libraries are referenced relative to the object file
+    const size_t sep = path.find_last_of("/\\");
+    tinyobj::MaterialFileReader mtl_reader((sep == std::string::npos) ? std::string() : path.substr(0, sep + 1));
+
+    std::string warn, err;
+    if(!tinyobj::LoadObj(&this->attrib, &this->shapes, &this->mtls, &warn, &err, &in, &mtl_reader, true))
+        throw std::runtime_error("[pt::ObjFile::load]: Failed to load object file \"" + path + "\": " + err);
+
+    // Group the faces of every shape by their material. Iterating the materials in
+    // ascending order makes the order of the meshes deterministic.
+    for(uint32_t s = 0; s < this->shapes.size(); s++)
+    {
+        std::map<int, uint32_t> face_counts;
+        for(int mtl : this->shapes[s].mesh.material_ids) face_counts[mtl]++;
+        // faces without a material use the first material of the file, see 'build_mesh'
+        if(this->mtls.empty() && face_counts.count(-1) != 0)
+            throw std::runtime_error("[pt::ObjFile::load]: Object file \"" + path + "\" has faces without a material, but no material library.");
+        for(const auto& fc : face_counts)
+            this->infos.push_back({ s, fc.first, fc.second });
+    }
+}
+
+void pt::ObjFile::clear(void) noexcept
+{
+    this->attrib = tinyobj::attrib_t();
+    std::vector<tinyobj::shape_t>().swap(this->shapes);
+    std::vector<tinyobj::material_t>().swap(this->mtls);
+    std::vector<ObjMeshInfo>().swap(this->infos);
+}
+
+void pt::ObjFile::build_mesh(size_t i, ObjMesh& mesh) const
+{
+    const ObjMeshInfo& info = this->infos.at(i);
+    const tinyobj::mesh_t& src = this->shapes.at(info.shape).mesh;
+
+    mesh.clear();
+    mesh.attrib = &this->attrib;
+    mesh.mtl = (info.material < 0) ? 0 : info.material; // faces without a material use the first material of the file
+    mesh.idx.reserve(info.face_count * 3);
+
+    // Every unique combination of position, normal and texture coordinate becomes one vertex.
+    // The faces are already triangulated, so every face has exactly 3 indices.
+    // The lookup table only lives while the mesh is built, its nodes are allocated from the scratch arena.
+    ScratchScope scratch;
+    std::unordered_map<tinyobj::index_t, uint32_t, IndexHash, IndexEqual, ScratchAllocator<std::pair<const tinyobj::index_t, uint32_t>>> unique;
+    unique.reserve(info.face_count);
+    for(size_t f = 0; f < src.material_ids.size(); f++)
+    {
+        if(src.material_ids[f] != info.material) continue;
+        for(size_t v = 0; v < 3; v++)
+        {
+            const tinyobj::index_t& ref = src.indices[f * 3 + v];
+            const auto it = unique.emplace(ref, static_cast<uint32_t>(mesh.refs.size()));
+            if(it.second) mesh.refs.push_back(ref);
+            mesh.idx.push_back(it.first->second);
+        }
+    }
+    mesh.build_tangents();
+}
+
+void pt::ObjMesh::build_tangents(void)
+{
+    // Same construction as MikkTSpace: the tangent and bitangent of every triangle follow the U and V direction of its
+    // texture coordinates. They are projected into the tangent plane of every corner and averaged weighted by the angle
+    // of the corner. The bitangent is not stored, only its side relative to cross(normal, tangent), so the shader rebuilds
+    // it as sign * cross(normal, tangent) from the interpolated vectors. The vertices are unique per position, normal
+    // and texture coordinate, so seams of the texture coordinates already split them.
+    this->tangents.assign(this->refs.size(), 0);
+    if(this->attrib->texcoords.empty()) return;
+
+    ScratchScope scratch;
+    std::vector<float, ScratchAllocator<float>> normals(this->refs.size() * 3);     // normal of the vertex, face normal if it has none
+    std::vector<float, ScratchAllocator<float>> frames(this->refs.size() * 6, 0.0f); // sum of the tangents (XYZ) and bitangents (XYZ)
+    const float* positions = this->attrib->vertices.data();
+    const float* texcoords = this->attrib->texcoords.data();
+
+    // vertices without a normal use the area weighted normal of the triangles around them
+    for(size_t t = 0; t < this->idx.size(); t += 3)
+    {
+        const float* p[3];
+        for(uint32_t k = 0; k < 3; k++) p[k] = positions + 3 * this->refs[this->idx[t + k]].vertex_index;
+        const float e1[3] = { p[1][0] - p[0][0], p[1][1] - p[0][1], p[1][2] - p[0][2] };
+        const float e2[3] = { p[2][0] - p[0][0], p[2][1] - p[0][1], p[2][2] - p[0][2] };
+        float ng[3];
+        cross3(e1, e2, ng);
+        for(uint32_t k = 0; k < 3; k++)
+        {
+            const uint32_t i = this->idx[t + k];
+            if(this->refs[i].normal_index >= 0) continue;
+            for(uint32_t c = 0; c < 3; c++) normals[i * 3 + c] += ng[c];
+        }
+    }
+    for(size_t i = 0; i < this->refs.size(); i++)
+    {
+        float* n = normals.data() + i * 3;
+        if(this->refs[i].normal_index >= 0) std::copy_n(this->attrib->normals.data() + 3 * this->refs[i].normal_index, 3, n);
+        const float len = std::sqrt(dot3(n, n));
+        if(len > 1e-20f) for(uint32_t c = 0; c < 3; c++) n[c] /= len;
+    }
+
+    for(size_t t = 0; t < this->idx.size(); t += 3)
+    {
+        const tinyobj::index_t* r[3];
+        for(uint32_t k = 0; k < 3; k++) r[k] = &this->refs[this->idx[t + k]];
+        if(r[0]->texcoord_index < 0 || r[1]->texcoord_index < 0 || r[2]->texcoord_index < 0) continue;
+
+        const float* p[3];
+        const float* uv[3];
+        for(uint32_t k = 0; k < 3; k++)
+        {
+            p[k] = positions + 3 * r[k]->vertex_index;
+            uv[k] = texcoords + 2 * r[k]->texcoord_index;
+        }
+        const float e1[3] = { p[1][0] - p[0][0], p[1][1] - p[0][1], p[1][2] - p[0][2] };
+        const float e2[3] = { p[2][0] - p[0][0], p[2][1] - p[0][1], p[2][2] - p[0][2] };
+        const float du1 = uv[1][0] - uv[0][0], dv1 = uv[1][1] - uv[0][1];
+        const float du2 = uv[2][0] - uv[0][0], dv2 = uv[2][1] - uv[0][1];
+        const float det = du1 * dv2 - du2 * dv1;
+        if(det == 0.0f || !std::isfinite(det)) continue;
+
+        // only the directions are used, so the determinant only contributes its sign
+        const float s = (det > 0.0f) ? 1.0f : -1.0f;
+        float tangent[3], bitangent[3];
+        for(uint32_t c = 0; c < 3; c++)
+        {
+            tangent[c] = (e1[c] * dv2 - e2[c] * dv1) * s;
+            bitangent[c] = (e2[c] * du1 - e1[c] * du2) * s;
+        }
+
+        for(uint32_t k = 0; k < 3; k++)
+        {
+            // angle of the corner between its two edges
+            const float* a = p[(k + 1) % 3];
+            const float* b = p[(k + 2) % 3];
+            float ea[3] = { a[0] - p[k][0], a[1] - p[k][1], a[2] - p[k][2] };
+            float eb[3] = { b[0] - p[k][0], b[1] - p[k][1], b[2] - p[k][2] };
+            const float la = std::sqrt(dot3(ea, ea)), lb = std::sqrt(dot3(eb, eb));
+            if(!(la > 0.0f && lb > 0.0f)) continue;
+            const float angle = std::acos(std::min(std::max(dot3(ea, eb) / (la * lb), -1.0f), 1.0f));
+
+            const uint32_t i = this->idx[t + k];
+            const float* n = normals.data() + i * 3;
+            float tk[3], bk[3];
+            std::copy_n(tangent, 3, tk);
+            std::copy_n(bitangent, 3, bk);
+            if(!orthonormalize(tk, n)) continue;
+            if(!orthonormalize(bk, n)) std::fill_n(bk, 3, 0.0f);
+            for(uint32_t c = 0; c < 3; c++)
+            {
+                frames[i * 6 + c] += tk[c] * angle;
+                frames[i * 6 + 3 + c] += bk[c] * angle;
+            }
+        }
+    }
+
+    for(size_t i = 0; i < this->refs.size(); i++)
+    {
+        const float* n = normals.data() + i * 3;
+        float* tangent = frames.data() + i * 6;
+        const float* bitangent = tangent + 3;
+        if(!orthonormalize(tangent, n)) continue;
+        float side[3];
+        cross3(n, tangent, side);
+        this->tangents[i] = pack_tangent(tangent, dot3(side, bitangent) < 0.0f);
+    }
+}
+
+void pt::ObjMesh::write_vertices(float* dst, uint32_t first, uint32_t count) const
+{
+    // Two padded vertices are gathered into one 256 bit register, the padding lane is masked
+    // out and therefore zero. Masked lanes are never read, so the gather can not read past
+    // the end of the position array.
+    const float* positions = this->attrib->vertices.data();
+    const tinyobj::index_t* refs = this->refs.data() + first;
+    const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 0, 0, 1, 2, 0);
+    const __m256 mask256 = _mm256_castsi256_ps(_mm256_setr_epi32(-1, -1, -1, 0, -1, -1, -1, 0));
+
+    uint32_t i = 0;
+    for(; i + 2 <= count; i += 2, dst += 2 * VERTEX_COMPONENTS)
+    {
+        const int a = 3 * refs[i].vertex_index;
+        const int b = 3 * refs[i + 1].vertex_index;
+        const __m256i idx = _mm256_add_epi32(_mm256_setr_epi32(a, a, a, a, b, b, b, b), lanes);
+        _mm256_storeu_ps(dst, _mm256_mask_i32gather_ps(_mm256_setzero_ps(), positions, idx, mask256, sizeof(float)));
+    }
+
+    if(i < count)
+    {
+        const __m128i mask128 = _mm_setr_epi32(-1, -1, -1, 0);
+        _mm_storeu_ps(dst, _mm_maskload_ps(positions + 3 * refs[i].vertex_index, mask128));
+    }
+}
+
+void pt::ObjMesh::write_attributes(float* dst, uint32_t first, uint32_t count) const
+{
+    // Normals and texture coordinates are stored in different arrays, so they are
+    // loaded separately with masked loads. Missing normals or texture coordinates
+    // use an empty mask, which loads zero without touching memory. The padding of the
+    // normal holds the bits of the packed tangent frame.
+    const float* normals = this->attrib->normals.data();
+    const float* texcoords = this->attrib->texcoords.data();
+    const tinyobj::index_t* refs = this->refs.data() + first;
+    const __m128i none = _mm_setzero_si128();
+    const __m128i mask_n = _mm_setr_epi32(-1, -1, -1, 0);
+    const __m128i mask_t = _mm_setr_epi32(-1, -1, 0, 0);
+
+    for(uint32_t i = 0; i < count; i++, dst += ATTRIBUTE_COMPONENTS)
+    {
+        const tinyobj::index_t& ref = refs[i];
+        const bool has_n = ref.normal_index >= 0;
+        const bool has_t = ref.texcoord_index >= 0;
+        const __m128 n = _mm_maskload_ps(normals + (has_n ? 3 * ref.normal_index : 0), has_n ? mask_n : none);
+        const __m128 t = _mm_maskload_ps(texcoords + (has_t ? 2 * ref.texcoord_index : 0), has_t ? mask_t : none);
+        _mm_storeu_ps(dst, n);
+        std::memcpy(dst + 3, &this->tangents[first + i], sizeof(uint32_t));
+        _mm_storel_pi(reinterpret_cast<__m64*>(dst + 4), t);
+    }
+}
+
+void pt::ObjMesh::clear(void) noexcept
+{
+    std::vector<tinyobj::index_t>().swap(this->refs);
+    std::vector<uint32_t>().swap(this->idx);
+    std::vector<uint32_t>().swap(this->tangents);
+}
@@ -0,0 +1,247 @@
+#include "../application.h"
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+    constexpr uint8_t ALPHA_THRESHOLD = 128;    // texels with an alpha of at least 0.5 are opaque, same as the any hit shader
+    constexpr uint32_t STATE_SHIFT = 30;        // the state of a triangle is stored in the upper 2 bits
+    constexpr uint32_t INDEX_MASK = (1u << STATE_SHIFT) - 1;
+
+    // Texels the bilinear filter reads for the coordinates [c0, c1] along one axis of the texture. The filter reads
+    // the two texels around c * size - 0.5 and the coordinates repeat, so the first texel can be outside of the texture.
+    struct TexelRange
+    {
+        int64_t first;
+        uint32_t count;
+    };
+
+    TexelRange texel_range(float c0, float c1, uint32_t size) noexcept
+    {
+        const double first = std::floor(static_cast<double>(c0) * size - 0.5);
+        const double last = std::floor(static_cast<double>(c1) * size - 0.5) + 1.0;
+        if(last - first + 1.0 >= static_cast<double>(size)) return { 0, size };
+        return { static_cast<int64_t>(first), static_cast<uint32_t>(last - first + 1.0) };
+    }
+
+    // state of all texels that are read inside of the bounding box of some texture coordinates
+    uint32_t classify_box(const pt::HostImage& rma, const float uv_min[2], const float uv_max[2]) noexcept
+    {
+        for(uint32_t k = 0; k < 2; k++)
+            if(!std::isfinite(uv_min[k]) || !std::isfinite(uv_max[k])) return pt::MeshOpacity::STATE_UNKNOWN;
+
+        const uint32_t w = rma.extent.width, h = rma.extent.height;
+        const TexelRange x = texel_range(uv_min[0], uv_max[0], w);
+        const TexelRange y = texel_range(uv_min[1], uv_max[1], h);
+        const int64_t x0 = (x.first % w + w) % w;
+        const int64_t y0 = (y.first % h + h) % h;
+        const uint8_t* alpha = static_cast<const uint8_t*>(rma.data) + 2;
+
+        bool opaque = false, transparent = false;
+        for(uint32_t j = 0, ty = static_cast<uint32_t>(y0); j < y.count; j++, ty = (ty + 1 == h) ? 0 : ty + 1)
+        {
+            const uint8_t* row = alpha + static_cast<size_t>(ty) * w * 4;
+            for(uint32_t i = 0, tx = static_cast<uint32_t>(x0); i < x.count; i++, tx = (tx + 1 == w) ? 0 : tx + 1)
+            {
+                if(row[tx * 4] >= ALPHA_THRESHOLD) opaque = true;
+                else transparent = true;
+            }
+            if(opaque && transparent) return pt::MeshOpacity::STATE_UNKNOWN;
+        }
+        return opaque ? pt::MeshOpacity::STATE_OPAQUE : pt::MeshOpacity::STATE_TRANSPARENT;
+    }
+
+    // state of the texels inside of the triangle of three points in barycentric coordinates (weights of the second and third corner)
+    uint32_t classify_triangle(const pt::HostImage& rma, const float* texcoords, const float b[3][2]) noexcept
+    {
+        float uv_min[2] = { INFINITY, INFINITY }, uv_max[2] = { -INFINITY, -INFINITY };
+        for(uint32_t v = 0; v < 3; v++)
+        {
+            for(uint32_t k = 0; k < 2; k++)
+            {
+                const float c = texcoords[k] * (1.0f - b[v][0] - b[v][1]) + texcoords[2 + k] * b[v][0] + texcoords[4 + k] * b[v][1];
+                uv_min[k] = std::min(uv_min[k], c);
+                uv_max[k] = std::max(uv_max[k], c);
+            }
+        }
+        // NaN coordinates are not ordered, the box test treats them as unknown
+        if(!(uv_min[0] <= uv_max[0] && uv_min[1] <= uv_max[1])) return pt::MeshOpacity::STATE_UNKNOWN;
+        return classify_box(rma, uv_min, uv_max);
+    }
+}
+
+bool pt::classify_opacity(const float* texcoords, uint32_t triangle_count, const HostImage& rma, MeshOpacity& opacity)
+{
+    constexpr uint32_t N = MeshOpacity::SUBDIVISION;
+    opacity.states.assign(triangle_count, 0);
+    opacity.opaque = true;
+
+    // Most alpha maps are completely opaque, those don't need the texture coordinates.
+    const size_t texel_count = static_cast<size_t>(rma.extent.width) * rma.extent.height;
+    const uint8_t* alpha = static_cast<const uint8_t*>(rma.data) + 2;
+    bool any_opaque = false, any_transparent = false;
+    for(size_t i = 0; i < texel_count && !(any_opaque && any_transparent); i++)
+    {
+        if(alpha[i * 4] >= ALPHA_THRESHOLD) any_opaque = true;
+        else any_transparent = true;
+    }
+    if(!(any_opaque && any_transparent))
+    {
+        const uint32_t state = any_transparent ? MeshOpacity::STATE_TRANSPARENT : MeshOpacity::STATE_OPAQUE;
+        std::fill(opacity.states.begin(), opacity.states.end(), state << STATE_SHIFT);
+        opacity.opaque = (state == MeshOpacity::STATE_OPAQUE) || triangle_count == 0;
+        return false;
+    }
+
+    // the texture coordinates of meshes with a uniform alpha map are released, the any hit shader tests their triangles
+    if(texcoords == nullptr)
+    {
+        std::fill(opacity.states.begin(), opacity.states.end(), static_cast<uint32_t>(MeshOpacity::STATE_UNKNOWN) << STATE_SHIFT);
+        opacity.opaque = (triangle_count == 0);
+        return true;
+    }
+
+    const float whole[3][2] = { { 0.0f, 0.0f }, { 1.0f, 0.0f }, { 0.0f, 1.0f } };
+    for(uint32_t t = 0; t < triangle_count; t++)
+    {
+        const float* tc = texcoords + static_cast<size_t>(t) * 6;
+        uint32_t state = classify_triangle(rma, tc, whole);
+        if(state == MeshOpacity::STATE_UNKNOWN)
+        {
+            // The micro-triangles of row i have a second barycentric coordinate in [i / N, (i + 1) / N], every cell j of a row
+            // is split into a lower and an upper micro-triangle. The last cell of a row only has the lower one.
+            uint32_t mask[MeshOpacity::MASK_WORDS] = {};
+            bool found[3] = { false, false, false };
+            for(uint32_t i = 0; i < N; i++)
+            {
+                for(uint32_t j = 0; j < N - i; j++)
+                {
+                    for(uint32_t upper = 0; upper < ((j + 1 < N - i) ? 2u : 1u); upper++)
+                    {
+                        const float b0 = static_cast<float>(i) / N, b1 = static_cast<float>(i + 1) / N;
+                        const float c0 = static_cast<float>(j) / N, c1 = static_cast<float>(j + 1) / N;
+                        const float lower_corners[3][2] = { { b0, c0 }, { b1, c0 }, { b0, c1 } };
+                        const float upper_corners[3][2] = { { b1, c0 }, { b0, c1 }, { b1, c1 } };
+                        const uint32_t s = classify_triangle(rma, tc, upper ? upper_corners : lower_corners);
+                        const uint32_t index = i * (2 * N - i) + 2 * j + upper;
+                        mask[index / 16] |= s << ((index % 16) * 2);
+                        found[s] = true;
+                    }
+                }
+            }
+
+            // the box of the whole triangle is larger than the boxes of its micro-triangles, those may all have one state
+            if(!found[MeshOpacity::STATE_UNKNOWN] && found[MeshOpacity::STATE_OPAQUE] != found[MeshOpacity::STATE_TRANSPARENT])
+                state = found[MeshOpacity::STATE_OPAQUE] ? MeshOpacity::STATE_OPAQUE : MeshOpacity::STATE_TRANSPARENT;
+            else
+            {
+                const size_t index = opacity.states.size();
+                if(index > INDEX_MASK)
+                    throw std::runtime_error("[pt::classify_opacity]: The mesh has too many partly transparent triangles.");
+                opacity.states.insert(opacity.states.end(), mask, mask + MeshOpacity::MASK_WORDS);
+                opacity.states[t] = static_cast<uint32_t>(index);
+                state = MeshOpacity::STATE_MIXED;
+            }
+        }
+        opacity.states[t] |= state << STATE_SHIFT;
+        if(state != MeshOpacity::STATE_OPAQUE) opacity.opaque = false;
+    }
+    return true;
+}
+
+void pt::PathTracer::collect_texcoords(const ObjMesh& mesh, std::vector<float>& texcoords) const
+{
+    // Every material has an alpha map, so the texture coordinates of all triangles are collected. Those of partly cut out
+    // alpha maps are kept after loading, because the triangles are classified again if the alpha map is reloaded.
+    std::vector<float> attributes(static_cast<size_t>(mesh.vertex_count()) * ObjMesh::ATTRIBUTE_COMPONENTS);
+    mesh.write_attributes(attributes.data(), 0, mesh.vertex_count());
+
+    const uint32_t* indices = mesh.pindices();
+    texcoords.resize(static_cast<size_t>(mesh.index_count() / 3) * 6);
+    for(uint32_t t = 0; t < mesh.index_count() / 3; t++)
+    {
+        for(uint32_t k = 0; k < 3; k++)
+        {
+            const float* a = attributes.data() + static_cast<size_t>(indices[t * 3 + k]) * ObjMesh::ATTRIBUTE_COMPONENTS;
+            std::copy_n(a + 4, 2, texcoords.data() + static_cast<size_t>(t) * 6 + k * 2);
+        }
+    }
+}
+
+void pt::PathTracer::classify_meshes(const std::vector<bool>& decoded)
+{
+    // The alpha maps are only decoded while loading, so the meshes are classified before the images are released.
+    // Every mesh of a decoded material is classified by its own task.
+    std::vector<std::future<void>> tasks;
+    for(size_t i = 0; i < this->models.size(); i++)
+    {
+        for(size_t j = 0; j < this->models[i].size(); j++)
+        {
+            RenderMesh& rmesh = this->models[i][j];
+            if(!decoded.at(rmesh.properties.record.materialID)) continue;
+            tasks.push_back(this->loaders.submit([this, &rmesh, i, j]() {
+                // Only a partly cut out alpha map needs the texture coordinates, the others are released. If such an alpha map
+                // is reloaded with cut outs, the triangles are tested by the any hit shader until the model is reloaded.
+                std::vector<float>& texcoords = this->texcoords.at(i).at(j);
+                const RenderMaterial& mtl = this->materials[rmesh.properties.record.materialID];
+                const uint32_t triangle_count = rmesh.properties.index_count / 3;
+                if(!classify_opacity(texcoords.empty() ? nullptr : texcoords.data(), triangle_count, mtl.images.rman[0], rmesh.opacity))
+                    std::vector<float>().swap(texcoords);
+            }));
+        }
+    }
+    this->loaders.wait_all(tasks);
+}
+
+void pt::PathTracer::load_opacity_buffer(void)
+{
+    // the opacity of all meshes is concatenated in model order, the records of the meshes point to their part
+    size_t count = 0, alpha_tested = 0, mixed = 0;
+    for(auto& model : this->models)
+    {
+        for(RenderMesh& rmesh : model)
+        {
+            rmesh.properties.record.opacityOffset = static_cast<uint32_t>(count);
+            count += rmesh.opacity.states.size();
+            if(rmesh.opacity.opaque) continue;
+            alpha_tested++;
+            for(uint32_t t = 0; t < rmesh.properties.index_count / 3; t++)
+                if((rmesh.opacity.states[t] >> STATE_SHIFT) == MeshOpacity::STATE_MIXED) mixed++;
+        }
+    }
+    if(count > UINT32_MAX)
+        throw std::runtime_error("[pt::PathTracer::load_opacity_buffer]: The scene has too many triangles for the opacity buffer.");
+
+    // a scene without triangles still gets one entry, a buffer must not be empty
+    const VkDeviceSize size = std::max<size_t>(count, 1) * sizeof(uint32_t);
+    this->opacity_buffer.clear();
+    this->init_device_buffer(this->opacity_buffer, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, size);
+
+    vka::Buffer staging(this->setup->get_physical_device(), this->setup->get_device());
+    staging.set_create_flags(0);
+    staging.set_create_size(size);
+    staging.set_create_usage(VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
+    staging.set_create_sharing_mode(VK_SHARING_MODE_EXCLUSIVE);
+    staging.set_create_queue_families(&this->setup->get_rt_queue_info().queueFamilyIndex, 1);
+    staging.set_memory_properties(VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    if(staging.create() != VK_SUCCESS)
+        throw std::runtime_error("[pt::PathTracer::load_opacity_buffer]: Failed to create opacity staging buffer.");
+
+    uint32_t* map = static_cast<uint32_t*>(staging.map(size, 0));
+    map[0] = 0;
+    for(const auto& model : this->models)
+        for(const RenderMesh& rmesh : model)
+            std::copy(rmesh.opacity.states.begin(), rmesh.opacity.states.end(), map + rmesh.properties.record.opacityOffset);
+    staging.unmap();
+    this->notify(this->info_callback,
+        std::to_string(alpha_tested) + " meshes are alpha tested, " + std::to_string(mixed) +
+        " of their triangles are partly transparent and have an opacity mask."
+    );
+
+    std::lock_guard<std::mutex> lock(this->queue_mtx);
+    VkCommandBuffer cbo = vka::Buffer::enqueue_copy(this->setup->get_device(), this->cmd_pool, 1, &staging, &this->opacity_buffer);
+    const VkResult result = vka::utility::execute_scb(this->setup->get_device(), this->cmd_pool, this->setup->get_rt_queue(), 1, &cbo);
+    vkFreeCommandBuffers(this->setup->get_device(), this->cmd_pool, 1, &cbo);
+    if(result != VK_SUCCESS)
+        throw std::runtime_error("[pt::PathTracer::load_opacity_buffer]: Failed to copy staging buffer.");
+}
@@ -2,14 +2,21 @@
 
 void pt::PathTracer::create_pipeline(void)
 {
+    // the camera and the sample index are passed to the ray generation shader as push constants,
+    // so they can change without updating any descriptor
+    VkPushConstantRange push_range = {};
+    push_range.stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_NV;
+    push_range.offset = 0;
+    push_range.size = sizeof(PushConstants);
+
     VkPipelineLayoutCreateInfo layout_ci = {};
     layout_ci.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
     layout_ci.pNext = nullptr;
     layout_ci.flags = 0;
     layout_ci.setLayoutCount = this->descriptors.layouts().size();
     layout_ci.pSetLayouts = this->descriptors.layouts().data();
-    layout_ci.pushConstantRangeCount = 0;
-    layout_ci.pPushConstantRanges = nullptr;
+    layout_ci.pushConstantRangeCount = 1;
+    layout_ci.pPushConstantRanges = &push_range;
 
     if(vkCreatePipelineLayout(this->setup->get_device(), &layout_ci, nullptr, &rtp.layout) != VK_SUCCESS)
         throw std::runtime_error("[pt::PathTracer::create_pipeline]: Failed to create ray tracing pipeline layout.");
@@ -22,7 +29,8 @@ void pt::PathTracer::create_pipeline(void)
     pipeline_ci.pStages = this->stages.get_stages();
     pipeline_ci.groupCount = this->shader_groups.size();
     pipeline_ci.pGroups = this->shader_groups.data();
-    pipeline_ci.maxRecursionDepth = this->setup->get_settings()->iterations;
+    // the closest hit shader traces the shadow rays, so the depth is at least 2
+    pipeline_ci.maxRecursionDepth = std::max(this->setup->get_settings()->iterations, 2u);
     pipeline_ci.layout = rtp.layout;
     pipeline_ci.basePipelineHandle = VK_NULL_HANDLE;
     pipeline_ci.basePipelineIndex = 0;
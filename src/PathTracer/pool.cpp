@@ -2,6 +2,8 @@
 
 void pt::PathTracer::create_pools(void)
 {
+    this->loaders.start(this->setup->get_settings()->load_threads);
+
     VkCommandPoolCreateInfo ci = {};
     ci.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
     ci.pNext = nullptr;
@@ -1,7 +1,42 @@
 #include "../application.h"
+#include <cstring>
+#include <immintrin.h>
+
+namespace
+{
+    // F16C converts 8 half floats per instruction
+    void half_to_float(const uint16_t* src, float* dst, size_t count)
+    {
+        size_t i = 0;
+        for(; i + 8 <= count; i += 8)
+            _mm256_storeu_ps(dst + i, _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i))));
+        for(; i < count; i++)
+            dst[i] = _cvtsh_ss(src[i]);
+    }
+}
+
+VkCommandBuffer pt::PathTracer::record(uint32_t samples)
+{
+    PushConstants push = {};
+    push.camera = this->get_camera_data();
+    push.adaptive = this->tile_mask_valid ? 1 : 0;
+    push.features = this->features ? 1 : 0;
+    if(this->frame_extent.width == 0)
+    {
+        push.frame_extent[0] = this->render_extent.width;
+        push.frame_extent[1] = this->render_extent.height;
+    }
+    else
+    {
+        // a tile at the border may be padded beyond the frame, so all tiles have the same resolution
+        if(static_cast<uint32_t>(this->tile_offset.x) >= this->frame_extent.width || static_cast<uint32_t>(this->tile_offset.y) >= this->frame_extent.height)
+            throw std::runtime_error("[pt::PathTracer::record]: The tile is outside of the frame.");
+        push.tile_offset[0] = static_cast<uint32_t>(this->tile_offset.x);
+        push.tile_offset[1] = static_cast<uint32_t>(this->tile_offset.y);
+        push.frame_extent[0] = this->frame_extent.width;
+        push.frame_extent[1] = this->frame_extent.height;
+    }
 
-VkCommandBuffer pt::PathTracer::record(void)
-{   
     // Memory barrier to ensure synchronization between the image rendering and
     // the image copy after the render.
     VkImageMemoryBarrier render2copy_barrier = {};
@@ -20,11 +55,25 @@ VkCommandBuffer pt::PathTracer::record(void)
     render2copy_barrier.subresourceRange.baseArrayLayer = 0;
     render2copy_barrier.subresourceRange.layerCount = 1;
 
+    // after the copy the render target is written by the next run again
+    VkImageMemoryBarrier copy2render_barrier = render2copy_barrier;
+    copy2render_barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    copy2render_barrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    copy2render_barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    copy2render_barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+    // Every sample reads the mean of the previous samples from the accumulation image,
+    // so a sample must be finished before the next one starts.
+    VkMemoryBarrier accumulation_barrier = {};
+    accumulation_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    accumulation_barrier.pNext = nullptr;
+    accumulation_barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    accumulation_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
 
     // extent of the rendered image
     VkExtent3D rop_extent = {
-        this->setup->get_settings()->rt_width,
-        this->setup->get_settings()->rt_height,
+        this->render_extent.width,
+        this->render_extent.height,
         1
     };
 
@@ -66,26 +115,36 @@ VkCommandBuffer pt::PathTracer::record(void)
     vkCmdBindPipeline(cbo, VK_PIPELINE_BIND_POINT_RAY_TRACING_NV, this->rtp.pipeline);
     vkCmdBindDescriptorSets(cbo, VK_PIPELINE_BIND_POINT_RAY_TRACING_NV, this->rtp.layout, 0, this->descriptors.descriptor_set_count(), this->descriptors.descriptor_sets().data(), 0, nullptr);
     vkCmdWriteTimestamp(cbo, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_NV, this->timer_query_pool, 0);   // query ID 0 = start time
-    detail::vkCmdTraceRaysNV(
-        cbo,
-        this->sbt.buff.handle(),
-        this->sbt.rgen_offset,
-        this->sbt.buff.handle(),
-        this->sbt.miss_offset,
-        this->sbt.record_stride,
-        this->sbt.buff.handle(),
-        this->sbt.hg_offset,
-        this->sbt.record_stride,
-        VK_NULL_HANDLE,
-        0,
-        0,
-        rop_extent.width,
-        rop_extent.height,
-        rop_extent.depth
-    );
+    for(uint32_t i = 0; i < samples; i++)
+    {
+        if(i > 0)
+            vkCmdPipelineBarrier(cbo, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_NV, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_NV, 0, 1, &accumulation_barrier, 0, nullptr, 0, nullptr);
+
+        push.sample_count = this->accumulated_samples + i;
+        push.sample_index = this->first_sample + push.sample_count;
+        vkCmdPushConstants(cbo, this->rtp.layout, VK_SHADER_STAGE_RAYGEN_BIT_NV, 0, sizeof(PushConstants), &push);
+        detail::vkCmdTraceRaysNV(
+            cbo,
+            this->sbt.buff.handle(),
+            this->sbt.rgen_offset,
+            this->sbt.buff.handle(),
+            this->sbt.miss_offset,
+            this->sbt.record_stride,
+            this->sbt.buff.handle(),
+            this->sbt.hg_offset,
+            this->sbt.record_stride,
+            VK_NULL_HANDLE,
+            0,
+            0,
+            rop_extent.width,
+            rop_extent.height,
+            rop_extent.depth
+        );
+    }
     vkCmdWriteTimestamp(cbo, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_NV, this->timer_query_pool, 1); // query ID 1 = end time
     vkCmdPipelineBarrier(cbo, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_NV, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &render2copy_barrier);
     vkCmdCopyImage(cbo, this->render_target.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, this->output_image.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copy);
+    vkCmdPipelineBarrier(cbo, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_NV, 0, 0, nullptr, 0, nullptr, 1, &copy2render_barrier);
 
     if(vkEndCommandBuffer(cbo) != VK_SUCCESS)
         throw std::runtime_error("[pt::PathTracer::record]: Failed to stop recording command buffer.");
@@ -105,9 +164,127 @@ void pt::PathTracer::trace(VkCommandBuffer cbo)
     si.signalSemaphoreCount = 0;
     si.pSignalSemaphores = nullptr;
 
-    if(vkQueueSubmit(this->setup->get_rt_queue(), 1, &si, VK_NULL_HANDLE) != VK_SUCCESS)
+    // the command buffer is freed on every path, also if the submission fails
+    const bool submitted = (vkQueueSubmit(this->setup->get_rt_queue(), 1, &si, VK_NULL_HANDLE) == VK_SUCCESS);
+    const bool finished = submitted && (vkQueueWaitIdle(this->setup->get_rt_queue()) == VK_SUCCESS);
+    vkFreeCommandBuffers(this->setup->get_device(), this->cmd_pool, 1, &cbo);
+    if(!submitted)
         throw std::runtime_error("[pt::PathTracer::trace]: Failed to execute ray tracetrace commands.");
-    if(vkQueueWaitIdle(this->setup->get_rt_queue()) != VK_SUCCESS)
+    if(!finished)
         throw std::runtime_error("[pt::PathTracer::trace]: Failed to wait ray tracing process to finish.");
-    vkFreeCommandBuffers(this->setup->get_device(), this->cmd_pool, 1, &cbo);
+}
+
+void pt::PathTracer::read_render_image(VkImage image, VkDeviceSize pixel_size, void* dst)
+{
+    vka::Buffer readback;
+    readback.set_device(this->setup->get_device());
+    readback.set_physical_device(this->setup->get_physical_device());
+    readback.set_create_flags(0);
+    readback.set_create_size(static_cast<VkDeviceSize>(this->render_extent.width) * this->render_extent.height * pixel_size);
+    readback.set_create_usage(VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+    readback.set_create_sharing_mode(VK_SHARING_MODE_EXCLUSIVE);
+    readback.set_create_queue_families(&this->setup->get_rt_queue_info().queueFamilyIndex, 1);
+    readback.set_memory_properties(VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    if(readback.create() != VK_SUCCESS)
+        throw std::runtime_error("[pt::PathTracer::read_render_image]: Failed to create readback buffer.");
+
+    // the images of the accumulation stay in the general layout, the copy only has to wait for the last sample
+    VkMemoryBarrier render2copy_barrier = {};
+    render2copy_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    render2copy_barrier.pNext = nullptr;
+    render2copy_barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    render2copy_barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+    VkBufferImageCopy copy = {};
+    copy.bufferOffset = 0;
+    copy.bufferRowLength = 0;   // tightly packed
+    copy.bufferImageHeight = 0;
+    copy.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    copy.imageSubresource.mipLevel = 0;
+    copy.imageSubresource.baseArrayLayer = 0;
+    copy.imageSubresource.layerCount = 1;
+    copy.imageOffset = { 0, 0, 0 };
+    copy.imageExtent = { this->render_extent.width, this->render_extent.height, 1 };
+
+    VkCommandBuffer cbo;
+    VkCommandBufferAllocateInfo ai = {};
+    ai.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    ai.pNext = nullptr;
+    ai.commandPool = this->cmd_pool;
+    ai.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    ai.commandBufferCount = 1;
+    if(vkAllocateCommandBuffers(this->setup->get_device(), &ai, &cbo) != VK_SUCCESS)
+        throw std::runtime_error("[pt::PathTracer::read_render_image]: Failed to allocate command buffer.");
+
+    VkCommandBufferBeginInfo bi = {};
+    bi.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    bi.pNext = nullptr;
+    bi.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    bi.pInheritanceInfo = nullptr;
+    if(vkBeginCommandBuffer(cbo, &bi) != VK_SUCCESS)
+        throw std::runtime_error("[pt::PathTracer::read_render_image]: Failed to start recording command buffer.");
+    vkCmdPipelineBarrier(cbo, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_NV, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &render2copy_barrier, 0, nullptr, 0, nullptr);
+    vkCmdCopyImageToBuffer(cbo, image, VK_IMAGE_LAYOUT_GENERAL, readback.handle(), 1, &copy);
+    if(vkEndCommandBuffer(cbo) != VK_SUCCESS)
+        throw std::runtime_error("[pt::PathTracer::read_render_image]: Failed to stop recording command buffer.");
+    this->trace(cbo);
+
+    const void* map = readback.map(readback.size(), 0);
+    memcpy(dst, map, static_cast<size_t>(readback.size()));
+    readback.unmap();
+}
+
+void pt::PathTracer::read_accumulation(float* rgba)
+{
+    if(this->accumulated_samples == 0)
+        throw std::runtime_error("[pt::PathTracer::read_accumulation]: No sample is accumulated.");
+    this->read_render_image(this->accumulation_image.image, 4 * sizeof(float), rgba);
+}
+
+void pt::PathTracer::read_sample_counts(uint32_t* counts)
+{
+    if(this->accumulated_samples == 0)
+        throw std::runtime_error("[pt::PathTracer::read_sample_counts]: No sample is accumulated.");
+    this->read_render_image(this->sample_count_image.image, sizeof(uint32_t), counts);
+}
+
+void pt::PathTracer::read_features(float* albedo, float* normals)
+{
+    if(this->accumulated_samples == 0)
+        throw std::runtime_error("[pt::PathTracer::read_features]: No sample is accumulated.");
+    if(!this->features)
+        throw std::runtime_error("[pt::PathTracer::read_features]: The features are disabled.");
+
+    const size_t component_count = static_cast<size_t>(this->render_extent.width) * this->render_extent.height * 4;
+    std::vector<uint16_t> half(component_count);
+    if(albedo != nullptr)
+    {
+        this->read_render_image(this->albedo_image.image, 4 * sizeof(uint16_t), half.data());
+        half_to_float(half.data(), albedo, component_count);
+    }
+    if(normals != nullptr)
+    {
+        this->read_render_image(this->normal_image.image, 4 * sizeof(uint16_t), half.data());
+        half_to_float(half.data(), normals, component_count);
+    }
+}
+
+void pt::PathTracer::read_first_hit(float* depth, uint32_t* geometry_ids, uint32_t* material_ids)
+{
+    if(this->accumulated_samples == 0)
+        throw std::runtime_error("[pt::PathTracer::read_first_hit]: No sample is accumulated.");
+    if(!this->features)
+        throw std::runtime_error("[pt::PathTracer::read_first_hit]: The features are disabled.");
+    if(depth == nullptr && geometry_ids == nullptr && material_ids == nullptr)
+        return;
+
+    const size_t pixel_count = static_cast<size_t>(this->render_extent.width) * this->render_extent.height;
+    std::vector<uint32_t> hits(pixel_count * 4);
+    this->read_render_image(this->first_hit_image.image, 4 * sizeof(uint32_t), hits.data());
+    for(size_t i = 0; i < pixel_count; i++)
+    {
+        if(depth != nullptr) std::memcpy(depth + i, &hits[i * 4 + 0], sizeof(float));
+        if(geometry_ids != nullptr) geometry_ids[i] = hits[i * 4 + 1];
+        if(material_ids != nullptr) material_ids[i] = hits[i * 4 + 2];
+    }
 }
@@ -0,0 +1,131 @@
+#include "../application.h"
+
+void pt::PathTracer::watch_assets(void)
+{
+    // A file is watched once for every asset that uses it, so a texture that
+    // is used by multiple materials reloads all of them.
+    this->watcher.clear();
+    this->watched.clear();
+    const auto watch = [this](const std::string& path, WatchedAsset::Type type, size_t index) {
+        if(path.empty()) return;
+        this->watcher.watch(path);
+        this->watched.push_back({ type, index });
+    };
+
+    for(size_t i = 0; i < this->model_paths.size(); i++)
+        watch(this->model_paths[i], WatchedAsset::MODEL, i);
+
+    for(size_t i = 0; i < this->materials.size(); i++)
+    {
+        const MaterialProperties& properties = this->materials[i].properties;
+        watch(properties.map_albedo, WatchedAsset::ALBEDO, i);
+        watch(properties.map_emission, WatchedAsset::EMISSION, i);
+        watch(properties.map_roughness, WatchedAsset::RMAN, i);
+        watch(properties.map_metallic, WatchedAsset::RMAN, i);
+        watch(properties.map_alpha, WatchedAsset::RMAN, i);
+        watch(properties.map_normal, WatchedAsset::RMAN, i);
+    }
+
+    watch(this->environment_path, WatchedAsset::ENVIRONMENT, 0);
+}
+
+uint32_t pt::PathTracer::reload_changed(void)
+{
+    if(!this->initialized) return 0;
+
+    std::vector<size_t> changed;
+    this->watcher.poll(changed);
+    if(changed.empty()) return 0;
+
+    const auto reload_begin = std::chrono::steady_clock::now();
+    bool environment = false;
+    std::vector<WatchedAsset> textures;
+    std::vector<size_t> model_ids;
+    bool alpha = false;     // the alpha map of a material changed
+    for(size_t id : changed)
+    {
+        const WatchedAsset& asset = this->watched[id];
+        this->notify(this->info_callback, "File \"" + this->watcher.path(id) + "\" changed.");
+        switch(asset.type)
+        {
+        case WatchedAsset::MODEL:
+            model_ids.push_back(asset.index);
+            break;
+        case WatchedAsset::ENVIRONMENT:
+            environment = true;
+            break;
+        default:
+            alpha = alpha || (asset.type == WatchedAsset::RMAN);
+            textures.push_back(asset);
+            break;
+        }
+    }
+
+    // the objects that are replaced may still be used by the last trace
+    vkDeviceWaitIdle(this->setup->get_device());
+
+    // Every step loads its files before it replaces its part of the scene. If a step fails,
+    // the parts that were already replaced are still made visible to the shaders.
+    std::exception_ptr error;
+    try
+    {
+        if(environment)
+            this->reload_environment();
+
+        // textures are reloaded first, because reloading a model can change the material IDs
+        if(!textures.empty())
+            this->reload_textures(textures);
+
+        if(!model_ids.empty())
+            this->reload_models(model_ids);
+    }
+    catch(...)
+    {
+        error = std::current_exception();
+    }
+
+    // The state that is derived from the models and materials is rebuilt even if a step failed,
+    // a step that failed after it replaced its part of the scene must not leave stale references behind.
+    try
+    {
+        // the opacity decides which meshes are opaque, that is part of the geometries and the hit groups
+        if(alpha || !model_ids.empty())
+        {
+            this->load_opacity_buffer();
+            this->destroy_acceleration_structure();
+            this->create_acceleration_structure();
+            this->shader_groups.clear();
+            this->create_shader_groups();
+        }
+
+        // the lights are weighted by their emission maps and reference the geometry and material IDs
+        if(!textures.empty() || !model_ids.empty())
+            this->load_light_table();
+    }
+    catch(...)
+    {
+        if(!error) error = std::current_exception();
+    }
+
+    // the descriptors reference the replaced textures and buffers, the pipeline and the SBT depend on the descriptors
+    this->destroy_pipeline();
+    this->create_descriptors();
+    this->create_pipeline();
+    this->create_sbt();
+    this->wait_for_cancelled();
+    ScratchArena::reset_all();
+    this->reset_accumulation();
+
+    // the material IDs may have changed
+    if(!model_ids.empty())
+        this->watch_assets();
+
+    if(error)
+        std::rethrow_exception(error);
+
+    const uint64_t reload_ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - reload_begin).count());
+    this->notify(this->info_callback,
+        "Reloaded " + std::to_string(changed.size()) + " changed files in " + std::to_string(reload_ns / 1000000) + " ms."
+    );
+    return static_cast<uint32_t>(changed.size());
+}
@@ -0,0 +1,105 @@
+#include "../application.h"
+
+namespace
+{
+    // Generator matrices of the first 4 dimensions of the Sobol sequence (Joe and Kuo 2008), one column per bit of the index.
+    // The other dimensions reuse them with a different scrambling, same as SOBOL_MATRICES of the shaders.
+    constexpr uint32_t SOBOL_MATRICES[4][32] = {
+        {
+            0x80000000u, 0x40000000u, 0x20000000u, 0x10000000u, 0x08000000u, 0x04000000u, 0x02000000u, 0x01000000u,
+            0x00800000u, 0x00400000u, 0x00200000u, 0x00100000u, 0x00080000u, 0x00040000u, 0x00020000u, 0x00010000u,
+            0x00008000u, 0x00004000u, 0x00002000u, 0x00001000u, 0x00000800u, 0x00000400u, 0x00000200u, 0x00000100u,
+            0x00000080u, 0x00000040u, 0x00000020u, 0x00000010u, 0x00000008u, 0x00000004u, 0x00000002u, 0x00000001u
+        },
+        {
+            0x80000000u, 0xC0000000u, 0xA0000000u, 0xF0000000u, 0x88000000u, 0xCC000000u, 0xAA000000u, 0xFF000000u,
+            0x80800000u, 0xC0C00000u, 0xA0A00000u, 0xF0F00000u, 0x88880000u, 0xCCCC0000u, 0xAAAA0000u, 0xFFFF0000u,
+            0x80008000u, 0xC000C000u, 0xA000A000u, 0xF000F000u, 0x88008800u, 0xCC00CC00u, 0xAA00AA00u, 0xFF00FF00u,
+            0x80808080u, 0xC0C0C0C0u, 0xA0A0A0A0u, 0xF0F0F0F0u, 0x88888888u, 0xCCCCCCCCu, 0xAAAAAAAAu, 0xFFFFFFFFu
+        },
+        {
+            0x80000000u, 0xC0000000u, 0x60000000u, 0x90000000u, 0xE8000000u, 0x5C000000u, 0x8E000000u, 0xC5000000u,
+            0x68800000u, 0x9CC00000u, 0xEE600000u, 0x55900000u, 0x80680000u, 0xC09C0000u, 0x60EE0000u, 0x90550000u,
+            0xE8808000u, 0x5CC0C000u, 0x8E606000u, 0xC5909000u, 0x6868E800u, 0x9C9C5C00u, 0xEEEE8E00u, 0x5555C500u,
+            0x8000E880u, 0xC0005CC0u, 0x60008E60u, 0x9000C590u, 0xE8006868u, 0x5C009C9Cu, 0x8E00EEEEu, 0xC5005555u
+        },
+        {
+            0x80000000u, 0xC0000000u, 0x20000000u, 0x50000000u, 0xF8000000u, 0x74000000u, 0xA2000000u, 0x93000000u,
+            0xD8800000u, 0x25400000u, 0x59E00000u, 0xE6D00000u, 0x78080000u, 0xB40C0000u, 0x82020000u, 0xC3050000u,
+            0x208F8000u, 0x51474000u, 0xFBEA2000u, 0x75D93000u, 0xA0858800u, 0x914E5400u, 0xDBE79E00u, 0x25DB6D00u,
+            0x58800080u, 0xE54000C0u, 0x79E00020u, 0xB6D00050u, 0x800800F8u, 0xC00C0074u, 0x200200A2u, 0x50050093u
+        }
+    };
+
+    uint32_t reverse_bits(uint32_t x) noexcept
+    {
+        x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+        x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+        x = ((x >> 4) & 0x0F0F0F0Fu) | ((x & 0x0F0F0F0Fu) << 4);
+        x = ((x >> 8) & 0x00FF00FFu) | ((x & 0x00FF00FFu) << 8);
+        return (x >> 16) | (x << 16);
+    }
+
+    // Owen scrambling by hashing: every bit is flipped depending on the bits above it (Laine and Karras 2011,
+    // constants of Burley 2020). The hash only propagates to higher bits, so the bits are reversed around it.
+    uint32_t nested_uniform_scramble(uint32_t x, uint32_t seed) noexcept
+    {
+        x = reverse_bits(x);
+        x += seed;
+        x ^= x * 0x6C50B47Cu;
+        x ^= x * 0xB82F1E52u;
+        x ^= x * 0xC7AFE638u;
+        x ^= x * 0x8D22F6E6u;
+        return reverse_bits(x);
+    }
+
+    uint32_t sobol(uint32_t index, uint32_t dimension) noexcept
+    {
+        uint32_t x = 0;
+        for(uint32_t bit = 0; index != 0; bit++, index >>= 1)
+            if(index & 1) x ^= SOBOL_MATRICES[dimension][bit];
+        return x;
+    }
+
+    float to_float(uint32_t x) noexcept
+    {
+        return static_cast<float>(x >> 8) * (1.0f / 16777216.0f);
+    }
+}
+
+uint32_t pt::sobol_owen(uint32_t index, uint32_t dimension, uint32_t seed) noexcept
+{
+    // Shuffling the index decorrelates the 4D sets, the scrambling only permutes the indices
+    // inside of aligned blocks of powers of 2, so every prefix of 2^k samples stays stratified.
+    const uint32_t set_seed = hash_uint(seed ^ hash_uint(dimension / 4));
+    const uint32_t shuffled = nested_uniform_scramble(index, set_seed);
+    return nested_uniform_scramble(sobol(shuffled, dimension % 4), hash_uint(set_seed ^ (dimension % 4 + 1)));
+}
+
+pt::Sampler::Sampler(Type type, uint32_t seed, const BlueNoiseTile* tile) : type(type), seed(seed), tile(tile)
+{
+    if(type == BLUE_NOISE && (tile == nullptr || tile->get_size() == 0))
+        throw std::invalid_argument("[pt::Sampler::Sampler]: The blue noise sampler requieres a blue noise tile.");
+}
+
+float pt::Sampler::get(uint32_t x, uint32_t y, uint32_t index, uint32_t dimension) const noexcept
+{
+    switch(this->type)
+    {
+    case INDEPENDENT:
+        return to_float(hash_uint(hash_uint(hash_uint(hash_uint(x) ^ y ^ this->seed) ^ index) ^ dimension));
+    case SOBOL:
+        return to_float(sobol_owen(index, dimension, hash_uint(hash_uint(x) ^ y) ^ this->seed));
+    default:
+        break;
+    }
+
+    // Every dimension reads the tile at another offset, so the dimensions are not correlated. The rank rotates the
+    // sequence by the center of one of size^2 intervals, the sum wraps around like a Cranley-Patterson rotation.
+    const uint32_t offset = hash_uint(dimension ^ 0x2C1B3C6Du);
+    const uint32_t rank = this->tile->rank(x + (offset & 0xFFFFu), y + (offset >> 16));
+    uint32_t bits = 0;
+    while((1u << bits) < this->tile->get_size()) bits++;
+    const uint32_t rotation = (rank << (32 - 2 * bits)) | (1u << (31 - 2 * bits));
+    return to_float(sobol_owen(index, dimension, this->seed) + rotation);
+}
@@ -0,0 +1,310 @@
+#include "../application.h"
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+    constexpr float PI = 3.14159265358979f;
+
+    // Integrand over the unit hypercube with a known integral. The dimensions are chosen like the
+    // dimensions of a path: the first ones are the camera, the later ones cross the 4D Sobol sets.
+    struct Integrand
+    {
+        const char* name;
+        double reference;
+        float(*f)(const pt::Sampler&, uint32_t, uint32_t, uint32_t);
+    };
+
+    // quarter disk with an area of 1/2, the discontinuity is the worst case of a QMC sequence
+    float disk(const pt::Sampler& s, uint32_t x, uint32_t y, uint32_t i)
+    {
+        const float u0 = s.get(x, y, i, 0), u1 = s.get(x, y, i, 1);
+        return (u0 * u0 + u1 * u1 < 2.0f / PI) ? 1.0f : 0.0f;
+    }
+
+    // smooth 2D gaussian centered inside of the unit square
+    float gaussian(const pt::Sampler& s, uint32_t x, uint32_t y, uint32_t i)
+    {
+        const float u0 = s.get(x, y, i, 0) - 0.5f, u1 = s.get(x, y, i, 1) - 0.5f;
+        return std::exp(-8.0f * (u0 * u0 + u1 * u1));
+    }
+
+    // smooth product over one whole 4D set
+    float cosine(const pt::Sampler& s, uint32_t x, uint32_t y, uint32_t i)
+    {
+        float f = 1.0f;
+        for(uint32_t d = 0; d < 4; d++)
+            f *= 1.0f + 0.5f * std::cos(2.0f * PI * s.get(x, y, i, d));
+        return f;
+    }
+
+    // an edge in the dimensions after the lens, times a linear term in the next 4D set
+    float step(const pt::Sampler& s, uint32_t x, uint32_t y, uint32_t i)
+    {
+        const float u2 = s.get(x, y, i, 2), u3 = s.get(x, y, i, 3);
+        float sum = 0.0f;
+        for(uint32_t d = 4; d < 8; d++)
+            sum += s.get(x, y, i, d);
+        return (u2 + u3 < 1.0f) ? sum : 0.0f;
+    }
+
+    double gaussian_reference(void)
+    {
+        const double g = std::sqrt(static_cast<double>(PI) / 8.0) * std::erf(std::sqrt(8.0) * 0.5);
+        return g * g;
+    }
+
+    // the samples of the checks are drawn by this many tasks, every task counts into its own bins
+    constexpr uint32_t CHECK_TASKS = 64;
+    // relative difference of two densities of the same sample that is still accepted
+    constexpr double PDF_TOLERANCE = 1e-3;
+
+    // Draws the samples of a check. 'f' gets the independent sampler, the task and the index of the sample inside of the task,
+    // returns the bin of the sample and sets its last argument to false if the density of the sample does not match.
+    // The counts of the tasks are summed up.
+    template<typename F>
+    void count_samples(pt::ThreadPool& pool, uint64_t samples, size_t bin_count, std::vector<uint64_t>& counts, uint64_t& mismatches, F f)
+    {
+        const pt::Sampler sampler(pt::Sampler::INDEPENDENT, 0);
+        std::vector<std::vector<uint64_t>> task_counts(CHECK_TASKS, std::vector<uint64_t>(bin_count, 0));
+        std::vector<uint64_t> task_mismatches(CHECK_TASKS, 0);
+        std::vector<std::future<void>> tasks;
+        for(uint32_t t = 0; t < CHECK_TASKS; t++)
+        {
+            tasks.push_back(pool.submit([&, t]() {
+                const uint64_t count = samples / CHECK_TASKS + ((t < samples % CHECK_TASKS) ? 1 : 0);
+                for(uint64_t i = 0; i < count; i++)
+                {
+                    bool match = true;
+                    task_counts[t][f(sampler, t, static_cast<uint32_t>(i), match)]++;
+                    if(!match) task_mismatches[t]++;
+                }
+            }));
+        }
+        pool.wait_all(tasks);
+
+        counts.assign(bin_count, 0);
+        mismatches = 0;
+        for(uint32_t t = 0; t < CHECK_TASKS; t++)
+        {
+            for(size_t i = 0; i < bin_count; i++)
+                counts[i] += task_counts[t][i];
+            mismatches += task_mismatches[t];
+        }
+    }
+
+    // Pearson's chi-square test. Bins with an expected count below 5 are merged into one bin, otherwise the statistic
+    // does not follow the chi-square distribution. A sample in a bin without any probability fails the test.
+    // The p-value uses the approximation of the chi-square distribution by Wilson and Hilferty (1931).
+    void chi_square_test(const std::vector<uint64_t>& observed, const std::vector<double>& expected, pt::SamplerCheck& check)
+    {
+        constexpr double MIN_EXPECTED = 5.0;
+        double chi_square = 0.0, merged_observed = 0.0, merged_expected = 0.0;
+        uint32_t bins = 0;
+        for(size_t i = 0; i < observed.size(); i++)
+        {
+            if(expected[i] < MIN_EXPECTED)
+            {
+                merged_observed += static_cast<double>(observed[i]);
+                merged_expected += expected[i];
+                continue;
+            }
+            const double d = static_cast<double>(observed[i]) - expected[i];
+            chi_square += d * d / expected[i];
+            bins++;
+        }
+        if(merged_expected > 0.0)
+        {
+            const double d = merged_observed - merged_expected;
+            chi_square += d * d / merged_expected;
+            bins++;
+        }
+        else if(merged_observed > 0.0)
+            chi_square = INFINITY;
+
+        check.bins = bins;
+        check.chi_square = chi_square;
+        const double k = static_cast<double>(std::max(bins, 2u) - 1);
+        const double z = (std::cbrt(chi_square / k) - (1.0 - 2.0 / (9.0 * k))) / std::sqrt(2.0 / (9.0 * k));
+        check.p_value = 0.5 * std::erfc(z / std::sqrt(2.0));
+    }
+}
+
+std::vector<pt::SamplerConvergence> pt::benchmark_samplers(ThreadPool& pool, const BlueNoiseTile& tile, uint32_t width, uint32_t height, uint32_t max_spp)
+{
+    if(width == 0 || height == 0 || max_spp == 0)
+        throw std::invalid_argument("[pt::benchmark_samplers]: The resolution and the number of samples must not be 0.");
+    const Integrand integrands[] = {
+        { "disk 2D", 0.5, disk },
+        { "gaussian 2D", gaussian_reference(), gaussian },
+        { "cosine 4D", 1.0, cosine },
+        { "step 6D", 1.0, step }
+    };
+    const Sampler::Type types[] = { Sampler::INDEPENDENT, Sampler::SOBOL, Sampler::BLUE_NOISE };
+
+    // the estimates are recorded at every power of 2 samples
+    uint32_t levels = 0;
+    while((1u << levels) <= max_spp) levels++;
+    const size_t pixel_count = static_cast<size_t>(width) * height;
+
+    std::vector<SamplerConvergence> results;
+    std::vector<double> estimates(levels * pixel_count);
+    for(const Integrand& integrand : integrands)
+    {
+        for(Sampler::Type type : types)
+        {
+            const Sampler sampler(type, 0, &tile);
+            std::vector<std::future<void>> tasks;
+            for(uint32_t y = 0; y < height; y++)
+            {
+                tasks.push_back(pool.submit([&, y]() {
+                    for(uint32_t x = 0; x < width; x++)
+                    {
+                        double sum = 0.0;
+                        for(uint32_t i = 0, level = 0; level < levels; i++)
+                        {
+                            sum += integrand.f(sampler, x, y, i);
+                            if(i + 1 == (1u << level))
+                                estimates[level * pixel_count + static_cast<size_t>(y) * width + x] = sum / static_cast<double>(i + 1) - integrand.reference;
+                            level += (i + 1 == (1u << level)) ? 1 : 0;
+                        }
+                    }
+                }));
+            }
+            pool.wait_all(tasks);
+
+            // the box filter wraps around the image, like the blue noise tile
+            for(uint32_t level = 0; level < levels; level++)
+            {
+                const double* error = estimates.data() + level * pixel_count;
+                double squared = 0.0, filtered = 0.0;
+                for(uint32_t y = 0; y < height; y++)
+                {
+                    for(uint32_t x = 0; x < width; x++)
+                    {
+                        double box = 0.0;
+                        for(uint32_t dy = 0; dy < 3; dy++)
+                            for(uint32_t dx = 0; dx < 3; dx++)
+                                box += error[static_cast<size_t>((y + height + dy - 1) % height) * width + (x + width + dx - 1) % width];
+                        box /= 9.0;
+                        squared += error[static_cast<size_t>(y) * width + x] * error[static_cast<size_t>(y) * width + x];
+                        filtered += box * box;
+                    }
+                }
+                results.push_back({
+                    integrand.name, type, 1u << level,
+                    std::sqrt(squared / static_cast<double>(pixel_count)),
+                    std::sqrt(filtered / static_cast<double>(pixel_count))
+                });
+            }
+        }
+    }
+    return results;
+}
+
+pt::SamplerCheck pt::check_environment_sampler(ThreadPool& pool, uint64_t samples)
+{
+    constexpr uint32_t WIDTH = 64, HEIGHT = 32, BINS_PER_PIXEL = 2;
+    if(samples == 0)
+        throw std::invalid_argument("[pt::check_environment_sampler]: The number of samples must not be 0.");
+
+    // the sky gets brighter towards the zenith, the band below the horizon is black and the sun covers a few pixels
+    std::vector<float> rgba(static_cast<size_t>(WIDTH) * HEIGHT * 4);
+    for(uint32_t y = 0; y < HEIGHT; y++)
+    {
+        for(uint32_t x = 0; x < WIDTH; x++)
+        {
+            const float dx = static_cast<float>(x) - 20.0f, dy = static_cast<float>(y) - 22.0f;
+            const float sky = (y >= 12 && y < 15) ? 0.0f : 0.1f + static_cast<float>(y) / HEIGHT;
+            const float l = sky + 200.0f * std::exp(-0.5f * (dx * dx + dy * dy));
+            float* p = rgba.data() + (static_cast<size_t>(y) * WIDTH + x) * 4;
+            p[0] = p[1] = p[2] = l;
+            p[3] = 1.0f;
+        }
+    }
+    EnvironmentSampler env;
+    env.build(pool, rgba.data(), WIDTH, HEIGHT);
+
+    // The bins split every pixel, so the distribution inside of the pixels is tested as well. 'pdf' times the
+    // cosine of the latitude is constant inside of a pixel, so the integral over a bin is exact at its center.
+    constexpr uint32_t BINS_X = WIDTH * BINS_PER_PIXEL, BINS_Y = HEIGHT * BINS_PER_PIXEL;
+    std::vector<double> expected(BINS_X * BINS_Y);
+    for(uint32_t y = 0; y < BINS_Y; y++)
+    {
+        const float latitude = ((static_cast<float>(y) + 0.5f) / BINS_Y - 0.5f) * PI;
+        for(uint32_t x = 0; x < BINS_X; x++)
+        {
+            const float phi = ((static_cast<float>(x) + 0.5f) / BINS_X - 0.5f) * 2.0f * PI;
+            const float direction[3] = { std::cos(latitude) * std::cos(phi), std::sin(latitude), std::cos(latitude) * std::sin(phi) };
+            const double area = 2.0 * PI * PI * std::cos(latitude) / (static_cast<double>(BINS_X) * BINS_Y);
+            expected[y * BINS_X + x] = env.pdf(direction) * area * static_cast<double>(samples);
+        }
+    }
+
+    SamplerCheck check = {};
+    check.sampler = "environment";
+    check.samples = samples;
+    std::vector<uint64_t> observed;
+    count_samples(pool, samples, expected.size(), observed, check.pdf_mismatches, [&env](const Sampler& sampler, uint32_t t, uint32_t i, bool& match) {
+        float direction[3];
+        const float p = env.sample(sampler.get(t, 0, i, 0), sampler.get(t, 0, i, 1), direction);
+        const float reference = env.pdf(direction);
+        match = std::abs(p - reference) <= PDF_TOLERANCE * reference;
+
+        const float u = std::atan2(direction[2], direction[0]) / (2.0f * PI) + 0.5f;
+        const float v = std::asin(std::min(std::max(direction[1], -1.0f), 1.0f)) / PI + 0.5f;
+        const uint32_t x = std::min(static_cast<uint32_t>(std::max(u, 0.0f) * BINS_X), BINS_X - 1);
+        const uint32_t y = std::min(static_cast<uint32_t>(std::max(v, 0.0f) * BINS_Y), BINS_Y - 1);
+        return y * BINS_X + x;
+    });
+    chi_square_test(observed, expected, check);
+    return check;
+}
+
+pt::SamplerCheck pt::check_light_sampler(ThreadPool& pool, uint64_t samples)
+{
+    constexpr uint32_t LIGHT_COUNT = 1024;
+    if(samples == 0)
+        throw std::invalid_argument("[pt::check_light_sampler]: The number of samples must not be 0.");
+
+    // The triangles are spread over four orders of magnitude of area. Every 16th triangle is degenerated
+    // and the first material is black, the sampler removes those triangles.
+    const std::vector<float> luminances = { 0.0f, 0.25f, 1.0f, 8.0f };
+    const Sampler random(Sampler::INDEPENDENT, 1);
+    std::vector<LightEntry> lights(LIGHT_COUNT);
+    for(uint32_t i = 0; i < LIGHT_COUNT; i++)
+    {
+        LightEntry& light = lights[i];
+        const float scale = std::pow(10.0f, -2.0f * random.get(i, 0, 0, 0));
+        float* corners[3] = { light.p0, light.p1, light.p2 };
+        for(uint32_t c = 0; c < 3; c++)
+            for(uint32_t k = 0; k < 3; k++)
+                corners[c][k] = scale * (random.get(i, 0, 0, 1 + c * 3 + k) - 0.5f);
+        if(i % 16 == 15) std::copy_n(light.p1, 3, light.p2);
+        light.materialID = i % static_cast<uint32_t>(luminances.size());
+        light.primitive = i;
+    }
+    LightSampler sampler;
+    sampler.build(std::move(lights), luminances);
+
+    // every triangle is expected to be chosen with the probability of its alias entry, the density is relative to its area
+    const std::vector<LightEntry>& built = sampler.get_lights();
+    std::vector<double> expected(built.size());
+    for(size_t i = 0; i < built.size(); i++)
+        expected[i] = static_cast<double>(built[i].choice.probability) * static_cast<double>(samples);
+
+    SamplerCheck check = {};
+    check.sampler = "lights";
+    check.samples = samples;
+    std::vector<uint64_t> observed;
+    count_samples(pool, samples, expected.size(), observed, check.pdf_mismatches, [&](const Sampler& s, uint32_t t, uint32_t i, bool& match) {
+        float point[3];
+        uint32_t light;
+        const float p = sampler.sample(s.get(t, 0, i, 0), s.get(t, 0, i, 1), s.get(t, 0, i, 2), point, light);
+        const double reference = static_cast<double>(built[light].choice.probability) / built[light].area;
+        match = std::abs(p - reference) <= PDF_TOLERANCE * reference && std::abs(sampler.pdf(light) - reference) <= PDF_TOLERANCE * reference;
+        return light;
+    });
+    chi_square_test(observed, expected, check);
+    return check;
+}
@@ -4,15 +4,21 @@ void pt::PathTracer::create_shaders(void)
 {
     vka::Shader rgen(this->setup->get_device()),
                 rmiss(this->setup->get_device()),
-                rchit(this->setup->get_device());
+                rchit(this->setup->get_device()),
+                shadow_rmiss(this->setup->get_device()),
+                rahit(this->setup->get_device());
 
     rgen.load("./assets/shaders/out/main.rgen.spv", VK_SHADER_STAGE_RAYGEN_BIT_NV);
     rmiss.load("./assets/shaders/out/main.rmiss.spv", VK_SHADER_STAGE_MISS_BIT_NV);
     rchit.load("./assets/shaders/out/main.rchit.spv", VK_SHADER_STAGE_CLOSEST_HIT_BIT_NV);
-
-    this->stages.attach(rgen);  // shader has index 0
-    this->stages.attach(rmiss); // shader has index 1
-    this->stages.attach(rchit); // shader has index 2
+    shadow_rmiss.load("./assets/shaders/out/shadow.rmiss.spv", VK_SHADER_STAGE_MISS_BIT_NV);
+    rahit.load("./assets/shaders/out/alpha.rahit.spv", VK_SHADER_STAGE_ANY_HIT_BIT_NV);
+
+    this->stages.attach(rgen);          // shader has index 0
+    this->stages.attach(rmiss);         // shader has index 1
+    this->stages.attach(rchit);         // shader has index 2
+    this->stages.attach(shadow_rmiss);  // shader has index 3
+    this->stages.attach(rahit);         // shader has index 4
 }
 
 void pt::PathTracer::create_shader_groups(void)
@@ -39,11 +45,19 @@ void pt::PathTracer::create_shader_groups(void)
     group.intersectionShader = VK_SHADER_UNUSED_NV;
     this->shader_groups.push_back(group);
 
-    // hit groups (consisting of the closest hit shader, as we don't use a any hit or intersection shader)
-    // As every geometry invokes a different hit group record in the SBT, at least one shader group 
-    // for every geometry is requiered. There may also be more than one, if we decide to have multiple
-    // ray types. For example one hit group for a normal scene ray and one for a shadow ray, both
-    // ray types could then invoke different shaders, if they hit any geometry.
+    // miss hit group of the shadow rays, the miss records are in the order of the ray types
+    group.type = VK_RAY_TRACING_SHADER_GROUP_TYPE_GENERAL_NV;
+    group.generalShader = 3;    // index of the shader stages of the shadow miss shader
+    group.closestHitShader = VK_SHADER_UNUSED_NV;
+    group.anyHitShader = VK_SHADER_UNUSED_NV;
+    group.intersectionShader = VK_SHADER_UNUSED_NV;
+    this->shader_groups.push_back(group);
+
+    // hit groups (consisting of the closest hit shader and the alpha test, as we don't use a intersection shader)
+    // As every geometry invokes a different hit group record in the SBT, one shader group per ray type
+    // for every geometry is requiered, in the order of pt::RayType. The scene rays invoke the closest hit
+    // shader. The shadow rays end at their first hit and skip the closest hit shader, so their hit group
+    // only has the alpha test. Opaque meshes never invoke the any hit shader, so they don't get it.
     for(uint32_t i = 0; i < this->models.size(); i++)
     {
         for(uint32_t j = 0; j < this->models[i].size(); j++)
@@ -52,9 +66,13 @@ void pt::PathTracer::create_shader_groups(void)
             group.type = VK_RAY_TRACING_SHADER_GROUP_TYPE_TRIANGLES_HIT_GROUP_NV;
             group.generalShader = VK_SHADER_UNUSED_NV;    
             group.closestHitShader = 2; // index of the shader stages of the closest hit shader
-            group.anyHitShader = VK_SHADER_UNUSED_NV;
+            group.anyHitShader = this->models[i][j].opacity.opaque ? VK_SHADER_UNUSED_NV : 4;  // index of the alpha test
             group.intersectionShader = VK_SHADER_UNUSED_NV;
             this->shader_groups.push_back(group);
+
+            // hit group of the shadow rays
+            group.closestHitShader = VK_SHADER_UNUSED_NV;
+            this->shader_groups.push_back(group);
         }
     }
 }
@@ -69,7 +87,7 @@ void pt::PathTracer::create_sbt(void)
     const uint32_t handle_size      = this->setup->get_rt_properties().shaderGroupHandleSize;
     const uint32_t parameter_size   = static_cast<uint32_t>(sizeof(RecordParameter));           // additinal parameter to a sbt record
     const uint32_t record_size      = handle_size + parameter_size;                             // the size (stride) of a sbt record is the hadle size + the parameter size
-    const uint32_t ray_type_count   = 1;                                                        // number of ray types, number of hit groups per geometry, also refered to as the sbt record stride
+    const uint32_t ray_type_count   = RAY_TYPE_COUNT;                                           // number of ray types, number of hit groups per geometry, also refered to as the sbt record stride
     const uint32_t rgen_count       = 1;                                                        // number of ray generation shaders, there is always one
     const uint32_t hg_count         = mesh_count * ray_type_count;                              // number of hit groups: (number of geometries) * (number of hit groups per geometry)
     const uint32_t miss_count       = this->shader_groups.size() - hg_count - rgen_count;       // everything thats left from the shader groups must be the number of miss shaders
@@ -119,7 +137,7 @@ void pt::PathTracer::create_sbt(void)
 
     // copy ray generation record into SBT
     uint8_t* map_rgen = (uint8_t*)staging.map((rgen_count * this->sbt.record_stride), this->sbt.rgen_offset);
-    RecordParameter dummy = {0, 0};
+    RecordParameter dummy = {0, 0, 0};
     #pragma unroll_completely
     for(uint32_t i = 0; i < rgen_count; i++)
     {   
@@ -160,6 +178,7 @@ void pt::PathTracer::create_sbt(void)
     staging.unmap();
 
     // copy staging buffer to SBT buffer
+    std::lock_guard<std::mutex> lock(this->queue_mtx);
     VkCommandBuffer cbo = vka::Buffer::enqueue_copy(this->setup->get_device(), this->cmd_pool, 1, &staging, &this->sbt.buff);
     if(vka::utility::execute_scb(this->setup->get_device(), this->cmd_pool, this->setup->get_rt_queue(), 1, &cbo) != VK_SUCCESS)
         throw std::runtime_error("[pt::PathTracer::create_sbt]: Failed to copy staging buffer to SBT-buffer.");
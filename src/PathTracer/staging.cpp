@@ -0,0 +1,122 @@
+#include "../application.h"
+
+void pt::StagingWindow::init(const Setup* setup, VkCommandPool cmd_pool, std::mutex* queue_mtx, VkDeviceSize size)
+{
+    this->destroy();
+    this->setup = setup;
+    this->cmd_pool = cmd_pool;
+    this->queue_mtx = queue_mtx;
+
+    this->buff.set_device(this->setup->get_device());
+    this->buff.set_physical_device(this->setup->get_physical_device());
+    this->buff.set_create_flags(0);
+    this->buff.set_create_size(size);
+    this->buff.set_create_usage(VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
+    this->buff.set_create_sharing_mode(VK_SHARING_MODE_EXCLUSIVE);
+    this->buff.set_create_queue_families(&this->setup->get_rt_queue_info().queueFamilyIndex, 1);
+    this->buff.set_memory_properties(VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    if(this->buff.create() != VK_SUCCESS)
+        throw std::runtime_error("[pt::StagingWindow::init]: Failed to create staging buffer.");
+
+    // the staging buffer stays mapped as long as the window exists
+    this->map = reinterpret_cast<uint8_t*>(this->buff.map(this->buff.size(), 0));
+    this->used = 0;
+}
+
+void pt::StagingWindow::destroy(void)
+{
+    // pending copies are discarded, 'flush' must be called before
+    if(this->map == nullptr) return;
+    this->buff.unmap();
+    this->buff.clear();
+    this->pending.clear();
+    this->map = nullptr;
+    this->used = 0;
+}
+
+void* pt::StagingWindow::stage(VkBuffer dst, VkDeviceSize dst_offset, VkDeviceSize size)
+{
+    if(size > this->capacity())
+        throw std::invalid_argument("[pt::StagingWindow::stage]: Size of the staged region exceeds the capacity of the staging window.");
+
+    // every region starts at a 16 byte boundary, so it can be written with aligned vector stores
+    VkDeviceSize offset = (this->used + 15) & ~static_cast<VkDeviceSize>(15);
+    if(offset + size > this->capacity())
+    {
+        this->flush();
+        offset = 0;
+    }
+
+    VkBufferCopy region = {};
+    region.srcOffset = offset;
+    region.dstOffset = dst_offset;
+    region.size = size;
+    this->pending.push_back({ dst, region });
+    this->used = offset + size;
+    return this->map + offset;
+}
+
+void pt::StagingWindow::flush(void)
+{
+    if(this->pending.empty()) return;
+
+    // the command pool and the queue may be shared with other threads
+    std::unique_lock<std::mutex> lock;
+    if(this->queue_mtx != nullptr)
+        lock = std::unique_lock<std::mutex>(*this->queue_mtx);
+
+    VkCommandBuffer cbo;
+    VkCommandBufferAllocateInfo cbo_ai = {};
+    cbo_ai.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    cbo_ai.pNext = nullptr;
+    cbo_ai.commandPool = this->cmd_pool;
+    cbo_ai.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    cbo_ai.commandBufferCount = 1;
+    if(vkAllocateCommandBuffers(this->setup->get_device(), &cbo_ai, &cbo) != VK_SUCCESS)
+        throw std::runtime_error("[pt::StagingWindow::flush]: Failed to allocate command buffer.");
+
+    VkCommandBufferBeginInfo bi = {};
+    bi.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    bi.pNext = nullptr;
+    bi.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    bi.pInheritanceInfo = nullptr;
+
+    if(vkBeginCommandBuffer(cbo, &bi) != VK_SUCCESS)
+    {
+        vkFreeCommandBuffers(this->setup->get_device(), this->cmd_pool, 1, &cbo);
+        throw std::runtime_error("[pt::StagingWindow::flush]: Failed to begin command buffer.");
+    }
+
+    for(const auto& copy : this->pending)
+        vkCmdCopyBuffer(cbo, this->buff.handle(), copy.first, 1, &copy.second);
+
+    if(vkEndCommandBuffer(cbo) != VK_SUCCESS)
+    {
+        vkFreeCommandBuffers(this->setup->get_device(), this->cmd_pool, 1, &cbo);
+        throw std::runtime_error("[pt::StagingWindow::flush]: Failed to end command buffer.");
+    }
+
+    VkSubmitInfo si = {};
+    si.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    si.pNext = nullptr;
+    si.waitSemaphoreCount = 0;
+    si.pWaitSemaphores = nullptr;
+    si.pWaitDstStageMask = nullptr;
+    si.commandBufferCount = 1;
+    si.pCommandBuffers = &cbo;
+    si.signalSemaphoreCount = 0;
+    si.pSignalSemaphores = nullptr;
+
+    // the window is reused after the flush, so the copies must be finished
+    // the command buffer is freed before an error is thrown, a failed wait leaves the device lost
+    const bool submitted = (vkQueueSubmit(this->setup->get_rt_queue(), 1, &si, VK_NULL_HANDLE) == VK_SUCCESS);
+    const bool finished = submitted && (vkQueueWaitIdle(this->setup->get_rt_queue()) == VK_SUCCESS);
+    vkFreeCommandBuffers(this->setup->get_device(), this->cmd_pool, 1, &cbo);
+    if(!submitted)
+        throw std::runtime_error("[pt::StagingWindow::flush]: Failed to execute copy commands.");
+    if(!finished)
+        throw std::runtime_error("[pt::StagingWindow::flush]: Failed to wait for copy commands.");
+
+    this->pending.clear();
+    this->used = 0;
+}
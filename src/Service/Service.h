@@ -0,0 +1,581 @@
+#pragma once
+
+namespace pt
+{
+    // One image of a batch, rendered against the scene that is already resident.
+    struct RenderJob
+    {
+        std::string output;     // path of the PNG file the image is written to
+        uint32_t width;         // width of the image in pixels
+        uint32_t height;        // height of the image in pixels
+        uint32_t samples;       // maximum number of samples per pixel, 0 if the job is only limited by time or noise
+        uint32_t time_ms;       // wall-clock budget of the tracing in milliseconds, 0 for no limit
+        float noise;            // target noise, 0 for no limit, see 'PathTracer::estimate_noise'
+        bool adaptive;          // if true, converged tiles are not traced anymore, requires a target noise
+        std::string heatmap;    // optional path of a PNG file that shows the samples per pixel
+        std::string aovs;       // optional path of an OpenEXR file with the output variables of the image, see 'write_aovs'
+        bool denoise;           // if true, the image is denoised after the rendering, see 'Denoiser'
+        std::string checkpoint; // optional path of a checkpoint file, the job resumes from it and updates it while it renders
+        uint32_t checkpoint_interval_ms; // time between two checkpoints
+        Camera camera;
+
+        /**
+         * @param cancel    Optional flag that stops the rendering if another thread sets it.
+         * @return          Limits of the job.
+         */
+        RenderBudget get_budget(const std::atomic<bool>* cancel) const noexcept;
+
+        /**
+         * @return True if the job has a sample, time or noise limit. Adaptive sampling requires a noise limit.
+         */
+        inline bool is_limited(void) const noexcept
+        { return (this->samples != 0 || this->time_ms != 0 || this->noise > 0.0f) && (!this->adaptive || this->noise > 0.0f); }
+    };
+
+    // Files of a scene. Scenes with the same files in the same order are the same scene.
+    struct SceneDescription
+    {
+        std::string environment;            // equirectangular environment map in the HDR image format
+        std::vector<std::string> models;    // object files, in the order they are loaded
+
+        /**
+         * @return Key that identifies the scene in a cache.
+         */
+        std::string key(void) const;
+    };
+
+    // Render job that is sent to a render daemon.
+    struct RenderRequest
+    {
+        SceneDescription scene;
+        RenderJob job;          // the output path can be empty if the image is streamed
+        bool stream;            // if true, the pixels are sent back to the client
+        bool stream_mean;       // if true, the mean of the samples is streamed as RGBA32F instead of the RGBA8 image
+        uint32_t tile_x;        // position of the image inside of the frame in pixels
+        uint32_t tile_y;
+        uint32_t frame_width;   // size of the frame the image is a tile of, 0 if the image is the whole frame
+        uint32_t frame_height;
+        uint32_t first_sample;  // index of the first sample, see 'PathTracer::reset_accumulation'
+    };
+
+    /**
+     * @brief               Parses one line of whitespace separated 'key=value' pairs:
+     *                      output=<path> width=<uint> height=<uint> samples=<uint> time=<ms> noise=<float>
+     *                      adaptive=<0|1> heatmap=<path> aovs=<path> denoise=<0|1> position=<x,y,z> target=<x,y,z> up=<x,y,z> fov=<degrees> aspect=<float> aperture=<float> focus=<float>
+     *                      If 'scene_keys' is true, also environment=<path> model=<path> (repeatable) stream=<0|1>
+     *                      format=<rgba8|rgba32f> tile=<x,y> frame=<width,height> first_sample=<uint>.
+     *                      Otherwise checkpoint=<path> checkpoint_interval=<ms>, a daemon does not write checkpoints.
+     * @param line          Line to parse.
+     * @param request       Receives the values, the fields of missing keys are unchanged.
+     * @param scene_keys    If false, the keys of the scene and 'stream' are unknown keys, if true the checkpoint keys.
+     * @param context       Prefix of the error messages.
+     * @throw               runtime_error if a key is unknown or a value is invalid.
+     */
+    void parse_render_request(const std::string& line, RenderRequest& request, bool scene_keys, const std::string& context);
+
+    /**
+     * @brief           Formats a request as line of 'key=value' pairs, the inverse of 'parse_render_request'.
+     * @param request   Request to format, its paths must not contain whitespace.
+     * @return          Line that contains every key of the request.
+     * @throw           invalid_argument if a path contains whitespace.
+     */
+    std::string format_render_request(const RenderRequest& request);
+
+    /**
+     * @brief               Denoises the accumulated samples of a path tracer and converts them to 8 bit, like the render target.
+     * @param path_tracer   Path tracer with at least one accumulated sample.
+     * @param denoiser      Denoiser that filters the image.
+     * @param width         Width of the render images of the path tracer.
+     * @param height        Height of the render images of the path tracer.
+     * @param pixels        Receives width * height RGBA pixels, the rows are not padded.
+     * @return              Time of the denoising in nano seconds, without the readback of the images.
+     */
+    uint64_t denoise_image(PathTracer& path_tracer, Denoiser& denoiser, uint32_t width, uint32_t height, std::vector<uint8_t>& pixels);
+
+    // One channel of an OpenEXR file, see 'write_exr'.
+    struct ExrChannel
+    {
+        enum PixelType : int32_t
+        {
+            UINT = 0,
+            HALF = 1,
+            FLOAT = 2
+        };
+
+        std::string name;           // layers are separated by dots, e.g. "normal.X", at most 31 characters
+        PixelType type;
+        std::vector<uint8_t> data;  // width * height values of the type, the rows are not padded
+    };
+
+    /**
+     * @brief           Creates a channel from every 'stride'-th float of an image.
+     * @param name      Name of the channel.
+     * @param half      If true, the floats are converted to half floats.
+     * @param src       First value of the channel.
+     * @param count     Number of pixels.
+     * @param stride    Distance between the values of two pixels in floats.
+     * @return          The channel.
+     */
+    ExrChannel make_exr_channel(const std::string& name, bool half, const float* src, size_t count, size_t stride);
+
+    /**
+     * @brief           Creates a channel of unsigned integers from every 'stride'-th integer of an image.
+     * @param name      Name of the channel.
+     * @param src       First value of the channel.
+     * @param count     Number of pixels.
+     * @param stride    Distance between the values of two pixels in integers.
+     * @return          The channel.
+     */
+    ExrChannel make_exr_channel(const std::string& name, const uint32_t* src, size_t count, size_t stride);
+
+    /**
+     * @brief           Writes an uncompressed OpenEXR file with one scanline per block. The channels
+     *                  are sorted by name, as the format requires.
+     * @param path      Path of the file.
+     * @param width     Width of the image in pixels.
+     * @param height    Height of the image in pixels.
+     * @param channels  Channels of the image, their names must be unique.
+     * @throw           invalid_argument if a channel has an invalid name or size.
+     * @throw           runtime_error if the file could not be written.
+     */
+    void write_exr(const std::string& path, uint32_t width, uint32_t height, const std::vector<ExrChannel>& channels);
+
+    // Throughput of a rendered batch.
+    struct BatchStatistics
+    {
+        uint32_t frames;        // number of rendered images
+        uint64_t render_ns;     // time spent tracing on the GPU, summed over all images
+        uint64_t denoise_ns;    // time spent denoising, summed over all images
+        uint64_t wall_ns;       // time from the first trace until the last image is written
+        double frames_per_hour; // frames / wall time
+        bool cancelled;         // true if the batch was stopped by the cancel flag, the remaining jobs are not rendered
+    };
+
+    /**
+     * Writes images to disk on a background thread, so the next image can be rendered
+     * while the previous one is encoded. The pixels are copied before 'write_png' returns.
+     * At most 'max_pending' images are queued, further calls wait until an image is written.
+     */
+    class ImageWriter
+    {
+    private:
+        ThreadPool pool;
+        std::deque<std::future<void>> pending;
+        uint32_t max_pending;
+
+        // Waits for the oldest images until another image may be queued.
+        void wait_for_pending(void);
+
+    public:
+        explicit ImageWriter(uint32_t max_pending = 2);
+        virtual ~ImageWriter(void);
+
+        ImageWriter(const ImageWriter&) = delete;
+        ImageWriter& operator= (const ImageWriter&) = delete;
+
+        ImageWriter(ImageWriter&&) = delete;
+        ImageWriter& operator= (ImageWriter&&) = delete;
+
+        /**
+         * @brief                   Queues an image to be written as PNG file.
+         * @param path              Path of the file.
+         * @param width             Width of the image in pixels.
+         * @param height            Height of the image in pixels.
+         * @param component_count   Number of 8 bit components per pixel.
+         * @param pixels            Pixel data, only read during the call.
+         * @param row_stride        Size of one row of 'pixels' in bytes.
+         * @throw                   runtime_error if a previous image could not be written.
+         */
+        void write_png(const std::string& path, uint32_t width, uint32_t height, uint32_t component_count, const uint8_t* pixels, size_t row_stride);
+
+        /**
+         * @brief           Queues a heatmap of sample counts to be written as PNG file. The counts are scaled by the
+         *                  highest count: black pixels got no sample, white pixels the most samples.
+         * @param path      Path of the file.
+         * @param width     Width of the image in pixels.
+         * @param height    Height of the image in pixels.
+         * @param counts    Samples per pixel, the rows are not padded. Only read during the call.
+         * @throw           runtime_error if a previous image could not be written.
+         */
+        void write_heatmap(const std::string& path, uint32_t width, uint32_t height, const uint32_t* counts);
+
+        /**
+         * @brief           Queues an image to be written as OpenEXR file, see 'pt::write_exr'.
+         * @param path      Path of the file.
+         * @param width     Width of the image in pixels.
+         * @param height    Height of the image in pixels.
+         * @param channels  Channels of the image, they are moved to the writer thread.
+         * @throw           runtime_error if a previous image could not be written.
+         */
+        void write_exr(const std::string& path, uint32_t width, uint32_t height, std::vector<ExrChannel>&& channels);
+
+        /**
+         * @brief Waits until all queued images are written.
+         * @throw runtime_error if an image could not be written.
+         */
+        void flush(void);
+    };
+
+    /**
+     * @brief               Queues the output variables of the accumulated samples as layers of one OpenEXR file:
+     *                      R, G, B, A (mean color, not denoised), albedo.R/G/B, normal.X/Y/Z, depth.Z,
+     *                      geometry.id, material.id and samples.count. Depth and IDs are those of the first sample,
+     *                      a pixel without hit has an infinite depth and the ID 0xFFFFFFFF.
+     * @param path_tracer   Path tracer with at least one accumulated sample.
+     * @param writer        Writer that writes the file.
+     * @param path          Path of the file.
+     * @param width         Width of the render images of the path tracer.
+     * @param height        Height of the render images of the path tracer.
+     * @throw               runtime_error if a previous image of the writer could not be written.
+     */
+    void write_aovs(PathTracer& path_tracer, ImageWriter& writer, const std::string& path, uint32_t width, uint32_t height);
+
+    /**
+     * Renders a list of jobs with one path tracer. The scene, acceleration structures and
+     * pipeline are created once, every job only changes the camera and, if necessary, the
+     * resolution. The image of a job is written while the next job is rendered.
+     */
+    class BatchRenderer
+    {
+    public:
+        typedef void(*progress_callback_t)(const std::string&);
+    private:
+        std::vector<RenderJob> jobs;
+        ImageWriter writer;
+        Denoiser denoiser;
+        progress_callback_t progress_callback;
+        const std::atomic<bool>* cancel;
+
+    public:
+        BatchRenderer(void);
+
+        BatchRenderer(const BatchRenderer&) = delete;
+        BatchRenderer& operator= (const BatchRenderer&) = delete;
+
+        BatchRenderer(BatchRenderer&&) = delete;
+        BatchRenderer& operator= (BatchRenderer&&) = delete;
+
+        /**
+         * @brief       Appends the jobs of a job list. Every non-empty line that does not start with '#'
+         *              is one job of whitespace separated 'key=value' pairs:
+         *              output=<path> width=<uint> height=<uint> samples=<uint> position=<x,y,z> target=<x,y,z>
+         *              up=<x,y,z> fov=<degrees> aspect=<float> aperture=<float> focus=<float>
+         *              checkpoint=<path> checkpoint_interval=<ms>
+         *              Only 'output' is requiered, the other keys default to 'default_job'.
+         * @param path  Path to the job list.
+         * @throw       runtime_error if the file could not be read or a line is invalid.
+         */
+        void load_jobs(const std::string& path);
+
+        /**
+         * @brief       Appends a job.
+         * @throw       invalid_argument if the resolution, the sample count or the output path is empty.
+         */
+        void add_job(const RenderJob& job);
+
+        inline const std::vector<RenderJob>& get_jobs(void) const noexcept
+        { return this->jobs; }
+
+        inline void set_progress_callback(progress_callback_t callback) noexcept
+        { this->progress_callback = callback; }
+
+        /**
+         * @brief           Sets a flag that stops the batch if another thread or a signal handler sets it. The current
+         *                  job writes its checkpoint, so the batch continues where it stopped if it is rendered again.
+         * @param cancel    Flag to poll, nullptr to never stop.
+         */
+        inline void set_cancel_flag(const std::atomic<bool>* cancel) noexcept
+        { this->cancel = cancel; }
+
+        /**
+         * @return Job that provides the values of the keys that are missing in a job list.
+         */
+        static RenderJob default_job(void);
+
+        /**
+         * @brief               Renders all jobs and waits until all images are written.
+         * @param path_tracer   Initialized path tracer, its camera and resolution are changed.
+         * @return              Throughput of the batch.
+         * @throw               runtime_error if an image or a checkpoint could not be read or written.
+         */
+        BatchStatistics render(PathTracer& path_tracer);
+    };
+
+    /**
+     * Initialized scenes, ordered by their last use. If the device memory of all scenes exceeds the
+     * budget, the least recently used scenes are destroyed. The most recently used scene is always
+     * kept, even if it exceeds the budget on its own.
+     */
+    class SceneCache
+    {
+    private:
+        struct Entry
+        {
+            std::string key;
+            std::unique_ptr<PathTracer> path_tracer;
+            size_t memory_size;
+        };
+
+        std::list<Entry> entries;   // most recently used first
+        size_t budget;
+        size_t memory_size;
+
+    public:
+        explicit SceneCache(size_t budget) : budget(budget), memory_size(0) {}
+
+        SceneCache(const SceneCache&) = delete;
+        SceneCache& operator= (const SceneCache&) = delete;
+
+        /**
+         * @brief       Looks up a scene and marks it as most recently used.
+         * @param key   Key of the scene.
+         * @return      The scene or nullptr if it is not cached.
+         */
+        PathTracer* find(const std::string& key);
+
+        /**
+         * @brief               Adds a scene as most recently used and evicts scenes until the budget is met.
+         * @param key           Key of the scene, must not be cached yet.
+         * @param path_tracer   Initialized path tracer of the scene.
+         * @param memory_size   Device memory of the scene in bytes.
+         * @return              Number of evicted scenes.
+         * @throw               invalid_argument if the key is already cached.
+         */
+        uint32_t insert(const std::string& key, std::unique_ptr<PathTracer> path_tracer, size_t memory_size);
+
+        /**
+         * @brief Destroys all scenes.
+         */
+        void clear(void) noexcept;
+
+        inline size_t size(void) const noexcept
+        { return this->entries.size(); }
+
+        inline size_t get_memory_size(void) const noexcept
+        { return this->memory_size; }
+
+        inline size_t get_budget(void) const noexcept
+        { return this->budget; }
+    };
+
+    /**
+     * Long-lived render process that keeps scenes resident and executes render requests that are sent
+     * over a local socket. Every request is one message of 'key=value' pairs (see 'parse_render_request'),
+     * the message "shutdown" stops the daemon. Every request is answered with a header message:
+     * "ok width=<uint> height=<uint> components=<uint> component_size=<1|4> samples=<uint> render_ns=<uint>
+     * load_ns=<uint> denoise_ns=<uint> cached=<0|1> streamed=<0|1>" or "error <message>". The component size
+     * is 4 if the mean is streamed as 32 bit floats, otherwise 1. If the pixels are streamed, they follow the
+     * header as one message without padding between the rows. The image is written to the output path before the header is sent.
+     * Connections are served one after another, a connection can send any number of requests.
+     */
+    class RenderDaemon
+    {
+    public:
+        typedef void(*log_callback_t)(const std::string&);
+    private:
+        const Setup* setup;
+        SceneCache cache;
+        ImageWriter writer;
+        Denoiser denoiser;
+        std::atomic<bool> stopping;
+        log_callback_t log_callback;
+
+        void log(const std::string& msg);
+        PathTracer& acquire_scene(const SceneDescription& scene, bool& cached, uint64_t& load_ns);
+        void serve_connection(LocalSocket& connection);
+        void render(LocalSocket& connection, const RenderRequest& request);
+
+    public:
+        // requests are a single line of text, larger messages are rejected before they are allocated
+        constexpr static uint64_t MAX_REQUEST_SIZE = 1ull << 20;
+
+        /**
+         * @param setup         Initialized setup, all scenes use its device.
+         * @param cache_budget  Device memory of all cached scenes in bytes.
+         */
+        RenderDaemon(const Setup* setup, size_t cache_budget);
+
+        RenderDaemon(const RenderDaemon&) = delete;
+        RenderDaemon& operator= (const RenderDaemon&) = delete;
+
+        RenderDaemon(RenderDaemon&&) = delete;
+        RenderDaemon& operator= (RenderDaemon&&) = delete;
+
+        inline void set_log_callback(log_callback_t callback) noexcept
+        { this->log_callback = callback; }
+
+        /**
+         * @brief               Serves requests until 'stop' is called or a client sends "shutdown".
+         *                      The cached scenes are destroyed before the function returns.
+         * @param socket_path   Path of the socket file.
+         * @throw               runtime_error if the socket could not be created.
+         */
+        void serve(const std::string& socket_path);
+
+        /**
+         * @brief Stops serving after the current connection, can be called from any thread.
+         *        A job that is rendering is cancelled, the image of the samples traced so far is still sent.
+         */
+        inline void stop(void) noexcept
+        { this->stopping = true; }
+
+        inline const SceneCache& get_cache(void) const noexcept
+        { return this->cache; }
+    };
+
+    // Answer of a render daemon to one request.
+    struct RenderReply
+    {
+        uint32_t width;
+        uint32_t height;
+        uint32_t component_count;
+        uint32_t component_size;        // size of one component in bytes, 1 for RGBA8 and 4 for RGBA32F
+        uint32_t samples;       // samples per pixel that were traced
+        uint64_t render_ns;     // time spent tracing on the GPU
+        uint64_t load_ns;       // time spent loading the scene, 0 if it was cached
+        uint64_t denoise_ns;    // time spent denoising, 0 if the image was not denoised
+        bool cached;            // true if the scene was already resident
+        std::vector<uint8_t> pixels;    // streamed pixels, empty if the image was not streamed
+    };
+
+    /**
+     * Client of a render daemon.
+     */
+    class RenderClient
+    {
+    private:
+        LocalSocket socket;
+
+    public:
+        /**
+         * @brief       Connects to a render daemon.
+         * @param path  Path of the socket file of the daemon.
+         * @throw       runtime_error if the connection failed.
+         */
+        void connect(const std::string& path);
+
+        /**
+         * @brief           Sends a request and waits for the image.
+         * @param request   Request of 'key=value' pairs, see 'parse_render_request'.
+         * @return          Answer of the daemon.
+         * @throw           runtime_error if the daemon could not render the image or the connection was closed.
+         */
+        RenderReply submit(const std::string& request);
+
+        /**
+         * @brief           Sends a request without waiting for the answer, it is received with 'receive'.
+         * @throw           runtime_error if the connection is closed.
+         */
+        void send(const std::string& request);
+
+        /**
+         * @brief               Waits for the answer of the last request.
+         * @param timeout_ms    Time to wait in milliseconds.
+         * @return              True if the answer can be received without blocking.
+         */
+        inline bool poll(uint32_t timeout_ms)
+        { return this->socket.poll(timeout_ms); }
+
+        /**
+         * @brief   Receives the answer of the last request, blocks until it is received.
+         * @return  Answer of the daemon.
+         * @throw   runtime_error if the daemon could not render the image or the connection was closed.
+         */
+        RenderReply receive(void);
+
+        /**
+         * @brief Asks the daemon to stop and closes the connection.
+         */
+        void shutdown(void);
+    };
+
+    // Frame that is rendered by multiple render daemons.
+    struct DistributedFrame
+    {
+        RenderRequest request;  // scene, camera, resolution, samples per pixel and output path of the whole frame
+        uint32_t tile_size;     // width and height of a tile in pixels
+        uint32_t pass_samples;  // samples per pixel of one work unit, the samples of a tile are split into passes
+    };
+
+    // Execution of a distributed frame.
+    struct DistributedStatistics
+    {
+        uint32_t units;             // number of work units (tiles x passes)
+        uint32_t reissued;          // units that were sent again, because their worker failed or was slow
+        uint32_t failed_workers;    // workers that failed or did not answer in time, they are not used anymore
+        uint64_t wall_ns;           // time until all units were merged
+    };
+
+    /**
+     * Renders one frame with multiple render daemons (workers). The frame is split into tiles and the
+     * samples of every tile into passes, every tile and pass is one work unit. Idle workers take the next
+     * unit, the means of the units are merged into one accumulation buffer as they arrive.
+     * A worker that fails or does not answer in time is dropped and its unit is sent to another worker.
+     * If all remaining units are in progress, an idle worker renders a copy of the oldest unit that only
+     * one worker renders, so a slow worker does not delay the frame. The first result of a unit is used.
+     */
+    class TileCoordinator
+    {
+    public:
+        typedef void(*progress_callback_t)(const std::string&);
+    private:
+        struct WorkUnit
+        {
+            uint32_t tile;          // index of the tile
+            uint32_t x, y, width, height;
+            uint32_t first_sample;
+            uint32_t samples;
+            uint32_t active;        // number of workers that currently render the unit
+            uint32_t attempts;      // number of workers the unit was sent to
+            bool done;
+            std::chrono::steady_clock::time_point issued;
+        };
+
+        std::vector<std::string> workers;
+        uint32_t timeout_ms;
+        progress_callback_t progress_callback;
+
+        // state of the current frame, guarded by 'mtx'
+        std::mutex mtx;
+        std::condition_variable cv;
+        std::vector<WorkUnit> units;
+        std::vector<uint32_t> tile_samples;     // samples per pixel that are merged per tile
+        std::vector<float> accumulation;        // RGBA32F mean of the merged samples of the whole frame
+        uint32_t frame_width;
+        uint32_t completed;
+        uint32_t alive_workers;
+        DistributedStatistics stats;
+        std::string last_error;
+
+        size_t acquire_unit(void);
+        void release_unit(size_t i, const RenderReply* reply);
+        void work(const std::string& socket_path, const DistributedFrame& frame);
+
+    public:
+        /**
+         * @param worker_sockets    Socket paths of the render daemons.
+         * @param timeout_ms        Time a worker may take for one unit, before it is dropped.
+         */
+        TileCoordinator(const std::vector<std::string>& worker_sockets, uint32_t timeout_ms);
+
+        TileCoordinator(const TileCoordinator&) = delete;
+        TileCoordinator& operator= (const TileCoordinator&) = delete;
+
+        inline void set_progress_callback(progress_callback_t callback) noexcept
+        { this->progress_callback = callback; }
+
+        /**
+         * @brief       Renders a frame and writes it to the output path of the request, if it is not empty.
+         * @param frame Frame to render.
+         * @return      Execution of the frame.
+         * @throw       runtime_error if all workers failed before the frame was finished.
+         */
+        DistributedStatistics render(const DistributedFrame& frame);
+
+        /**
+         * @return RGBA32F mean of the last rendered frame, the rows are not padded.
+         */
+        inline const std::vector<float>& get_accumulation(void) const noexcept
+        { return this->accumulation; }
+    };
+} // namespace pt
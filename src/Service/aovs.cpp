@@ -0,0 +1,37 @@
+#include "../application.h"
+
+void pt::write_aovs(PathTracer& path_tracer, ImageWriter& writer, const std::string& path, uint32_t width, uint32_t height)
+{
+    const size_t pixel_count = static_cast<size_t>(width) * height;
+    std::vector<float> color(pixel_count * 4);
+    std::vector<float> albedo(pixel_count * 4);
+    std::vector<float> normals(pixel_count * 4);
+    std::vector<float> depth(pixel_count);
+    std::vector<uint32_t> geometry_ids(pixel_count);
+    std::vector<uint32_t> material_ids(pixel_count);
+    std::vector<uint32_t> counts(pixel_count);
+    path_tracer.read_accumulation(color.data());
+    path_tracer.read_features(albedo.data(), normals.data());
+    path_tracer.read_first_hit(depth.data(), geometry_ids.data(), material_ids.data());
+    path_tracer.read_sample_counts(counts.data());
+
+    // A of the accumulation is the mean of the squared luminance, the image itself is opaque
+    const float alpha = 1.0f;
+    std::vector<ExrChannel> channels;
+    channels.push_back(make_exr_channel("R", true, color.data() + 0, pixel_count, 4));
+    channels.push_back(make_exr_channel("G", true, color.data() + 1, pixel_count, 4));
+    channels.push_back(make_exr_channel("B", true, color.data() + 2, pixel_count, 4));
+    channels.push_back(make_exr_channel("A", true, &alpha, pixel_count, 0));
+    channels.push_back(make_exr_channel("albedo.R", true, albedo.data() + 0, pixel_count, 4));
+    channels.push_back(make_exr_channel("albedo.G", true, albedo.data() + 1, pixel_count, 4));
+    channels.push_back(make_exr_channel("albedo.B", true, albedo.data() + 2, pixel_count, 4));
+    channels.push_back(make_exr_channel("normal.X", true, normals.data() + 0, pixel_count, 4));
+    channels.push_back(make_exr_channel("normal.Y", true, normals.data() + 1, pixel_count, 4));
+    channels.push_back(make_exr_channel("normal.Z", true, normals.data() + 2, pixel_count, 4));
+    // half floats would round the depth of distant hits to whole units
+    channels.push_back(make_exr_channel("depth.Z", false, depth.data(), pixel_count, 1));
+    channels.push_back(make_exr_channel("geometry.id", geometry_ids.data(), pixel_count, 1));
+    channels.push_back(make_exr_channel("material.id", material_ids.data(), pixel_count, 1));
+    channels.push_back(make_exr_channel("samples.count", counts.data(), pixel_count, 1));
+    writer.write_exr(path, width, height, std::move(channels));
+}
@@ -0,0 +1,222 @@
+#include "../application.h"
+#include <fstream>
+#include <algorithm>
+
+namespace
+{
+    /**
+     * @brief       Continues a job from its checkpoint and reduces the budget by the restored samples and time.
+     * @return      True if the restored rendering already reached the sample or time limit.
+     */
+    bool resume_job(pt::PathTracer& path_tracer, const pt::RenderJob& job, pt::RenderBudget& budget, pt::BatchRenderer::progress_callback_t progress_callback)
+    {
+        pt::Checkpoint checkpoint;
+        if(!pt::read_checkpoint(job.checkpoint, checkpoint))
+            return false;
+        try
+        {
+            path_tracer.restore_checkpoint(checkpoint);
+        }
+        catch(const std::invalid_argument& e)
+        {
+            // the job was changed since the checkpoint was written, its samples can't be reused
+            if(progress_callback)
+                progress_callback("The checkpoint \"" + job.checkpoint + "\" does not belong to the job and is ignored: " + e.what());
+            path_tracer.reset_accumulation();
+            return false;
+        }
+        if(progress_callback)
+        {
+            progress_callback("Resumed \"" + job.output + "\" from \"" + job.checkpoint + "\" at " + std::to_string(checkpoint.accumulated_samples)
+                + " spp after " + std::to_string(checkpoint.elapsed_ns / 1000000) + " ms.");
+        }
+
+        bool done = false;
+        if(budget.max_samples != 0)
+        {
+            done = done || checkpoint.accumulated_samples >= budget.max_samples;
+            budget.max_samples -= std::min(checkpoint.accumulated_samples, budget.max_samples);
+        }
+        if(budget.time_ns != 0)
+        {
+            done = done || checkpoint.elapsed_ns >= budget.time_ns;
+            budget.time_ns -= std::min(checkpoint.elapsed_ns, budget.time_ns);
+        }
+        return done;
+    }
+}
+
+pt::BatchRenderer::BatchRenderer(void)
+{
+    this->progress_callback = nullptr;
+    this->cancel = nullptr;
+}
+
+pt::RenderJob pt::BatchRenderer::default_job(void)
+{
+    RenderJob job;
+    job.width = 1920;
+    job.height = 1080;
+    job.samples = 1;
+    job.time_ms = 0;
+    job.noise = 0.0f;
+    job.adaptive = false;
+    job.denoise = false;
+    job.checkpoint_interval_ms = 60000;
+    job.camera.position = glm2::vec3(0.0f, 0.0f, -5.0f);
+    job.camera.target = glm2::vec3(0.0f, 0.0f, 0.0f);
+    job.camera.up = glm2::vec3(0.0f, 1.0f, 0.0f);
+    job.camera.fov = 90.0f;
+    job.camera.aspect = 0.0f;
+    job.camera.aperture = 0.0f;
+    job.camera.focus_distance = 1.0f;
+    return job;
+}
+
+void pt::BatchRenderer::load_jobs(const std::string& path)
+{
+    std::ifstream file(path);
+    if(!file.is_open())
+        throw std::runtime_error("[pt::BatchRenderer::load_jobs]: Failed to open job list \"" + path + "\".");
+
+    // the jobs are only appended if the whole list is valid
+    std::vector<RenderJob> parsed;
+    std::string line;
+    for(size_t line_number = 1; std::getline(file, line); line_number++)
+    {
+        const size_t first = line.find_first_not_of(" \t\r");
+        if(first == std::string::npos || line[first] == '#') continue;
+
+        const std::string context = "[pt::BatchRenderer::load_jobs]: Line " + std::to_string(line_number) + ": ";
+        RenderRequest request = {};
+        request.job = default_job();
+        parse_render_request(line, request, false, context);
+        if(request.job.output.empty())
+            throw std::runtime_error(context + "The job has no output path.");
+        if(!request.job.is_limited())
+            throw std::runtime_error(context + "Adaptive sampling requires a noise limit.");
+        parsed.push_back(request.job);
+    }
+
+    for(const RenderJob& job : parsed)
+        this->add_job(job);
+}
+
+void pt::BatchRenderer::add_job(const RenderJob& job)
+{
+    if(job.output.empty())
+        throw std::invalid_argument("[pt::BatchRenderer::add_job]: The output path must not be empty.");
+    if(job.width == 0 || job.height == 0)
+        throw std::invalid_argument("[pt::BatchRenderer::add_job]: The resolution must not be 0.");
+    if(!job.is_limited())
+        throw std::invalid_argument("[pt::BatchRenderer::add_job]: The job has no sample, time or noise limit, or adaptive sampling has no noise limit.");
+    this->jobs.push_back(job);
+}
+
+pt::BatchStatistics pt::BatchRenderer::render(PathTracer& path_tracer)
+{
+    BatchStatistics stats = {};
+    const auto begin = std::chrono::steady_clock::now();
+
+    for(size_t i = 0; i < this->jobs.size(); i++)
+    {
+        const RenderJob& job = this->jobs[i];
+        if(this->cancel != nullptr && this->cancel->load())
+        {
+            stats.cancelled = true;
+            break;
+        }
+
+        // only changing the resolution recreates the render target, the scene stays resident
+        path_tracer.set_resolution(job.width, job.height);
+        path_tracer.set_features(job.denoise || !job.aovs.empty());
+        path_tracer.set_camera(job.camera);
+        RenderBudget budget = job.get_budget(this->cancel);
+        std::unique_ptr<CheckpointWriter> checkpoints;
+        bool done = false;
+        if(!job.checkpoint.empty())
+        {
+            checkpoints = std::make_unique<CheckpointWriter>(job.checkpoint);
+            budget.checkpoints = checkpoints.get();
+            budget.checkpoint_interval_ns = static_cast<uint64_t>(job.checkpoint_interval_ms) * 1000000;
+            done = resume_job(path_tracer, job, budget, this->progress_callback);
+        }
+
+        // a finished checkpoint is the result, its samples are reported
+        RenderResult result = {};
+        if(done)
+            result.accumulated = path_tracer.get_accumulated_samples();
+        else
+            result = path_tracer.run(budget);
+        stats.render_ns += result.render_ns;
+
+        // the image of a cancelled job is not finished, its checkpoint is the result
+        if(result.reason == RenderResult::CANCELLED)
+        {
+            if(checkpoints)
+                checkpoints->flush();
+            if(this->progress_callback)
+            {
+                this->progress_callback(
+                    "Job " + std::to_string(i + 1) + "/" + std::to_string(this->jobs.size()) + ": cancelled at " + std::to_string(result.accumulated) + " spp"
+                    + (checkpoints ? ", the rendering continues from \"" + job.checkpoint + "\" next time." : ".")
+                );
+            }
+            stats.cancelled = true;
+            break;
+        }
+
+        uint64_t denoise_ns = 0;
+        if(job.denoise)
+        {
+            std::vector<uint8_t> denoised;
+            denoise_ns = denoise_image(path_tracer, this->denoiser, job.width, job.height, denoised);
+            this->writer.write_png(job.output, job.width, job.height, 4, denoised.data(), static_cast<size_t>(job.width) * 4);
+            stats.denoise_ns += denoise_ns;
+        }
+        else
+        {
+            // the writer copies the pixels, so the image can be unmapped before it is written
+            size_t row_stride;
+            uint32_t component_count;
+            const uint8_t* pixels = path_tracer.map_image(row_stride, component_count);
+            try
+            {
+                this->writer.write_png(job.output, job.width, job.height, component_count, pixels, row_stride);
+            }
+            catch(...)
+            {
+                path_tracer.unmap_image();
+                throw;
+            }
+            path_tracer.unmap_image();
+        }
+        if(!job.heatmap.empty())
+        {
+            std::vector<uint32_t> counts(static_cast<size_t>(job.width) * job.height);
+            path_tracer.read_sample_counts(counts.data());
+            this->writer.write_heatmap(job.heatmap, job.width, job.height, counts.data());
+        }
+        if(!job.aovs.empty())
+            write_aovs(path_tracer, this->writer, job.aovs, job.width, job.height);
+        // the checkpoint of a finished job would only resume an image that already exists
+        if(checkpoints)
+            checkpoints->remove();
+        stats.frames++;
+
+        if(this->progress_callback)
+        {
+            this->progress_callback(
+                "Job " + std::to_string(i + 1) + "/" + std::to_string(this->jobs.size()) + ": rendered \"" + job.output + "\" ("
+                + std::to_string(job.width) + "x" + std::to_string(job.height) + ", " + std::to_string(result.accumulated) + " spp) in "
+                + std::to_string(result.render_ns / 1000000) + " ms, " + std::to_string(result.pixel_samples) + " pixel samples"
+                + (job.denoise ? ", denoised in " + std::to_string(denoise_ns / 1000000) + " ms." : ".")
+            );
+        }
+    }
+    this->writer.flush();
+
+    stats.wall_ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin).count());
+    stats.frames_per_hour = (stats.wall_ns > 0) ? static_cast<double>(stats.frames) * 3.6e12 / static_cast<double>(stats.wall_ns) : 0.0;
+    return stats;
+}
@@ -0,0 +1,71 @@
+#include "../application.h"
+#include <cstdlib>
+#include <sstream>
+
+void pt::RenderClient::connect(const std::string& path)
+{
+    this->socket.connect(path);
+}
+
+pt::RenderReply pt::RenderClient::submit(const std::string& request)
+{
+    this->send(request);
+    return this->receive();
+}
+
+void pt::RenderClient::send(const std::string& request)
+{
+    this->socket.send_message(request);
+}
+
+pt::RenderReply pt::RenderClient::receive(void)
+{
+    std::vector<uint8_t> message;
+    if(!this->socket.receive_message(message))
+        throw std::runtime_error("[pt::RenderClient::receive]: The daemon closed the connection.");
+    const std::string header(message.begin(), message.end());
+    if(header.compare(0, 6, "error ") == 0)
+        throw std::runtime_error("[pt::RenderClient::receive]: " + header.substr(6));
+    if(header.compare(0, 3, "ok ") != 0)
+        throw std::runtime_error("[pt::RenderClient::receive]: Invalid answer \"" + header + "\".");
+
+    RenderReply reply = {};
+    reply.component_size = 1;
+    bool streamed = false;
+    std::istringstream tokens(header.substr(3));
+    std::string token;
+    while(tokens >> token)
+    {
+        const size_t eq = token.find('=');
+        if(eq == std::string::npos) continue;
+        const std::string key = token.substr(0, eq);
+        const uint64_t value = std::strtoull(token.c_str() + eq + 1, nullptr, 10);
+        if(key == "width")              reply.width = static_cast<uint32_t>(value);
+        else if(key == "height")        reply.height = static_cast<uint32_t>(value);
+        else if(key == "components")    reply.component_count = static_cast<uint32_t>(value);
+        else if(key == "component_size") reply.component_size = static_cast<uint32_t>(value);
+        else if(key == "samples")       reply.samples = static_cast<uint32_t>(value);
+        else if(key == "render_ns")     reply.render_ns = value;
+        else if(key == "load_ns")       reply.load_ns = value;
+        else if(key == "denoise_ns")    reply.denoise_ns = value;
+        else if(key == "cached")        reply.cached = (value != 0);
+        else if(key == "streamed")      streamed = (value != 0);
+    }
+
+    if(streamed)
+    {
+        if(!this->socket.receive_message(reply.pixels))
+            throw std::runtime_error("[pt::RenderClient::receive]: The daemon closed the connection before the pixels were sent.");
+        if(reply.pixels.size() != static_cast<size_t>(reply.width) * reply.height * reply.component_count * reply.component_size)
+            throw std::runtime_error("[pt::RenderClient::receive]: The size of the streamed image does not match its extent.");
+    }
+    return reply;
+}
+
+void pt::RenderClient::shutdown(void)
+{
+    this->socket.send_message(std::string("shutdown"));
+    std::vector<uint8_t> message;
+    this->socket.receive_message(message);
+    this->socket.close();
+}
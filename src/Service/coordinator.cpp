@@ -0,0 +1,247 @@
+#include "../application.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+    constexpr size_t NO_UNIT = ~size_t(0);
+    // interval in which a waiting worker checks if the frame is finished
+    constexpr uint32_t POLL_INTERVAL_MS = 50;
+}
+
+pt::TileCoordinator::TileCoordinator(const std::vector<std::string>& worker_sockets, uint32_t timeout_ms)
+    : workers(worker_sockets), timeout_ms(timeout_ms), progress_callback(nullptr), frame_width(0), completed(0), alive_workers(0), stats{}
+{
+    if(this->workers.empty())
+        throw std::invalid_argument("[pt::TileCoordinator::TileCoordinator]: At least one worker is required.");
+    if(this->timeout_ms == 0)
+        throw std::invalid_argument("[pt::TileCoordinator::TileCoordinator]: The timeout must not be 0.");
+}
+
+size_t pt::TileCoordinator::acquire_unit(void)
+{
+    std::unique_lock<std::mutex> lock(this->mtx);
+    for(;;)
+    {
+        if(this->completed == this->units.size()) return NO_UNIT;
+
+        // units are ordered by pass, so the first passes of all tiles are finished first
+        size_t next = NO_UNIT;
+        for(size_t i = 0; i < this->units.size() && next == NO_UNIT; i++)
+        {
+            if(!this->units[i].done && this->units[i].active == 0)
+                next = i;
+        }
+        // if every unit is in progress, the oldest one is rendered a second time
+        if(next == NO_UNIT)
+        {
+            for(size_t i = 0; i < this->units.size(); i++)
+            {
+                const WorkUnit& unit = this->units[i];
+                if(!unit.done && unit.active == 1 && (next == NO_UNIT || unit.issued < this->units[next].issued))
+                    next = i;
+            }
+        }
+
+        if(next != NO_UNIT)
+        {
+            WorkUnit& unit = this->units[next];
+            if(unit.attempts > 0) this->stats.reissued++;
+            if(unit.active == 0) unit.issued = std::chrono::steady_clock::now();
+            unit.active++;
+            unit.attempts++;
+            return next;
+        }
+        this->cv.wait(lock);
+    }
+}
+
+void pt::TileCoordinator::release_unit(size_t i, const RenderReply* reply)
+{
+    std::lock_guard<std::mutex> lock(this->mtx);
+    WorkUnit& unit = this->units[i];
+    unit.active--;
+
+    // the first result of a unit is used, the result of a copy is discarded
+    if(reply != nullptr && !unit.done)
+    {
+        // the reply is not aligned for floats, it is padded to the common tile size and cropped here
+        std::vector<float> mean(static_cast<size_t>(reply->width) * reply->height * 4);
+        std::memcpy(mean.data(), reply->pixels.data(), mean.size() * sizeof(float));
+
+        // running mean weighted by the number of samples
+        const uint32_t merged = this->tile_samples[unit.tile];
+        const float weight = static_cast<float>(unit.samples) / static_cast<float>(merged + unit.samples);
+        for(uint32_t y = 0; y < unit.height; y++)
+        {
+            float* dst = this->accumulation.data() + ((static_cast<size_t>(unit.y) + y) * this->frame_width + unit.x) * 4;
+            const float* src = mean.data() + static_cast<size_t>(y) * reply->width * 4;
+            for(uint32_t c = 0; c < unit.width * 4; c++)
+                dst[c] += (src[c] - dst[c]) * weight;
+        }
+        this->tile_samples[unit.tile] = merged + unit.samples;
+
+        unit.done = true;
+        this->completed++;
+        if(this->progress_callback)
+        {
+            this->progress_callback(
+                "Merged tile " + std::to_string(unit.tile) + " (samples " + std::to_string(unit.first_sample) + "-"
+                + std::to_string(unit.first_sample + unit.samples - 1) + "), " + std::to_string(this->completed) + "/"
+                + std::to_string(this->units.size()) + " units done."
+            );
+        }
+    }
+    this->cv.notify_all();
+}
+
+void pt::TileCoordinator::work(const std::string& socket_path, const DistributedFrame& frame)
+{
+    size_t current = NO_UNIT;
+    try
+    {
+        RenderClient client;
+        client.connect(socket_path);
+
+        // every unit has the same resolution, so the worker does not recreate its render images per tile
+        const uint32_t padded_width = std::min(frame.tile_size, frame.request.job.width);
+        const uint32_t padded_height = std::min(frame.tile_size, frame.request.job.height);
+        while((current = this->acquire_unit()) != NO_UNIT)
+        {
+            const WorkUnit& unit = this->units[current];
+            RenderRequest request = frame.request;
+            request.job.output.clear();
+            request.job.heatmap.clear();
+            request.job.width = padded_width;
+            request.job.height = padded_height;
+            request.job.samples = unit.samples;
+            request.stream = true;
+            request.stream_mean = true;
+            request.tile_x = unit.x;
+            request.tile_y = unit.y;
+            request.frame_width = frame.request.job.width;
+            request.frame_height = frame.request.job.height;
+            request.first_sample = unit.first_sample;
+            client.send(format_render_request(request));
+
+            // the wait is interrupted if another worker finishes the frame
+            const auto begin = std::chrono::steady_clock::now();
+            while(!client.poll(POLL_INTERVAL_MS))
+            {
+                bool finished;
+                {
+                    std::lock_guard<std::mutex> lock(this->mtx);
+                    finished = (this->completed == this->units.size());
+                }
+                if(finished)
+                {
+                    this->release_unit(current, nullptr);
+                    return;
+                }
+                if(std::chrono::steady_clock::now() - begin > std::chrono::milliseconds(this->timeout_ms))
+                    throw std::runtime_error("The worker did not answer within " + std::to_string(this->timeout_ms) + " ms.");
+            }
+
+            const RenderReply reply = client.receive();
+            if(reply.width != padded_width || reply.height != padded_height || reply.component_count != 4 || reply.component_size != sizeof(float))
+                throw std::runtime_error("The worker sent an image of the wrong format.");
+            if(reply.samples != unit.samples)
+                throw std::runtime_error("The worker stopped before all samples were traced.");
+            this->release_unit(current, &reply);
+        }
+    }
+    catch(const std::exception& e)
+    {
+        // the worker is dropped, its unit is taken by the next idle worker
+        std::lock_guard<std::mutex> lock(this->mtx);
+        if(current != NO_UNIT)
+            this->units[current].active--;
+        this->stats.failed_workers++;
+        this->alive_workers--;
+        this->last_error = "Worker \"" + socket_path + "\": " + e.what();
+        if(this->progress_callback)
+            this->progress_callback(this->last_error + " The worker is dropped.");
+        this->cv.notify_all();
+    }
+}
+
+pt::DistributedStatistics pt::TileCoordinator::render(const DistributedFrame& frame)
+{
+    const RenderJob& job = frame.request.job;
+    if(job.width == 0 || job.height == 0 || job.samples == 0)
+        throw std::invalid_argument("[pt::TileCoordinator::render]: The resolution and the sample count must not be 0.");
+    // the passes of a tile must trace their whole sample range, otherwise the ranges of the passes overlap
+    if(job.time_ms != 0 || job.noise > 0.0f || job.adaptive)
+        throw std::invalid_argument("[pt::TileCoordinator::render]: A distributed frame can't be limited by time or noise.");
+    if(job.denoise)
+        throw std::invalid_argument("[pt::TileCoordinator::render]: A distributed frame can't be denoised by the workers, their tiles miss the neighbouring pixels.");
+    if(!job.aovs.empty())
+        throw std::invalid_argument("[pt::TileCoordinator::render]: A distributed frame has no output variables, the workers only return the color of their tiles.");
+    if(!job.checkpoint.empty())
+        throw std::invalid_argument("[pt::TileCoordinator::render]: A distributed frame has no checkpoint, a failed unit is rendered again instead.");
+    if(frame.tile_size == 0 || frame.pass_samples == 0)
+        throw std::invalid_argument("[pt::TileCoordinator::render]: The tile size and the samples per pass must not be 0.");
+    if(frame.request.scene.environment.empty())
+        throw std::invalid_argument("[pt::TileCoordinator::render]: The frame has no environment map.");
+
+    const auto begin = std::chrono::steady_clock::now();
+    const uint32_t tiles_x = (job.width + frame.tile_size - 1) / frame.tile_size;
+    const uint32_t tiles_y = (job.height + frame.tile_size - 1) / frame.tile_size;
+    const uint32_t passes = (job.samples + frame.pass_samples - 1) / frame.pass_samples;
+
+    // every pass of a tile traces its own range of samples, so the passes don't repeat random numbers
+    this->units.clear();
+    this->units.reserve(static_cast<size_t>(tiles_x) * tiles_y * passes);
+    for(uint32_t pass = 0; pass < passes; pass++)
+    {
+        for(uint32_t ty = 0; ty < tiles_y; ty++)
+        {
+            for(uint32_t tx = 0; tx < tiles_x; tx++)
+            {
+                WorkUnit unit = {};
+                unit.tile = ty * tiles_x + tx;
+                unit.x = tx * frame.tile_size;
+                unit.y = ty * frame.tile_size;
+                unit.width = std::min(frame.tile_size, job.width - unit.x);
+                unit.height = std::min(frame.tile_size, job.height - unit.y);
+                unit.first_sample = pass * frame.pass_samples;
+                unit.samples = std::min(frame.pass_samples, job.samples - unit.first_sample);
+                this->units.push_back(unit);
+            }
+        }
+    }
+    this->tile_samples.assign(static_cast<size_t>(tiles_x) * tiles_y, 0);
+    this->accumulation.assign(static_cast<size_t>(job.width) * job.height * 4, 0.0f);
+    this->frame_width = job.width;
+    this->completed = 0;
+    this->alive_workers = static_cast<uint32_t>(this->workers.size());
+    this->stats = {};
+    this->stats.units = static_cast<uint32_t>(this->units.size());
+    this->last_error.clear();
+
+    // a worker thread only ends if the frame is finished or the worker failed
+    std::vector<std::thread> threads;
+    threads.reserve(this->workers.size());
+    for(const std::string& worker : this->workers)
+        threads.emplace_back(&TileCoordinator::work, this, worker, std::cref(frame));
+    for(std::thread& thread : threads)
+        thread.join();
+
+    if(this->completed != this->units.size())
+        throw std::runtime_error("[pt::TileCoordinator::render]: All workers failed, the last error was: " + this->last_error);
+
+    if(!job.output.empty())
+    {
+        // same conversion as the store of the shader to the RGBA8 image, alpha is the second moment of the luminance
+        std::vector<uint8_t> pixels(this->accumulation.size());
+        for(size_t i = 0; i < pixels.size(); i++)
+            pixels[i] = ((i & 3) == 3) ? 255 : static_cast<uint8_t>(std::lround(std::min(std::max(this->accumulation[i], 0.0f), 1.0f) * 255.0f));
+        ImageWriter writer(1);
+        writer.write_png(job.output, job.width, job.height, 4, pixels.data(), static_cast<size_t>(job.width) * 4);
+        writer.flush();
+    }
+
+    this->stats.wall_ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin).count());
+    return this->stats;
+}
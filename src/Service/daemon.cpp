@@ -0,0 +1,223 @@
+#include "../application.h"
+#include <algorithm>
+
+pt::PathTracer* pt::SceneCache::find(const std::string& key)
+{
+    for(auto it = this->entries.begin(); it != this->entries.end(); ++it)
+    {
+        if(it->key != key) continue;
+        this->entries.splice(this->entries.begin(), this->entries, it);
+        return this->entries.front().path_tracer.get();
+    }
+    return nullptr;
+}
+
+uint32_t pt::SceneCache::insert(const std::string& key, std::unique_ptr<PathTracer> path_tracer, size_t memory_size)
+{
+    for(const Entry& entry : this->entries)
+    {
+        if(entry.key == key)
+            throw std::invalid_argument("[pt::SceneCache::insert]: The scene is already cached.");
+    }
+
+    this->entries.push_front({ key, std::move(path_tracer), memory_size });
+    this->memory_size += memory_size;
+
+    uint32_t evicted = 0;
+    while(this->memory_size > this->budget && this->entries.size() > 1)
+    {
+        this->memory_size -= this->entries.back().memory_size;
+        this->entries.pop_back();
+        evicted++;
+    }
+    return evicted;
+}
+
+void pt::SceneCache::clear(void) noexcept
+{
+    this->entries.clear();
+    this->memory_size = 0;
+}
+
+pt::RenderDaemon::RenderDaemon(const Setup* setup, size_t cache_budget)
+    : setup(setup), cache(cache_budget), writer(1), stopping(false), log_callback(nullptr)
+{}
+
+void pt::RenderDaemon::log(const std::string& msg)
+{
+    if(this->log_callback) this->log_callback(msg);
+}
+
+pt::PathTracer& pt::RenderDaemon::acquire_scene(const SceneDescription& scene, bool& cached, uint64_t& load_ns)
+{
+    const std::string key = scene.key();
+    PathTracer* path_tracer = this->cache.find(key);
+    cached = (path_tracer != nullptr);
+    load_ns = 0;
+    if(cached) return *path_tracer;
+
+    const auto load_begin = std::chrono::steady_clock::now();
+    std::unique_ptr<PathTracer> loaded = std::make_unique<PathTracer>();
+    loaded->set_info_callback(this->log_callback);
+    loaded->load_environment(scene.environment);
+    for(const std::string& model : scene.models)
+        loaded->load_model(model);
+    loaded->init(this->setup);
+    load_ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - load_begin).count());
+
+    path_tracer = loaded.get();
+    const size_t memory_size = loaded->get_scene_memory_size();
+    const uint32_t evicted = this->cache.insert(key, std::move(loaded), memory_size);
+    this->log(
+        "Loaded scene with " + std::to_string(scene.models.size()) + " models (" + std::to_string(memory_size >> 20) + " MiB) in "
+        + std::to_string(load_ns / 1000000) + " ms, evicted " + std::to_string(evicted) + " scenes. "
+        + std::to_string(this->cache.size()) + " scenes are cached (" + std::to_string(this->cache.get_memory_size() >> 20) + " MiB)."
+    );
+    return *path_tracer;
+}
+
+void pt::RenderDaemon::render(LocalSocket& connection, const RenderRequest& request)
+{
+    const RenderJob& job = request.job;
+    if(request.scene.environment.empty())
+        throw std::invalid_argument("The request has no environment map.");
+    if(job.output.empty() && !request.stream)
+        throw std::invalid_argument("The request has neither an output path nor streams the image.");
+    if(job.width == 0 || job.height == 0)
+        throw std::invalid_argument("The resolution must not be 0.");
+    if(!job.is_limited())
+        throw std::invalid_argument("The request has no sample, time or noise limit, or adaptive sampling has no noise limit.");
+    if(request.stream_mean && !request.stream)
+        throw std::invalid_argument("The format of the image only applies if it is streamed.");
+    if(job.denoise && (request.stream_mean || request.frame_width != 0))
+        throw std::invalid_argument("Only a whole frame in 8 bit can be denoised, the mean of a tile is merged with other tiles first.");
+
+    bool cached;
+    uint64_t load_ns;
+    PathTracer& path_tracer = this->acquire_scene(request.scene, cached, load_ns);
+    path_tracer.set_resolution(job.width, job.height);
+    // a tile is traced with the rays and random numbers of its pixels in the whole frame
+    path_tracer.set_tile(request.tile_x, request.tile_y, request.frame_width, request.frame_height);
+    path_tracer.set_features(job.denoise || !job.aovs.empty());
+    path_tracer.set_camera(job.camera);
+    path_tracer.reset_accumulation(request.first_sample);
+    // 'stop' cancels the job, the samples that are already traced are still sent
+    const RenderResult result = path_tracer.run(job.get_budget(&this->stopping));
+
+    // the pixels are packed before the image is unmapped, so the next request can't overwrite them
+    // a streamed mean is read from the accumulation, the 8 bit image is only packed if it is used
+    uint32_t component_count = 4;
+    size_t packed_stride = 0;
+    std::vector<uint8_t> pixels;
+    if(!job.output.empty() || job.denoise || !request.stream_mean)
+    {
+        size_t row_stride;
+        const uint8_t* mapped = path_tracer.map_image(row_stride, component_count);
+        packed_stride = static_cast<size_t>(job.width) * component_count;
+        pixels.resize(packed_stride * job.height);
+        for(uint32_t y = 0; y < job.height; y++)
+            std::copy(mapped + y * row_stride, mapped + y * row_stride + packed_stride, pixels.data() + y * packed_stride);
+        path_tracer.unmap_image();
+    }
+    // the denoised image replaces the packed one, it has the same layout
+    uint64_t denoise_ns = 0;
+    if(job.denoise)
+        denoise_ns = denoise_image(path_tracer, this->denoiser, job.width, job.height, pixels);
+
+    // the unclamped mean can be merged with the samples of other workers
+    std::vector<float> mean;
+    if(request.stream_mean)
+    {
+        mean.resize(static_cast<size_t>(job.width) * job.height * 4);
+        path_tracer.read_accumulation(mean.data());
+    }
+
+    // the client may read the file as soon as it gets the answer
+    if(!job.output.empty())
+    {
+        this->writer.write_png(job.output, job.width, job.height, component_count, pixels.data(), packed_stride);
+        this->writer.flush();
+    }
+    if(!job.heatmap.empty())
+    {
+        std::vector<uint32_t> counts(static_cast<size_t>(job.width) * job.height);
+        path_tracer.read_sample_counts(counts.data());
+        this->writer.write_heatmap(job.heatmap, job.width, job.height, counts.data());
+        this->writer.flush();
+    }
+    if(!job.aovs.empty())
+    {
+        write_aovs(path_tracer, this->writer, job.aovs, job.width, job.height);
+        this->writer.flush();
+    }
+
+    connection.send_message(
+        "ok width=" + std::to_string(job.width) + " height=" + std::to_string(job.height)
+        + " components=" + std::to_string(request.stream_mean ? 4 : component_count) + " component_size=" + (request.stream_mean ? "4" : "1")
+        + " samples=" + std::to_string(result.samples) + " render_ns=" + std::to_string(result.render_ns) + " load_ns=" + std::to_string(load_ns)
+        + " denoise_ns=" + std::to_string(denoise_ns)
+        + " cached=" + (cached ? "1" : "0") + " streamed=" + (request.stream ? "1" : "0")
+    );
+    if(request.stream_mean)
+        connection.send_message(mean.data(), mean.size() * sizeof(float));
+    else if(request.stream)
+        connection.send_message(pixels.data(), pixels.size());
+}
+
+void pt::RenderDaemon::serve_connection(LocalSocket& connection)
+{
+    std::vector<uint8_t> message;
+    while(connection.receive_message(message, MAX_REQUEST_SIZE))
+    {
+        const std::string line(message.begin(), message.end());
+        if(line == "shutdown")
+        {
+            this->stopping = true;
+            connection.send_message("ok");
+            return;
+        }
+
+        // a failed request is answered with an error, the daemon keeps serving
+        try
+        {
+            RenderRequest request = {};
+            request.job = BatchRenderer::default_job();
+            request.job.output.clear();
+            parse_render_request(line, request, true, "");
+            this->render(connection, request);
+        }
+        catch(const std::exception& e)
+        {
+            this->log(std::string("Request failed: ") + e.what());
+            connection.send_message(std::string("error ") + e.what());
+        }
+    }
+}
+
+void pt::RenderDaemon::serve(const std::string& socket_path)
+{
+    LocalSocket server;
+    server.listen(socket_path);
+    this->stopping = false;
+    this->log("Listening on \"" + socket_path + "\".");
+
+    while(!this->stopping)
+    {
+        // the timeout bounds the time until 'stop' is noticed
+        LocalSocket connection;
+        try
+        {
+            if(!server.accept(connection, 100)) continue;
+            this->serve_connection(connection);
+        }
+        catch(const std::exception& e)
+        {
+            // a client that disconnects while it is served does not stop the daemon
+            this->log(std::string("Connection failed: ") + e.what());
+        }
+    }
+
+    // the scenes use the device of the setup, so they must be destroyed before it
+    this->cache.clear();
+    this->log("Stopped serving.");
+}
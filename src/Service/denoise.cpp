@@ -0,0 +1,23 @@
+#include "../application.h"
+#include <algorithm>
+
+uint64_t pt::denoise_image(PathTracer& path_tracer, Denoiser& denoiser, uint32_t width, uint32_t height, std::vector<uint8_t>& pixels)
+{
+    const size_t pixel_count = static_cast<size_t>(width) * height;
+    std::vector<float> color(pixel_count * 4);
+    std::vector<uint32_t> counts(pixel_count);
+    std::vector<float> albedo(pixel_count * 4);
+    std::vector<float> normals(pixel_count * 4);
+    path_tracer.read_accumulation(color.data());
+    path_tracer.read_sample_counts(counts.data());
+    path_tracer.read_features(albedo.data(), normals.data());
+
+    std::vector<float> denoised(pixel_count * 4);
+    const uint64_t denoise_ns = denoiser.denoise(width, height, color.data(), counts.data(), albedo.data(), normals.data(), denoised.data());
+
+    // same conversion as the store of the ray generation shader to the render target
+    pixels.resize(pixel_count * 4);
+    for(size_t i = 0; i < pixels.size(); i++)
+        pixels[i] = static_cast<uint8_t>(std::min(std::max(denoised[i], 0.0f), 1.0f) * 255.0f + 0.5f);
+    return denoise_ns;
+}
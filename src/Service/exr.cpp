@@ -0,0 +1,177 @@
+#include "../application.h"
+#include <algorithm>
+#include <fstream>
+#include <immintrin.h>
+
+namespace
+{
+    // the values of the file are little endian, like the values of the host
+    template<typename T>
+    void append(std::vector<uint8_t>& bytes, const T& value)
+    {
+        const uint8_t* p = reinterpret_cast<const uint8_t*>(&value);
+        bytes.insert(bytes.end(), p, p + sizeof(T));
+    }
+
+    void append_string(std::vector<uint8_t>& bytes, const std::string& s)
+    {
+        bytes.insert(bytes.end(), s.begin(), s.end());
+        bytes.push_back(0);
+    }
+
+    // An attribute of the header is its name, its type, the size of its value and the value.
+    void append_attribute(std::vector<uint8_t>& bytes, const std::string& name, const std::string& type, const std::vector<uint8_t>& value)
+    {
+        append_string(bytes, name);
+        append_string(bytes, type);
+        append(bytes, static_cast<int32_t>(value.size()));
+        bytes.insert(bytes.end(), value.begin(), value.end());
+    }
+
+    std::vector<uint8_t> box2i(uint32_t width, uint32_t height)
+    {
+        std::vector<uint8_t> value;
+        append(value, int32_t(0));
+        append(value, int32_t(0));
+        append(value, static_cast<int32_t>(width) - 1);
+        append(value, static_cast<int32_t>(height) - 1);
+        return value;
+    }
+
+    size_t pixel_size(pt::ExrChannel::PixelType type)
+    {
+        return (type == pt::ExrChannel::HALF) ? sizeof(uint16_t) : sizeof(uint32_t);
+    }
+}
+
+pt::ExrChannel pt::make_exr_channel(const std::string& name, bool half, const float* src, size_t count, size_t stride)
+{
+    ExrChannel channel;
+    channel.name = name;
+    channel.type = half ? ExrChannel::HALF : ExrChannel::FLOAT;
+    channel.data.resize(count * pixel_size(channel.type));
+
+    if(!half)
+    {
+        float* dst = reinterpret_cast<float*>(channel.data.data());
+        for(size_t i = 0; i < count; i++)
+            dst[i] = src[i * stride];
+        return channel;
+    }
+
+    // F16C converts 8 floats per instruction, rounded to the nearest half float
+    uint16_t* dst = reinterpret_cast<uint16_t*>(channel.data.data());
+    size_t i = 0;
+    for(; i + 8 <= count; i += 8)
+    {
+        alignas(32) float gathered[8];
+        for(size_t j = 0; j < 8; j++)
+            gathered[j] = src[(i + j) * stride];
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm256_cvtps_ph(_mm256_load_ps(gathered), _MM_FROUND_TO_NEAREST_INT));
+    }
+    for(; i < count; i++)
+        dst[i] = _cvtss_sh(src[i * stride], _MM_FROUND_TO_NEAREST_INT);
+    return channel;
+}
+
+pt::ExrChannel pt::make_exr_channel(const std::string& name, const uint32_t* src, size_t count, size_t stride)
+{
+    ExrChannel channel;
+    channel.name = name;
+    channel.type = ExrChannel::UINT;
+    channel.data.resize(count * sizeof(uint32_t));
+    uint32_t* dst = reinterpret_cast<uint32_t*>(channel.data.data());
+    for(size_t i = 0; i < count; i++)
+        dst[i] = src[i * stride];
+    return channel;
+}
+
+void pt::write_exr(const std::string& path, uint32_t width, uint32_t height, const std::vector<ExrChannel>& channels)
+{
+    if(width == 0 || height == 0)
+        throw std::invalid_argument("[pt::write_exr]: The resolution must not be 0.");
+    if(channels.empty())
+        throw std::invalid_argument("[pt::write_exr]: The image has no channel.");
+
+    // the channels of a scanline are stored in the order of their names
+    std::vector<const ExrChannel*> sorted;
+    for(const ExrChannel& channel : channels)
+        sorted.push_back(&channel);
+    std::sort(sorted.begin(), sorted.end(), [](const ExrChannel* a, const ExrChannel* b) { return a->name < b->name; });
+
+    const size_t pixel_count = static_cast<size_t>(width) * height;
+    size_t row_size = 0;
+    for(size_t i = 0; i < sorted.size(); i++)
+    {
+        const ExrChannel& channel = *sorted[i];
+        // longer names would require the long names flag, which not every reader supports
+        if(channel.name.empty() || channel.name.size() > 31)
+            throw std::invalid_argument("[pt::write_exr]: The name of a channel must have 1 to 31 characters.");
+        if(i > 0 && channel.name == sorted[i - 1]->name)
+            throw std::invalid_argument("[pt::write_exr]: The channel \"" + channel.name + "\" exists twice.");
+        if(channel.data.size() != pixel_count * pixel_size(channel.type))
+            throw std::invalid_argument("[pt::write_exr]: The channel \"" + channel.name + "\" does not match the resolution.");
+        row_size += width * pixel_size(channel.type);
+    }
+
+    std::vector<uint8_t> header;
+    append(header, uint32_t(20000630));     // magic number
+    append(header, uint32_t(2));            // version 2, single part scanline image
+
+    std::vector<uint8_t> channel_list;
+    for(const ExrChannel* channel : sorted)
+    {
+        append_string(channel_list, channel->name);
+        append(channel_list, static_cast<int32_t>(channel->type));
+        append(channel_list, uint32_t(0));  // pLinear and reserved bytes
+        append(channel_list, int32_t(1));   // x sampling
+        append(channel_list, int32_t(1));   // y sampling
+    }
+    channel_list.push_back(0);
+
+    std::vector<uint8_t> zero_byte(1, 0);
+    std::vector<uint8_t> one_float, window_center;
+    append(one_float, 1.0f);
+    append(window_center, 0.0f);
+    append(window_center, 0.0f);
+    append_attribute(header, "channels", "chlist", channel_list);
+    append_attribute(header, "compression", "compression", zero_byte);     // no compression
+    append_attribute(header, "dataWindow", "box2i", box2i(width, height));
+    append_attribute(header, "displayWindow", "box2i", box2i(width, height));
+    append_attribute(header, "lineOrder", "lineOrder", zero_byte);         // increasing y
+    append_attribute(header, "pixelAspectRatio", "float", one_float);
+    append_attribute(header, "screenWindowCenter", "v2f", window_center);
+    append_attribute(header, "screenWindowWidth", "float", one_float);
+    header.push_back(0);
+
+    // every scanline is a block of its y coordinate, the size of its data and the rows of the channels
+    const uint64_t first_block = header.size() + static_cast<uint64_t>(height) * sizeof(uint64_t);
+    const uint64_t block_size = 2 * sizeof(int32_t) + row_size;
+    for(uint32_t y = 0; y < height; y++)
+        append(header, first_block + y * block_size);
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if(!file.is_open())
+        throw std::runtime_error("[pt::write_exr]: Failed to open file \"" + path + "\".");
+    file.write(reinterpret_cast<const char*>(header.data()), static_cast<std::streamsize>(header.size()));
+
+    std::vector<uint8_t> block;
+    block.reserve(block_size);
+    for(uint32_t y = 0; y < height; y++)
+    {
+        block.clear();
+        append(block, static_cast<int32_t>(y));
+        append(block, static_cast<int32_t>(row_size));
+        for(const ExrChannel* channel : sorted)
+        {
+            const size_t channel_row = width * pixel_size(channel->type);
+            const uint8_t* row = channel->data.data() + y * channel_row;
+            block.insert(block.end(), row, row + channel_row);
+        }
+        file.write(reinterpret_cast<const char*>(block.data()), static_cast<std::streamsize>(block.size()));
+    }
+    // the buffered rest is only written by close, its errors must be checked too
+    file.close();
+    if(!file)
+        throw std::runtime_error("[pt::write_exr]: Failed to write file \"" + path + "\".");
+}
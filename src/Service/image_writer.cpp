@@ -0,0 +1,110 @@
+#include "../application.h"
+#include <algorithm>
+#include <cstring>
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <stb/stb_image_write.h>
+
+namespace
+{
+    // Maps a value in [0, 1] to black, blue, magenta, orange and white.
+    void heat_color(float t, uint8_t* rgba)
+    {
+        static const float STOPS[5][3] = {
+            { 0.0f, 0.0f, 0.0f },
+            { 0.1f, 0.1f, 0.8f },
+            { 0.8f, 0.1f, 0.6f },
+            { 1.0f, 0.6f, 0.0f },
+            { 1.0f, 1.0f, 1.0f }
+        };
+        const float x = std::min(std::max(t, 0.0f), 1.0f) * 4.0f;
+        const uint32_t i = std::min(static_cast<uint32_t>(x), 3u);
+        const float f = x - static_cast<float>(i);
+        for(uint32_t c = 0; c < 3; c++)
+            rgba[c] = static_cast<uint8_t>((STOPS[i][c] + (STOPS[i + 1][c] - STOPS[i][c]) * f) * 255.0f + 0.5f);
+        rgba[3] = 255;
+    }
+}
+
+pt::ImageWriter::ImageWriter(uint32_t max_pending)
+{
+    if(max_pending == 0)
+        throw std::invalid_argument("[pt::ImageWriter::ImageWriter]: At least one image must be allowed to be pending.");
+    this->max_pending = max_pending;
+    // one thread keeps the images in order and the encoding off the rendering thread
+    this->pool.start(1);
+}
+
+pt::ImageWriter::~ImageWriter(void)
+{
+    // the pool finishes all queued images before it stops, errors can't be reported anymore
+    this->pool.stop();
+}
+
+void pt::ImageWriter::wait_for_pending(void)
+{
+    // wait for the oldest image, so the copies of the pixels don't pile up if encoding is slower than rendering
+    while(this->pending.size() >= this->max_pending)
+    {
+        std::future<void> f = std::move(this->pending.front());
+        this->pending.pop_front();
+        f.get();
+    }
+}
+
+void pt::ImageWriter::write_png(const std::string& path, uint32_t width, uint32_t height, uint32_t component_count, const uint8_t* pixels, size_t row_stride)
+{
+    this->wait_for_pending();
+
+    // the image is stored without padding between the rows
+    const size_t packed_stride = static_cast<size_t>(width) * component_count;
+    auto image = std::make_shared<std::vector<uint8_t>>(packed_stride * height);
+    for(uint32_t y = 0; y < height; y++)
+        std::memcpy(image->data() + y * packed_stride, pixels + y * row_stride, packed_stride);
+
+    this->pending.push_back(this->pool.submit([path, width, height, component_count, packed_stride, image]() {
+        if(stbi_write_png(path.c_str(), width, height, component_count, image->data(), static_cast<int>(packed_stride)) == 0)
+            throw std::runtime_error("[pt::ImageWriter::write_png]: Failed to write image \"" + path + "\".");
+    }));
+}
+
+void pt::ImageWriter::write_heatmap(const std::string& path, uint32_t width, uint32_t height, const uint32_t* counts)
+{
+    const size_t pixel_count = static_cast<size_t>(width) * height;
+    const uint32_t max_count = (pixel_count > 0) ? *std::max_element(counts, counts + pixel_count) : 0;
+
+    // the colors are computed here, so the pixels are copied only once
+    std::vector<uint8_t> image(pixel_count * 4);
+    for(size_t i = 0; i < pixel_count; i++)
+        heat_color((max_count > 0) ? static_cast<float>(counts[i]) / static_cast<float>(max_count) : 0.0f, image.data() + i * 4);
+    this->write_png(path, width, height, 4, image.data(), static_cast<size_t>(width) * 4);
+}
+
+void pt::ImageWriter::write_exr(const std::string& path, uint32_t width, uint32_t height, std::vector<ExrChannel>&& channels)
+{
+    this->wait_for_pending();
+    auto image = std::make_shared<std::vector<ExrChannel>>(std::move(channels));
+    this->pending.push_back(this->pool.submit([path, width, height, image]() {
+        pt::write_exr(path, width, height, *image);
+    }));
+}
+
+void pt::ImageWriter::flush(void)
+{
+    // every image is waited for, even if an earlier one failed
+    std::exception_ptr error;
+    while(!this->pending.empty())
+    {
+        std::future<void> f = std::move(this->pending.front());
+        this->pending.pop_front();
+        try
+        {
+            f.get();
+        }
+        catch(...)
+        {
+            if(!error) error = std::current_exception();
+        }
+    }
+    if(error)
+        std::rethrow_exception(error);
+}
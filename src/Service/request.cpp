@@ -0,0 +1,182 @@
+#include "../application.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+
+namespace
+{
+    bool parse_uint(const std::string& s, uint32_t& value)
+    {
+        if(s.empty() || s[0] == '-') return false;
+        char* end;
+        errno = 0;
+        const unsigned long v = std::strtoul(s.c_str(), &end, 10);
+        if(*end != '\0' || errno == ERANGE || v > 0xFFFFFFFFul) return false;
+        value = static_cast<uint32_t>(v);
+        return true;
+    }
+
+    bool parse_float(const std::string& s, float& value)
+    {
+        if(s.empty()) return false;
+        char* end;
+        value = std::strtof(s.c_str(), &end);
+        return *end == '\0';
+    }
+
+    // vectors are written as "x,y,z"
+    bool parse_vec3(const std::string& s, glm2::vec3& value)
+    {
+        float v[3];
+        size_t begin = 0;
+        for(uint32_t i = 0; i < 3; i++)
+        {
+            const size_t end = (i < 2) ? s.find(',', begin) : s.size();
+            if(end == std::string::npos || !parse_float(s.substr(begin, end - begin), v[i]))
+                return false;
+            begin = end + 1;
+        }
+        value = glm2::vec3(v[0], v[1], v[2]);
+        return true;
+    }
+
+    // pairs are written as "x,y"
+    bool parse_uint2(const std::string& s, uint32_t& x, uint32_t& y)
+    {
+        const size_t comma = s.find(',');
+        return comma != std::string::npos && parse_uint(s.substr(0, comma), x) && parse_uint(s.substr(comma + 1), y);
+    }
+
+    bool parse_bool(const std::string& s, bool& value)
+    {
+        if(s != "0" && s != "1") return false;
+        value = (s == "1");
+        return true;
+    }
+
+    // 9 significant digits restore every float exactly
+    std::string format_float(float value)
+    {
+        char buffer[32];
+        std::snprintf(buffer, sizeof(buffer), "%.9g", value);
+        return buffer;
+    }
+
+    std::string format_vec3(const glm2::vec3& value)
+    {
+        // glm2::vec3 stores 4 components
+        float v[4];
+        value.store(v);
+        return format_float(v[0]) + "," + format_float(v[1]) + "," + format_float(v[2]);
+    }
+
+    std::string format_path(const std::string& key, const std::string& path)
+    {
+        if(path.find_first_of(" \t\r\n") != std::string::npos)
+            throw std::invalid_argument("[pt::format_render_request]: The path \"" + path + "\" contains whitespace.");
+        return " " + key + "=" + path;
+    }
+}
+
+pt::RenderBudget pt::RenderJob::get_budget(const std::atomic<bool>* cancel) const noexcept
+{
+    RenderBudget budget = {};
+    budget.max_samples = this->samples;
+    budget.time_ns = static_cast<uint64_t>(this->time_ms) * 1000000;
+    budget.target_noise = this->noise;
+    budget.cancel = cancel;
+    budget.adaptive = this->adaptive;
+    return budget;
+}
+
+std::string pt::SceneDescription::key(void) const
+{
+    // a newline can't be part of the paths of a request, so the key is unique
+    std::string key = this->environment;
+    for(const std::string& model : this->models)
+        key += "\n" + model;
+    return key;
+}
+
+void pt::parse_render_request(const std::string& line, RenderRequest& request, bool scene_keys, const std::string& context)
+{
+    RenderJob& job = request.job;
+    std::istringstream tokens(line);
+    std::string token;
+    while(tokens >> token)
+    {
+        const size_t eq = token.find('=');
+        if(eq == std::string::npos)
+            throw std::runtime_error(context + "Expected \"key=value\" instead of \"" + token + "\".");
+        const std::string key = token.substr(0, eq);
+        const std::string value = token.substr(eq + 1);
+
+        bool valid;
+        if(key == "output")         valid = !(job.output = value).empty();
+        else if(key == "width")     valid = parse_uint(value, job.width);
+        else if(key == "height")    valid = parse_uint(value, job.height);
+        else if(key == "samples")   valid = parse_uint(value, job.samples);
+        else if(key == "time")      valid = parse_uint(value, job.time_ms);
+        else if(key == "noise")     valid = parse_float(value, job.noise) && job.noise >= 0.0f;
+        else if(key == "adaptive")  valid = parse_bool(value, job.adaptive);
+        else if(key == "heatmap")   valid = !(job.heatmap = value).empty();
+        else if(key == "aovs")      valid = !(job.aovs = value).empty();
+        else if(key == "denoise")   valid = parse_bool(value, job.denoise);
+        else if(!scene_keys && key == "checkpoint")             valid = !(job.checkpoint = value).empty();
+        else if(!scene_keys && key == "checkpoint_interval")    valid = parse_uint(value, job.checkpoint_interval_ms) && job.checkpoint_interval_ms > 0;
+        else if(key == "position")  valid = parse_vec3(value, job.camera.position);
+        else if(key == "target")    valid = parse_vec3(value, job.camera.target);
+        else if(key == "up")        valid = parse_vec3(value, job.camera.up);
+        else if(key == "fov")       valid = parse_float(value, job.camera.fov);
+        else if(key == "aspect")    valid = parse_float(value, job.camera.aspect);
+        else if(key == "aperture")  valid = parse_float(value, job.camera.aperture);
+        else if(key == "focus")     valid = parse_float(value, job.camera.focus_distance);
+        else if(scene_keys && key == "environment") valid = !(request.scene.environment = value).empty();
+        else if(scene_keys && key == "model")
+        {
+            request.scene.models.push_back(value);
+            valid = !value.empty();
+        }
+        else if(scene_keys && key == "stream") valid = parse_bool(value, request.stream);
+        else if(scene_keys && key == "format")
+        {
+            valid = (value == "rgba8" || value == "rgba32f");
+            request.stream_mean = (value == "rgba32f");
+        }
+        else if(scene_keys && key == "tile")            valid = parse_uint2(value, request.tile_x, request.tile_y);
+        else if(scene_keys && key == "frame")           valid = parse_uint2(value, request.frame_width, request.frame_height);
+        else if(scene_keys && key == "first_sample")    valid = parse_uint(value, request.first_sample);
+        else throw std::runtime_error(context + "Unknown key \"" + key + "\".");
+
+        if(!valid)
+            throw std::runtime_error(context + "Invalid value \"" + value + "\" of key \"" + key + "\".");
+    }
+}
+
+std::string pt::format_render_request(const RenderRequest& request)
+{
+    const RenderJob& job = request.job;
+    std::string line =
+        "width=" + std::to_string(job.width) + " height=" + std::to_string(job.height) + " samples=" + std::to_string(job.samples)
+        + " time=" + std::to_string(job.time_ms) + " noise=" + format_float(job.noise) + " adaptive=" + (job.adaptive ? "1" : "0")
+        + " denoise=" + (job.denoise ? "1" : "0")
+        + " position=" + format_vec3(job.camera.position) + " target=" + format_vec3(job.camera.target) + " up=" + format_vec3(job.camera.up)
+        + " fov=" + format_float(job.camera.fov) + " aspect=" + format_float(job.camera.aspect)
+        + " aperture=" + format_float(job.camera.aperture) + " focus=" + format_float(job.camera.focus_distance)
+        + " stream=" + (request.stream ? "1" : "0") + " format=" + (request.stream_mean ? "rgba32f" : "rgba8")
+        + " tile=" + std::to_string(request.tile_x) + "," + std::to_string(request.tile_y)
+        + " frame=" + std::to_string(request.frame_width) + "," + std::to_string(request.frame_height)
+        + " first_sample=" + std::to_string(request.first_sample);
+    if(!job.output.empty())
+        line += format_path("output", job.output);
+    if(!job.heatmap.empty())
+        line += format_path("heatmap", job.heatmap);
+    if(!job.aovs.empty())
+        line += format_path("aovs", job.aovs);
+    if(!request.scene.environment.empty())
+        line += format_path("environment", request.scene.environment);
+    for(const std::string& model : request.scene.models)
+        line += format_path("model", model);
+    return line;
+}
@@ -7,6 +7,12 @@ namespace pt
         uint32_t rt_width;
         uint32_t rt_height;
         uint32_t iterations;
+        size_t stream_budget;   // Size of the staging window in bytes that is used for streamed model loading.
+                                // If 0, every model is loaded resident before it is uploaded.
+                                // Models that are parsed in the background before they are uploaded stay resident until then.
+        uint32_t load_threads;  // Number of threads that load the models concurrently, if 0 one thread per hardware thread is used.
+                                // Files that are loaded before 'init' only start loading in 'init', unless these settings
+                                // are passed to 'PathTracer::set_load_settings' before.
     };
 
     struct SetupCreateInfo
@@ -82,13 +82,39 @@ void pt::Setup::create_device(void)
         extensions.push_back(extension.c_str());
     }
 
+    // The shaders index the buffer and the texture arrays with the IDs of the hit mesh and its material,
+    // those are not uniform across the invocations.
+    VkPhysicalDeviceDescriptorIndexingFeatures supported_indexing = {};
+    supported_indexing.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES;
+    supported_indexing.pNext = nullptr;
+    // the attributes are tightly packed, their buffers use the scalar block layout
+    VkPhysicalDeviceScalarBlockLayoutFeaturesEXT supported_scalar = {};
+    supported_scalar.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SCALAR_BLOCK_LAYOUT_FEATURES_EXT;
+    supported_scalar.pNext = nullptr;
+    supported_indexing.pNext = &supported_scalar;
+    VkPhysicalDeviceFeatures2 supported_features2 = {};
+    supported_features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    supported_features2.pNext = &supported_indexing;
+    vkGetPhysicalDeviceFeatures2(this->physical_device, &supported_features2);
+    if(!supported_indexing.shaderStorageBufferArrayNonUniformIndexing || !supported_indexing.shaderSampledImageArrayNonUniformIndexing || !supported_indexing.runtimeDescriptorArray)
+        throw std::runtime_error("[pt::Setup::create_device]: Device does not support non-uniform indexing of buffer and texture arrays.");
+    if(!supported_scalar.scalarBlockLayout)
+        throw std::runtime_error("[pt::Setup::create_device]: Device does not support the scalar block layout.");
+
     // enabled device features
     VkPhysicalDeviceDescriptorIndexingFeatures indexing_features = {};
     indexing_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES;
     indexing_features.pNext = nullptr;
     indexing_features.shaderStorageBufferArrayNonUniformIndexing = VK_TRUE;
+    indexing_features.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
     indexing_features.runtimeDescriptorArray = VK_TRUE;
 
+    VkPhysicalDeviceScalarBlockLayoutFeaturesEXT scalar_features = {};
+    scalar_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SCALAR_BLOCK_LAYOUT_FEATURES_EXT;
+    scalar_features.pNext = nullptr;
+    scalar_features.scalarBlockLayout = VK_TRUE;
+    indexing_features.pNext = &scalar_features;
+
     VkPhysicalDeviceFeatures2 features2 = {};
     features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
     features2.pNext = &indexing_features;
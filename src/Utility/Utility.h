@@ -0,0 +1,607 @@
+#pragma once
+
+namespace pt
+{
+    /**
+     * Read-only memory mapping of a whole file.
+     * The mapping is backed by the page cache of the operating system, so only the
+     * pages that are currently being read count towards the resident set of the process.
+     */
+    class MappedFile
+    {
+    private:
+        const char* pdata;
+        size_t map_size;
+    #ifdef _WIN32
+        void* file_handle;
+        void* map_handle;
+    #else
+        int fd;
+    #endif
+
+    public:
+        MappedFile(void);
+        explicit MappedFile(const std::string& path);
+        virtual ~MappedFile(void)
+        { this->close(); }
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator= (const MappedFile&) = delete;
+
+        MappedFile(MappedFile&&) = delete;
+        MappedFile& operator= (MappedFile&&) = delete;
+
+        /**
+         * @brief       Maps a file into the address space of the process.
+         * @param path  Path to the file.
+         * @throw       runtime_error if the file could not be opened or mapped.
+         */
+        void open(const std::string& path);
+
+        /**
+         * @brief Unmaps the file, does nothing if no file is mapped.
+         */
+        void close(void) noexcept;
+
+        inline const char* data(void) const noexcept
+        { return this->pdata; }
+
+        inline size_t size(void) const noexcept
+        { return this->map_size; }
+
+        inline bool is_open(void) const noexcept
+        { return this->pdata != nullptr; }
+    };
+
+    // 128 bit content hash, the probability of a collision is low enough
+    // to treat equal hashes as equal content.
+    struct Hash128
+    {
+        uint64_t lo;
+        uint64_t hi;
+
+        inline bool operator== (const Hash128& other) const noexcept
+        { return this->lo == other.lo && this->hi == other.hi; }
+
+        inline bool operator!= (const Hash128& other) const noexcept
+        { return !(*this == other); }
+    };
+
+    struct Hash128Hasher
+    {
+        inline size_t operator() (const Hash128& h) const noexcept
+        { return static_cast<size_t>(h.lo); }
+    };
+
+    /**
+     * Incremental hash over arbitrary data. The data can be passed in any number of parts,
+     * the digest only depends on the concatenation of all parts.
+     * Two independent 64 bit lanes are combined to a 128 bit digest.
+     */
+    class ContentHasher
+    {
+    private:
+        uint64_t lanes[2];
+        uint64_t length;
+        uint8_t tail[8];
+        uint32_t tail_size;
+
+        void consume(uint64_t word) noexcept;
+
+    public:
+        ContentHasher(void) noexcept
+        { this->reset(); }
+
+        /**
+         * @brief Resets the hasher to its initial state.
+         */
+        void reset(void) noexcept;
+
+        /**
+         * @brief       Hashes the next part of the data.
+         * @param data  Pointer to the data.
+         * @param size  Size of the data in bytes.
+         */
+        void update(const void* data, size_t size) noexcept;
+
+        /**
+         * @return Hash of all data passed so far.
+         */
+        Hash128 digest(void) const noexcept;
+    };
+
+    // Statistics of the scratch arenas of all threads.
+    struct ScratchStatistics
+    {
+        size_t allocation_count;    // number of allocations since the last reset
+        size_t peak_bytes;          // sum of the highest number of bytes that was in use per arena
+        size_t reserved_bytes;      // size of all blocks that are currently allocated from the heap
+    };
+
+    /**
+     * Bump allocator for short-lived memory of the loading phase. Every thread owns
+     * one arena ('local'), so allocations never contend on a lock. Memory is returned
+     * in bulk by rewinding the arena to a marker, single allocations are only released
+     * if they are the last allocation of the arena.
+     * The arenas of all threads are reset with 'reset_all' when loading has finished.
+     */
+    class ScratchArena
+    {
+    private:
+        struct Block
+        {
+            uint8_t* data;
+            size_t size;
+            size_t used;
+        };
+
+        std::vector<Block> blocks;
+        size_t current;         // index of the block that is allocated from
+        void* last;             // last allocation, it can be released or resized in place
+        size_t last_offset;     // offset of the last allocation inside the current block
+        size_t in_use;
+        // Only the owning thread writes the statistics, 'statistics' reads them from any thread.
+        std::atomic<size_t> peak;
+        std::atomic<size_t> allocations;
+        std::atomic<size_t> reserved;   // size of all blocks
+
+        ScratchArena(void);
+        void update_peak(void) noexcept;
+
+    public:
+        // Position inside an arena, returned by 'mark'.
+        struct Marker
+        {
+            size_t block;
+            size_t used;
+        };
+
+        // default size of a block, larger allocations get a block of their own
+        constexpr static size_t BLOCK_SIZE = 4 * 1024 * 1024;
+
+        ~ScratchArena(void);
+
+        ScratchArena(const ScratchArena&) = delete;
+        ScratchArena& operator= (const ScratchArena&) = delete;
+
+        ScratchArena(ScratchArena&&) = delete;
+        ScratchArena& operator= (ScratchArena&&) = delete;
+
+        /**
+         * @return The arena of the calling thread.
+         */
+        static ScratchArena& local(void);
+
+        /**
+         * @brief Frees the blocks of all arenas and clears their statistics.
+         *        No thread must use its arena during the reset.
+         */
+        static void reset_all(void);
+
+        /**
+         * @return Statistics summed over the arenas of all threads.
+         */
+        static ScratchStatistics statistics(void);
+
+        /**
+         * @brief       Allocates memory from the arena.
+         * @param size  Size in bytes.
+         * @param align Alignment in bytes, must be a power of 2.
+         * @return      Pointer to the memory, never nullptr.
+         * @throw       bad_alloc if a new block could not be allocated.
+         */
+        void* allocate(size_t size, size_t align = 16);
+
+        /**
+         * @brief           Resizes an allocation, in place if it is the last allocation of the arena.
+         * @param p         Allocation to resize, can be nullptr.
+         * @param old_size  Current size of the allocation.
+         * @param new_size  New size of the allocation.
+         */
+        void* reallocate(void* p, size_t old_size, size_t new_size);
+
+        /**
+         * @brief   Releases an allocation if it is the last one, otherwise the memory
+         *          is released with the next 'rewind' or 'reset'.
+         */
+        void free(void* p) noexcept;
+
+        template<typename T>
+        inline T* allocate_array(size_t count)
+        { return reinterpret_cast<T*>(this->allocate(count * sizeof(T), alignof(T) > 16 ? alignof(T) : 16)); }
+
+        /**
+         * @return The current position of the arena.
+         */
+        Marker mark(void) const noexcept;
+
+        /**
+         * @brief Releases all allocations that were made after the marker. The blocks are kept.
+         */
+        void rewind(const Marker& marker) noexcept;
+
+        /**
+         * @brief Frees all blocks and clears the statistics.
+         */
+        void reset(void) noexcept;
+    };
+
+    /**
+     * Releases everything that is allocated from the arena of the calling thread
+     * during the lifetime of the scope, also if an exception is thrown.
+     */
+    class ScratchScope
+    {
+    private:
+        ScratchArena& arena;
+        ScratchArena::Marker marker;
+
+    public:
+        ScratchScope(void) : arena(ScratchArena::local()), marker(arena.mark()) {}
+        ~ScratchScope(void)
+        { this->arena.rewind(this->marker); }
+
+        ScratchScope(const ScratchScope&) = delete;
+        ScratchScope& operator= (const ScratchScope&) = delete;
+    };
+
+    // Allocator for standard containers that allocates from the arena of the thread that created it.
+    // An arena is not thread-safe, so a container must only allocate on that thread. A container that is
+    // destroyed on another thread does not touch the arena, its memory is released when the owner rewinds.
+    template<typename T>
+    struct ScratchAllocator
+    {
+        using value_type = T;
+
+        ScratchArena* arena;    // arena of the thread that created the allocator
+
+        ScratchAllocator(void) noexcept : arena(&ScratchArena::local()) {}
+        template<typename U>
+        ScratchAllocator(const ScratchAllocator<U>& other) noexcept : arena(other.arena) {}
+
+        /**
+         * @throw logic_error if the calling thread does not own the arena.
+         */
+        inline T* allocate(size_t n)
+        {
+            if(this->arena != &ScratchArena::local())
+                throw std::logic_error("[pt::ScratchAllocator::allocate]: A scratch container must only grow on the thread that created it.");
+            return this->arena->allocate_array<T>(n);
+        }
+
+        inline void deallocate(T* p, size_t) noexcept
+        {
+            if(this->arena == &ScratchArena::local())
+                this->arena->free(p);
+        }
+
+        template<typename U>
+        inline bool operator== (const ScratchAllocator<U>& other) const noexcept
+        { return this->arena == other.arena; }
+
+        template<typename U>
+        inline bool operator!= (const ScratchAllocator<U>& other) const noexcept
+        { return this->arena != other.arena; }
+    };
+
+    /**
+     * Fixed number of worker threads that execute tasks in the order they were submitted.
+     * If the pool has not been started, tasks are executed immediately by the submitting thread.
+     */
+    class ThreadPool
+    {
+    private:
+        std::vector<std::thread> threads;
+        std::deque<std::function<void(void)>> tasks;
+        std::mutex mtx;
+        std::condition_variable cv;
+        bool stopping;
+
+        void work(void);
+
+    public:
+        ThreadPool(void) : stopping(false) {}
+        virtual ~ThreadPool(void)
+        { this->stop(); }
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator= (const ThreadPool&) = delete;
+
+        ThreadPool(ThreadPool&&) = delete;
+        ThreadPool& operator= (ThreadPool&&) = delete;
+
+        /**
+         * @brief               Starts the worker threads, does nothing if the pool is already running.
+         * @param thread_count  Number of worker threads, if 0 one thread per hardware thread is started.
+         */
+        void start(uint32_t thread_count);
+
+        /**
+         * @brief Finishes all tasks that are already submitted and joins the worker threads.
+         */
+        void stop(void) noexcept;
+
+        inline uint32_t size(void) const noexcept
+        { return static_cast<uint32_t>(this->threads.size()); }
+
+        /**
+         * @brief   Executes one task that is waiting in the queue on the calling thread.
+         * @return  False if there was no waiting task.
+         */
+        bool run_pending(void);
+
+        /**
+         * @brief   Waits for a future or shared future. While waiting, the calling thread executes waiting tasks,
+         *          so tasks of the pool can wait for other tasks of the pool without a deadlock.
+         */
+        template<typename F>
+        void wait(const F& f)
+        {
+            while(f.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+            {
+                if(!this->run_pending())
+                    f.wait_for(std::chrono::milliseconds(1));
+            }
+        }
+
+        /**
+         * @brief           Waits for all futures and rethrows the exception of the first failed one.
+         *                  In contrast to calling 'get' in a loop, no task is still running when this function throws.
+         * @param futures   Futures to wait for, they are invalid afterwards.
+         */
+        void wait_all(std::vector<std::future<void>>& futures);
+
+        /**
+         * @brief       Enqueues a task.
+         * @param task  Callable without parameters.
+         * @return      Future of the result of the task, an exception thrown by the task is rethrown by the future.
+         */
+        template<typename F>
+        std::future<decltype(std::declval<F>()())> submit(F&& task)
+        {
+            using result_t = decltype(std::declval<F>()());
+            // std::function requieres a copyable callable, so the packaged task is shared
+            auto ptask = std::make_shared<std::packaged_task<result_t(void)>>(std::forward<F>(task));
+            std::future<result_t> result = ptask->get_future();
+            if(this->threads.empty())
+            {
+                (*ptask)();
+                return result;
+            }
+            {
+                std::lock_guard<std::mutex> lock(this->mtx);
+                this->tasks.emplace_back([ptask]() { (*ptask)(); });
+            }
+            this->cv.notify_one();
+            return result;
+        }
+    };
+
+    /**
+     * @brief           Computes the inclusive prefix sum of an array on a thread pool: every block of the array
+     *                  is summed up by its own task, then the sums of the previous blocks are added to each block.
+     *                  The sums are accumulated in double precision.
+     * @param pool      Pool that runs the blocks, if it is not started the sum is computed by the calling thread.
+     * @param src       Values to sum up.
+     * @param dst       Receives the sum of src[0] to src[i] at index i.
+     * @param count     Number of values.
+     * @return          Sum of all values.
+     */
+    double parallel_prefix_sum(ThreadPool& pool, const float* src, double* dst, size_t count);
+
+    // Measured execution of one node of a task graph, the times are relative to the start of the graph.
+    struct TaskTiming
+    {
+        std::string name;
+        uint64_t begin_ns;
+        uint64_t end_ns;
+    };
+
+    /**
+     * Set of tasks with dependencies between them. Every task is started on a thread pool as soon
+     * as all of its dependencies are finished, so independent chains of tasks run concurrently.
+     * If a task throws, the tasks that are not started yet are skipped and the exception is
+     * rethrown by 'run'.
+     */
+    class TaskGraph
+    {
+    private:
+        struct Node
+        {
+            std::string name;
+            std::function<void(void)> task;
+            std::vector<size_t> dependents;
+            uint32_t dependency_count;
+            uint32_t pending;   // number of dependencies that are not finished yet
+            TaskTiming timing;
+        };
+
+        std::vector<Node> nodes;
+        std::mutex mtx;
+        std::condition_variable cv;
+        size_t remaining;
+        std::exception_ptr error;
+        std::chrono::steady_clock::time_point start;
+
+        void launch(ThreadPool& pool, size_t i);
+        void execute(ThreadPool& pool, size_t i);
+
+    public:
+        TaskGraph(void) : remaining(0) {}
+
+        TaskGraph(const TaskGraph&) = delete;
+        TaskGraph& operator= (const TaskGraph&) = delete;
+
+        /**
+         * @brief               Adds a task to the graph.
+         * @param name          Name of the task, used for the timings.
+         * @param task          Callable without parameters.
+         * @param dependencies  Tasks that must be finished before this task is started.
+         * @return              ID of the task that is used as dependency of other tasks.
+         * @throw               invalid_argument if a dependency does not exist.
+         */
+        size_t add(const std::string& name, std::function<void(void)> task, std::initializer_list<size_t> dependencies = {});
+
+        /**
+         * @brief       Executes all tasks and waits until they are finished. The calling thread
+         *              executes tasks of the pool while waiting.
+         * @param pool  Pool that executes the tasks.
+         */
+        void run(ThreadPool& pool);
+
+        /**
+         * @return Timings of all tasks of the last run, in the order the tasks were added.
+         */
+        std::vector<TaskTiming> timings(void) const;
+
+        /**
+         * @return Longest chain of dependent tasks of the last run, summed over the execution times of the tasks.
+         */
+        uint64_t critical_path_ns(void) const;
+    };
+
+    /**
+     * Detects changes of files by polling their modification time and size. A change is only
+     * reported once the file did not change between two polls, so a file that is still being
+     * written is not reported too early.
+     */
+    class FileWatcher
+    {
+    private:
+        struct Stamp
+        {
+            int64_t mtime;
+            uint64_t size;
+            bool exists;
+
+            inline bool operator== (const Stamp& other) const noexcept
+            { return this->mtime == other.mtime && this->size == other.size && this->exists == other.exists; }
+        };
+
+        struct Entry
+        {
+            std::string path;
+            Stamp stamp;        // state of the file when it was last reported
+            Stamp pending;      // state of the file that was seen by the last poll, if it differs from 'stamp'
+            bool has_pending;
+        };
+
+        std::vector<Entry> entries;
+
+        static Stamp query(const std::string& path) noexcept;
+
+    public:
+        /**
+         * @brief       Starts watching a file, the current state of the file is the unchanged state.
+         * @param path  Path to the file, the file does not need to exist.
+         * @return      ID of the file that is reported by 'poll'.
+         */
+        size_t watch(const std::string& path);
+
+        /**
+         * @brief Stops watching all files.
+         */
+        void clear(void) noexcept;
+
+        /**
+         * @brief           Checks all files for changes. A changed file is reported once, until it changes again.
+         *                  Files that do not exist are never reported.
+         * @param changed   Receives the IDs of the changed files, in ascending order.
+         */
+        void poll(std::vector<size_t>& changed);
+
+        inline size_t size(void) const noexcept
+        { return this->entries.size(); }
+
+        inline const std::string& path(size_t id) const
+        { return this->entries.at(id).path; }
+    };
+
+    /**
+     * Stream socket of the local machine (Unix domain socket) that exchanges whole messages.
+     * Every message is sent with its size in front of it, so the receiver gets exactly the
+     * data of one 'send_message'. A socket either listens for connections or is connected.
+     */
+    class LocalSocket
+    {
+    private:
+        intptr_t handle;        // native socket, -1 if the socket is closed
+        std::string bound_path; // path the socket listens on, the file is removed when the socket is closed
+
+        void create(const std::string& path, void* address);
+        void send_all(const uint8_t* data, size_t size);
+        bool receive_all(uint8_t* data, size_t size);
+
+    public:
+        // larger messages are rejected, so a corrupted size can't allocate all memory
+        constexpr static uint64_t MAX_MESSAGE_SIZE = 1ull << 32;
+
+        LocalSocket(void) : handle(-1) {}
+        virtual ~LocalSocket(void)
+        { this->close(); }
+
+        LocalSocket(const LocalSocket&) = delete;
+        LocalSocket& operator= (const LocalSocket&) = delete;
+
+        LocalSocket(LocalSocket&&) = delete;
+        LocalSocket& operator= (LocalSocket&&) = delete;
+
+        /**
+         * @brief       Creates a socket file and listens for connections on it.
+         *              A socket file that is left over by a previous process is replaced.
+         * @param path  Path of the socket file.
+         * @throw       runtime_error if the socket could not be created.
+         */
+        void listen(const std::string& path);
+
+        /**
+         * @brief       Connects to a socket that is listening.
+         * @param path  Path of the socket file.
+         * @throw       runtime_error if the connection failed.
+         */
+        void connect(const std::string& path);
+
+        /**
+         * @brief               Waits for a connection of a client.
+         * @param connection    Receives the connection, a previous connection is closed.
+         * @param timeout_ms    Time to wait for a connection in milliseconds.
+         * @return              False if no client connected in time.
+         * @throw               runtime_error if the socket is not listening or the connection failed.
+         */
+        bool accept(LocalSocket& connection, uint32_t timeout_ms);
+
+        /**
+         * @brief               Waits until data can be received.
+         * @param timeout_ms    Time to wait in milliseconds.
+         * @return              True if a message or the end of the connection can be received without blocking.
+         * @throw               runtime_error if the socket is not connected.
+         */
+        bool poll(uint32_t timeout_ms);
+
+        /**
+         * @brief       Sends a message, blocks until all data is sent.
+         * @throw       runtime_error if the connection is closed.
+         */
+        void send_message(const void* data, size_t size);
+
+        inline void send_message(const std::string& msg)
+        { this->send_message(msg.data(), msg.size()); }
+
+        /**
+         * @brief       Receives the next message, blocks until all data is received.
+         * @param data      Receives the content of the message.
+         * @param max_size  Larger messages are rejected before their data is allocated.
+         * @return          False if the other side closed the connection before the message started.
+         * @throw           runtime_error if the connection is closed inside of a message or the message is larger than 'max_size'.
+         */
+        bool receive_message(std::vector<uint8_t>& data, uint64_t max_size = MAX_MESSAGE_SIZE);
+
+        /**
+         * @brief Closes the socket and removes the socket file if it is listening.
+         */
+        void close(void) noexcept;
+
+        inline bool is_open(void) const noexcept
+        { return this->handle != -1; }
+    };
+} // namespace pt
@@ -0,0 +1,194 @@
+#include "../application.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <new>
+
+namespace
+{
+    // All arenas that exist, so their statistics can be gathered and they can be reset
+    // from one thread. The registry is only locked when a thread creates or destroys its
+    // arena and by the static functions, never while allocating.
+    std::mutex& registry_mutex(void)
+    {
+        static std::mutex mtx;
+        return mtx;
+    }
+
+    std::vector<pt::ScratchArena*>& registry(void)
+    {
+        static std::vector<pt::ScratchArena*> arenas;
+        return arenas;
+    }
+
+    inline size_t align_up(size_t value, size_t align) noexcept
+    {
+        return (value + align - 1) & ~(align - 1);
+    }
+}
+
+pt::ScratchArena::ScratchArena(void)
+{
+    this->current = 0;
+    this->last = nullptr;
+    this->last_offset = 0;
+    this->in_use = 0;
+    this->peak = 0;
+    this->allocations = 0;
+    this->reserved = 0;
+
+    std::lock_guard<std::mutex> lock(registry_mutex());
+    registry().push_back(this);
+}
+
+pt::ScratchArena::~ScratchArena(void)
+{
+    {
+        std::lock_guard<std::mutex> lock(registry_mutex());
+        std::vector<ScratchArena*>& arenas = registry();
+        arenas.erase(std::remove(arenas.begin(), arenas.end(), this), arenas.end());
+    }
+    this->reset();
+}
+
+pt::ScratchArena& pt::ScratchArena::local(void)
+{
+    thread_local ScratchArena arena;
+    return arena;
+}
+
+void pt::ScratchArena::reset_all(void)
+{
+    std::lock_guard<std::mutex> lock(registry_mutex());
+    for(ScratchArena* arena : registry())
+        arena->reset();
+}
+
+pt::ScratchStatistics pt::ScratchArena::statistics(void)
+{
+    ScratchStatistics stats = {};
+    std::lock_guard<std::mutex> lock(registry_mutex());
+    for(const ScratchArena* arena : registry())
+    {
+        // the blocks are only read by the owning thread, the counters can be read while it allocates
+        stats.allocation_count += arena->allocations.load(std::memory_order_relaxed);
+        stats.peak_bytes += arena->peak.load(std::memory_order_relaxed);
+        stats.reserved_bytes += arena->reserved.load(std::memory_order_relaxed);
+    }
+    return stats;
+}
+
+void* pt::ScratchArena::allocate(size_t size, size_t align)
+{
+    if(size == 0) size = 1;
+
+    // Try the current block first, then the blocks that were kept by a rewind.
+    // If none of them fits, a new block is appended.
+    for(; this->current < this->blocks.size(); this->current++)
+    {
+        Block& block = this->blocks[this->current];
+        const size_t offset = align_up(reinterpret_cast<uintptr_t>(block.data) + block.used, align) - reinterpret_cast<uintptr_t>(block.data);
+        if(offset + size <= block.size)
+        {
+            this->in_use += offset + size - block.used;
+            this->last_offset = block.used;
+            block.used = offset + size;
+            break;
+        }
+    }
+
+    if(this->current == this->blocks.size())
+    {
+        const size_t block_size = std::max(BLOCK_SIZE, size + align);
+        Block block;
+        block.data = reinterpret_cast<uint8_t*>(std::malloc(block_size));
+        if(block.data == nullptr)
+            throw std::bad_alloc();
+        block.size = block_size;
+        block.used = align_up(reinterpret_cast<uintptr_t>(block.data), align) - reinterpret_cast<uintptr_t>(block.data) + size;
+        this->blocks.push_back(block);
+        this->reserved.fetch_add(block_size, std::memory_order_relaxed);
+        this->in_use += block.used;
+        this->last_offset = 0;
+    }
+
+    const Block& block = this->blocks[this->current];
+    this->last = block.data + block.used - size;
+    this->update_peak();
+    this->allocations.fetch_add(1, std::memory_order_relaxed);
+    return this->last;
+}
+
+void pt::ScratchArena::update_peak(void) noexcept
+{
+    if(this->in_use > this->peak.load(std::memory_order_relaxed))
+        this->peak.store(this->in_use, std::memory_order_relaxed);
+}
+
+void* pt::ScratchArena::reallocate(void* p, size_t old_size, size_t new_size)
+{
+    if(p == nullptr)
+        return this->allocate(new_size);
+
+    // the last allocation can grow or shrink in place, if the block is large enough
+    if(p == this->last)
+    {
+        Block& block = this->blocks[this->current];
+        const size_t begin = static_cast<size_t>(reinterpret_cast<uint8_t*>(p) - block.data);
+        if(begin + new_size <= block.size)
+        {
+            this->in_use = this->in_use - block.used + begin + new_size;
+            this->update_peak();
+            block.used = begin + new_size;
+            return p;
+        }
+    }
+
+    void* q = this->allocate(new_size);
+    memcpy(q, p, std::min(old_size, new_size));
+    return q;
+}
+
+void pt::ScratchArena::free(void* p) noexcept
+{
+    if(p == nullptr || p != this->last) return;
+    Block& block = this->blocks[this->current];
+    this->in_use -= block.used - this->last_offset;
+    block.used = this->last_offset;
+    this->last = nullptr;
+}
+
+pt::ScratchArena::Marker pt::ScratchArena::mark(void) const noexcept
+{
+    if(this->blocks.empty()) return { 0, 0 };
+    return { this->current, this->blocks[this->current].used };
+}
+
+void pt::ScratchArena::rewind(const Marker& marker) noexcept
+{
+    if(marker.block >= this->blocks.size()) return;
+    this->blocks[marker.block].used = marker.used;
+    for(size_t i = marker.block + 1; i < this->blocks.size(); i++)
+        this->blocks[i].used = 0;
+
+    this->current = marker.block;
+    this->last = nullptr;
+    this->in_use = 0;
+    for(const Block& block : this->blocks)
+        this->in_use += block.used;
+}
+
+void pt::ScratchArena::reset(void) noexcept
+{
+    for(Block& block : this->blocks)
+        std::free(block.data);
+    this->blocks.clear();
+    this->current = 0;
+    this->last = nullptr;
+    this->last_offset = 0;
+    this->in_use = 0;
+    this->peak = 0;
+    this->allocations = 0;
+    this->reserved = 0;
+}
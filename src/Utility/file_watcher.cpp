@@ -0,0 +1,56 @@
+#include "../application.h"
+#include <filesystem>
+
+pt::FileWatcher::Stamp pt::FileWatcher::query(const std::string& path) noexcept
+{
+    std::error_code ec;
+    const std::filesystem::file_time_type mtime = std::filesystem::last_write_time(path, ec);
+    if(ec) return { 0, 0, false };
+    const uintmax_t size = std::filesystem::file_size(path, ec);
+    if(ec) return { 0, 0, false };
+    return { static_cast<int64_t>(mtime.time_since_epoch().count()), static_cast<uint64_t>(size), true };
+}
+
+size_t pt::FileWatcher::watch(const std::string& path)
+{
+    Entry entry;
+    entry.path = path;
+    entry.stamp = query(path);
+    entry.pending = entry.stamp;
+    entry.has_pending = false;
+    this->entries.push_back(std::move(entry));
+    return this->entries.size() - 1;
+}
+
+void pt::FileWatcher::clear(void) noexcept
+{
+    this->entries.clear();
+}
+
+void pt::FileWatcher::poll(std::vector<size_t>& changed)
+{
+    changed.clear();
+    for(size_t i = 0; i < this->entries.size(); i++)
+    {
+        Entry& entry = this->entries[i];
+        const Stamp current = query(entry.path);
+        if(current == entry.stamp)
+        {
+            // the file was changed back or the change was reverted before it settled
+            entry.has_pending = false;
+            continue;
+        }
+
+        // Editors often truncate a file and write it in multiple parts, the change is
+        // reported as soon as the same state was seen by two consecutive polls.
+        if(entry.has_pending && current == entry.pending && current.exists)
+        {
+            entry.stamp = current;
+            entry.has_pending = false;
+            changed.push_back(i);
+            continue;
+        }
+        entry.pending = current;
+        entry.has_pending = true;
+    }
+}
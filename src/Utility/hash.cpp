@@ -0,0 +1,88 @@
+#include "../application.h"
+
+namespace
+{
+    constexpr uint64_t PRIME0 = 0x9E3779B185EBCA87ull;
+    constexpr uint64_t PRIME1 = 0xC2B2AE3D27D4EB4Full;
+    constexpr uint64_t PRIME2 = 0x165667B19E3779F9ull;
+    constexpr uint64_t PRIME3 = 0x85EBCA77C2B2AE63ull;
+
+    inline uint64_t rotl(uint64_t x, uint32_t r) noexcept
+    {
+        return (x << r) | (x >> (64 - r));
+    }
+
+    // final avalanche of a 64 bit value (MurmurHash3 fmix64)
+    inline uint64_t fmix(uint64_t x) noexcept
+    {
+        x ^= x >> 33;
+        x *= 0xFF51AFD7ED558CCDull;
+        x ^= x >> 33;
+        x *= 0xC4CEB9FE1A85EC53ull;
+        x ^= x >> 33;
+        return x;
+    }
+}
+
+void pt::ContentHasher::reset(void) noexcept
+{
+    this->lanes[0] = PRIME2;
+    this->lanes[1] = PRIME3;
+    this->length = 0;
+    this->tail_size = 0;
+}
+
+void pt::ContentHasher::consume(uint64_t word) noexcept
+{
+    // both lanes use different constants and rotations, so they are independent of each other
+    this->lanes[0] = rotl(this->lanes[0] ^ (word * PRIME0), 31) * PRIME1;
+    this->lanes[1] = rotl(this->lanes[1] + (word * PRIME2), 27) * PRIME3;
+}
+
+void pt::ContentHasher::update(const void* data, size_t size) noexcept
+{
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data);
+    this->length += size;
+
+    // complete the word that is left from the previous part
+    while(this->tail_size != 0 && size != 0)
+    {
+        this->tail[this->tail_size++] = *bytes++;
+        size--;
+        if(this->tail_size == 8)
+        {
+            uint64_t word;
+            memcpy(&word, this->tail, sizeof(uint64_t));
+            this->consume(word);
+            this->tail_size = 0;
+        }
+    }
+
+    for(; size >= 8; size -= 8, bytes += 8)
+    {
+        uint64_t word;
+        memcpy(&word, bytes, sizeof(uint64_t));    // the data is not requiered to be aligned
+        this->consume(word);
+    }
+
+    for(; size != 0; size--)
+        this->tail[this->tail_size++] = *bytes++;
+}
+
+pt::Hash128 pt::ContentHasher::digest(void) const noexcept
+{
+    uint64_t lanes[2] = { this->lanes[0], this->lanes[1] };
+    if(this->tail_size != 0)
+    {
+        uint64_t word = 0;
+        memcpy(&word, this->tail, this->tail_size);
+        lanes[0] = rotl(lanes[0] ^ (word * PRIME0), 31) * PRIME1;
+        lanes[1] = rotl(lanes[1] + (word * PRIME2), 27) * PRIME3;
+    }
+
+    // the length is mixed in, so data that only differs by trailing zeros hashes differently
+    Hash128 h;
+    h.lo = fmix(lanes[0] ^ this->length);
+    h.hi = fmix(lanes[1] ^ rotl(this->length, 32)) ^ h.lo;
+    return h;
+}
@@ -0,0 +1,108 @@
+#include "../application.h"
+#ifdef _WIN32
+    #define WIN32_LEAN_AND_MEAN
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+pt::MappedFile::MappedFile(void)
+{
+    this->pdata = nullptr;
+    this->map_size = 0;
+#ifdef _WIN32
+    this->file_handle = INVALID_HANDLE_VALUE;
+    this->map_handle = nullptr;
+#else
+    this->fd = -1;
+#endif
+}
+
+pt::MappedFile::MappedFile(const std::string& path) : MappedFile()
+{
+    this->open(path);
+}
+
+#ifdef _WIN32
+void pt::MappedFile::open(const std::string& path)
+{
+    this->close();
+
+    this->file_handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if(this->file_handle == INVALID_HANDLE_VALUE)
+        throw std::runtime_error("[pt::MappedFile::open]: Failed to open file: " + path);
+
+    LARGE_INTEGER size;
+    if(!GetFileSizeEx(this->file_handle, &size) || size.QuadPart == 0)
+    {
+        this->close();
+        throw std::runtime_error("[pt::MappedFile::open]: File is empty or its size could not be queried: " + path);
+    }
+
+    this->map_handle = CreateFileMappingA(this->file_handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if(this->map_handle == nullptr)
+    {
+        this->close();
+        throw std::runtime_error("[pt::MappedFile::open]: Failed to create file mapping: " + path);
+    }
+
+    this->pdata = reinterpret_cast<const char*>(MapViewOfFile(this->map_handle, FILE_MAP_READ, 0, 0, 0));
+    if(this->pdata == nullptr)
+    {
+        this->close();
+        throw std::runtime_error("[pt::MappedFile::open]: Failed to map file: " + path);
+    }
+    this->map_size = static_cast<size_t>(size.QuadPart);
+}
+
+void pt::MappedFile::close(void) noexcept
+{
+    if(this->pdata != nullptr) UnmapViewOfFile(this->pdata);
+    if(this->map_handle != nullptr) CloseHandle(this->map_handle);
+    if(this->file_handle != INVALID_HANDLE_VALUE) CloseHandle(this->file_handle);
+    this->pdata = nullptr;
+    this->map_size = 0;
+    this->map_handle = nullptr;
+    this->file_handle = INVALID_HANDLE_VALUE;
+}
+#else
+void pt::MappedFile::open(const std::string& path)
+{
+    this->close();
+
+    this->fd = ::open(path.c_str(), O_RDONLY);
+    if(this->fd < 0)
+        throw std::runtime_error("[pt::MappedFile::open]: Failed to open file: " + path);
+
+    struct stat st;
+    if(fstat(this->fd, &st) != 0 || st.st_size == 0)
+    {
+        this->close();
+        throw std::runtime_error("[pt::MappedFile::open]: File is empty or its size could not be queried: " + path);
+    }
+
+    void* map = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, this->fd, 0);
+    if(map == MAP_FAILED)
+    {
+        this->close();
+        throw std::runtime_error("[pt::MappedFile::open]: Failed to map file: " + path);
+    }
+
+    // the file is parsed from front to back, so the kernel can read ahead and drop pages behind
+    madvise(map, static_cast<size_t>(st.st_size), MADV_SEQUENTIAL);
+    this->pdata = reinterpret_cast<const char*>(map);
+    this->map_size = static_cast<size_t>(st.st_size);
+}
+
+void pt::MappedFile::close(void) noexcept
+{
+    if(this->pdata != nullptr) munmap(const_cast<char*>(this->pdata), this->map_size);
+    if(this->fd >= 0) ::close(this->fd);
+    this->pdata = nullptr;
+    this->map_size = 0;
+    this->fd = -1;
+}
+#endif
@@ -0,0 +1,45 @@
+#include "../application.h"
+#include <algorithm>
+
+double pt::parallel_prefix_sum(ThreadPool& pool, const float* src, double* dst, size_t count)
+{
+    if(count == 0) return 0.0;
+
+    // a few blocks per thread balance the load, small arrays are not worth a task
+    constexpr size_t MIN_BLOCK_SIZE = 1 << 14;
+    const size_t max_blocks = std::max<size_t>(pool.size(), 1) * 4;
+    const size_t block_count = std::max<size_t>(std::min(max_blocks, count / MIN_BLOCK_SIZE), 1);
+    const size_t block_size = (count + block_count - 1) / block_count;
+
+    // first pass: every block is summed up on its own
+    std::vector<std::future<void>> tasks;
+    tasks.reserve(block_count);
+    for(size_t first = 0; first < count; first += block_size)
+    {
+        const size_t last = std::min(first + block_size, count);
+        tasks.push_back(pool.submit([src, dst, first, last]() {
+            double sum = 0.0;
+            for(size_t i = first; i < last; i++)
+                dst[i] = (sum += src[i]);
+        }));
+    }
+    pool.wait_all(tasks);
+
+    // second pass: the sums of the previous blocks are added to every block, the first block is already done.
+    // The offsets are computed before, the tasks change the last values of the blocks.
+    std::vector<double> offsets(1, 0.0);
+    for(size_t first = block_size; first < count; first += block_size)
+        offsets.push_back(offsets.back() + dst[first - 1]);
+    tasks.clear();
+    for(size_t first = block_size; first < count; first += block_size)
+    {
+        const double offset = offsets[first / block_size];
+        const size_t last = std::min(first + block_size, count);
+        tasks.push_back(pool.submit([dst, first, last, offset]() {
+            for(size_t i = first; i < last; i++)
+                dst[i] += offset;
+        }));
+    }
+    pool.wait_all(tasks);
+    return dst[count - 1];
+}
@@ -0,0 +1,240 @@
+#include "../application.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#ifdef _WIN32
+    #define WIN32_LEAN_AND_MEAN
+    #define NOMINMAX
+    #include <winsock2.h>
+    #include <afunix.h>
+#else
+    #include <cerrno>
+    #include <poll.h>
+    #include <sys/socket.h>
+    #include <sys/un.h>
+    #include <unistd.h>
+#endif
+
+namespace
+{
+#ifdef _WIN32
+    using native_socket_t = SOCKET;
+    constexpr int SEND_FLAGS = 0;
+
+    // winsock has to be initialized once per process, Windows 10 supports AF_UNIX since build 17063
+    void init_sockets(void)
+    {
+        static const bool initialized = []() {
+            WSADATA data;
+            return WSAStartup(MAKEWORD(2, 2), &data) == 0;
+        }();
+        if(!initialized)
+            throw std::runtime_error("[pt::LocalSocket]: Failed to initialize winsock.");
+    }
+
+    inline void close_native(native_socket_t s) noexcept
+    { closesocket(s); }
+
+    inline bool interrupted(void) noexcept
+    { return false; }
+
+    inline int wait_readable(native_socket_t s, uint32_t timeout_ms) noexcept
+    {
+        WSAPOLLFD pfd = {};
+        pfd.fd = s;
+        pfd.events = POLLRDNORM;
+        return WSAPoll(&pfd, 1, static_cast<INT>(timeout_ms));
+    }
+#else
+    using native_socket_t = int;
+    // a closed connection is reported as error instead of terminating the process with SIGPIPE
+    #ifdef MSG_NOSIGNAL
+    constexpr int SEND_FLAGS = MSG_NOSIGNAL;
+    #else
+    constexpr int SEND_FLAGS = 0;
+    #endif
+
+    inline void init_sockets(void) {}
+
+    inline void close_native(native_socket_t s) noexcept
+    { ::close(s); }
+
+    inline bool interrupted(void) noexcept
+    { return errno == EINTR; }
+
+    inline int wait_readable(native_socket_t s, uint32_t timeout_ms) noexcept
+    {
+        pollfd pfd = {};
+        pfd.fd = s;
+        pfd.events = POLLIN;
+        int ret;
+        do ret = poll(&pfd, 1, static_cast<int>(timeout_ms));
+        while(ret < 0 && errno == EINTR);
+        return ret;
+    }
+#endif
+
+    inline native_socket_t native(intptr_t handle) noexcept
+    { return static_cast<native_socket_t>(handle); }
+}
+
+void pt::LocalSocket::create(const std::string& path, void* address)
+{
+    init_sockets();
+    this->close();
+
+    sockaddr_un& addr = *reinterpret_cast<sockaddr_un*>(address);
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if(path.empty() || path.size() >= sizeof(addr.sun_path))
+        throw std::invalid_argument("[pt::LocalSocket::create]: The path of the socket is empty or too long: " + path);
+    std::memcpy(addr.sun_path, path.c_str(), path.size());
+
+    const native_socket_t s = socket(AF_UNIX, SOCK_STREAM, 0);
+    // INVALID_SOCKET of winsock is -1 as signed integer
+    if(static_cast<intptr_t>(s) == -1)
+        throw std::runtime_error("[pt::LocalSocket::create]: Failed to create socket.");
+    this->handle = static_cast<intptr_t>(s);
+}
+
+void pt::LocalSocket::listen(const std::string& path)
+{
+    sockaddr_un addr;
+    this->create(path, &addr);
+
+    std::remove(path.c_str());
+    if(bind(native(this->handle), reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0)
+    {
+        this->close();
+        throw std::runtime_error("[pt::LocalSocket::listen]: Failed to bind socket to \"" + path + "\".");
+    }
+    this->bound_path = path;
+
+    if(::listen(native(this->handle), SOMAXCONN) != 0)
+    {
+        this->close();
+        throw std::runtime_error("[pt::LocalSocket::listen]: Failed to listen on \"" + path + "\".");
+    }
+}
+
+void pt::LocalSocket::connect(const std::string& path)
+{
+    sockaddr_un addr;
+    this->create(path, &addr);
+
+    if(::connect(native(this->handle), reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0)
+    {
+        this->close();
+        throw std::runtime_error("[pt::LocalSocket::connect]: Failed to connect to \"" + path + "\".");
+    }
+}
+
+bool pt::LocalSocket::accept(LocalSocket& connection, uint32_t timeout_ms)
+{
+    if(this->bound_path.empty())
+        throw std::runtime_error("[pt::LocalSocket::accept]: The socket is not listening.");
+    connection.close();
+
+    const int ready = wait_readable(native(this->handle), timeout_ms);
+    if(ready < 0)
+        throw std::runtime_error("[pt::LocalSocket::accept]: Failed to wait for a connection.");
+    if(ready == 0) return false;
+
+    native_socket_t s;
+    do s = ::accept(native(this->handle), nullptr, nullptr);
+    while(static_cast<intptr_t>(s) == -1 && interrupted());
+    if(static_cast<intptr_t>(s) == -1)
+        throw std::runtime_error("[pt::LocalSocket::accept]: Failed to accept connection.");
+    connection.handle = static_cast<intptr_t>(s);
+    return true;
+}
+
+bool pt::LocalSocket::poll(uint32_t timeout_ms)
+{
+    if(!this->is_open())
+        throw std::runtime_error("[pt::LocalSocket::poll]: The socket is not connected.");
+    const int ready = wait_readable(native(this->handle), timeout_ms);
+    if(ready < 0)
+        throw std::runtime_error("[pt::LocalSocket::poll]: Failed to wait for data.");
+    return ready > 0;
+}
+
+void pt::LocalSocket::send_all(const uint8_t* data, size_t size)
+{
+    while(size > 0)
+    {
+        // winsock takes the size as int
+        const int chunk = static_cast<int>(std::min<size_t>(size, 1 << 30));
+        const auto sent = send(native(this->handle), reinterpret_cast<const char*>(data), chunk, SEND_FLAGS);
+        if(sent < 0 && interrupted()) continue;
+        if(sent <= 0)
+            throw std::runtime_error("[pt::LocalSocket::send_message]: The connection is closed.");
+        data += sent;
+        size -= static_cast<size_t>(sent);
+    }
+}
+
+bool pt::LocalSocket::receive_all(uint8_t* data, size_t size)
+{
+    while(size > 0)
+    {
+        const int chunk = static_cast<int>(std::min<size_t>(size, 1 << 30));
+        const auto received = recv(native(this->handle), reinterpret_cast<char*>(data), chunk, 0);
+        if(received < 0 && interrupted()) continue;
+        if(received <= 0) return false;
+        data += received;
+        size -= static_cast<size_t>(received);
+    }
+    return true;
+}
+
+void pt::LocalSocket::send_message(const void* data, size_t size)
+{
+    if(!this->is_open())
+        throw std::runtime_error("[pt::LocalSocket::send_message]: The socket is not connected.");
+    if(size > MAX_MESSAGE_SIZE)
+        throw std::invalid_argument("[pt::LocalSocket::send_message]: The message is too large.");
+
+    // the size is sent as 64 bit little endian integer
+    uint8_t header[8];
+    for(uint32_t i = 0; i < 8; i++)
+        header[i] = static_cast<uint8_t>(static_cast<uint64_t>(size) >> (8 * i));
+    this->send_all(header, sizeof(header));
+    this->send_all(reinterpret_cast<const uint8_t*>(data), size);
+}
+
+bool pt::LocalSocket::receive_message(std::vector<uint8_t>& data, uint64_t max_size)
+{
+    if(!this->is_open())
+        throw std::runtime_error("[pt::LocalSocket::receive_message]: The socket is not connected.");
+
+    uint8_t header[8];
+    // the first byte tells if the other side closed the connection between two messages
+    auto received = recv(native(this->handle), reinterpret_cast<char*>(header), 1, 0);
+    while(received < 0 && interrupted())
+        received = recv(native(this->handle), reinterpret_cast<char*>(header), 1, 0);
+    if(received == 0) return false;
+    if(received < 0 || !this->receive_all(header + 1, sizeof(header) - 1))
+        throw std::runtime_error("[pt::LocalSocket::receive_message]: The connection was closed inside of a message.");
+
+    uint64_t size = 0;
+    for(uint32_t i = 0; i < 8; i++)
+        size |= static_cast<uint64_t>(header[i]) << (8 * i);
+    if(size > max_size)
+        throw std::runtime_error("[pt::LocalSocket::receive_message]: The message is too large.");
+
+    data.resize(static_cast<size_t>(size));
+    if(!this->receive_all(data.data(), data.size()))
+        throw std::runtime_error("[pt::LocalSocket::receive_message]: The connection was closed inside of a message.");
+    return true;
+}
+
+void pt::LocalSocket::close(void) noexcept
+{
+    if(this->handle != -1)
+        close_native(native(this->handle));
+    if(!this->bound_path.empty())
+        std::remove(this->bound_path.c_str());
+    this->handle = -1;
+    this->bound_path.clear();
+}
@@ -0,0 +1,126 @@
+#include "../application.h"
+#include <algorithm>
+
+size_t pt::TaskGraph::add(const std::string& name, std::function<void(void)> task, std::initializer_list<size_t> dependencies)
+{
+    const size_t id = this->nodes.size();
+    for(size_t dep : dependencies)
+    {
+        // a dependency must be added before its dependents, so the graph can not contain cycles
+        if(dep >= id)
+            throw std::invalid_argument("[pt::TaskGraph::add]: Dependency of task \"" + name + "\" does not exist.");
+        this->nodes[dep].dependents.push_back(id);
+    }
+
+    Node node;
+    node.name = name;
+    node.task = std::move(task);
+    node.dependency_count = static_cast<uint32_t>(dependencies.size());
+    node.pending = 0;
+    node.timing = { name, 0, 0 };
+    this->nodes.push_back(std::move(node));
+    return id;
+}
+
+void pt::TaskGraph::run(ThreadPool& pool)
+{
+    std::vector<size_t> roots;
+    {
+        std::lock_guard<std::mutex> lock(this->mtx);
+        this->remaining = this->nodes.size();
+        this->error = nullptr;
+        this->start = std::chrono::steady_clock::now();
+        for(size_t i = 0; i < this->nodes.size(); i++)
+        {
+            this->nodes[i].pending = this->nodes[i].dependency_count;
+            this->nodes[i].timing.begin_ns = this->nodes[i].timing.end_ns = 0;
+            if(this->nodes[i].pending == 0) roots.push_back(i);
+        }
+    }
+    for(size_t i : roots)
+        this->launch(pool, i);
+
+    // the calling thread helps executing the tasks until the graph is finished
+    std::unique_lock<std::mutex> lock(this->mtx);
+    while(this->remaining != 0)
+    {
+        lock.unlock();
+        const bool executed = pool.run_pending();
+        lock.lock();
+        if(!executed && this->remaining != 0)
+            this->cv.wait_for(lock, std::chrono::milliseconds(1));
+    }
+    if(this->error != nullptr)
+        std::rethrow_exception(this->error);
+}
+
+void pt::TaskGraph::launch(ThreadPool& pool, size_t i)
+{
+    // the future is not needed, the result of the task is reported by 'execute'
+    pool.submit([this, &pool, i]() { this->execute(pool, i); });
+}
+
+void pt::TaskGraph::execute(ThreadPool& pool, size_t i)
+{
+    Node& node = this->nodes[i];
+    bool skip;
+    {
+        std::lock_guard<std::mutex> lock(this->mtx);
+        skip = (this->error != nullptr);
+    }
+
+    const auto begin = std::chrono::steady_clock::now();
+    std::exception_ptr failure = nullptr;
+    if(!skip)
+    {
+        try { node.task(); }
+        catch(...) { failure = std::current_exception(); }
+    }
+    const auto end = std::chrono::steady_clock::now();
+
+    // Dependents are launched outside of the lock, because a pool without
+    // threads executes them immediately.
+    std::vector<size_t> ready;
+    {
+        std::lock_guard<std::mutex> lock(this->mtx);
+        node.timing.begin_ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(begin - this->start).count());
+        node.timing.end_ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - this->start).count());
+        if(failure != nullptr && this->error == nullptr)
+            this->error = failure;
+        for(size_t dep : node.dependents)
+            if(--this->nodes[dep].pending == 0) ready.push_back(dep);
+    }
+    for(size_t dep : ready)
+        this->launch(pool, dep);
+
+    // 'run' may return as soon as the lock is released, so the graph is not accessed afterwards
+    std::lock_guard<std::mutex> lock(this->mtx);
+    this->remaining--;
+    this->cv.notify_all();
+}
+
+std::vector<pt::TaskTiming> pt::TaskGraph::timings(void) const
+{
+    std::vector<TaskTiming> ret;
+    ret.reserve(this->nodes.size());
+    for(const Node& node : this->nodes)
+        ret.push_back(node.timing);
+    return ret;
+}
+
+uint64_t pt::TaskGraph::critical_path_ns(void) const
+{
+    // Dependencies always have a lower ID than their dependents, so
+    // the nodes are already in topological order.
+    std::vector<uint64_t> path(this->nodes.size(), 0);
+    uint64_t longest = 0;
+    for(size_t i = 0; i < this->nodes.size(); i++)
+    {
+        const Node& node = this->nodes[i];
+        path[i] += node.timing.end_ns - node.timing.begin_ns;
+        for(size_t dep : node.dependents)
+            path[dep] = std::max(path[dep], path[i]);
+        longest = std::max(longest, path[i]);
+    }
+    return longest;
+}
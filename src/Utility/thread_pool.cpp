@@ -0,0 +1,65 @@
+#include "../application.h"
+#include <algorithm>
+
+void pt::ThreadPool::start(uint32_t thread_count)
+{
+    if(!this->threads.empty()) return;
+    if(thread_count == 0)
+        thread_count = std::max(std::thread::hardware_concurrency(), 1u);
+
+    this->stopping = false;
+    this->threads.reserve(thread_count);
+    for(uint32_t i = 0; i < thread_count; i++)
+        this->threads.emplace_back(&ThreadPool::work, this);
+}
+
+void pt::ThreadPool::stop(void) noexcept
+{
+    if(this->threads.empty()) return;
+    {
+        std::lock_guard<std::mutex> lock(this->mtx);
+        this->stopping = true;
+    }
+    this->cv.notify_all();
+    for(std::thread& t : this->threads)
+        t.join();
+    this->threads.clear();
+}
+
+void pt::ThreadPool::work(void)
+{
+    for(;;)
+    {
+        std::function<void(void)> task;
+        {
+            std::unique_lock<std::mutex> lock(this->mtx);
+            this->cv.wait(lock, [this]() { return this->stopping || !this->tasks.empty(); });
+            // the remaining tasks are still executed when the pool is stopped
+            if(this->tasks.empty()) return;
+            task = std::move(this->tasks.front());
+            this->tasks.pop_front();
+        }
+        task();
+    }
+}
+
+bool pt::ThreadPool::run_pending(void)
+{
+    std::function<void(void)> task;
+    {
+        std::lock_guard<std::mutex> lock(this->mtx);
+        if(this->tasks.empty()) return false;
+        task = std::move(this->tasks.front());
+        this->tasks.pop_front();
+    }
+    task();
+    return true;
+}
+
+void pt::ThreadPool::wait_all(std::vector<std::future<void>>& futures)
+{
+    for(std::future<void>& f : futures)
+        if(f.valid()) this->wait(f);
+    for(std::future<void>& f : futures)
+        if(f.valid()) f.get();
+}
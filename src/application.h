@@ -3,7 +3,21 @@
 #define VKA_GLFW_DISABLE
 #define VKA_DEBUG
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <initializer_list>
+#include <list>
+#include <memory>
+#include <mutex>
 #include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 
 #include <vulkan/vulkan.h>
@@ -11,5 +25,8 @@
 #include <glm2.h>
 
 #include "fwd.h"
+#include "Utility/Utility.h"
 #include "Setup/Setup.h"
 #include "PathTracer/PathTracer.h"
+#include "Host/Host.h"
+#include "Service/Service.h"